@@ -10,6 +10,7 @@
 #include <mutex>
 #include <utility>
 
+#include "openhd_blackboard.h"
 #include "openhd_link_statistics.hpp"
 #include "openhd_spdlog.h"
 #include "openhd_util.h"
@@ -44,11 +45,15 @@ class ArmingStateHelper {
   void unregister_listener(const std::string& tag);
   // For fetching the arming state in a manner where a deterministic arm /
   // disarm pattern is not needed
-  bool is_currently_armed() { return m_is_armed; }
+  bool is_currently_armed() { return m_is_armed.read(); }
+  // Incremented on each arm / disarm, see Blackboard
+  uint64_t get_arming_state_version() { return m_is_armed.get_version(); }
   void update_arming_state_if_changed(bool armed);
 
  private:
-  std::atomic_bool m_is_armed = false;
+  Blackboard<bool> m_is_armed{false};
+  // Serializes the listener calls with (un)registering
+  std::mutex m_cbs_mutex;
   std::map<std::string, STATE_CHANGED_CB> m_cbs;
   std::shared_ptr<spdlog::logger> m_console =
       openhd::log::create_or_get("ArmingStateHelper");
@@ -62,17 +67,22 @@ class FCRcChannelsHelper {
   FCRcChannelsHelper(const FCRcChannelsHelper&) = delete;
   FCRcChannelsHelper(const FCRcChannelsHelper&&) = delete;
   static FCRcChannelsHelper& instance();
-  typedef std::function<void(const std::array<int, 18>& rc_channels)>
+  using RC_CHANNELS = std::array<int, 18>;
+  typedef std::function<void(const RC_CHANNELS& rc_channels)>
       ACTION_ON_ANY_RC_CHANNEL_CB;
   // called every time a rc channel value(s) mavlink packet is received from the
   // FC (regardless if there was an actual change on any of the channels or not)
   // Works well on Ardupilot, which broadcasts the proper telem message by
   // default
-  void update_rc_channels(const std::array<int, 18>& rc_channels);
+  void update_rc_channels(const RC_CHANNELS& rc_channels);
   void action_on_any_rc_channel_register(ACTION_ON_ANY_RC_CHANNEL_CB cb);
+  // Alternative to the cb - the last reported rc channels (version 0 if the
+  // FC never reported any), for polling.
+  Blackboard<RC_CHANNELS>& get_rc_channels() { return m_rc_channels; }
 
  private:
   std::shared_ptr<ACTION_ON_ANY_RC_CHANNEL_CB> m_action_rc_channel = nullptr;
+  Blackboard<RC_CHANNELS> m_rc_channels{};
 };
 
 class LinkActionHandler {
@@ -146,8 +156,7 @@ class LinkActionHandler {
  public:
   // Camera stats / info that is broadcast in regular intervals
   // Set by the camera streaming implementation - read by OHDMainComponent
-  // (mavlink broadcast) Simple read - write pattern (mutex is a bit overkill,
-  // but we don't have atomic struct)
+  // (mavlink broadcast) and the wb link stats.
   struct CamInfo {
     bool active = false;  // Do not send stats for a non-active camera
     uint8_t cam_index = 0;
@@ -163,70 +172,45 @@ class LinkActionHandler {
     uint8_t supports_variable_bitrate = 0;
   };
   void set_cam_info(uint8_t cam_index, CamInfo camInfo) {
-    if (cam_index == 0) {
-      std::lock_guard<std::mutex> lock(m_cam_info_cam1_mutex);
-      m_cam_info_cam1 = camInfo;
-    } else {
-      std::lock_guard<std::mutex> lock(m_cam_info_cam2_mutex);
-      m_cam_info_cam2 = camInfo;
-    }
+    cam_info(cam_index).publish(camInfo);
   }
   void set_cam_info_bitrate(uint8_t cam_index, uint16_t bitrate_kbits) {
-    if (cam_index == 0) {
-      std::lock_guard<std::mutex> lock(m_cam_info_cam1_mutex);
-      m_cam_info_cam1.encoding_bitrate_kbits = bitrate_kbits;
-    } else {
-      std::lock_guard<std::mutex> lock(m_cam_info_cam2_mutex);
-      m_cam_info_cam2.encoding_bitrate_kbits = bitrate_kbits;
-    }
+    cam_info(cam_index).modify([bitrate_kbits](CamInfo& info) {
+      info.encoding_bitrate_kbits = bitrate_kbits;
+    });
   }
   void set_cam_info_status(uint8_t cam_index, uint8_t status) {
-    if (cam_index == 0) {
-      std::lock_guard<std::mutex> lock(m_cam_info_cam1_mutex);
-      m_cam_info_cam1.cam_status = status;
-    } else {
-      std::lock_guard<std::mutex> lock(m_cam_info_cam2_mutex);
-      m_cam_info_cam2.cam_status = status;
-    }
+    cam_info(cam_index).modify(
+        [status](CamInfo& info) { info.cam_status = status; });
   }
   void set_cam_info_type(uint8_t cam_index, uint8_t type) {
-    if (cam_index == 0) {
-      std::lock_guard<std::mutex> lock(m_cam_info_cam1_mutex);
-      m_cam_info_cam1.cam_type = type;
-    } else {
-      std::lock_guard<std::mutex> lock(m_cam_info_cam2_mutex);
-      m_cam_info_cam2.cam_type = type;
-    }
+    cam_info(cam_index).modify([type](CamInfo& info) { info.cam_type = type; });
   }
-  CamInfo get_cam_info(int cam_index) {
-    if (cam_index == 0) {
-      std::lock_guard<std::mutex> lock(m_cam_info_cam1_mutex);
-      return m_cam_info_cam1;
-    }
-    std::lock_guard<std::mutex> lock(m_cam_info_cam2_mutex);
-    return m_cam_info_cam2;
+  CamInfo get_cam_info(int cam_index) { return cam_info(cam_index).read(); }
+  // Camera 0 (primary) or 1 (secondary)
+  Blackboard<CamInfo>& cam_info(int cam_index) {
+    return cam_index == 0 ? m_cam_info_cam1 : m_cam_info_cam2;
   }
 
  private:
-  CamInfo m_cam_info_cam1{};
-  CamInfo m_cam_info_cam2{};
-  std::mutex m_cam_info_cam1_mutex;
-  std::mutex m_cam_info_cam2_mutex;
+  Blackboard<CamInfo> m_cam_info_cam1{};
+  Blackboard<CamInfo> m_cam_info_cam2{};
   // LINK STATISTICS
   // Written by wb_link, published via mavlink by telemetry OHDMainComponent
- private:
-  std::mutex m_last_link_stats_mutex;
-  openhd::link_statistics::StatsAirGround m_last_link_stats{};
-
  public:
+  using LinkStatsBlackboard =
+      Blackboard<openhd::link_statistics::StatsAirGround>;
   void update_link_stats(openhd::link_statistics::StatsAirGround stats) {
-    std::lock_guard<std::mutex> guard(m_last_link_stats_mutex);
-    m_last_link_stats = std::move(stats);
+    m_last_link_stats.publish(std::move(stats));
   }
+  // Prefer link_stats().read_ref() (no copy) where possible
   openhd::link_statistics::StatsAirGround get_link_stats() {
-    std::lock_guard<std::mutex> guard(m_last_link_stats_mutex);
-    return m_last_link_stats;
+    return m_last_link_stats.read();
   }
+  LinkStatsBlackboard& link_stats() { return m_last_link_stats; }
+
+ private:
+  LinkStatsBlackboard m_last_link_stats{};
 
  public:
   std::function<std::vector<uint16_t>()> wb_get_supported_channels = nullptr;
@@ -286,6 +270,32 @@ class LinkActionHandler {
   std::atomic_uint8_t m_external_devices_count = 0;
 };
 
+// All the params in openhd are changed by the user via mavlink - except
+// channel frequency and channel width during the channel scan feature / when
+// following the air unit. The module that changed such a param notifies the
+// mavlink param server(s) here, which then update (and broadcast) the value.
+class ParamChangedHelper {
+ public:
+  ParamChangedHelper() = default;
+  ParamChangedHelper(const ParamChangedHelper&) = delete;
+  ParamChangedHelper(const ParamChangedHelper&&) = delete;
+  static ParamChangedHelper& instance();
+  typedef std::function<void(const std::string& param_id, int value)>
+      INT_PARAM_CHANGED_CB;
+  /**
+   * @param tag needs to be a unique tag (per all submodules)
+   * The cb must not block - it is called from the thread that changed the
+   * param.
+   */
+  void register_listener(const std::string& tag, INT_PARAM_CHANGED_CB cb);
+  void unregister_listener(const std::string& tag);
+  void notify_int_param_changed(const std::string& param_id, int value);
+
+ private:
+  std::mutex m_cbs_mutex;
+  std::map<std::string, INT_PARAM_CHANGED_CB> m_cbs;
+};
+
 class TerminateHelper {
  public:
   static TerminateHelper& instance();
@@ -0,0 +1,282 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#ifndef OPENHD_OPENHD_OHD_COMMON_INC_OPENHD_BLACKBOARD_H_
+#define OPENHD_OPENHD_OHD_COMMON_INC_OPENHD_BLACKBOARD_H_
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// State that is written by one openhd module and read by another (e.g. the
+// link stats, written by the wb stats thread and broadcast by telemetry).
+// Every value carries a version, which is incremented on each publish - a
+// reader can cheaply check if a value changed since it last read it, without
+// copying it. Readers never block writers. Writers are serialized among
+// themselves (there is usually only one anyways).
+//
+// Use openhd::Blackboard<T>, which picks:
+// SeqlockValue for small, trivially copyable T (no allocations at all) and
+// SnapshotValue for everything else.
+namespace openhd {
+
+/**
+ * Seqlock: The writer makes the sequence odd, writes, makes it even again. The
+ * reader copies the value and retries if the sequence was odd or changed
+ * meanwhile. The value is stored in atomic words, such that the (possibly torn,
+ * then discarded) copy of the reader is not a data race.
+ * Reading is wait-free as long as there is no concurrent write.
+ */
+template <typename T>
+class SeqlockValue {
+  static_assert(std::is_trivially_copyable_v<T>,
+                "SeqlockValue needs a trivially copyable type");
+
+ public:
+  explicit SeqlockValue(const T& initial = T{}) {
+    m_current = initial;
+    store_words(initial);
+  }
+  SeqlockValue(const SeqlockValue&) = delete;
+  SeqlockValue& operator=(const SeqlockValue&) = delete;
+  /**
+   * Publish a new value, returns its version.
+   */
+  uint64_t publish(const T& value) {
+    std::lock_guard<std::mutex> guard(m_write_mutex);
+    return publish_locked(value);
+  }
+  /**
+   * Read - modify - publish, atomic with respect to other writers.
+   * @param modify called with the current value, must not block.
+   */
+  template <typename F>
+  uint64_t modify(F&& modify) {
+    std::lock_guard<std::mutex> guard(m_write_mutex);
+    T value = m_current;
+    modify(value);
+    return publish_locked(value);
+  }
+  /**
+   * @param version optional, set to the version of the returned value.
+   */
+  T read(uint64_t* version = nullptr) const {
+    std::array<uint64_t, N_WORDS> words;
+    uint64_t seq_begin;
+    while (true) {
+      seq_begin = m_seq.load(std::memory_order_acquire);
+      if (seq_begin & 1) continue;  // write in progress
+      for (size_t i = 0; i < N_WORDS; i++) {
+        words[i] = m_words[i].load(std::memory_order_relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (m_seq.load(std::memory_order_relaxed) == seq_begin) break;
+    }
+    T ret;
+    std::memcpy(static_cast<void*>(&ret), words.data(), sizeof(T));
+    if (version) *version = seq_begin / 2;
+    return ret;
+  }
+  /**
+   * Copies the value to @param out only if it changed since @param
+   * last_version (and updates last_version). Returns true if it changed.
+   */
+  bool read_if_changed(T& out, uint64_t& last_version) const {
+    if (get_version() == last_version) return false;
+    out = read(&last_version);
+    return true;
+  }
+  // 0 until the first publish
+  [[nodiscard]] uint64_t get_version() const {
+    return m_seq.load(std::memory_order_acquire) / 2;
+  }
+
+ private:
+  static constexpr size_t N_WORDS = (sizeof(T) + 7) / 8;
+  uint64_t publish_locked(const T& value) {
+    m_current = value;
+    const uint64_t seq = m_seq.load(std::memory_order_relaxed);
+    m_seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    store_words(value);
+    m_seq.store(seq + 2, std::memory_order_release);
+    return (seq + 2) / 2;
+  }
+  void store_words(const T& value) {
+    std::array<uint64_t, N_WORDS> words{};
+    std::memcpy(words.data(), &value, sizeof(T));
+    for (size_t i = 0; i < N_WORDS; i++) {
+      m_words[i].store(words[i], std::memory_order_relaxed);
+    }
+  }
+
+ private:
+  std::atomic<uint64_t> m_seq{0};
+  std::array<std::atomic<uint64_t>, N_WORDS> m_words;
+  std::mutex m_write_mutex;
+  // Only touched by the writer (under m_write_mutex), for modify()
+  T m_current;
+};
+
+/**
+ * Multi-buffer with per-buffer reader counts (RCU-like, with deferred
+ * reclamation): The writer fills a buffer no reader holds and swaps the
+ * current pointer, the reader pins the current buffer and reads the value in
+ * place - a read never copies T (unless the caller wants a copy). A buffer is
+ * only re-used once it is neither current nor pinned, if there is none the
+ * writer adds one - the writer never waits for a reader (at most one buffer
+ * per concurrent reader is needed). A reader only retries if a publish
+ * happened while it was pinning, it never takes a lock.
+ * For values that cannot be copied bytewise (e.g. contain a std::vector).
+ */
+template <typename T>
+class SnapshotValue {
+  struct Entry {
+    std::atomic<int> n_readers{0};
+    uint64_t version = 0;
+    T value;
+  };
+
+ public:
+  // Reference to a (pinned) snapshot, the value is not modified (and stays
+  // valid) as long as the reference exists. Must not outlive the
+  // SnapshotValue.
+  class Ref {
+   public:
+    Ref(Ref&& other) noexcept
+        : m_entry(std::exchange(other.m_entry, nullptr)) {}
+    Ref& operator=(Ref&& other) noexcept {
+      if (this != &other) {
+        unpin();
+        m_entry = std::exchange(other.m_entry, nullptr);
+      }
+      return *this;
+    }
+    Ref(const Ref&) = delete;
+    Ref& operator=(const Ref&) = delete;
+    ~Ref() { unpin(); }
+    const T& operator*() const { return m_entry->value; }
+    const T* operator->() const { return &m_entry->value; }
+    [[nodiscard]] uint64_t get_version() const { return m_entry->version; }
+
+   private:
+    friend class SnapshotValue;
+    explicit Ref(Entry* entry) : m_entry(entry) {}
+    void unpin() {
+      if (m_entry) m_entry->n_readers.fetch_sub(1, std::memory_order_release);
+    }
+    Entry* m_entry;
+  };
+  explicit SnapshotValue(T initial = T{}) {
+    m_entries.push_back(std::make_unique<Entry>());
+    m_entries.back()->value = std::move(initial);
+    m_current.store(m_entries.back().get());
+  }
+  SnapshotValue(const SnapshotValue&) = delete;
+  SnapshotValue& operator=(const SnapshotValue&) = delete;
+  uint64_t publish(T value) {
+    std::lock_guard<std::mutex> guard(m_write_mutex);
+    return publish_locked(std::move(value));
+  }
+  template <typename F>
+  uint64_t modify(F&& modify) {
+    std::lock_guard<std::mutex> guard(m_write_mutex);
+    // Only the writer replaces the current entry
+    T value = m_current.load(std::memory_order_relaxed)->value;
+    modify(value);
+    return publish_locked(std::move(value));
+  }
+  /**
+   * The current value, without copying it.
+   * @param version optional, set to the version of the returned value.
+   */
+  Ref read_ref(uint64_t* version = nullptr) const {
+    // seq_cst: Either the writer sees our pin before it re-uses the entry, or
+    // we see that the entry is not current anymore (and retry).
+    Entry* entry = m_current.load();
+    while (true) {
+      entry->n_readers.fetch_add(1);
+      Entry* current = m_current.load();
+      if (current == entry) break;
+      entry->n_readers.fetch_sub(1, std::memory_order_release);
+      entry = current;
+    }
+    if (version) *version = entry->version;
+    return Ref(entry);
+  }
+  T read(uint64_t* version = nullptr) const { return *read_ref(version); }
+  bool read_if_changed(T& out, uint64_t& last_version) const {
+    if (get_version() == last_version) return false;
+    out = *read_ref(&last_version);
+    return true;
+  }
+  [[nodiscard]] uint64_t get_version() const {
+    return m_version.load(std::memory_order_acquire);
+  }
+  /**
+   * Resets the value of all buffers that are neither current nor pinned,
+   * such that whatever they hold (e.g. sockets) is destroyed now, on the
+   * calling thread (and not whenever the buffer is re-used).
+   */
+  void clear_unused() {
+    std::lock_guard<std::mutex> guard(m_write_mutex);
+    Entry* current = m_current.load(std::memory_order_relaxed);
+    for (auto& entry : m_entries) {
+      if (entry.get() != current && entry->n_readers.load() == 0) {
+        entry->value = T{};
+      }
+    }
+  }
+
+ private:
+  uint64_t publish_locked(T value) {
+    Entry* entry = get_unused_entry_locked();
+    const uint64_t version = m_version.load(std::memory_order_relaxed) + 1;
+    // Re-uses the memory of the previous value where possible (e.g. vector
+    // capacity)
+    entry->value = std::move(value);
+    entry->version = version;
+    m_current.store(entry);
+    m_version.store(version, std::memory_order_release);
+    return version;
+  }
+  Entry* get_unused_entry_locked() {
+    Entry* current = m_current.load(std::memory_order_relaxed);
+    for (auto& entry : m_entries) {
+      // Acquire (seq_cst): the readers that un-pinned are done reading
+      if (entry.get() != current && entry->n_readers.load() == 0) {
+        return entry.get();
+      }
+    }
+    m_entries.push_back(std::make_unique<Entry>());
+    return m_entries.back().get();
+  }
+
+ private:
+  std::atomic<Entry*> m_current{nullptr};
+  std::atomic<uint64_t> m_version{0};
+  std::mutex m_write_mutex;
+  // Only touched by the writer (under m_write_mutex)
+  std::vector<std::unique_ptr<Entry>> m_entries;
+};
+
+// Above this, copying the whole value on every read costs more than taking a
+// reference to a snapshot
+static constexpr size_t BLACKBOARD_MAX_SEQLOCK_SIZE = 256;
+
+template <typename T>
+using Blackboard =
+    std::conditional_t<std::is_trivially_copyable_v<T> &&
+                           sizeof(T) <= BLACKBOARD_MAX_SEQLOCK_SIZE,
+                       SeqlockValue<T>, SnapshotValue<T>>;
+
+}  // namespace openhd
+
+#endif  // OPENHD_OPENHD_OHD_COMMON_INC_OPENHD_BLACKBOARD_H_
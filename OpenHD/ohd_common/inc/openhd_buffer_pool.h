@@ -0,0 +1,92 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#ifndef OPENHD_OPENHD_BUFFER_POOL_H
+#define OPENHD_OPENHD_BUFFER_POOL_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace openhd {
+
+/**
+ * Pool of MTU-sized buffers for the data that is passed around as
+ * std::shared_ptr<std::vector<uint8_t>> (rtp fragments, telemetry packets).
+ * Once the pool is warmed up, acquiring a buffer performs no malloc / free at
+ * all (neither for the data nor for the shared_ptr control block) and memory
+ * use is bounded by max_n_buffers per producing thread.
+ *
+ * Each thread that acquires buffers owns its own free list, acquire() never
+ * takes a lock and never touches memory shared with other producers:
+ * - Buffers released on the owning thread go straight back to its free list.
+ * - Buffers released on another thread (the common case, e.g. the wb tx
+ * thread dropping a fragment produced by the video thread) are pushed onto a
+ * lock-free list of the owner, which the owner takes over as a whole once its
+ * free list runs empty.
+ * The free list is LIFO, such that the most recently used (cache-hot) buffers
+ * are re-used first.
+ * Data that doesn't fit into a pooled buffer, or acquiring a buffer while all
+ * buffers of the thread are in use falls back to a regular heap allocation
+ * (counted as a miss).
+ * Buffers of a thread that exits are taken over by the next thread that
+ * starts acquiring buffers.
+ * Thread-safe. The pool must outlive all buffers acquired from it (the
+ * instance() is never destroyed).
+ */
+class FragmentBufferPool {
+ public:
+  // Large enough for rtp fragments (1440) and wb telemetry packets
+  static constexpr size_t BUFFER_CAPACITY = 1500;
+  static constexpr size_t MAX_N_BUFFERS = 2048;
+  explicit FragmentBufferPool(size_t max_n_buffers = MAX_N_BUFFERS);
+  ~FragmentBufferPool();
+  FragmentBufferPool(const FragmentBufferPool&) = delete;
+  FragmentBufferPool& operator=(const FragmentBufferPool&) = delete;
+  // One pool shared by all producers in openhd
+  static FragmentBufferPool& instance();
+  /**
+   * @return a buffer holding a copy of the given data. The returned buffer
+   * goes back to the pool once the caller (and everybody it was passed to)
+   * drops the last reference.
+   */
+  std::shared_ptr<std::vector<uint8_t>> acquire(const uint8_t* data,
+                                                size_t data_len);
+  struct Stats {
+    uint64_t count_hit = 0;
+    uint64_t count_miss = 0;
+    // Data larger than BUFFER_CAPACITY - never pooled
+    uint64_t count_oversize = 0;
+    // Buffers currently owned by the pool (free or in use)
+    int n_buffers = 0;
+    [[nodiscard]] std::string to_string() const;
+  };
+  Stats get_stats();
+
+ private:
+  struct Buffer;
+  struct ThreadCache;
+  struct ThreadLocalCaches;
+  template <typename T>
+  struct ControlBlockAllocator;
+  ThreadCache& get_thread_cache();
+  ThreadCache& register_thread(ThreadLocalCaches& thread_local_caches);
+  static void release(Buffer* buffer);
+  const size_t m_max_n_buffers;
+  // Unique per pool, never re-used (unlike the address)
+  const uint64_t m_id;
+  // Only taken when a thread acquires its first buffer or exits, and for the
+  // stats
+  std::mutex m_mutex;
+  std::vector<std::unique_ptr<ThreadCache>> m_caches;
+  // Caches of threads that exited, taken over by new threads
+  std::vector<ThreadCache*> m_orphaned_caches;
+};
+
+}  // namespace openhd
+
+#endif  // OPENHD_OPENHD_BUFFER_POOL_H
@@ -28,10 +28,13 @@ struct Config {
   std::string NW_ETHERNET_CARD = RPI_ETHERNET_ONLY;
   std::vector<std::string> NW_MANUAL_FORWARDING_IPS;
   bool NW_FORWARD_TO_LOCALHOST_58XX = false;
+  bool NW_BATCH_VIDEO_UDP_EGRESS = false;
   // GENERAL
   bool GEN_ENABLE_LAST_KNOWN_POSITION = false;
   int GEN_RF_METRICS_LEVEL = 0;
   bool GEN_NO_QOPENHD_AUTOSTART = false;
+  int GEN_TELEMETRY_CPU_CORE = -1;
+  bool GEN_ENABLE_TELEMETRY_RECORDER = false;
 };
 // Otherwise, default location is used
 void set_config_file(const std::string& config_file_path);
@@ -0,0 +1,131 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#ifndef OPENHD_OPENHD_EVENT_LOOP_H
+#define OPENHD_OPENHD_EVENT_LOOP_H
+
+#include <sys/epoll.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "openhd_spdlog.h"
+
+namespace openhd {
+
+/**
+ * Single threaded reactor (epoll). Owns one thread that waits for readiness of
+ * all registered fds (e.g. sockets, UART) and for timers (timerfd), and runs
+ * their callbacks. This way, a module with many small I/O sources (e.g.
+ * telemetry) doesn't need one blocking thread per source - all its callbacks
+ * run on the same thread, one at a time (no contention between them), and
+ * periodic work is driven by timers (no drift, unlike sleep_for in a loop).
+ * Callbacks must not block.
+ * All public methods are thread-safe.
+ */
+class EventLoop {
+ public:
+  // Called with the epoll events (EPOLLIN, EPOLLHUP, ...) of the fd
+  using FD_CALLBACK = std::function<void(uint32_t events)>;
+  using TIMER_CALLBACK = std::function<void()>;
+  using TimerId = int;
+  explicit EventLoop(std::string tag);
+  EventLoop(const EventLoop&) = delete;
+  EventLoop& operator=(const EventLoop&) = delete;
+  ~EventLoop();
+  /**
+   * Start the loop thread. Fds / timers can be added before or after.
+   * @param cpu_core pin the loop thread to this core, -1 for no pinning
+   */
+  void start(int cpu_core = -1);
+  // Stop (and join) the loop thread. Callbacks are not called anymore once this
+  // returns.
+  void stop();
+  /**
+   * Call @param cb on the loop thread whenever one of @param events is ready on
+   * @param fd (level-triggered). The fd is owned by the caller, but must not be
+   * closed before remove_fd() has been called.
+   * @return false if the fd cannot be added (e.g. already added)
+   */
+  bool add_fd(int fd, uint32_t events, FD_CALLBACK cb);
+  // Change the events of an already added fd
+  void modify_fd(int fd, uint32_t events);
+  // Once this returns, the callback of fd is not running and never called
+  // again.
+  void remove_fd(int fd);
+  /**
+   * Call @param cb every @param interval on the loop thread, first call after
+   * one interval. If the loop cannot keep up, missed expirations are skipped
+   * (and counted), not called in a burst.
+   * @return id to remove the timer, -1 on error
+   */
+  TimerId add_timer(std::chrono::nanoseconds interval, TIMER_CALLBACK cb);
+  // Same guarantees as remove_fd()
+  void remove_timer(TimerId id);
+  // Run @param fn on the loop thread as soon as possible (FIFO). Dropped if the
+  // loop has been stopped.
+  void post(std::function<void()> fn);
+  // Run @param fn on the loop thread and wait until it has run. Runs it
+  // directly if called from the loop thread or if the loop is not running.
+  void run_sync(const std::function<void()>& fn);
+  [[nodiscard]] bool is_in_loop_thread() const;
+
+  struct Stats {
+    uint64_t n_wakeups = 0;
+    uint64_t n_fd_events = 0;
+    uint64_t n_timer_expirations = 0;
+    // timer expirations skipped since the loop could not keep up
+    uint64_t n_timer_missed = 0;
+    uint64_t n_posted = 0;
+    // longest time a single callback blocked the loop
+    std::chrono::nanoseconds max_callback_duration{0};
+    [[nodiscard]] std::string to_string() const;
+  };
+  Stats get_stats();
+
+ private:
+  struct Handler {
+    int fd;
+    FD_CALLBACK cb;
+  };
+  void loop();
+  void run_posted();
+  void wakeup() const;
+  void on_callback_done(std::chrono::steady_clock::time_point begin);
+  // removes the handler of fd, needs to be called on the loop thread (or with
+  // the loop not running)
+  void remove_fd_on_loop(int fd);
+
+ private:
+  const std::string m_tag;
+  std::shared_ptr<spdlog::logger> m_console;
+  int m_epoll_fd;
+  int m_event_fd;
+  std::unique_ptr<std::thread> m_thread;
+  std::atomic<bool> m_keep_running = false;
+  std::atomic<std::thread::id> m_loop_thread_id{};
+  std::mutex m_mutex;
+  // All below require m_mutex
+  bool m_is_running = false;
+  bool m_is_stopped = false;
+  // key is stored in epoll_event.data.u64 - never re-used, such that a (stale)
+  // event of a removed fd cannot end up at a new handler for the same fd.
+  std::map<uint64_t, std::shared_ptr<Handler>> m_handlers;
+  std::map<int, uint64_t> m_fd_to_key;
+  uint64_t m_next_key = 1;
+  std::vector<std::function<void()>> m_posted;
+  Stats m_stats{};
+};
+
+}  // namespace openhd
+
+#endif  // OPENHD_OPENHD_EVENT_LOOP_H
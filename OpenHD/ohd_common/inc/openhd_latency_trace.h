@@ -0,0 +1,94 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#ifndef OPENHD_OPENHD_LATENCY_TRACE_H
+#define OPENHD_OPENHD_LATENCY_TRACE_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+// Per-stage latency histograms for the video path, such that we can see where
+// the latency budget goes. Recording is lock-free and cheap enough to be done
+// per frame / per fragment.
+namespace openhd::latency {
+
+/**
+ * Log-linear histogram of durations in microseconds (8 sub-buckets per power
+ * of 2, aka ~12% resolution) from 1us up to a couple of hours.
+ * add() is thread-safe and wait-free, percentiles are approximate (upper bound
+ * of the bucket).
+ */
+class Histogram {
+ public:
+  static constexpr int N_SUB_BUCKETS = 8;
+  static constexpr int N_BUCKETS = 32 * N_SUB_BUCKETS;
+  void add(std::chrono::nanoseconds duration);
+  struct Summary {
+    uint64_t count = 0;
+    uint32_t p50_us = 0;
+    uint32_t p95_us = 0;
+    uint32_t p99_us = 0;
+    uint32_t max_us = 0;
+  };
+  // Not atomic in regard to concurrent add() calls - good enough for stats
+  Summary get_summary() const;
+  void reset();
+
+ private:
+  static int bucket_index(uint64_t us);
+  static uint64_t bucket_upper_bound_us(int index);
+  std::array<std::atomic<uint64_t>, N_BUCKETS> m_buckets{};
+  std::atomic<uint64_t> m_max_us = 0;
+};
+
+enum class Stage : int {
+  // Capture timestamp of the buffer (gst PTS on the pipeline clock) until we
+  // pull the first fragment of the frame out of the appsink (~encode latency)
+  AIR_CAPTURE_TO_APPSINK = 0,
+  // First fragment of a frame pulled from the appsink until the frame is
+  // complete and handed to the link
+  AIR_FRAME_ASSEMBLY,
+  // Frame creation until the wb link has enqueued it for FEC / injection.
+  // The FEC / injection part is reported by wb itself (curr_tx_delay_xx_us)
+  AIR_LINK_ENQUEUE,
+  // Ground: Time from receiving a fragment until it was handed to all UDP
+  // destinations (QOpenHD, WebRTC, external devices), per fragment. With
+  // batched egress this includes the time the fragment waited for its batch.
+  GND_UDP_EGRESS,
+  COUNT
+};
+std::string stage_to_string(Stage stage);
+
+class LatencyTracer {
+ public:
+  static LatencyTracer& instance();
+  void record(Stage stage, std::chrono::nanoseconds duration);
+  Histogram::Summary get_summary(Stage stage) const;
+  // One line per (non-empty) stage
+  std::string summary_to_string() const;
+  // Logs the summary (and resets all histograms) at most once per interval.
+  // Returns true if it has been logged
+  bool log_and_reset_if_elapsed(std::chrono::seconds interval);
+
+ private:
+  std::array<Histogram, static_cast<int>(Stage::COUNT)> m_histograms;
+  std::mutex m_log_mutex;
+  std::chrono::steady_clock::time_point m_last_log =
+      std::chrono::steady_clock::now();
+};
+
+// Record the time elapsed since begin
+inline void record_since(Stage stage,
+                         std::chrono::steady_clock::time_point begin) {
+  LatencyTracer::instance().record(stage,
+                                   std::chrono::steady_clock::now() - begin);
+}
+
+}  // namespace openhd::latency
+
+#endif  // OPENHD_OPENHD_LATENCY_TRACE_H
@@ -50,6 +50,13 @@ class OHDLink {
    * send telemetry data to the ground if air unit and vice versa.
    */
   virtual void transmit_telemetry_data(TelemetryTxPacket packet) = 0;
+  /**
+   * valid on both air and ground instance
+   * @return the n of telemetry packets queued inside the link (not yet
+   * sent), approximately. Lets the caller keep this queue shallow and do the
+   * scheduling itself.
+   */
+  virtual int get_telemetry_tx_queue_depth() { return 0; }
 
   /**
    * valid on both air and ground instance
@@ -103,10 +110,30 @@ class OHDLink {
     }
     m_video_data_cb = std::make_shared<ON_VIDEO_DATA_CB>(cb);
   }
+  typedef std::function<void(int stream_index)> ON_VIDEO_BLOCK_DONE_CB;
+  // Called by the wifibroadcast receiver on the ground unit only, after all
+  // (recoverable) fragments of a FEC block have been handed out via
+  // on_receive_video_data. Allows the consumer to batch per block.
+  void on_receive_video_block_done(int stream_index) {
+    auto tmp = m_video_block_done_cb;
+    if (tmp) {
+      auto& cb = *tmp;
+      cb(stream_index);
+    }
+  }
+  void register_on_receive_video_block_done_cb(
+      const ON_VIDEO_BLOCK_DONE_CB& cb) {
+    if (cb == nullptr) {
+      m_video_block_done_cb = nullptr;
+      return;
+    }
+    m_video_block_done_cb = std::make_shared<ON_VIDEO_BLOCK_DONE_CB>(cb);
+  }
 
  private:
   std::shared_ptr<ON_TELE_DATA_CB> m_tele_data_cb;
   std::shared_ptr<ON_VIDEO_DATA_CB> m_video_data_cb;
+  std::shared_ptr<ON_VIDEO_BLOCK_DONE_CB> m_video_block_done_cb;
 };
 
 class DummyDebugLink : public OHDLink {
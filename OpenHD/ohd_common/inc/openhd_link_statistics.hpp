@@ -158,6 +158,15 @@ struct Xmavlink_openhd_wifbroadcast_gnd_operating_mode_t {
                                         EVER), 0=disabled, 1=enabled.*/
 };
 
+// Not sent via mavlink (yet), for debugging / monitoring the memory use of the
+// (video / telemetry) fragment buffer pool, see openhd_buffer_pool.h
+struct StatsBufferPool {
+  uint64_t count_hit = 0;
+  uint64_t count_miss = 0;
+  uint64_t count_oversize = 0;
+  int n_buffers = 0;
+};
+
 // Stats per connected card
 using StatsAllCards =
     std::array<Xmavlink_openhd_stats_monitor_mode_wifi_card_t, 4>;
@@ -176,6 +185,8 @@ struct StatsAirGround {
   std::vector<Xmavlink_openhd_stats_wb_video_ground_t> stats_wb_video_ground;
   Xmavlink_openhd_stats_wb_video_ground_fec_performance_t gnd_fec_performance;
   Xmavlink_openhd_wifbroadcast_gnd_operating_mode_t gnd_operating_mode;
+  // air and ground
+  StatsBufferPool buffer_pool;
 };
 
 typedef std::function<void(StatsAirGround all_stats)> STATS_CALLBACK;
@@ -0,0 +1,122 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#ifndef OPENHD_OPENHD_SEND_QUEUE_H
+#define OPENHD_OPENHD_SEND_QUEUE_H
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "openhd_spdlog.h"
+
+namespace openhd {
+
+/**
+ * Bounded, non-blocking send queue for one destination (socket).
+ * Sending never blocks the caller: If the socket can take the data right away
+ * (and nothing is queued), it is sent directly. Otherwise, the data is queued
+ * and the queue is drained by a (shared) epoll I/O worker thread once the
+ * socket becomes writable again. When the queue is full, the oldest packet is
+ * dropped - this way a slow consumer (e.g. a phone on a weak hotspot) can
+ * neither block nor add latency to other consumers / the caller.
+ * Works with datagram sockets (a destination address is given) and connected
+ * stream sockets (partial writes are continued, a partially sent packet is
+ * never dropped).
+ * The socket is owned by the caller, but must not be closed before shutdown()
+ * has been called.
+ */
+class NonBlockingSendQueue
+    : public std::enable_shared_from_this<NonBlockingSendQueue> {
+ public:
+  struct Stats {
+    uint64_t n_packets_sent = 0;
+    // Packets that could not be sent right away and had to be queued
+    uint64_t n_packets_queued = 0;
+    // Packets dropped since the queue was full (drop-oldest)
+    uint64_t n_packets_dropped = 0;
+    uint64_t n_send_errors = 0;
+    int queue_depth = 0;
+    int max_queue_depth = 0;
+    [[nodiscard]] std::string to_string() const;
+  };
+  /**
+   * @param sockfd the socket to send data on
+   * @param dest_addr destination for datagram sockets, std::nullopt for
+   * connected (stream) sockets
+   * @param tag used for (rate-limited) logging only
+   * @param max_n_packets max n of queued packets
+   */
+  static std::shared_ptr<NonBlockingSendQueue> create(
+      int sockfd, std::optional<struct sockaddr_in> dest_addr, std::string tag,
+      int max_n_packets);
+  ~NonBlockingSendQueue();
+  NonBlockingSendQueue(const NonBlockingSendQueue&) = delete;
+  NonBlockingSendQueue& operator=(const NonBlockingSendQueue&) = delete;
+  /**
+   * Send (or queue) the given packet. Never blocks.
+   */
+  void send(const uint8_t* data, int data_len);
+  /**
+   * Send (or queue) multiple packets, using a single sendmmsg() if possible.
+   * Only valid for datagram sockets.
+   */
+  void send_batch(const struct iovec* packets, int n_packets);
+  /**
+   * After this call returns, the socket is never touched again and can be
+   * closed.
+   */
+  void shutdown();
+  // Set once a (fatal) error occurred on a stream socket, e.g. the peer
+  // disconnected.
+  [[nodiscard]] bool has_fatal_error();
+  Stats get_stats();
+  // Called by the I/O worker once the socket is writable
+  void on_writable();
+
+ private:
+  explicit NonBlockingSendQueue(int sockfd,
+                                std::optional<struct sockaddr_in> dest_addr,
+                                std::string tag, int max_n_packets);
+  // All private methods below require m_mutex to be held
+  void enqueue(const uint8_t* data, int data_len);
+  // Send as much as possible from the queue, @return true if the queue has
+  // been drained completely
+  bool drain();
+  // @return n bytes written, 0 if the socket would block, -1 on error
+  int send_once(const uint8_t* data, int data_len);
+  void on_send_error(int err);
+  void arm_worker();
+  void log_stats_rate_limited();
+
+ private:
+  const int m_sockfd;
+  const std::optional<struct sockaddr_in> m_dest_addr;
+  const std::string m_tag;
+  const int m_max_n_packets;
+  std::shared_ptr<spdlog::logger> m_console;
+  std::mutex m_mutex;
+  std::deque<std::shared_ptr<std::vector<uint8_t>>> m_queue;
+  // Stream sockets only: n bytes of the front packet already written
+  int m_front_offset = 0;
+  bool m_is_shutdown = false;
+  bool m_has_fatal_error = false;
+  bool m_worker_armed = false;
+  Stats m_stats{};
+  std::vector<struct mmsghdr> m_mmsg_buff;
+  std::chrono::steady_clock::time_point m_last_log =
+      std::chrono::steady_clock::now();
+};
+
+}  // namespace openhd
+
+#endif  // OPENHD_OPENHD_SEND_QUEUE_H
@@ -29,22 +29,18 @@ create_log_only_cb_string();
 // default implementation that just prints the change request and always returns
 // true, mostly for debugging / testing. But in general, all OpenHD modules that
 // are configurable overwrite this callback with their own proper
-// implementation. get_callback: Quite dirty - all the params in openhd are
-// changed by the user via mavlink only - Except channel frequency and channel
-// width during the channel scan feature. Workaround for this rare case - don't
-// ask ;)
+// implementation. The rare case(s) where openhd changes a param value itself
+// (channel scan) are handled by openhd::ParamChangedHelper.
 
 struct IntSetting {
   int value;
   std::function<bool(std::string id, int requested_value)> change_callback =
       create_log_only_cb_int();
-  std::function<int()> get_callback = nullptr;
 };
 struct StringSetting {
   std::string value;
   std::function<bool(std::string id, std::string requested_value)>
       change_callback = create_log_only_cb_string();
-  std::function<std::string()> get_callback = nullptr;
 };
 
 struct Setting {
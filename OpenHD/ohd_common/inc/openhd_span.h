@@ -0,0 +1,74 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#ifndef OPENHD_OPENHD_SPAN_H
+#define OPENHD_OPENHD_SPAN_H
+
+#include <cstddef>
+#include <type_traits>
+
+namespace openhd {
+
+template <class T>
+class Span;
+
+template <class T>
+struct is_span : std::false_type {};
+template <class T>
+struct is_span<Span<T>> : std::true_type {};
+
+/**
+ * Minimal non-owning view on a contiguous sequence of T (we are on c++17, no
+ * std::span). Can be created from a std::vector (or anything else with
+ * data() and size()), but not from a temporary one - the span would dangle
+ * as soon as it is stored or returned.
+ */
+template <class T>
+class Span {
+ public:
+  using element_type = T;
+  constexpr Span() = default;
+  constexpr Span(T* data, size_t size) : m_data(data), m_size(size) {}
+  template <class Container,
+            class = std::enable_if_t<
+                !is_span<Container>::value &&
+                std::is_convertible_v<
+                    decltype(std::declval<Container&>().data()), T*>>>
+  constexpr Span(Container& container)
+      : m_data(container.data()), m_size(container.size()) {}
+  template <class Container,
+            class = std::enable_if_t<
+                !is_span<Container>::value &&
+                std::is_convertible_v<
+                    decltype(std::declval<const Container&>().data()), T*>>,
+            class = void>
+  constexpr Span(const Container& container)
+      : m_data(container.data()), m_size(container.size()) {}
+  template <class Container,
+            class = std::enable_if_t<
+                !std::is_lvalue_reference_v<Container> &&
+                !is_span<std::remove_cv_t<Container>>::value &&
+                std::is_convertible_v<
+                    decltype(std::declval<Container&>().data()), T*>>>
+  Span(Container&& container) = delete;
+  // Span<T> -> Span<const T>
+  template <class U,
+            class = std::enable_if_t<std::is_convertible_v<U*, T*> &&
+                                     !std::is_same_v<U, T>>>
+  constexpr Span(Span<U> other) : m_data(other.data()), m_size(other.size()) {}
+  [[nodiscard]] constexpr T* data() const { return m_data; }
+  [[nodiscard]] constexpr size_t size() const { return m_size; }
+  [[nodiscard]] constexpr bool empty() const { return m_size == 0; }
+  constexpr T& operator[](size_t idx) const { return m_data[idx]; }
+  constexpr T* begin() const { return m_data; }
+  constexpr T* end() const { return m_data + m_size; }
+
+ private:
+  T* m_data = nullptr;
+  size_t m_size = 0;
+};
+
+}  // namespace openhd
+
+#endif  // OPENHD_OPENHD_SPAN_H
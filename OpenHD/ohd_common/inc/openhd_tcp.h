@@ -5,21 +5,33 @@
 #ifndef OPENHD_OPENHD_TCP_H
 #define OPENHD_OPENHD_TCP_H
 
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <deque>
-#include <thread>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 
+#include "openhd_event_loop.h"
 #include "openhd_spdlog.h"
 
 namespace openhd {
 /**
- * Non-blocking multiple-client(s) multi-threaded TCP server
+ * Non-blocking multiple-client(s) TCP server
  * FEATURES:
- * 1) Multiple clients (multi-threaded)
+ * 1) Multiple clients, all served by one event loop thread (no thread per
+ * client)
  * 2) Automatically disconnect dead clients
  * 3) Generic interface where implementation can overwrite the following events:
  *      a) client connected / disconnected
- *      b) message received (any client)
+ *      b) data received (any client)
  *   And send messages with a broadcast-like interface.
+ * Each client has its own bounded output buffer - a slow client only loses
+ * (its oldest, whole) messages and never delays the other clients / the
+ * caller. A client that cannot keep up for a longer time is disconnected.
  */
 class TCPServer {
  public:
@@ -28,17 +40,30 @@ class TCPServer {
     // std::string ip;
     int port;
   };
-  explicit TCPServer(std::string tag, Config config, bool debug = false);
-  ~TCPServer();
+  /**
+   * @param event_loop loop to run on (e.g. shared with the rest of telemetry),
+   * if nullptr the server creates its own (one thread).
+   */
+  explicit TCPServer(std::string tag, Config config, bool debug = false,
+                     std::shared_ptr<EventLoop> event_loop = nullptr);
+  virtual ~TCPServer();
+  /**
+   * Disconnect all clients and stop accepting new ones. Once this returns, none
+   * of the virtual methods is called anymore - implementations must call this
+   * in their destructor.
+   */
+  void stop();
   /**
    * Needs to be overridden by implementation.
-   * Called every time a packet (from any client) has been received.
-   * The thread calling the method is different for every client.
+   * Called every time data (from any client) has been received, on the event
+   * loop thread. TCP is a stream - data is not aligned to messages, but data of
+   * different clients is never mixed (@param client_id).
    */
-  virtual void on_packet_any_tcp_client(const uint8_t* data, int data_len) = 0;
+  virtual void on_packet_any_tcp_client(int client_id, const uint8_t* data,
+                                        int data_len) = 0;
   /**
-   * Send the given message to all (currently) connected clients.
-   * Non-blocking -
+   * Send the given message to all (currently) connected clients. Never blocks,
+   * thread-safe. A message is either sent completely or not at all.
    */
   void send_message_to_all_clients(const uint8_t* data, int data_len);
   /**
@@ -47,35 +72,76 @@ class TCPServer {
    * once a client disconnects (Or is dead and has been disconnected as a
    * caution feature)
    */
-  virtual void on_external_device(std::string ip, int port, bool connected) = 0;
-
- private:
-  const Config m_config;
-  const bool m_debug;
-  std::shared_ptr<spdlog::logger> m_console;
-  std::unique_ptr<std::thread> m_accept_thread = nullptr;
-  bool m_keep_accept_thread_alive = true;
-  int server_fd = 0;
-  static constexpr const size_t READ_BUFF_SIZE = 65507;
-  void loop_accept();
+  virtual void on_external_device(int client_id, std::string ip, int port,
+                                  bool connected) = 0;
+  struct Stats {
+    int n_clients = 0;
+    uint64_t n_accepted = 0;
+    // Clients rejected since MAX_N_CLIENTS was reached
+    uint64_t n_rejected = 0;
+    uint64_t n_disconnected = 0;
+    uint64_t n_bytes_sent = 0;
+    uint64_t n_bytes_received = 0;
+    // Messages dropped since a client's output buffer was full
+    uint64_t n_messages_dropped = 0;
+    [[nodiscard]] std::string to_string() const;
+  };
+  Stats get_stats();
+  static constexpr int MAX_N_CLIENTS = 64;
+  // Per client - ~1s of telemetry
+  static constexpr size_t MAX_CLIENT_TX_BUFFER_BYTES = 64 * 1024;
+  // A client that has not been able to take data (output buffer full) for this
+  // long is disconnected
+  static constexpr auto CLIENT_STALL_TIMEOUT = std::chrono::seconds(5);
 
  private:
-  struct ConnectedClient {
+  struct Client {
+    int id;
     int sock_fd;
     std::string ip;
     int port;
-    bool marked_to_be_removed = false;
-    std::shared_ptr<std::thread> rx_loop_thread;
-    void loop_rx();
-    bool keep_rx_looping = true;
-    TCPServer* parent;
+    // Whole messages, the front one might be partially sent already
+    std::deque<std::shared_ptr<std::vector<uint8_t>>> tx_queue;
+    size_t tx_front_offset = 0;
+    size_t tx_queued_bytes = 0;
+    bool tx_want_writable = false;
+    bool has_error = false;
+    // Set once the first message has been dropped since the queue was empty
+    std::chrono::steady_clock::time_point tx_dropping_since{};
   };
-  std::mutex m_clients_list_mutex;
-  std::deque<std::shared_ptr<ConnectedClient>> m_clients_list;
+  // All called on the event loop thread
+  void on_accept();
+  void on_client_event(int sock_fd, uint32_t events);
+  void disconnect_client(int sock_fd);
+  // All require m_mutex
+  // @return false if the client needs to be disconnected
+  bool send_or_enqueue(Client& client, const uint8_t* data, int data_len,
+                       std::shared_ptr<std::vector<uint8_t>>& shared_copy);
+  bool flush_tx_queue(Client& client);
+  void set_want_writable(Client& client, bool want_writable);
+
+ private:
+  const std::string m_tag;
+  const Config m_config;
+  const bool m_debug;
+  std::shared_ptr<spdlog::logger> m_console;
+  // Only set if we created it
+  std::shared_ptr<EventLoop> m_own_event_loop;
+  std::shared_ptr<EventLoop> m_event_loop;
+  int m_server_fd = -1;
+  std::atomic<bool> m_is_stopped = false;
+  int m_next_client_id = 0;
+  // Only used on the loop thread
+  static constexpr const size_t READ_BUFF_SIZE = 65507;
+  std::unique_ptr<std::array<uint8_t, READ_BUFF_SIZE>> m_read_buff;
+  std::mutex m_mutex;
+  // sock fd -> client
+  std::map<int, std::unique_ptr<Client>> m_clients;
+  Stats m_stats{};
   template <typename... Args>
   void debug_if(spdlog::format_string_t<Args...> fmt, Args&&... args) {
     if (m_debug) {
-      m_console->debug(std::forward<Args>(args)...);
+      m_console->debug(fmt, std::forward<Args>(args)...);
     }
   }
 };
@@ -0,0 +1,214 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#ifndef OPENHD_OPENHD_OHD_COMMON_INC_OPENHD_TELEMETRY_FEC_H_
+#define OPENHD_OPENHD_OHD_COMMON_INC_OPENHD_TELEMETRY_FEC_H_
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace openhd {
+
+/**
+ * Small-block forward error correction for the (lossy, low rate) telemetry
+ * link - instead of blindly injecting each packet n times.
+ * Systematic Cauchy Reed-Solomon code over GF(2^8) on variable length
+ * packets: Data packets are sent right away (with a small header), such that
+ * FEC adds no latency as long as nothing is lost. Once a block is closed,
+ * parity packets are sent - any k of the k data + n parity packets are enough
+ * to recover all data packets of the block.
+ * The amount of parity of a block and how long its parity may be held back
+ * depend on the priority class of the packets in it (the n of injections they
+ * used to get, 1..4). A block is closed when it is full or when the latency
+ * cap of one of its packets has elapsed (tail flush) - a lone command is
+ * therefore never left unprotected for more than a few milliseconds.
+ * FEC packets start with a magic byte that is never the start of a mavlink
+ * frame, such that the receiver can tell them apart from plain (non-FEC)
+ * telemetry packets.
+ * Commands (and everything else that used to be injected 3 or more times)
+ * keep being injected n times: Once they share a block with other packets,
+ * matching the protection of 4 injections takes more parity than it saves.
+ * Trade-off (see test_telemetry_fec): less airtime per delivered byte than
+ * duplicate injection, but lower overall delivery at high loss (20% and
+ * more), which is why it is optional.
+ */
+namespace telemetry_fec {
+
+static constexpr uint8_t PACKET_MAGIC = 0xA5;
+static constexpr int HEADER_SIZE = 6;
+static constexpr int MAX_K = 16;
+static constexpr int MAX_N_PARITY = 16;
+// Max size of a data packet (a symbol also contains the length)
+static constexpr int MAX_PACKET_SIZE = 2048;
+static constexpr int N_PRIORITY_CLASSES = 4;
+
+struct PriorityClass {
+  // n of parity packets for a block of k packets:
+  // max(min_parity, round(k * parity_percent / 100))
+  int parity_percent;
+  int min_parity;
+  // A block with a packet of this class is closed (and its parity sent) after
+  // this time at the latest, even if not full
+  std::chrono::milliseconds max_block_latency;
+  // Packets of this class bypass the FEC and are injected n times instead
+  bool duplicate_injection = false;
+};
+
+struct Config {
+  // Max n of data packets per block
+  int max_k = 8;
+  // Indexed by the n of injections the packet used to get (1..4) - 1.
+  // Defaults: Roughly the same protection for a lone packet as duplicate
+  // injection, but much less overhead if multiple packets share a block.
+  // Commands (3 and 4 injections) stay at duplicate injection.
+  std::array<PriorityClass, N_PRIORITY_CLASSES> priority_classes{
+      PriorityClass{15, 0, std::chrono::milliseconds(40)},
+      PriorityClass{50, 1, std::chrono::milliseconds(40)},
+      PriorityClass{100, 2, std::chrono::milliseconds(10), true},
+      PriorityClass{100, 3, std::chrono::milliseconds(5), true}};
+};
+
+// n of parity packets for a block of k data packets with the given (highest)
+// priority class
+int get_n_parity(const Config& config, int k, int priority_class);
+
+// false if a packet that used to be injected n times should still be (instead
+// of going through the Encoder)
+bool uses_fec(const Config& config, int n_injections);
+
+/**
+ * Encodes (wraps) telemetry packets and generates the parity packets. The
+ * resulting packets are passed to the output callback, each needs to be sent
+ * exactly once. Thread-safe.
+ */
+class Encoder {
+ public:
+  typedef std::function<void(std::shared_ptr<std::vector<uint8_t>> packet)>
+      OUTPUT_CB;
+  Encoder(Config config, OUTPUT_CB output_cb);
+  ~Encoder();
+  Encoder(const Encoder&) = delete;
+  Encoder& operator=(const Encoder&) = delete;
+  /**
+   * Sends the data packet right away, then the parity of the block if it is
+   * closed by this packet.
+   * @param n_injections the n of injections the packet would have used
+   * without FEC (1 = normal, 4 = command)
+   */
+  void add_packet(const uint8_t* data, int data_len, int n_injections,
+                  std::chrono::steady_clock::time_point now =
+                      std::chrono::steady_clock::now());
+  // See telemetry_fec::uses_fec()
+  [[nodiscard]] bool uses_fec(int n_injections) const {
+    return telemetry_fec::uses_fec(m_config, n_injections);
+  }
+  // Closes the current block if its latency cap has elapsed
+  void flush_if_expired(std::chrono::steady_clock::time_point now =
+                            std::chrono::steady_clock::now());
+  // When the current block needs to be closed, std::nullopt if no block is
+  // open
+  std::optional<std::chrono::steady_clock::time_point> get_flush_deadline();
+  /**
+   * Calls flush_if_expired() at the right time(s) from an internal thread -
+   * use this unless you drive the flush yourself (e.g. simulated time).
+   * No-op if already running.
+   */
+  void start_tail_flush_thread();
+  // Stops the thread (if running). Also called by the destructor.
+  void stop_tail_flush_thread();
+  struct Stats {
+    uint64_t n_data_packets = 0;
+    uint64_t n_parity_packets = 0;
+    uint64_t n_blocks = 0;
+    // All bytes that were output, including header(s) and parity
+    uint64_t n_bytes_out = 0;
+    // Blocks closed by the tail flush (latency cap)
+    uint64_t n_tail_flushes = 0;
+    [[nodiscard]] std::string to_string() const;
+  };
+  Stats get_stats();
+
+ private:
+  void close_block_locked(bool tail_flush);
+  void output(std::shared_ptr<std::vector<uint8_t>> packet);
+  const Config m_config;
+  const OUTPUT_CB m_output_cb;
+  std::mutex m_mutex;
+  uint16_t m_block_idx = 0;
+  // Symbols (length + data) of the current block
+  std::vector<std::vector<uint8_t>> m_symbols;
+  int m_block_priority_class = 0;
+  std::chrono::steady_clock::time_point m_block_deadline;
+  Stats m_stats{};
+  std::condition_variable m_flush_cv;
+  bool m_flush_thread_run = false;
+  // Serializes start / stop of the thread
+  std::mutex m_flush_thread_mutex;
+  std::unique_ptr<std::thread> m_flush_thread;
+};
+
+/**
+ * Decodes the packets of an Encoder: Data packets are forwarded as soon as
+ * they arrive, missing ones as soon as they can be recovered. Not thread-safe,
+ * call from the link rx thread only.
+ */
+class Decoder {
+ public:
+  typedef std::function<void(const uint8_t* data, int data_len)> OUTPUT_CB;
+  explicit Decoder(OUTPUT_CB output_cb);
+  // true if the given packet was created by an Encoder
+  static bool is_fec_packet(const uint8_t* data, int data_len);
+  void process_packet(const uint8_t* data, int data_len);
+  struct Stats {
+    uint64_t n_data_packets = 0;
+    uint64_t n_parity_packets = 0;
+    uint64_t n_recovered = 0;
+    // Data packets that were lost and could not be recovered (counted once
+    // the block is complete / given up on)
+    uint64_t n_lost = 0;
+    uint64_t n_duplicates = 0;
+    uint64_t n_bad_packets = 0;
+    [[nodiscard]] std::string to_string() const;
+  };
+  [[nodiscard]] const Stats& get_stats() const { return m_stats; }
+
+ private:
+  struct Block {
+    uint16_t block_idx;
+    // -1 until the first parity packet has been received
+    int k = -1;
+    std::array<std::vector<uint8_t>, MAX_K> data_symbols;
+    std::array<bool, MAX_K> have_data{};
+    std::array<std::vector<uint8_t>, MAX_N_PARITY> parity_symbols;
+    std::array<bool, MAX_N_PARITY> have_parity{};
+    int n_data = 0;
+    int n_parity = 0;
+    bool done = false;
+  };
+  Block& get_block(uint16_t block_idx);
+  void try_recover(Block& block);
+  void retire(const Block& block);
+  // Forward the data of a (length prefixed) symbol
+  void forward_symbol(const std::vector<uint8_t>& symbol);
+  const OUTPUT_CB m_output_cb;
+  // Most recent blocks, oldest first
+  std::deque<Block> m_blocks;
+  static constexpr int MAX_N_BLOCKS = 8;
+  Stats m_stats{};
+};
+
+}  // namespace telemetry_fec
+}  // namespace openhd
+
+#endif  // OPENHD_OPENHD_OHD_COMMON_INC_OPENHD_TELEMETRY_FEC_H_
@@ -0,0 +1,22 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#ifndef OPENHD_OPENHD_OHD_COMMON_INC_OPENHD_TEST_UTIL_H_
+#define OPENHD_OPENHD_OHD_COMMON_INC_OPENHD_TEST_UTIL_H_
+
+#include <stdexcept>
+#include <string>
+
+// Shared by the test_* executables of all modules, not used by openhd itself
+namespace openhd::test {
+
+// Fails the test (uncaught exception -> non-zero exit code) with @param what
+// unless @param condition holds
+inline void check(bool condition, const std::string& what) {
+  if (!condition) throw std::runtime_error(what);
+}
+
+}  // namespace openhd::test
+
+#endif  // OPENHD_OPENHD_OHD_COMMON_INC_OPENHD_TEST_UTIL_H_
@@ -0,0 +1,48 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#ifndef OPENHD_OPENHD_OHD_COMMON_INC_OPENHD_TX_BUDGET_H_
+#define OPENHD_OPENHD_OHD_COMMON_INC_OPENHD_TX_BUDGET_H_
+
+#include <chrono>
+#include <optional>
+
+namespace openhd {
+
+/**
+ * Token bucket for the rate a component may send data with (e.g. param list
+ * or mavlink ftp transfers), such that it can't congest a low bandwidth link.
+ * Allows bursts of up to 1/4 second worth of budget. Sending more than is
+ * available (e.g. a response that has to go out anyways) is paid back by the
+ * following refills.
+ * Not thread-safe, use it under the lock of its owner.
+ */
+class TxBudget {
+ public:
+  // std::nullopt == unlimited. Starts with a full bucket.
+  void set_bytes_per_second(std::optional<int> bytes_per_second,
+                            std::chrono::steady_clock::time_point now =
+                                std::chrono::steady_clock::now());
+  [[nodiscard]] bool is_limited() const {
+    return m_bytes_per_second.has_value();
+  }
+  /**
+   * Refills the bucket for the time elapsed since the last refill.
+   * @return the n of bytes that can be sent now, INT_MAX if unlimited.
+   */
+  int refill(std::chrono::steady_clock::time_point now =
+                 std::chrono::steady_clock::now());
+  // Takes the bytes that have been sent out of the bucket (no-op if unlimited)
+  void consume(int n_bytes);
+
+ private:
+  std::optional<int> m_bytes_per_second;
+  double m_available_bytes = 0;
+  std::chrono::steady_clock::time_point m_last_refill =
+      std::chrono::steady_clock::now();
+};
+
+}  // namespace openhd
+
+#endif  // OPENHD_OPENHD_OHD_COMMON_INC_OPENHD_TX_BUDGET_H_
@@ -6,7 +6,10 @@
 #define OPENHD_OPENHD_UDP_H
 
 #include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 
+#include <array>
 #include <functional>
 #include <list>
 #include <memory>
@@ -14,6 +17,11 @@
 #include <optional>
 #include <string>
 #include <thread>
+#include <vector>
+
+#include "openhd_blackboard.h"
+#include "openhd_event_loop.h"
+#include "openhd_send_queue.h"
 
 //
 // openhd UDP helpers
@@ -21,6 +29,8 @@
 namespace openhd {
 // Wrapper around an UDP port you can send data to
 // opens port on construction, closes port on destruction
+// Sending never blocks - if the destination is slow, packets are queued
+// (bounded, drop-oldest) and sent by the I/O worker, see NonBlockingSendQueue
 class UDPForwarder {
  public:
   explicit UDPForwarder(std::string client_addr1, int client_udp_port1);
@@ -28,10 +38,16 @@ class UDPForwarder {
   UDPForwarder &operator=(const UDPForwarder &) = delete;
   ~UDPForwarder();
   void forwardPacketViaUDP(const uint8_t *packet, std::size_t packetSize) const;
+  // Send multiple packets, using a single syscall (sendmmsg) if possible
+  void forwardPacketsViaUDP(const struct iovec *packets, int n_packets) const;
+  [[nodiscard]] NonBlockingSendQueue::Stats get_stats() const;
+  // ~300ms of video at 5MBit/s
+  static constexpr int MAX_N_QUEUED_PACKETS = 128;
 
  private:
   struct sockaddr_in saddr {};
   int sockfd;
+  std::shared_ptr<NonBlockingSendQueue> m_send_queue;
 
  public:
   const std::string client_addr;
@@ -40,11 +56,16 @@ class UDPForwarder {
 
 /**
  * Similar to UDP forwarder, but allows forwarding the same data to 0 or more
- * IP::Port tuples
+ * IP::Port tuples.
+ * The list of destinations is a snapshot (see openhd::SnapshotValue) - adding
+ * / removing a destination publishes a new snapshot, the (per-packet) forward
+ * path only pins the current one: it never takes a lock and never waits for
+ * add / remove. A removed destination (its socket) is destroyed on the thread
+ * calling add / remove, never on the forwarding thread.
  */
 class UDPMultiForwarder {
  public:
-  explicit UDPMultiForwarder() = default;
+  explicit UDPMultiForwarder();
   UDPMultiForwarder(const UDPMultiForwarder &) = delete;
   UDPMultiForwarder &operator=(const UDPMultiForwarder &) = delete;
   /**
@@ -60,14 +81,29 @@ class UDPMultiForwarder {
    * Forward data to all added IP::Port tuples via UDP
    */
   void forwardPacketViaUDP(const uint8_t *packet, std::size_t packetSize);
-  [[nodiscard]] const std::list<std::unique_ptr<UDPForwarder>> &getForwarders()
-      const;
+  /**
+   * Batched alternative to forwardPacketViaUDP: The packet is copied into an
+   * internal buffer and sent to all added IP::Port tuples on flush() - using a
+   * single sendmmsg() call for all packets and destinations instead of one
+   * sendto() per packet per destination. Flushes automatically when the batch
+   * is full. Not thread-safe in regard to other enqueue / flush calls.
+   * As with forwardPacketViaUDP, a slow destination cannot block the others.
+   */
+  void enqueuePacket(const uint8_t *packet, std::size_t packetSize);
+  void flush();
+  using Destinations = std::vector<std::shared_ptr<const UDPForwarder>>;
+  [[nodiscard]] Destinations getForwarders() const;
 
  private:
-  // list of host::port tuples where we send the data to.
-  std::list<std::unique_ptr<UDPForwarder>> udpForwarders;
-  // modifying the list of forwarders must be thread-safe
+  // host::port tuples where we send the data to
+  SnapshotValue<Destinations> m_destinations;
+  // Serializes add / remove (writers) only
   std::mutex udpForwardersLock;
+  // Batching
+  static constexpr int MAX_BATCH_N_PACKETS = 64;
+  std::vector<std::vector<uint8_t>> m_batch;
+  int m_batch_n_packets = 0;
+  std::vector<struct iovec> m_batch_iovs;
 };
 
 // Open the specified port for udp receiving
@@ -101,13 +137,21 @@ class UDPReceiver {
                            const uint8_t *packet, std::size_t packetSize) const;
   void stopLooping();
   void runInBackground();
+  // Alternative to runInBackground() - receive on the given (shared) event
+  // loop instead of a dedicated thread. The callback is called on the loop
+  // thread.
+  void runInEventLoop(std::shared_ptr<EventLoop> event_loop);
   void stopBackground();
 
  private:
+  // Called by the event loop when the socket is readable
+  void on_readable();
   const OUTPUT_DATA_CALLBACK mCb;
   bool receiving = true;
   int mSocket;
   std::unique_ptr<std::thread> receiverThread = nullptr;
+  std::shared_ptr<EventLoop> m_event_loop = nullptr;
+  std::unique_ptr<std::array<uint8_t, UDP_PACKET_MAX_SIZE>> m_rx_buff;
 };
 
 static const std::string ADDRESS_LOCALHOST = "127.0.0.1";
@@ -164,6 +164,11 @@ std::string str_vec_as_string(const std::vector<std::string>& v);
 
 std::string bytes_as_string(const uint8_t* data, int data_len);
 
+// CRC32 (reflected, polynomial 0xEDB88320) without initial / final inversion,
+// same as crc32part() of PX4 / NuttX (used by mavlink ftp and the param cache
+// hash). Pass the previous result as @param crc to continue a crc.
+uint32_t crc32(const uint8_t* data, size_t data_len, uint32_t crc = 0);
+
 // maps [0,100] to [-1.0,1.0] with 50% == 0.0
 float map_int_percentage_to_minus1_to_1(int percentage);
 // maps [0,200] to [-1.0,1.0] with 100% = 0.0
@@ -11,11 +11,13 @@ openhd::ArmingStateHelper &openhd::ArmingStateHelper::instance() {
 
 void openhd::ArmingStateHelper::register_listener(
     const std::string &tag, openhd::ArmingStateHelper::STATE_CHANGED_CB cb) {
+  std::lock_guard<std::mutex> guard(m_cbs_mutex);
   assert(m_cbs.find(tag) == m_cbs.end());
   m_cbs[tag] = std::move(cb);
 }
 
 void openhd::ArmingStateHelper::unregister_listener(const std::string &tag) {
+  std::lock_guard<std::mutex> guard(m_cbs_mutex);
   auto element = m_cbs.find(tag);
   if (element == m_cbs.end()) {
     openhd::log::get_default()->warn("Cannot unregister arming listener {}",
@@ -26,8 +28,11 @@ void openhd::ArmingStateHelper::unregister_listener(const std::string &tag) {
 }
 
 void openhd::ArmingStateHelper::update_arming_state_if_changed(bool armed) {
-  if (m_is_armed == armed) return;
-  m_is_armed = armed;
+  // Called on each FC heartbeat, the state rarely changes
+  if (m_is_armed.read() == armed) return;
+  std::lock_guard<std::mutex> guard(m_cbs_mutex);
+  if (m_is_armed.read() == armed) return;
+  m_is_armed.publish(armed);
   m_console->debug("MAV armed:{}, calling listeners.",
                    OHDUtil::yes_or_no(armed));
   for (auto &element : m_cbs) {
@@ -44,8 +49,9 @@ openhd::FCRcChannelsHelper &openhd::FCRcChannelsHelper::instance() {
 }
 
 void openhd::FCRcChannelsHelper::update_rc_channels(
-    const std::array<int, 18> &rc_channels) {
-  auto tmp = m_action_rc_channel;
+    const RC_CHANNELS &rc_channels) {
+  m_rc_channels.publish(rc_channels);
+  auto tmp = std::atomic_load(&m_action_rc_channel);
   if (tmp) {
     ACTION_ON_ANY_RC_CHANNEL_CB cb = *tmp;
     cb(rc_channels);
@@ -55,10 +61,12 @@ void openhd::FCRcChannelsHelper::update_rc_channels(
 void openhd::FCRcChannelsHelper::action_on_any_rc_channel_register(
     openhd::FCRcChannelsHelper::ACTION_ON_ANY_RC_CHANNEL_CB cb) {
   if (cb == nullptr) {
-    m_action_rc_channel = nullptr;
+    std::atomic_store(&m_action_rc_channel,
+                      std::shared_ptr<ACTION_ON_ANY_RC_CHANNEL_CB>());
     return;
   }
-  m_action_rc_channel = std::make_shared<ACTION_ON_ANY_RC_CHANNEL_CB>(cb);
+  std::atomic_store(&m_action_rc_channel,
+                    std::make_shared<ACTION_ON_ANY_RC_CHANNEL_CB>(cb));
 }
 
 openhd::LinkActionHandler &openhd::LinkActionHandler::instance() {
@@ -66,6 +74,32 @@ openhd::LinkActionHandler &openhd::LinkActionHandler::instance() {
   return instance;
 }
 
+openhd::ParamChangedHelper &openhd::ParamChangedHelper::instance() {
+  static openhd::ParamChangedHelper instance;
+  return instance;
+}
+
+void openhd::ParamChangedHelper::register_listener(
+    const std::string &tag,
+    openhd::ParamChangedHelper::INT_PARAM_CHANGED_CB cb) {
+  std::lock_guard<std::mutex> guard(m_cbs_mutex);
+  assert(m_cbs.find(tag) == m_cbs.end());
+  m_cbs[tag] = std::move(cb);
+}
+
+void openhd::ParamChangedHelper::unregister_listener(const std::string &tag) {
+  std::lock_guard<std::mutex> guard(m_cbs_mutex);
+  m_cbs.erase(tag);
+}
+
+void openhd::ParamChangedHelper::notify_int_param_changed(
+    const std::string &param_id, int value) {
+  std::lock_guard<std::mutex> guard(m_cbs_mutex);
+  for (auto &element : m_cbs) {
+    element.second(param_id, value);
+  }
+}
+
 openhd::TerminateHelper &openhd::TerminateHelper::instance() {
   static TerminateHelper instance;
   return instance;
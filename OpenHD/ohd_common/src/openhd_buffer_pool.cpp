@@ -0,0 +1,223 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#include "openhd_buffer_pool.h"
+
+#include <cassert>
+#include <cstddef>
+#include <map>
+#include <sstream>
+#include <thread>
+
+namespace {
+// Large enough for the control block of a shared_ptr with an empty deleter
+// and our allocator (checked at compile time)
+constexpr size_t CONTROL_BLOCK_SIZE = 64;
+
+// A thread that exits hands its caches back to the pools that are still alive
+std::mutex& live_pools_mutex() {
+  static auto* mutex = new std::mutex();
+  return *mutex;
+}
+std::map<uint64_t, openhd::FragmentBufferPool*>& live_pools() {
+  static auto* pools = new std::map<uint64_t, openhd::FragmentBufferPool*>();
+  return *pools;
+}
+std::atomic<uint64_t> next_pool_id{0};
+}  // namespace
+
+struct openhd::FragmentBufferPool::Buffer {
+  std::vector<uint8_t> data;
+  ThreadCache* home;
+  // Intrusive link for the free lists
+  Buffer* next = nullptr;
+  // The shared_ptr control block lives here - no allocation per acquire
+  alignas(std::max_align_t) unsigned char control_block[CONTROL_BLOCK_SIZE];
+};
+
+struct openhd::FragmentBufferPool::ThreadCache {
+  // The thread that acquires from this cache, none if it exited
+  std::atomic<std::thread::id> owner;
+  // Owner only
+  std::vector<std::unique_ptr<Buffer>> buffers;
+  std::vector<Buffer*> free_buffers;
+  // Released on other threads. Pushed with a CAS, but only ever taken as a
+  // whole by the owner (exchange) - no ABA problem.
+  std::atomic<Buffer*> remote_free_buffers{nullptr};
+  // Written by the owner only, such that counting is not a shared RMW
+  std::atomic<uint64_t> count_hit{0};
+  std::atomic<uint64_t> count_miss{0};
+  std::atomic<uint64_t> count_oversize{0};
+  std::atomic<int> n_buffers{0};
+  static void increment(std::atomic<uint64_t>& counter) {
+    counter.store(counter.load(std::memory_order_relaxed) + 1,
+                  std::memory_order_relaxed);
+  }
+  Buffer* pop_free_buffer() {
+    if (free_buffers.empty()) {
+      Buffer* list = remote_free_buffers.exchange(nullptr,
+                                                  std::memory_order_acquire);
+      for (; list != nullptr; list = list->next) free_buffers.push_back(list);
+    }
+    if (free_buffers.empty()) return nullptr;
+    Buffer* ret = free_buffers.back();
+    free_buffers.pop_back();
+    return ret;
+  }
+};
+
+struct openhd::FragmentBufferPool::ThreadLocalCaches {
+  // pool id -> cache of this thread, usually only one entry
+  std::vector<std::pair<uint64_t, ThreadCache*>> caches;
+  ~ThreadLocalCaches() {
+    std::lock_guard<std::mutex> live_guard(live_pools_mutex());
+    for (const auto& [pool_id, cache] : caches) {
+      auto it = live_pools().find(pool_id);
+      if (it == live_pools().end()) continue;
+      FragmentBufferPool& pool = *it->second;
+      std::lock_guard<std::mutex> guard(pool.m_mutex);
+      cache->owner.store(std::thread::id(), std::memory_order_relaxed);
+      pool.m_orphaned_caches.push_back(cache);
+    }
+  }
+};
+
+// Places the shared_ptr control block inside the buffer. Deallocating the
+// control block is the very last thing shared_ptr does with a buffer - that's
+// where it goes back to the pool.
+template <typename T>
+struct openhd::FragmentBufferPool::ControlBlockAllocator {
+  using value_type = T;
+  Buffer* buffer;
+  explicit ControlBlockAllocator(Buffer* buffer) : buffer(buffer) {}
+  // Implicit, as required for rebinding
+  template <typename U>
+  ControlBlockAllocator(const ControlBlockAllocator<U>& other)  // NOLINT
+      : buffer(other.buffer) {}
+  T* allocate(size_t n) {
+    static_assert(sizeof(T) <= CONTROL_BLOCK_SIZE,
+                  "CONTROL_BLOCK_SIZE too small");
+    static_assert(alignof(T) <= alignof(std::max_align_t));
+    assert(n == 1);
+    return reinterpret_cast<T*>(buffer->control_block);
+  }
+  void deallocate(T* /*p*/, size_t /*n*/) { release(buffer); }
+  template <typename U>
+  bool operator==(const ControlBlockAllocator<U>& other) const {
+    return buffer == other.buffer;
+  }
+  template <typename U>
+  bool operator!=(const ControlBlockAllocator<U>& other) const {
+    return buffer != other.buffer;
+  }
+};
+
+openhd::FragmentBufferPool::FragmentBufferPool(size_t max_n_buffers)
+    : m_max_n_buffers(max_n_buffers), m_id(next_pool_id++) {
+  std::lock_guard<std::mutex> guard(live_pools_mutex());
+  live_pools()[m_id] = this;
+}
+
+openhd::FragmentBufferPool::~FragmentBufferPool() {
+  std::lock_guard<std::mutex> guard(live_pools_mutex());
+  live_pools().erase(m_id);
+}
+
+openhd::FragmentBufferPool& openhd::FragmentBufferPool::instance() {
+  // Intentionally never destroyed - buffers might be released by other
+  // static objects / threads during shutdown.
+  static auto* instance = new FragmentBufferPool();
+  return *instance;
+}
+
+std::shared_ptr<std::vector<uint8_t>> openhd::FragmentBufferPool::acquire(
+    const uint8_t* data, size_t data_len) {
+  ThreadCache& cache = get_thread_cache();
+  if (data_len > BUFFER_CAPACITY) {
+    ThreadCache::increment(cache.count_oversize);
+    return std::make_shared<std::vector<uint8_t>>(data, data + data_len);
+  }
+  Buffer* buffer = cache.pop_free_buffer();
+  if (buffer != nullptr) {
+    ThreadCache::increment(cache.count_hit);
+  } else {
+    ThreadCache::increment(cache.count_miss);
+    if (cache.buffers.size() >= m_max_n_buffers) {
+      return std::make_shared<std::vector<uint8_t>>(data, data + data_len);
+    }
+    // Grow the pool (of this thread)
+    auto new_buffer = std::make_unique<Buffer>();
+    new_buffer->data.reserve(BUFFER_CAPACITY);
+    new_buffer->home = &cache;
+    buffer = new_buffer.get();
+    cache.buffers.push_back(std::move(new_buffer));
+    cache.free_buffers.reserve(cache.buffers.size());
+    cache.n_buffers.store(static_cast<int>(cache.buffers.size()),
+                          std::memory_order_relaxed);
+  }
+  // Capacity is large enough, no re-allocation
+  buffer->data.assign(data, data + data_len);
+  return {&buffer->data, [](std::vector<uint8_t>*) {},
+          ControlBlockAllocator<uint8_t>(buffer)};
+}
+
+void openhd::FragmentBufferPool::release(Buffer* buffer) {
+  ThreadCache* home = buffer->home;
+  if (home->owner.load(std::memory_order_relaxed) ==
+      std::this_thread::get_id()) {
+    // Capacity reserved when the buffer was created
+    home->free_buffers.push_back(buffer);
+    return;
+  }
+  Buffer* head = home->remote_free_buffers.load(std::memory_order_relaxed);
+  do {
+    buffer->next = head;
+  } while (!home->remote_free_buffers.compare_exchange_weak(
+      head, buffer, std::memory_order_release, std::memory_order_relaxed));
+}
+
+openhd::FragmentBufferPool::ThreadCache&
+openhd::FragmentBufferPool::get_thread_cache() {
+  static thread_local ThreadLocalCaches thread_local_caches;
+  for (const auto& [pool_id, cache] : thread_local_caches.caches) {
+    if (pool_id == m_id) return *cache;
+  }
+  return register_thread(thread_local_caches);
+}
+
+openhd::FragmentBufferPool::ThreadCache&
+openhd::FragmentBufferPool::register_thread(
+    ThreadLocalCaches& thread_local_caches) {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  ThreadCache* cache;
+  if (!m_orphaned_caches.empty()) {
+    cache = m_orphaned_caches.back();
+    m_orphaned_caches.pop_back();
+  } else {
+    m_caches.push_back(std::make_unique<ThreadCache>());
+    cache = m_caches.back().get();
+  }
+  cache->owner.store(std::this_thread::get_id(), std::memory_order_relaxed);
+  thread_local_caches.caches.emplace_back(m_id, cache);
+  return *cache;
+}
+
+openhd::FragmentBufferPool::Stats openhd::FragmentBufferPool::get_stats() {
+  Stats ret{};
+  std::lock_guard<std::mutex> guard(m_mutex);
+  for (const auto& cache : m_caches) {
+    ret.count_hit += cache->count_hit.load(std::memory_order_relaxed);
+    ret.count_miss += cache->count_miss.load(std::memory_order_relaxed);
+    ret.count_oversize += cache->count_oversize.load(std::memory_order_relaxed);
+    ret.n_buffers += cache->n_buffers.load(std::memory_order_relaxed);
+  }
+  return ret;
+}
+
+std::string openhd::FragmentBufferPool::Stats::to_string() const {
+  std::stringstream ss;
+  ss << "BufferPool{hit:" << count_hit << ", miss:" << count_miss
+     << ", oversize:" << count_oversize << ", n_buffers:" << n_buffers << "}";
+  return ss.str();
+}
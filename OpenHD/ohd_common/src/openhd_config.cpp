@@ -52,12 +52,20 @@ static openhd::Config load_or_default() {
         r.GetVector<std::string>("network", "NW_MANUAL_FORWARDING_IPS");
     ret.NW_FORWARD_TO_LOCALHOST_58XX =
         r.Get<bool>("network", "NW_FORWARD_TO_LOCALHOST_58XX");
+    // Optional, such that older config files stay valid
+    ret.NW_BATCH_VIDEO_UDP_EGRESS =
+        r.Get<bool>("network", "NW_BATCH_VIDEO_UDP_EGRESS", false);
 
     ret.GEN_ENABLE_LAST_KNOWN_POSITION =
         r.Get<bool>("generic", "GEN_ENABLE_LAST_KNOWN_POSITION");
     ret.GEN_RF_METRICS_LEVEL = r.Get<int>("generic", "GEN_RF_METRICS_LEVEL");
     ret.GEN_NO_QOPENHD_AUTOSTART =
         r.Get<bool>("generic", "GEN_NO_QOPENHD_AUTOSTART");
+    // Optional, such that older config files stay valid
+    ret.GEN_TELEMETRY_CPU_CORE =
+        r.Get<int>("generic", "GEN_TELEMETRY_CPU_CORE", -1);
+    ret.GEN_ENABLE_TELEMETRY_RECORDER =
+        r.Get<bool>("generic", "GEN_ENABLE_TELEMETRY_RECORDER", false);
     return ret;
   } catch (std::exception& exception) {
     get_logger()->error("Ill-formatted config file {}",
@@ -78,8 +86,9 @@ void openhd::debug_config(const openhd::Config& config) {
       "WIFI_FORCE_NO_LINK_BUT_HOTSPOT:{}, WIFI_LOCAL_NETWORK_ENABLE:{}, "
       "WIFI_LOCAL_NETWORK_SSID:[{}], WIFI_LOCAL_NETWORK_PASSWORD:[{}]\n"
       "NW_MANUAL_FORWARDING_IPS:{},NW_ETHERNET_CARD:{},NW_FORWARD_TO_LOCALHOST_"
-      "58XX:{}\n"
-      "GEN_RF_METRICS_LEVEL:{}, GEN_NO_QOPENHD_AUTOSTART:{}\n",
+      "58XX:{}, NW_BATCH_VIDEO_UDP_EGRESS:{}\n"
+      "GEN_RF_METRICS_LEVEL:{}, GEN_NO_QOPENHD_AUTOSTART:{}, "
+      "GEN_TELEMETRY_CPU_CORE:{}, GEN_ENABLE_TELEMETRY_RECORDER:{}\n",
       config.WIFI_ENABLE_AUTODETECT,
       OHDUtil::str_vec_as_string(config.WIFI_WB_LINK_CARDS),
       config.WIFI_WIFI_HOTSPOT_CARD, config.WIFI_MONITOR_CARD_EMULATE,
@@ -87,7 +96,9 @@ void openhd::debug_config(const openhd::Config& config) {
       config.WIFI_LOCAL_NETWORK_SSID, config.WIFI_LOCAL_NETWORK_PASSWORD,
       OHDUtil::str_vec_as_string(config.NW_MANUAL_FORWARDING_IPS),
       config.NW_ETHERNET_CARD, config.NW_FORWARD_TO_LOCALHOST_58XX,
-      config.GEN_RF_METRICS_LEVEL, config.GEN_NO_QOPENHD_AUTOSTART);
+      config.NW_BATCH_VIDEO_UDP_EGRESS,
+      config.GEN_RF_METRICS_LEVEL, config.GEN_NO_QOPENHD_AUTOSTART,
+      config.GEN_TELEMETRY_CPU_CORE, config.GEN_ENABLE_TELEMETRY_RECORDER);
 }
 
 void openhd::debug_config() {
@@ -0,0 +1,327 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#include "openhd_event_loop.h"
+
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <array>
+#include <cstring>
+#include <future>
+#include <sstream>
+
+namespace {
+// epoll_event.data.u64 of the wakeup eventfd, handler keys start at 1
+constexpr uint64_t WAKEUP_KEY = 0;
+}  // namespace
+
+std::string openhd::EventLoop::Stats::to_string() const {
+  std::stringstream ss;
+  ss << "wakeups:" << n_wakeups << " fd_events:" << n_fd_events
+     << " timer:" << n_timer_expirations << " timer_missed:" << n_timer_missed
+     << " posted:" << n_posted << " max_cb:"
+     << std::chrono::duration_cast<std::chrono::microseconds>(
+            max_callback_duration)
+            .count()
+     << "us";
+  return ss.str();
+}
+
+openhd::EventLoop::EventLoop(std::string tag) : m_tag(std::move(tag)) {
+  m_console = openhd::log::create_or_get(m_tag);
+  m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  m_event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (m_epoll_fd < 0 || m_event_fd < 0) {
+    m_console->error("Cannot create epoll / eventfd {}", strerror(errno));
+  }
+  struct epoll_event ev {};
+  ev.events = EPOLLIN;
+  ev.data.u64 = WAKEUP_KEY;
+  epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_event_fd, &ev);
+}
+
+openhd::EventLoop::~EventLoop() {
+  stop();
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    if (!m_handlers.empty()) {
+      m_console->debug("{} fds / timers still registered", m_handlers.size());
+    }
+    m_handlers.clear();
+    m_fd_to_key.clear();
+  }
+  close(m_event_fd);
+  close(m_epoll_fd);
+}
+
+void openhd::EventLoop::start(const int cpu_core) {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  if (m_thread != nullptr || m_is_stopped) {
+    m_console->warn("Already started");
+    return;
+  }
+  m_keep_running = true;
+  m_is_running = true;
+  m_thread = std::make_unique<std::thread>(&EventLoop::loop, this);
+  // Thread names are limited to 15 chars
+  pthread_setname_np(m_thread->native_handle(), m_tag.substr(0, 15).c_str());
+  if (cpu_core >= 0) {
+    if (cpu_core >= (int)std::thread::hardware_concurrency()) {
+      m_console->warn("Cannot pin to core {}, only {} cores", cpu_core,
+                      std::thread::hardware_concurrency());
+    } else {
+      cpu_set_t cpuset;
+      CPU_ZERO(&cpuset);
+      CPU_SET(cpu_core, &cpuset);
+      const int ret = pthread_setaffinity_np(m_thread->native_handle(),
+                                             sizeof(cpu_set_t), &cpuset);
+      if (ret != 0) {
+        m_console->warn("Cannot pin to core {} {}", cpu_core, strerror(ret));
+      } else {
+        m_console->debug("Pinned to core {}", cpu_core);
+      }
+    }
+  }
+}
+
+void openhd::EventLoop::stop() {
+  if (is_in_loop_thread()) {
+    m_console->error("stop() called from the loop thread");
+    return;
+  }
+  std::unique_ptr<std::thread> thread;
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    if (m_is_stopped) return;
+    m_is_stopped = true;
+    thread = std::move(m_thread);
+  }
+  m_keep_running = false;
+  wakeup();
+  if (thread && thread->joinable()) {
+    thread->join();
+  }
+  std::lock_guard<std::mutex> guard(m_mutex);
+  m_posted.clear();
+}
+
+bool openhd::EventLoop::add_fd(const int fd, const uint32_t events,
+                               FD_CALLBACK cb) {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  if (m_fd_to_key.find(fd) != m_fd_to_key.end()) {
+    m_console->warn("fd {} already added", fd);
+    return false;
+  }
+  const uint64_t key = m_next_key++;
+  struct epoll_event ev {};
+  ev.events = events;
+  ev.data.u64 = key;
+  if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+    m_console->warn("Cannot add fd {} {}", fd, strerror(errno));
+    return false;
+  }
+  m_handlers[key] = std::make_shared<Handler>(Handler{fd, std::move(cb)});
+  m_fd_to_key[fd] = key;
+  return true;
+}
+
+void openhd::EventLoop::modify_fd(const int fd, const uint32_t events) {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  auto it = m_fd_to_key.find(fd);
+  if (it == m_fd_to_key.end()) return;
+  struct epoll_event ev {};
+  ev.events = events;
+  ev.data.u64 = it->second;
+  if (epoll_ctl(m_epoll_fd, EPOLL_CTL_MOD, fd, &ev) != 0) {
+    m_console->warn("Cannot modify fd {} {}", fd, strerror(errno));
+  }
+}
+
+void openhd::EventLoop::remove_fd(const int fd) {
+  // Removing it on the loop thread guarantees the callback is not running
+  // concurrently
+  run_sync([this, fd] { remove_fd_on_loop(fd); });
+}
+
+void openhd::EventLoop::remove_fd_on_loop(const int fd) {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  auto it = m_fd_to_key.find(fd);
+  if (it == m_fd_to_key.end()) return;
+  epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+  // If we are called from its own callback, the loop still holds a reference
+  m_handlers.erase(it->second);
+  m_fd_to_key.erase(it);
+}
+
+openhd::EventLoop::TimerId openhd::EventLoop::add_timer(
+    const std::chrono::nanoseconds interval, TIMER_CALLBACK cb) {
+  const int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (fd < 0) {
+    m_console->warn("Cannot create timerfd {}", strerror(errno));
+    return -1;
+  }
+  struct itimerspec spec {};
+  spec.it_interval.tv_sec = interval.count() / 1000000000;
+  spec.it_interval.tv_nsec = interval.count() % 1000000000;
+  spec.it_value = spec.it_interval;
+  if (timerfd_settime(fd, 0, &spec, nullptr) != 0) {
+    m_console->warn("Cannot set timerfd {}", strerror(errno));
+    close(fd);
+    return -1;
+  }
+  auto on_expired = [this, fd, cb = std::move(cb)](uint32_t) {
+    uint64_t n_expirations = 0;
+    if (read(fd, &n_expirations, sizeof(n_expirations)) !=
+            sizeof(n_expirations) ||
+        n_expirations == 0) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> guard(m_mutex);
+      m_stats.n_timer_expirations++;
+      m_stats.n_timer_missed += n_expirations - 1;
+    }
+    cb();
+  };
+  if (!add_fd(fd, EPOLLIN, std::move(on_expired))) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+void openhd::EventLoop::remove_timer(const TimerId id) {
+  if (id < 0) return;
+  remove_fd(id);
+  close(id);
+}
+
+void openhd::EventLoop::post(std::function<void()> fn) {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  if (m_is_stopped) return;
+  m_posted.push_back(std::move(fn));
+  m_stats.n_posted++;
+  // Only wake up once per batch of posted tasks
+  if (m_is_running && m_posted.size() == 1) wakeup();
+}
+
+void openhd::EventLoop::run_sync(const std::function<void()>& fn) {
+  if (is_in_loop_thread()) {
+    fn();
+    return;
+  }
+  std::promise<void> done;
+  auto future = done.get_future();
+  bool queued = false;
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    if (m_is_running) {
+      // Runs at the latest in the final drain when the loop exits
+      m_posted.emplace_back([&fn, &done] {
+        fn();
+        done.set_value();
+      });
+      queued = true;
+      if (m_posted.size() == 1) wakeup();
+    }
+  }
+  if (!queued) {
+    // Not started or already exited, nothing can run concurrently
+    fn();
+    return;
+  }
+  future.wait();
+}
+
+bool openhd::EventLoop::is_in_loop_thread() const {
+  return m_loop_thread_id.load() == std::this_thread::get_id();
+}
+
+openhd::EventLoop::Stats openhd::EventLoop::get_stats() {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  return m_stats;
+}
+
+void openhd::EventLoop::wakeup() const {
+  const uint64_t one = 1;
+  if (write(m_event_fd, &one, sizeof(one)) != sizeof(one)) {
+    // Counter already non-zero (EAGAIN) - the loop wakes up anyways
+  }
+}
+
+void openhd::EventLoop::on_callback_done(
+    const std::chrono::steady_clock::time_point begin) {
+  const auto duration = std::chrono::steady_clock::now() - begin;
+  std::lock_guard<std::mutex> guard(m_mutex);
+  if (duration > m_stats.max_callback_duration) {
+    m_stats.max_callback_duration = duration;
+  }
+}
+
+void openhd::EventLoop::run_posted() {
+  std::vector<std::function<void()>> posted;
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    posted.swap(m_posted);
+  }
+  for (auto& fn : posted) {
+    const auto begin = std::chrono::steady_clock::now();
+    fn();
+    on_callback_done(begin);
+  }
+}
+
+void openhd::EventLoop::loop() {
+  m_loop_thread_id = std::this_thread::get_id();
+  m_console->debug("loop begin");
+  // Tasks posted before start
+  run_posted();
+  std::array<struct epoll_event, 32> events{};
+  while (m_keep_running) {
+    const int n = epoll_wait(m_epoll_fd, events.data(), events.size(), -1);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      m_console->error("epoll_wait {}", strerror(errno));
+      break;
+    }
+    bool run_posted_tasks = false;
+    for (int i = 0; i < n; i++) {
+      const uint64_t key = events[i].data.u64;
+      if (key == WAKEUP_KEY) {
+        uint64_t value;
+        read(m_event_fd, &value, sizeof(value));
+        run_posted_tasks = true;
+        continue;
+      }
+      std::shared_ptr<Handler> handler;
+      {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        auto it = m_handlers.find(key);
+        // Removed by a previous callback of this batch
+        if (it == m_handlers.end()) continue;
+        handler = it->second;
+        m_stats.n_fd_events++;
+      }
+      const auto begin = std::chrono::steady_clock::now();
+      handler->cb(events[i].events);
+      on_callback_done(begin);
+    }
+    {
+      std::lock_guard<std::mutex> guard(m_mutex);
+      m_stats.n_wakeups++;
+    }
+    if (run_posted_tasks) run_posted();
+  }
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    m_is_running = false;
+  }
+  // Everything posted while we were running (e.g. a run_sync() that waits)
+  run_posted();
+  m_loop_thread_id = std::thread::id{};
+  m_console->debug("loop end");
+}
@@ -0,0 +1,130 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#include "openhd_latency_trace.h"
+
+#include <sstream>
+
+#include "openhd_spdlog.h"
+
+int openhd::latency::Histogram::bucket_index(uint64_t us) {
+  if (us < N_SUB_BUCKETS) return static_cast<int>(us);
+  // Position of the highest bit, then the next 3 bits select the sub-bucket
+  const int msb = 63 - __builtin_clzll(us);
+  const int sub = static_cast<int>((us >> (msb - 3)) & (N_SUB_BUCKETS - 1));
+  const int index = (msb - 2) * N_SUB_BUCKETS + sub;
+  return index < N_BUCKETS ? index : N_BUCKETS - 1;
+}
+
+uint64_t openhd::latency::Histogram::bucket_upper_bound_us(int index) {
+  if (index < N_SUB_BUCKETS) return index;
+  const int msb = index / N_SUB_BUCKETS + 2;
+  const uint64_t sub = index % N_SUB_BUCKETS;
+  return ((N_SUB_BUCKETS + sub + 1) << (msb - 3)) - 1;
+}
+
+void openhd::latency::Histogram::add(std::chrono::nanoseconds duration) {
+  const auto us = static_cast<uint64_t>(std::max<int64_t>(
+      0,
+      std::chrono::duration_cast<std::chrono::microseconds>(duration).count()));
+  m_buckets[bucket_index(us)].fetch_add(1, std::memory_order_relaxed);
+  uint64_t prev_max = m_max_us.load(std::memory_order_relaxed);
+  while (us > prev_max && !m_max_us.compare_exchange_weak(
+                              prev_max, us, std::memory_order_relaxed)) {
+  }
+}
+
+openhd::latency::Histogram::Summary
+openhd::latency::Histogram::get_summary() const {
+  std::array<uint64_t, N_BUCKETS> buckets{};
+  Summary ret{};
+  for (int i = 0; i < N_BUCKETS; i++) {
+    buckets[i] = m_buckets[i].load(std::memory_order_relaxed);
+    ret.count += buckets[i];
+  }
+  if (ret.count == 0) return ret;
+  const auto percentile = [&buckets, &ret](double perc) -> uint32_t {
+    const auto rank = static_cast<uint64_t>(perc * (double)ret.count);
+    uint64_t cumulative = 0;
+    for (int i = 0; i < N_BUCKETS; i++) {
+      cumulative += buckets[i];
+      if (cumulative > rank) {
+        return static_cast<uint32_t>(bucket_upper_bound_us(i));
+      }
+    }
+    return static_cast<uint32_t>(bucket_upper_bound_us(N_BUCKETS - 1));
+  };
+  ret.p50_us = percentile(0.50);
+  ret.p95_us = percentile(0.95);
+  ret.p99_us = percentile(0.99);
+  ret.max_us = static_cast<uint32_t>(m_max_us.load(std::memory_order_relaxed));
+  // The bucket upper bound might be slightly larger than the actual max
+  ret.p50_us = std::min(ret.p50_us, ret.max_us);
+  ret.p95_us = std::min(ret.p95_us, ret.max_us);
+  ret.p99_us = std::min(ret.p99_us, ret.max_us);
+  return ret;
+}
+
+void openhd::latency::Histogram::reset() {
+  for (auto& bucket : m_buckets) bucket.store(0, std::memory_order_relaxed);
+  m_max_us.store(0, std::memory_order_relaxed);
+}
+
+std::string openhd::latency::stage_to_string(openhd::latency::Stage stage) {
+  switch (stage) {
+    case Stage::AIR_CAPTURE_TO_APPSINK:
+      return "AIR_CAPTURE_TO_APPSINK";
+    case Stage::AIR_FRAME_ASSEMBLY:
+      return "AIR_FRAME_ASSEMBLY";
+    case Stage::AIR_LINK_ENQUEUE:
+      return "AIR_LINK_ENQUEUE";
+    case Stage::GND_UDP_EGRESS:
+      return "GND_UDP_EGRESS";
+    default:
+      break;
+  }
+  return "UNKNOWN";
+}
+
+openhd::latency::LatencyTracer& openhd::latency::LatencyTracer::instance() {
+  static LatencyTracer instance;
+  return instance;
+}
+
+void openhd::latency::LatencyTracer::record(
+    openhd::latency::Stage stage, std::chrono::nanoseconds duration) {
+  m_histograms[static_cast<int>(stage)].add(duration);
+}
+
+openhd::latency::Histogram::Summary
+openhd::latency::LatencyTracer::get_summary(
+    openhd::latency::Stage stage) const {
+  return m_histograms[static_cast<int>(stage)].get_summary();
+}
+
+std::string openhd::latency::LatencyTracer::summary_to_string() const {
+  std::stringstream ss;
+  for (int i = 0; i < static_cast<int>(Stage::COUNT); i++) {
+    const auto summary = m_histograms[i].get_summary();
+    if (summary.count == 0) continue;
+    ss << stage_to_string(static_cast<Stage>(i)) << "{n:" << summary.count
+       << " p50:" << summary.p50_us << "us p95:" << summary.p95_us
+       << "us p99:" << summary.p99_us << "us max:" << summary.max_us
+       << "us}\n";
+  }
+  return ss.str();
+}
+
+bool openhd::latency::LatencyTracer::log_and_reset_if_elapsed(
+    std::chrono::seconds interval) {
+  std::lock_guard<std::mutex> guard(m_log_mutex);
+  if (std::chrono::steady_clock::now() - m_last_log < interval) return false;
+  m_last_log = std::chrono::steady_clock::now();
+  const auto summary = summary_to_string();
+  if (!summary.empty()) {
+    openhd::log::create_or_get("latency")->debug("\n{}", summary);
+  }
+  for (auto& histogram : m_histograms) histogram.reset();
+  return true;
+}
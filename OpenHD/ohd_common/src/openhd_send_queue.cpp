@@ -0,0 +1,317 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#include "openhd_send_queue.h"
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstring>
+#include <map>
+#include <sstream>
+#include <thread>
+
+#include "openhd_buffer_pool.h"
+
+namespace {
+
+// One epoll thread shared by all send queues - only queues with a backlog are
+// registered (EPOLLOUT, one-shot), so the thread is idle most of the time.
+class SendQueueWorker {
+ public:
+  static SendQueueWorker& instance() {
+    static SendQueueWorker instance{};
+    return instance;
+  }
+  SendQueueWorker() {
+    m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    m_event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    struct epoll_event ev {};
+    ev.events = EPOLLIN;
+    ev.data.fd = m_event_fd;
+    epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_event_fd, &ev);
+    m_thread = std::thread(&SendQueueWorker::loop, this);
+  }
+  ~SendQueueWorker() {
+    m_keep_running = false;
+    const uint64_t one = 1;
+    write(m_event_fd, &one, sizeof(one));
+    m_thread.join();
+    close(m_event_fd);
+    close(m_epoll_fd);
+  }
+  // Get notified (once) when the socket becomes writable
+  void arm(int sockfd,
+           const std::shared_ptr<openhd::NonBlockingSendQueue>& queue) {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    struct epoll_event ev {};
+    ev.events = EPOLLOUT | EPOLLONESHOT;
+    ev.data.fd = sockfd;
+    auto it = m_queues.find(sockfd);
+    if (it == m_queues.end()) {
+      m_queues[sockfd] = queue;
+      epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, sockfd, &ev);
+    } else {
+      it->second = queue;
+      epoll_ctl(m_epoll_fd, EPOLL_CTL_MOD, sockfd, &ev);
+    }
+  }
+  void remove(int sockfd) {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    if (m_queues.erase(sockfd) > 0) {
+      epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, sockfd, nullptr);
+    }
+  }
+
+ private:
+  void loop() {
+    std::array<struct epoll_event, 16> events{};
+    while (m_keep_running) {
+      const int n = epoll_wait(m_epoll_fd, events.data(), events.size(), 1000);
+      for (int i = 0; i < n; i++) {
+        const int fd = events[i].data.fd;
+        if (fd == m_event_fd) continue;
+        std::shared_ptr<openhd::NonBlockingSendQueue> queue;
+        {
+          std::lock_guard<std::mutex> guard(m_mutex);
+          auto it = m_queues.find(fd);
+          if (it != m_queues.end()) queue = it->second.lock();
+        }
+        // Never call into a queue with m_mutex held (lock order queue ->
+        // worker)
+        if (queue) queue->on_writable();
+      }
+    }
+  }
+  int m_epoll_fd;
+  int m_event_fd;
+  std::atomic_bool m_keep_running = true;
+  std::mutex m_mutex;
+  std::map<int, std::weak_ptr<openhd::NonBlockingSendQueue>> m_queues;
+  std::thread m_thread;
+};
+
+bool is_would_block(int err) { return err == EAGAIN || err == EWOULDBLOCK; }
+
+}  // namespace
+
+std::string openhd::NonBlockingSendQueue::Stats::to_string() const {
+  std::stringstream ss;
+  ss << "sent:" << n_packets_sent << " queued:" << n_packets_queued
+     << " dropped:" << n_packets_dropped << " errors:" << n_send_errors
+     << " depth:" << queue_depth << " max_depth:" << max_queue_depth;
+  return ss.str();
+}
+
+std::shared_ptr<openhd::NonBlockingSendQueue>
+openhd::NonBlockingSendQueue::create(int sockfd,
+                                     std::optional<struct sockaddr_in> dest_addr,
+                                     std::string tag, int max_n_packets) {
+  return std::shared_ptr<NonBlockingSendQueue>(new NonBlockingSendQueue(
+      sockfd, dest_addr, std::move(tag), max_n_packets));
+}
+
+openhd::NonBlockingSendQueue::NonBlockingSendQueue(
+    int sockfd, std::optional<struct sockaddr_in> dest_addr, std::string tag,
+    int max_n_packets)
+    : m_sockfd(sockfd),
+      m_dest_addr(dest_addr),
+      m_tag(std::move(tag)),
+      m_max_n_packets(max_n_packets) {
+  m_console = openhd::log::create_or_get("send_queue");
+}
+
+openhd::NonBlockingSendQueue::~NonBlockingSendQueue() { shutdown(); }
+
+void openhd::NonBlockingSendQueue::send(const uint8_t* data, int data_len) {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  if (m_is_shutdown || m_has_fatal_error) return;
+  if (!m_queue.empty()) {
+    // Keep the order, the I/O worker is already waiting for the socket
+    enqueue(data, data_len);
+    return;
+  }
+  const int n_written = send_once(data, data_len);
+  if (n_written == data_len) {
+    m_stats.n_packets_sent++;
+    return;
+  }
+  if (n_written < 0) {
+    // Packet is lost
+    return;
+  }
+  // Socket would block (or partial write on a stream socket) - continue in
+  // the I/O worker
+  enqueue(data, data_len);
+  m_front_offset = n_written;
+  arm_worker();
+}
+
+void openhd::NonBlockingSendQueue::send_batch(const struct iovec* packets,
+                                              int n_packets) {
+  assert(m_dest_addr.has_value());
+  std::lock_guard<std::mutex> guard(m_mutex);
+  if (m_is_shutdown || m_has_fatal_error) return;
+  int n_done = 0;
+  if (m_queue.empty()) {
+    m_mmsg_buff.resize(n_packets);
+    for (int i = 0; i < n_packets; i++) {
+      auto& msg = m_mmsg_buff[i];
+      std::memset(&msg, 0, sizeof(msg));
+      msg.msg_hdr.msg_name = (void*)&m_dest_addr.value();
+      msg.msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+      msg.msg_hdr.msg_iov = (struct iovec*)&packets[i];
+      msg.msg_hdr.msg_iovlen = 1;
+    }
+    while (n_done < n_packets) {
+      const int ret = sendmmsg(m_sockfd, &m_mmsg_buff[n_done],
+                               n_packets - n_done, MSG_DONTWAIT);
+      if (ret > 0) {
+        n_done += ret;
+        m_stats.n_packets_sent += ret;
+        continue;
+      }
+      if (is_would_block(errno)) break;
+      // Skip the packet that cannot be sent, continue with the rest
+      on_send_error(errno);
+      n_done++;
+    }
+  }
+  if (n_done == n_packets) return;
+  for (int i = n_done; i < n_packets; i++) {
+    enqueue((const uint8_t*)packets[i].iov_base, (int)packets[i].iov_len);
+  }
+  arm_worker();
+}
+
+void openhd::NonBlockingSendQueue::shutdown() {
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    if (m_is_shutdown) return;
+    m_is_shutdown = true;
+    m_queue.clear();
+  }
+  SendQueueWorker::instance().remove(m_sockfd);
+}
+
+bool openhd::NonBlockingSendQueue::has_fatal_error() {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  return m_has_fatal_error;
+}
+
+openhd::NonBlockingSendQueue::Stats openhd::NonBlockingSendQueue::get_stats() {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  auto ret = m_stats;
+  ret.queue_depth = (int)m_queue.size();
+  return ret;
+}
+
+void openhd::NonBlockingSendQueue::on_writable() {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  m_worker_armed = false;
+  if (m_is_shutdown) return;
+  if (!drain()) {
+    arm_worker();
+  }
+}
+
+void openhd::NonBlockingSendQueue::enqueue(const uint8_t* data, int data_len) {
+  if ((int)m_queue.size() >= m_max_n_packets) {
+    // Drop oldest - but never a partially written packet on a stream socket,
+    // that would corrupt the stream
+    if (m_front_offset > 0 && m_queue.size() > 1) {
+      m_queue.erase(m_queue.begin() + 1);
+    } else {
+      m_queue.pop_front();
+      m_front_offset = 0;
+    }
+    m_stats.n_packets_dropped++;
+    log_stats_rate_limited();
+  }
+  m_queue.push_back(FragmentBufferPool::instance().acquire(data, data_len));
+  m_stats.n_packets_queued++;
+  m_stats.max_queue_depth =
+      std::max(m_stats.max_queue_depth, (int)m_queue.size());
+}
+
+bool openhd::NonBlockingSendQueue::drain() {
+  while (!m_queue.empty()) {
+    const auto& packet = *m_queue.front();
+    const int remaining = (int)packet.size() - m_front_offset;
+    const int n_written =
+        send_once(packet.data() + m_front_offset, remaining);
+    if (n_written == 0) {
+      return false;
+    }
+    if (n_written < 0) {
+      if (m_has_fatal_error) {
+        m_queue.clear();
+        m_front_offset = 0;
+        return true;
+      }
+      // Packet is lost, continue with the next one
+      m_queue.pop_front();
+      continue;
+    }
+    if (n_written < remaining) {
+      // Partial write (stream socket), socket buffer is full
+      m_front_offset += n_written;
+      return false;
+    }
+    m_queue.pop_front();
+    m_front_offset = 0;
+    m_stats.n_packets_sent++;
+  }
+  return true;
+}
+
+int openhd::NonBlockingSendQueue::send_once(const uint8_t* data,
+                                            int data_len) {
+  // MSG_NOSIGNAL - otherwise we might crash if the (stream) socket disconnects
+  const int flags = MSG_DONTWAIT | MSG_NOSIGNAL;
+  ssize_t ret;
+  if (m_dest_addr.has_value()) {
+    ret = sendto(m_sockfd, data, data_len, flags,
+                 (const struct sockaddr*)&m_dest_addr.value(),
+                 sizeof(struct sockaddr_in));
+  } else {
+    ret = ::send(m_sockfd, data, data_len, flags);
+  }
+  if (ret >= 0) {
+    return (int)ret;
+  }
+  if (is_would_block(errno)) {
+    return 0;
+  }
+  on_send_error(errno);
+  return -1;
+}
+
+void openhd::NonBlockingSendQueue::on_send_error(int err) {
+  m_stats.n_send_errors++;
+  // A stream socket cannot recover from an error (peer is gone)
+  if (!m_dest_addr.has_value()) {
+    m_has_fatal_error = true;
+    m_console->debug("{} disconnected ({})", m_tag, strerror(err));
+    return;
+  }
+  log_stats_rate_limited();
+}
+
+void openhd::NonBlockingSendQueue::arm_worker() {
+  if (m_worker_armed) return;
+  m_worker_armed = true;
+  SendQueueWorker::instance().arm(m_sockfd, shared_from_this());
+}
+
+void openhd::NonBlockingSendQueue::log_stats_rate_limited() {
+  const auto now = std::chrono::steady_clock::now();
+  if (now - m_last_log < std::chrono::seconds(5)) return;
+  m_last_log = now;
+  m_console->warn("{} slow / failing consumer {}", m_tag, m_stats.to_string());
+}
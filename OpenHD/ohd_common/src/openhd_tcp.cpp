@@ -5,132 +5,319 @@
 #include "openhd_tcp.h"
 
 #include <arpa/inet.h>
+#include <netinet/tcp.h>
 #include <unistd.h>
 
-#include <csignal>
-#include <queue>
+#include <cstring>
+#include <sstream>
 #include <utility>
 
-openhd::TCPServer::TCPServer(const std::string tag,
-                             openhd::TCPServer::Config config, bool debug)
-    : m_config(config), m_debug(debug) {
-  m_console = openhd::log::create_or_get(tag);
-  assert(m_console);
-  m_accept_thread =
-      std::make_unique<std::thread>(&TCPServer::loop_accept, this);
-  m_console->debug("created with {}", m_config.port);
+#include "openhd_buffer_pool.h"
+
+static bool is_would_block(int err) {
+  return err == EAGAIN || err == EWOULDBLOCK;
 }
 
-openhd::TCPServer::~TCPServer() {
-  // debug_if("TCPEndpoint::~TCPEndpoint() begin");
-  //  First we make sure we don't accept any new connections anymore
-  m_keep_accept_thread_alive = false;
-  shutdown(server_fd, SHUT_RDWR);  // This will break out of select
-  m_accept_thread->join();
-  m_accept_thread = nullptr;
-  server_fd = 0;
-  // Then we make sure to clean up any connected client(s) (If there are any)
-  for (const auto& client : m_clients_list) {
-    client->marked_to_be_removed = true;
-    client->keep_rx_looping = false;
-    shutdown(client->sock_fd, SHUT_RDWR);
-    client->rx_loop_thread->join();
-    client->rx_loop_thread = nullptr;
-  }
-  m_console->debug("TCPEndpoint::~TCPEndpoint() end");
+std::string openhd::TCPServer::Stats::to_string() const {
+  std::stringstream ss;
+  ss << "clients:" << n_clients << " accepted:" << n_accepted
+     << " rejected:" << n_rejected << " disconnected:" << n_disconnected
+     << " tx:" << n_bytes_sent << "B rx:" << n_bytes_received
+     << "B dropped:" << n_messages_dropped;
+  return ss.str();
 }
 
-void openhd::TCPServer::loop_accept() {
+openhd::TCPServer::TCPServer(std::string tag, openhd::TCPServer::Config config,
+                             bool debug,
+                             std::shared_ptr<EventLoop> event_loop)
+    : m_tag(std::move(tag)),
+      m_config(config),
+      m_debug(debug),
+      m_event_loop(std::move(event_loop)) {
+  m_console = openhd::log::create_or_get(m_tag);
+  assert(m_console);
+  m_read_buff = std::make_unique<std::array<uint8_t, READ_BUFF_SIZE>>();
+  if (!m_event_loop) {
+    m_own_event_loop = std::make_shared<EventLoop>(m_tag + "_loop");
+    m_event_loop = m_own_event_loop;
+  }
   struct sockaddr_in sockaddr {};
-  if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+  if ((m_server_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                            0)) < 0) {
     m_console->warn("open socket failed");
     return;
   }
   int opt = 1;
-  if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR | SO_REUSEPORT, &opt,
+  if (setsockopt(m_server_fd, SOL_SOCKET, SO_REUSEADDR | SO_REUSEPORT, &opt,
                  sizeof(opt))) {
     m_console->warn("setsockopt failed");
-    close(server_fd);
+    close(m_server_fd);
+    m_server_fd = -1;
     return;
   }
   sockaddr.sin_family = AF_INET;
   sockaddr.sin_addr.s_addr = INADDR_ANY;
   sockaddr.sin_port = htons(m_config.port);
-  if (bind(server_fd, (struct sockaddr*)&sockaddr, sizeof(sockaddr)) < 0) {
+  if (bind(m_server_fd, (struct sockaddr*)&sockaddr, sizeof(sockaddr)) < 0) {
     m_console->warn("bind failed");
-    close(server_fd);
+    close(m_server_fd);
+    m_server_fd = -1;
     return;
   }
   // signal readiness to accept clients
-  if (listen(server_fd, 5) < 0) {
+  if (listen(m_server_fd, 16) < 0) {
     m_console->warn("listen failed");
-    close(server_fd);
+    close(m_server_fd);
+    m_server_fd = -1;
     return;
   }
-  const int sockaddr_len = sizeof(sockaddr);
-  while (m_keep_accept_thread_alive) {
-    const auto accept_result = accept(server_fd, (struct sockaddr*)&sockaddr,
-                                      (socklen_t*)&sockaddr_len);
-    if (accept_result < 0) {
-      m_console->debug("accept failed");
-      close(server_fd);
+  m_event_loop->add_fd(m_server_fd, EPOLLIN, [this](uint32_t) { on_accept(); });
+  if (m_own_event_loop) m_own_event_loop->start();
+  m_console->debug("created with {}", m_config.port);
+}
+
+openhd::TCPServer::~TCPServer() { stop(); }
+
+void openhd::TCPServer::stop() {
+  if (m_is_stopped.exchange(true)) return;
+  // First we make sure we don't accept any new connections anymore
+  if (m_server_fd != -1) {
+    m_event_loop->remove_fd(m_server_fd);
+    close(m_server_fd);
+    m_server_fd = -1;
+  }
+  // Then we make sure to clean up any connected client(s) (If there are any)
+  std::map<int, std::unique_ptr<Client>> clients;
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    clients.swap(m_clients);
+  }
+  for (const auto& [sock_fd, client] : clients) {
+    // Waits for a callback that is currently running
+    m_event_loop->remove_fd(sock_fd);
+    close(sock_fd);
+  }
+  if (m_own_event_loop) m_own_event_loop->stop();
+  m_console->debug("stop() end");
+}
+
+void openhd::TCPServer::on_accept() {
+  while (!m_is_stopped) {
+    struct sockaddr_in sockaddr {};
+    socklen_t sockaddr_len = sizeof(sockaddr);
+    const int sock_fd =
+        accept4(m_server_fd, (struct sockaddr*)&sockaddr, &sockaddr_len,
+                SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (sock_fd < 0) {
+      if (!is_would_block(errno) && errno != EINTR) {
+        m_console->debug("accept failed {}", strerror(errno));
+      }
       return;
     }
     const std::string client_ip = inet_ntoa(sockaddr.sin_addr);
     const int client_port = ntohs(sockaddr.sin_port);
-    m_console->debug("accepted client,sockfd:{}, ip:{}, port:{}", accept_result,
+    auto client = std::make_unique<Client>();
+    {
+      std::lock_guard<std::mutex> guard(m_mutex);
+      if ((int)m_clients.size() >= MAX_N_CLIENTS) {
+        m_stats.n_rejected++;
+        m_console->warn("Rejecting client {}:{}, too many clients", client_ip,
+                        client_port);
+        close(sock_fd);
+        continue;
+      }
+      client->id = m_next_client_id++;
+    }
+    // Telemetry is latency-sensitive and consists of small messages
+    int opt = 1;
+    setsockopt(sock_fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    m_console->debug("accepted client,sockfd:{}, ip:{}, port:{}", sock_fd,
                      client_ip, client_port);
-    auto new_client = std::make_shared<ConnectedClient>();
-    new_client->sock_fd = accept_result;
-    new_client->ip = client_ip;
-    new_client->port = client_port;
-    new_client->keep_rx_looping = true;
-    new_client->parent = this;
-    new_client->rx_loop_thread = std::make_shared<std::thread>(
-        &TCPServer::ConnectedClient::loop_rx, new_client.get());
-    on_external_device(client_ip, client_port, true);
+    client->sock_fd = sock_fd;
+    client->ip = client_ip;
+    client->port = client_port;
+    const int client_id = client->id;
     {
-      std::lock_guard<std::mutex> guard(m_clients_list_mutex);
-      m_clients_list.push_back(new_client);
+      std::lock_guard<std::mutex> guard(m_mutex);
+      m_clients[sock_fd] = std::move(client);
+      m_stats.n_accepted++;
     }
+    m_event_loop->add_fd(sock_fd, EPOLLIN, [this, sock_fd](uint32_t events) {
+      on_client_event(sock_fd, events);
+    });
+    on_external_device(client_id, client_ip, client_port, true);
   }
 }
 
+void openhd::TCPServer::on_client_event(const int sock_fd,
+                                        const uint32_t events) {
+  int client_id;
+  bool disconnect = false;
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    auto it = m_clients.find(sock_fd);
+    if (it == m_clients.end()) return;
+    auto& client = *it->second;
+    client_id = client.id;
+    if ((events & EPOLLOUT) && !client.has_error && !flush_tx_queue(client)) {
+      client.has_error = true;
+    }
+    if (client.has_error) {
+      debug_if("Client {} disconnected (cannot send data)", client.ip);
+      disconnect = true;
+    }
+  }
+  if (!disconnect && (events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+    const ssize_t message_length =
+        read(sock_fd, m_read_buff->data(), m_read_buff->size());
+    if (message_length > 0) {
+      {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_stats.n_bytes_received += message_length;
+      }
+      // Not holding m_mutex - the implementation might send data
+      on_packet_any_tcp_client(client_id, m_read_buff->data(),
+                               (int)message_length);
+    } else if (message_length == 0) {
+      debug_if("Client disconnected");
+      disconnect = true;
+    } else if (!is_would_block(errno) && errno != EINTR) {
+      debug_if("Read error {} {}", message_length, strerror(errno));
+      disconnect = true;
+    }
+  }
+  if (disconnect) disconnect_client(sock_fd);
+}
+
+void openhd::TCPServer::disconnect_client(const int sock_fd) {
+  std::unique_ptr<Client> client;
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    auto it = m_clients.find(sock_fd);
+    if (it == m_clients.end()) return;
+    client = std::move(it->second);
+    m_clients.erase(it);
+    m_stats.n_disconnected++;
+  }
+  m_event_loop->remove_fd(sock_fd);
+  close(sock_fd);
+  on_external_device(client->id, client->ip, client->port, false);
+}
+
 void openhd::TCPServer::send_message_to_all_clients(const uint8_t* data,
                                                     int data_len) {
-  std::lock_guard<std::mutex> guard(m_clients_list_mutex);
-  for (auto& client : m_clients_list) {
-    if (!client->marked_to_be_removed) {
-      const int flags =
-          MSG_DONTWAIT |  // otherwise we might block if the socket got
-                          // disconnected
-          MSG_NOSIGNAL;   // otherwise we might crash if the socket disconnects
-      if (!send(client->sock_fd, data, data_len, flags)) {
-        m_console->debug("Client {} disconnected (cannot send data)",
-                         client->ip);
-        // Will be disconnected / removed by the accept thread
-        client->marked_to_be_removed = true;
-      }
+  // Copied (once) only if any client cannot take the data right away
+  std::shared_ptr<std::vector<uint8_t>> shared_copy = nullptr;
+  std::lock_guard<std::mutex> guard(m_mutex);
+  for (auto& [sock_fd, client] : m_clients) {
+    if (client->has_error) continue;
+    if (!send_or_enqueue(*client, data, data_len, shared_copy)) {
+      // Disconnected on the loop thread
+      client->has_error = true;
+      set_want_writable(*client, true);
     }
   }
 }
 
-void openhd::TCPServer::ConnectedClient::loop_rx() {
-  auto console = openhd::log::create_or_get(fmt::format("TCPClient{}", ip));
-  const auto buff = std::make_unique<std::array<uint8_t, READ_BUFF_SIZE>>();
-  while (keep_rx_looping) {
-    const ssize_t message_length = read(sock_fd, buff->data(), buff->size());
-    if (message_length < 0) {
-      console->debug("Read error {} {}", message_length, strerror(errno));
-      marked_to_be_removed = true;
-      break;
+bool openhd::TCPServer::send_or_enqueue(
+    Client& client, const uint8_t* data, int data_len,
+    std::shared_ptr<std::vector<uint8_t>>& shared_copy) {
+  int n_written = 0;
+  if (client.tx_queue.empty()) {
+    const ssize_t ret =
+        send(client.sock_fd, data, data_len, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (ret < 0) {
+      if (!is_would_block(errno)) return false;
+    } else {
+      n_written = (int)ret;
+      m_stats.n_bytes_sent += n_written;
+      if (n_written == data_len) return true;
     }
-    if (message_length == 0) {
-      console->debug("Client disconnected");
-      marked_to_be_removed = true;
-      break;
+  }
+  // Socket would block (or partial write) - continue once writable
+  const auto now = std::chrono::steady_clock::now();
+  if (client.tx_queue.empty()) {
+    client.tx_dropping_since = {};
+  }
+  // Make room by dropping the oldest whole messages that have not been
+  // started yet
+  const size_t size = data_len - n_written;
+  while (client.tx_queued_bytes + size > MAX_CLIENT_TX_BUFFER_BYTES &&
+         !client.tx_queue.empty()) {
+    const bool front_started = client.tx_front_offset > 0;
+    if (front_started && client.tx_queue.size() == 1) break;
+    const auto it = client.tx_queue.begin() + (front_started ? 1 : 0);
+    client.tx_queued_bytes -= (*it)->size();
+    client.tx_queue.erase(it);
+    m_stats.n_messages_dropped++;
+    if (client.tx_dropping_since == std::chrono::steady_clock::time_point{}) {
+      client.tx_dropping_since = now;
     }
-    parent->on_packet_any_tcp_client(buff->data(), message_length);
   }
-  parent->on_external_device(ip, port, false);
+  if (client.tx_dropping_since != std::chrono::steady_clock::time_point{} &&
+      now - client.tx_dropping_since > CLIENT_STALL_TIMEOUT) {
+    m_console->warn("Client {}:{} stalled, disconnecting", client.ip,
+                    client.port);
+    return false;
+  }
+  if (client.tx_queued_bytes + size > MAX_CLIENT_TX_BUFFER_BYTES) {
+    // Doesn't fit at all (the partially sent front message is too big)
+    m_stats.n_messages_dropped++;
+    return true;
+  }
+  if (n_written > 0) {
+    // Partially written, queue the rest (the queue was empty)
+    client.tx_queue.push_back(
+        openhd::FragmentBufferPool::instance().acquire(data, data_len));
+    client.tx_front_offset = n_written;
+    client.tx_queued_bytes += data_len;
+  } else {
+    if (shared_copy == nullptr) {
+      shared_copy = openhd::FragmentBufferPool::instance().acquire(data, data_len);
+    }
+    client.tx_queue.push_back(shared_copy);
+    client.tx_queued_bytes += data_len;
+  }
+  set_want_writable(client, true);
+  return true;
+}
+
+bool openhd::TCPServer::flush_tx_queue(Client& client) {
+  while (!client.tx_queue.empty()) {
+    const auto& front = *client.tx_queue.front();
+    const size_t remaining = front.size() - client.tx_front_offset;
+    const ssize_t ret =
+        send(client.sock_fd, front.data() + client.tx_front_offset, remaining,
+             MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (ret < 0) {
+      if (is_would_block(errno)) return true;
+      return false;
+    }
+    m_stats.n_bytes_sent += ret;
+    if ((size_t)ret < remaining) {
+      client.tx_front_offset += ret;
+      return true;
+    }
+    client.tx_queued_bytes -= front.size();
+    client.tx_queue.pop_front();
+    client.tx_front_offset = 0;
+  }
+  client.tx_dropping_since = {};
+  set_want_writable(client, false);
+  return true;
+}
+
+void openhd::TCPServer::set_want_writable(Client& client,
+                                          const bool want_writable) {
+  if (client.tx_want_writable == want_writable) return;
+  client.tx_want_writable = want_writable;
+  m_event_loop->modify_fd(client.sock_fd,
+                          want_writable ? (EPOLLIN | EPOLLOUT) : EPOLLIN);
+}
+
+openhd::TCPServer::Stats openhd::TCPServer::get_stats() {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  auto ret = m_stats;
+  ret.n_clients = (int)m_clients.size();
+  return ret;
 }
@@ -0,0 +1,435 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#include "openhd_telemetry_fec.h"
+
+#include <pthread.h>
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+namespace openhd::telemetry_fec {
+
+namespace {
+
+// GF(2^8) with the polynomial 0x11d
+struct GF256 {
+  std::array<uint8_t, 512> exp{};
+  std::array<int, 256> log{};
+  GF256() {
+    int x = 1;
+    for (int i = 0; i < 255; i++) {
+      exp[i] = (uint8_t)x;
+      log[x] = i;
+      x <<= 1;
+      if (x & 0x100) x ^= 0x11d;
+    }
+    for (int i = 255; i < 512; i++) exp[i] = exp[i - 255];
+  }
+  [[nodiscard]] uint8_t mul(uint8_t a, uint8_t b) const {
+    if (a == 0 || b == 0) return 0;
+    return exp[log[a] + log[b]];
+  }
+  [[nodiscard]] uint8_t inv(uint8_t a) const { return exp[255 - log[a]]; }
+};
+
+const GF256& gf() {
+  static const GF256 instance;
+  return instance;
+}
+
+// Cauchy matrix element for parity row j and data column i - any square
+// sub-matrix is invertible.
+uint8_t cauchy(int j, int i) {
+  return gf().inv((uint8_t)((MAX_K + j) ^ i));
+}
+
+// dst += c * src
+void mul_add(uint8_t* dst, const uint8_t* src, uint8_t c, size_t len) {
+  if (c == 0) return;
+  const auto& tables = gf();
+  const int log_c = tables.log[c];
+  for (size_t i = 0; i < len; i++) {
+    if (src[i] != 0) dst[i] ^= tables.exp[tables.log[src[i]] + log_c];
+  }
+}
+
+struct Header {
+  bool is_parity;
+  uint16_t block_idx;
+  int fragment_idx;
+  // Only valid on parity packets
+  int k;
+};
+
+void write_header(uint8_t* dst, const Header& header) {
+  dst[0] = PACKET_MAGIC;
+  dst[1] = header.is_parity ? 1 : 0;
+  dst[2] = header.block_idx & 0xFF;
+  dst[3] = header.block_idx >> 8;
+  dst[4] = (uint8_t)header.fragment_idx;
+  dst[5] = (uint8_t)header.k;
+}
+
+Header read_header(const uint8_t* src) {
+  Header header{};
+  header.is_parity = (src[1] & 1) != 0;
+  header.block_idx = (uint16_t)(src[2] | (src[3] << 8));
+  header.fragment_idx = src[4];
+  header.k = src[5];
+  return header;
+}
+
+// A symbol is the data prefixed with its length, zero padded when encoding
+std::vector<uint8_t> make_symbol(const uint8_t* data, int data_len) {
+  std::vector<uint8_t> symbol(data_len + 2);
+  symbol[0] = data_len & 0xFF;
+  symbol[1] = (data_len >> 8) & 0xFF;
+  std::memcpy(symbol.data() + 2, data, data_len);
+  return symbol;
+}
+
+}  // namespace
+
+int get_n_parity(const Config& config, int k, int priority_class) {
+  const auto& cls = config.priority_classes[std::clamp(
+      priority_class, 0, N_PRIORITY_CLASSES - 1)];
+  const int n_parity =
+      std::max(cls.min_parity, (k * cls.parity_percent + 50) / 100);
+  return std::min(n_parity, MAX_N_PARITY);
+}
+
+bool uses_fec(const Config& config, int n_injections) {
+  const int priority_class =
+      std::clamp(n_injections, 1, N_PRIORITY_CLASSES) - 1;
+  return !config.priority_classes[priority_class].duplicate_injection;
+}
+
+Encoder::Encoder(Config config, OUTPUT_CB output_cb)
+    : m_config(config), m_output_cb(std::move(output_cb)) {
+  m_symbols.reserve(MAX_K);
+}
+
+Encoder::~Encoder() { stop_tail_flush_thread(); }
+
+void Encoder::add_packet(const uint8_t* data, int data_len, int n_injections,
+                         std::chrono::steady_clock::time_point now) {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  if (data_len <= 0 || data_len > MAX_PACKET_SIZE) {
+    // Cannot be protected, send as it is (the decoder passes non-FEC packets
+    // through)
+    output(std::make_shared<std::vector<uint8_t>>(data, data + data_len));
+    return;
+  }
+  const int priority_class =
+      std::clamp(n_injections, 1, N_PRIORITY_CLASSES) - 1;
+  const auto deadline =
+      now + m_config.priority_classes[priority_class].max_block_latency;
+  const bool earlier_deadline =
+      m_symbols.empty() || deadline < m_block_deadline;
+  if (m_symbols.empty()) m_block_priority_class = priority_class;
+  m_block_priority_class = std::max(m_block_priority_class, priority_class);
+  if (earlier_deadline) m_block_deadline = deadline;
+  auto packet = std::make_shared<std::vector<uint8_t>>(HEADER_SIZE + data_len);
+  write_header(packet->data(),
+               Header{false, m_block_idx, (int)m_symbols.size(), 0});
+  std::memcpy(packet->data() + HEADER_SIZE, data, data_len);
+  output(packet);
+  m_stats.n_data_packets++;
+  m_symbols.push_back(make_symbol(data, data_len));
+  const int max_k = std::clamp(m_config.max_k, 1, MAX_K);
+  if ((int)m_symbols.size() >= max_k || now >= m_block_deadline) {
+    close_block_locked(false);
+  } else if (earlier_deadline) {
+    m_flush_cv.notify_one();
+  }
+}
+
+void Encoder::flush_if_expired(std::chrono::steady_clock::time_point now) {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  if (!m_symbols.empty() && now >= m_block_deadline) {
+    close_block_locked(true);
+  }
+}
+
+std::optional<std::chrono::steady_clock::time_point>
+Encoder::get_flush_deadline() {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  if (m_symbols.empty()) return std::nullopt;
+  return m_block_deadline;
+}
+
+void Encoder::start_tail_flush_thread() {
+  std::lock_guard<std::mutex> thread_guard(m_flush_thread_mutex);
+  if (m_flush_thread) return;
+  std::lock_guard<std::mutex> guard(m_mutex);
+  m_flush_thread_run = true;
+  m_flush_thread = std::make_unique<std::thread>([this] {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (m_flush_thread_run) {
+      if (m_symbols.empty()) {
+        m_flush_cv.wait(lock);
+        continue;
+      }
+      const auto deadline = m_block_deadline;
+      m_flush_cv.wait_until(lock, deadline);
+      if (!m_symbols.empty() &&
+          std::chrono::steady_clock::now() >= m_block_deadline) {
+        close_block_locked(true);
+      }
+    }
+  });
+  pthread_setname_np(m_flush_thread->native_handle(), "tele_fec_flush");
+}
+
+void Encoder::stop_tail_flush_thread() {
+  std::lock_guard<std::mutex> thread_guard(m_flush_thread_mutex);
+  if (!m_flush_thread) return;
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    m_flush_thread_run = false;
+  }
+  m_flush_cv.notify_all();
+  m_flush_thread->join();
+  m_flush_thread = nullptr;
+}
+
+Encoder::Stats Encoder::get_stats() {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  return m_stats;
+}
+
+void Encoder::close_block_locked(const bool tail_flush) {
+  const int k = (int)m_symbols.size();
+  const int n_parity = get_n_parity(m_config, k, m_block_priority_class);
+  size_t symbol_len = 0;
+  for (const auto& symbol : m_symbols) {
+    symbol_len = std::max(symbol_len, symbol.size());
+  }
+  for (int j = 0; j < n_parity; j++) {
+    auto packet =
+        std::make_shared<std::vector<uint8_t>>(HEADER_SIZE + symbol_len, 0);
+    write_header(packet->data(), Header{true, m_block_idx, j, k});
+    uint8_t* parity = packet->data() + HEADER_SIZE;
+    for (int i = 0; i < k; i++) {
+      mul_add(parity, m_symbols[i].data(), cauchy(j, i), m_symbols[i].size());
+    }
+    output(packet);
+  }
+  m_stats.n_parity_packets += n_parity;
+  m_stats.n_blocks++;
+  if (tail_flush) m_stats.n_tail_flushes++;
+  m_symbols.clear();
+  m_block_idx++;
+}
+
+void Encoder::output(std::shared_ptr<std::vector<uint8_t>> packet) {
+  m_stats.n_bytes_out += packet->size();
+  m_output_cb(std::move(packet));
+}
+
+std::string Encoder::Stats::to_string() const {
+  std::stringstream ss;
+  ss << "data:" << n_data_packets << " parity:" << n_parity_packets
+     << " blocks:" << n_blocks << " tail_flushes:" << n_tail_flushes
+     << " bytes:" << n_bytes_out;
+  return ss.str();
+}
+
+Decoder::Decoder(OUTPUT_CB output_cb) : m_output_cb(std::move(output_cb)) {}
+
+bool Decoder::is_fec_packet(const uint8_t* data, int data_len) {
+  return data_len > HEADER_SIZE && data[0] == PACKET_MAGIC;
+}
+
+void Decoder::process_packet(const uint8_t* data, const int data_len) {
+  if (!is_fec_packet(data, data_len)) {
+    m_stats.n_bad_packets++;
+    return;
+  }
+  const auto header = read_header(data);
+  const uint8_t* payload = data + HEADER_SIZE;
+  const int payload_len = data_len - HEADER_SIZE;
+  if (!m_blocks.empty()) {
+    const auto age = (int16_t)(m_blocks.back().block_idx - header.block_idx);
+    if (age >= MAX_N_BLOCKS) {
+      // Too old, we might have forwarded it already
+      m_stats.n_duplicates++;
+      return;
+    }
+  }
+  if (header.is_parity) {
+    if (header.k < 1 || header.k > MAX_K ||
+        header.fragment_idx >= MAX_N_PARITY) {
+      m_stats.n_bad_packets++;
+      return;
+    }
+    m_stats.n_parity_packets++;
+    auto& block = get_block(header.block_idx);
+    if (block.done || block.have_parity[header.fragment_idx]) {
+      if (block.have_parity[header.fragment_idx]) m_stats.n_duplicates++;
+      return;
+    }
+    block.k = header.k;
+    block.parity_symbols[header.fragment_idx].assign(payload,
+                                                     payload + payload_len);
+    block.have_parity[header.fragment_idx] = true;
+    block.n_parity++;
+    try_recover(block);
+    return;
+  }
+  if (header.fragment_idx >= MAX_K) {
+    m_stats.n_bad_packets++;
+    return;
+  }
+  m_stats.n_data_packets++;
+  auto& block = get_block(header.block_idx);
+  if (block.done || block.have_data[header.fragment_idx]) {
+    m_stats.n_duplicates++;
+    return;
+  }
+  m_output_cb(payload, payload_len);
+  block.data_symbols[header.fragment_idx] = make_symbol(payload, payload_len);
+  block.have_data[header.fragment_idx] = true;
+  block.n_data++;
+  try_recover(block);
+}
+
+Decoder::Block& Decoder::get_block(const uint16_t block_idx) {
+  for (auto& block : m_blocks) {
+    if (block.block_idx == block_idx) return block;
+  }
+  // Blocks are mostly received in order, keep them sorted anyways
+  auto it = m_blocks.end();
+  while (it != m_blocks.begin() &&
+         (int16_t)(std::prev(it)->block_idx - block_idx) > 0) {
+    --it;
+  }
+  it = m_blocks.insert(it, Block{});
+  it->block_idx = block_idx;
+  // Since too old packets are dropped, the new block is never the oldest one
+  // if the window is full
+  if ((int)m_blocks.size() > MAX_N_BLOCKS && it != m_blocks.begin()) {
+    retire(m_blocks.front());
+    m_blocks.pop_front();
+  }
+  return *it;
+}
+
+void Decoder::try_recover(Block& block) {
+  if (block.done || block.k < 0) return;
+  if (block.n_data >= block.k) {
+    block.done = true;
+    return;
+  }
+  if (block.n_data + block.n_parity < block.k) return;
+  std::vector<int> missing;
+  for (int i = 0; i < block.k; i++) {
+    if (!block.have_data[i]) missing.push_back(i);
+  }
+  std::vector<int> rows;
+  size_t symbol_len = 0;
+  for (int j = 0; j < MAX_N_PARITY && rows.size() < missing.size(); j++) {
+    if (!block.have_parity[j]) continue;
+    rows.push_back(j);
+    symbol_len = block.parity_symbols[j].size();
+  }
+  // All parity packets of a block have the same size, no data symbol can be
+  // longer
+  for (int j : rows) {
+    if (block.parity_symbols[j].size() != symbol_len) {
+      m_stats.n_bad_packets++;
+      return;
+    }
+  }
+  const int m = (int)missing.size();
+  // Right hand side: parity minus the contribution of the received data
+  std::vector<std::vector<uint8_t>> rhs(m);
+  for (int r = 0; r < m; r++) {
+    rhs[r] = block.parity_symbols[rows[r]];
+    for (int i = 0; i < block.k; i++) {
+      if (!block.have_data[i]) continue;
+      const auto& symbol = block.data_symbols[i];
+      if (symbol.size() > symbol_len) {
+        m_stats.n_bad_packets++;
+        return;
+      }
+      mul_add(rhs[r].data(), symbol.data(), cauchy(rows[r], i), symbol.size());
+    }
+  }
+  // Invert the m x m cauchy sub-matrix (Gauss-Jordan)
+  std::vector<std::vector<uint8_t>> a(m, std::vector<uint8_t>(m));
+  std::vector<std::vector<uint8_t>> inv(m, std::vector<uint8_t>(m, 0));
+  for (int r = 0; r < m; r++) {
+    for (int c = 0; c < m; c++) a[r][c] = cauchy(rows[r], missing[c]);
+    inv[r][r] = 1;
+  }
+  const auto& tables = gf();
+  for (int c = 0; c < m; c++) {
+    int pivot = c;
+    while (pivot < m && a[pivot][c] == 0) pivot++;
+    if (pivot == m) return;
+    std::swap(a[pivot], a[c]);
+    std::swap(inv[pivot], inv[c]);
+    const uint8_t scale = tables.inv(a[c][c]);
+    for (int x = 0; x < m; x++) {
+      a[c][x] = tables.mul(a[c][x], scale);
+      inv[c][x] = tables.mul(inv[c][x], scale);
+    }
+    for (int r = 0; r < m; r++) {
+      if (r == c || a[r][c] == 0) continue;
+      const uint8_t factor = a[r][c];
+      for (int x = 0; x < m; x++) {
+        a[r][x] ^= tables.mul(factor, a[c][x]);
+        inv[r][x] ^= tables.mul(factor, inv[c][x]);
+      }
+    }
+  }
+  for (int r = 0; r < m; r++) {
+    std::vector<uint8_t> symbol(symbol_len, 0);
+    for (int c = 0; c < m; c++) {
+      mul_add(symbol.data(), rhs[c].data(), inv[r][c], symbol_len);
+    }
+    const int i = missing[r];
+    block.data_symbols[i] = std::move(symbol);
+    block.have_data[i] = true;
+    block.n_data++;
+    m_stats.n_recovered++;
+    forward_symbol(block.data_symbols[i]);
+  }
+  block.done = true;
+}
+
+void Decoder::retire(const Block& block) {
+  if (block.done) return;
+  int n_expected = block.k;
+  if (n_expected < 0) {
+    // No parity received, we only know about the highest data packet
+    n_expected = 0;
+    for (int i = 0; i < MAX_K; i++) {
+      if (block.have_data[i]) n_expected = i + 1;
+    }
+  }
+  m_stats.n_lost += std::max(0, n_expected - block.n_data);
+}
+
+void Decoder::forward_symbol(const std::vector<uint8_t>& symbol) {
+  const int data_len = symbol[0] | (symbol[1] << 8);
+  if (data_len + 2 > (int)symbol.size()) {
+    m_stats.n_bad_packets++;
+    return;
+  }
+  m_output_cb(symbol.data() + 2, data_len);
+}
+
+std::string Decoder::Stats::to_string() const {
+  std::stringstream ss;
+  ss << "data:" << n_data_packets << " parity:" << n_parity_packets
+     << " recovered:" << n_recovered << " lost:" << n_lost
+     << " duplicates:" << n_duplicates << " bad:" << n_bad_packets;
+  return ss.str();
+}
+
+}  // namespace openhd::telemetry_fec
@@ -0,0 +1,33 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#include "openhd_tx_budget.h"
+
+#include <algorithm>
+#include <limits>
+
+void openhd::TxBudget::set_bytes_per_second(
+    std::optional<int> bytes_per_second,
+    std::chrono::steady_clock::time_point now) {
+  m_bytes_per_second = bytes_per_second;
+  m_available_bytes =
+      bytes_per_second.has_value() ? bytes_per_second.value() / 4.0 : 0;
+  m_last_refill = now;
+}
+
+int openhd::TxBudget::refill(std::chrono::steady_clock::time_point now) {
+  if (!m_bytes_per_second.has_value()) {
+    return std::numeric_limits<int>::max();
+  }
+  const double rate = m_bytes_per_second.value();
+  const std::chrono::duration<double> elapsed = now - m_last_refill;
+  m_last_refill = now;
+  m_available_bytes =
+      std::min(m_available_bytes + elapsed.count() * rate, rate / 4);
+  return m_available_bytes > 0 ? (int)m_available_bytes : 0;
+}
+
+void openhd::TxBudget::consume(int n_bytes) {
+  if (m_bytes_per_second.has_value()) m_available_bytes -= n_bytes;
+}
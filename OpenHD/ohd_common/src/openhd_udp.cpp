@@ -31,32 +31,47 @@ openhd::UDPForwarder::UDPForwarder(std::string client_addr1,
   // saddr.sin_addr.s_addr = inet_addr(client_addr.c_str());
   inet_aton(client_addr.c_str(), (in_addr *)&saddr.sin_addr.s_addr);
   saddr.sin_port = htons((uint16_t)client_udp_port);
+  m_send_queue = NonBlockingSendQueue::create(
+      sockfd, saddr, fmt::format("UDP {}:{}", client_addr, client_udp_port),
+      MAX_N_QUEUED_PACKETS);
   get_console()->info("UDPForwarder::configured for {} {}", client_addr,
                       client_udp_port);
 }
 
-openhd::UDPForwarder::~UDPForwarder() { close(sockfd); }
+openhd::UDPForwarder::~UDPForwarder() {
+  // Make sure the I/O worker doesn't touch the socket anymore
+  m_send_queue->shutdown();
+  close(sockfd);
+}
 
 void openhd::UDPForwarder::forwardPacketViaUDP(
     const uint8_t *packet, const std::size_t packetSize) const {
-  // send(sockfd,packet,packetSize, MSG_DONTWAIT);
   // openhd::log::get_default()->debug("Forward {}",packetSize);
-  const auto ret = sendto(sockfd, packet, packetSize, 0,
-                          (const struct sockaddr *)&saddr, sizeof(saddr));
-  if (ret < 0 || ret != packetSize) {
-    get_console()->warn("Error sending packet of size:{} to {}:{} code:{} {}",
-                        packetSize, client_addr, client_udp_port, ret,
-                        strerror(errno));
-  }
+  m_send_queue->send(packet, (int)packetSize);
+}
+
+void openhd::UDPForwarder::forwardPacketsViaUDP(const struct iovec *packets,
+                                                int n_packets) const {
+  m_send_queue->send_batch(packets, n_packets);
+}
+
+openhd::NonBlockingSendQueue::Stats openhd::UDPForwarder::get_stats() const {
+  return m_send_queue->get_stats();
+}
+
+openhd::UDPMultiForwarder::UDPMultiForwarder() {
+  m_batch.resize(MAX_BATCH_N_PACKETS);
+  m_batch_iovs.resize(MAX_BATCH_N_PACKETS);
 }
 
 void openhd::UDPMultiForwarder::addForwarder(const std::string &client_addr,
                                              int client_udp_port) {
   std::lock_guard<std::mutex> guard(udpForwardersLock);
+  auto updated = m_destinations.read();
   // check if we already forward data to this IP::Port tuple
-  for (const auto &udpForwarder : udpForwarders) {
-    if (udpForwarder->client_addr == client_addr &&
-        udpForwarder->client_udp_port == client_udp_port) {
+  for (const auto &destination : updated) {
+    if (destination->client_addr == client_addr &&
+        destination->client_udp_port == client_udp_port) {
       get_console()->info("UDPMultiForwarder: already forwarding to: {}:{}",
                           client_addr, client_udp_port);
       return;
@@ -64,32 +79,69 @@ void openhd::UDPMultiForwarder::addForwarder(const std::string &client_addr,
   }
   get_console()->info("UDPMultiForwarder: add forwarding to: {}:{}",
                       client_addr, client_udp_port);
-  udpForwarders.emplace_back(
-      std::make_unique<openhd::UDPForwarder>(client_addr, client_udp_port));
+  updated.push_back(
+      std::make_shared<const UDPForwarder>(client_addr, client_udp_port));
+  m_destinations.publish(std::move(updated));
+  m_destinations.clear_unused();
 }
 
 void openhd::UDPMultiForwarder::removeForwarder(const std::string &client_addr,
                                                 int client_udp_port) {
   std::lock_guard<std::mutex> guard(udpForwardersLock);
-  udpForwarders.erase(
-      std::find_if(udpForwarders.begin(), udpForwarders.end(),
-                   [&client_addr, &client_udp_port](const auto &udpForwarder) {
-                     return udpForwarder->client_addr == client_addr &&
-                            udpForwarder->client_udp_port == client_udp_port;
-                   }));
+  auto updated = m_destinations.read();
+  const auto it =
+      std::find_if(updated.begin(), updated.end(),
+                   [&client_addr, &client_udp_port](const auto &destination) {
+                     return destination->client_addr == client_addr &&
+                            destination->client_udp_port == client_udp_port;
+                   });
+  if (it == updated.end()) {
+    get_console()->debug("UDPMultiForwarder: not forwarding to {}:{}",
+                         client_addr, client_udp_port);
+    return;
+  }
+  updated.erase(it);
+  m_destinations.publish(std::move(updated));
+  // Close the socket here and not on the forwarding thread (unless a packet
+  // is being forwarded right now, then on the next add / remove)
+  m_destinations.clear_unused();
 }
 
 void openhd::UDPMultiForwarder::forwardPacketViaUDP(
     const uint8_t *packet, const std::size_t packetSize) {
-  std::lock_guard<std::mutex> guard(udpForwardersLock);
-  for (const auto &udpForwarder : udpForwarders) {
-    udpForwarder->forwardPacketViaUDP(packet, packetSize);
+  const auto destinations = m_destinations.read_ref();
+  for (const auto &destination : *destinations) {
+    destination->forwardPacketViaUDP(packet, packetSize);
   }
 }
 
-const std::list<std::unique_ptr<openhd::UDPForwarder>>
-    &openhd::UDPMultiForwarder::getForwarders() const {
-  return udpForwarders;
+void openhd::UDPMultiForwarder::enqueuePacket(const uint8_t *packet,
+                                              std::size_t packetSize) {
+  // Re-uses the capacity of the previous batch(es)
+  m_batch[m_batch_n_packets].assign(packet, packet + packetSize);
+  m_batch_n_packets++;
+  if (m_batch_n_packets >= MAX_BATCH_N_PACKETS) {
+    flush();
+  }
+}
+
+void openhd::UDPMultiForwarder::flush() {
+  if (m_batch_n_packets == 0) return;
+  for (int i = 0; i < m_batch_n_packets; i++) {
+    m_batch_iovs[i].iov_base = m_batch[i].data();
+    m_batch_iovs[i].iov_len = m_batch[i].size();
+  }
+  // One sendmmsg() per destination (each destination has its own socket /
+  // send queue, such that a slow one doesn't hold back the others)
+  for (const auto &destination : *m_destinations.read_ref()) {
+    destination->forwardPacketsViaUDP(m_batch_iovs.data(), m_batch_n_packets);
+  }
+  m_batch_n_packets = 0;
+}
+
+openhd::UDPMultiForwarder::Destinations
+openhd::UDPMultiForwarder::getForwarders() const {
+  return m_destinations.read();
 }
 
 openhd::UDPReceiver::UDPReceiver(std::string client_addr, int client_udp_port,
@@ -164,7 +216,42 @@ void openhd::UDPReceiver::runInBackground() {
       std::make_unique<std::thread>(&UDPReceiver::loopUntilError, this);
 }
 
+void openhd::UDPReceiver::runInEventLoop(
+    std::shared_ptr<EventLoop> event_loop) {
+  if (receiverThread || m_event_loop) {
+    get_console()->warn(
+        "Receiver is already running or has not been properly stopped");
+    return;
+  }
+  receiving = true;
+  m_rx_buff = std::make_unique<std::array<uint8_t, UDP_PACKET_MAX_SIZE>>();
+  m_event_loop = std::move(event_loop);
+  m_event_loop->add_fd(mSocket, EPOLLIN, [this](uint32_t) { on_readable(); });
+}
+
+void openhd::UDPReceiver::on_readable() {
+  // Read what is there, but give the other fds of the loop a chance, too
+  for (int i = 0; i < 64; i++) {
+    const ssize_t message_length =
+        recv(mSocket, m_rx_buff->data(), m_rx_buff->size(), MSG_DONTWAIT);
+    if (message_length > 0) {
+      mCb(m_rx_buff->data(), (size_t)message_length);
+    } else {
+      if (message_length < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+        get_console()->warn("Got message length of: {} {}", message_length,
+                            strerror(errno));
+      }
+      return;
+    }
+  }
+}
+
 void openhd::UDPReceiver::stopBackground() {
+  if (m_event_loop) {
+    // Must happen before the socket is closed
+    m_event_loop->remove_fd(mSocket);
+    m_event_loop = nullptr;
+  }
   stopLooping();
   if (receiverThread && receiverThread->joinable()) {
     receiverThread->join();
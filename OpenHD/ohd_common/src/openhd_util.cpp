@@ -7,6 +7,7 @@
 #include <arpa/inet.h>
 #include <unistd.h>
 
+#include <array>
 #include <cctype>
 #include <chrono>
 #include <csignal>
@@ -401,3 +402,21 @@ std::string OHDUtil::bytes_as_string(const uint8_t* data, int data_len) {
   ss << "]";
   return ss.str();
 }
+
+uint32_t OHDUtil::crc32(const uint8_t* data, size_t data_len, uint32_t crc) {
+  static const auto table = [] {
+    std::array<uint32_t, 256> ret{};
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t value = i;
+      for (int bit = 0; bit < 8; bit++) {
+        value = (value & 1) ? (0xEDB88320 ^ (value >> 1)) : (value >> 1);
+      }
+      ret[i] = value;
+    }
+    return ret;
+  }();
+  for (size_t i = 0; i < data_len; i++) {
+    crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return crc;
+}
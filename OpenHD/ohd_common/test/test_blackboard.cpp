@@ -0,0 +1,292 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#include <chrono>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "openhd_action_handler.h"
+#include "openhd_blackboard.h"
+#include "openhd_test_util.h"
+
+// 1) Readers never see a torn value, versions only go up, read_if_changed
+// only copies on change.
+// 2) Contention benchmark: one writer and n readers hammering the link stats
+// (snapshot) and the camera info (seqlock), compared to the mutex + copy
+// LinkActionHandler used before.
+
+using openhd::test::check;
+using Clock = std::chrono::steady_clock;
+using StatsAirGround = openhd::link_statistics::StatsAirGround;
+using CamInfo = openhd::LinkActionHandler::CamInfo;
+
+static_assert(
+    std::is_same_v<openhd::Blackboard<CamInfo>, openhd::SeqlockValue<CamInfo>>);
+static_assert(std::is_same_v<openhd::Blackboard<StatsAirGround>,
+                             openhd::SnapshotValue<StatsAirGround>>);
+
+struct Words {
+  uint64_t values[16];
+};
+static Words create_words(uint64_t value) {
+  Words ret{};
+  for (auto& v : ret.values) v = value;
+  return ret;
+}
+static bool is_consistent(const Words& words) {
+  for (const auto& v : words.values) {
+    if (v != words.values[0]) return false;
+  }
+  return true;
+}
+
+// Value and version must always match (written together)
+template <typename BB, typename CREATE, typename GET>
+static void test_consistency(const std::string& name, CREATE create, GET get) {
+  BB blackboard{create(0)};
+  std::atomic_bool done = false;
+  std::atomic<int> n_errors = 0;
+  std::vector<std::thread> readers;
+  for (int i = 0; i < 3; i++) {
+    readers.emplace_back([&] {
+      uint64_t last_version = 0;
+      while (!done) {
+        uint64_t version;
+        const auto value = blackboard.read(&version);
+        const auto opt_value = get(value);
+        if (!opt_value.has_value() || opt_value.value() != version ||
+            version < last_version) {
+          n_errors++;
+        }
+        last_version = version;
+      }
+    });
+  }
+  const int n_writes = 200000;
+  for (uint64_t i = 1; i <= n_writes; i++) {
+    check(blackboard.publish(create(i)) == i, name + " publish version");
+  }
+  done = true;
+  for (auto& reader : readers) reader.join();
+  check(n_errors == 0, name + " torn read");
+  // read_if_changed
+  uint64_t version = 0;
+  auto value = create(0);
+  check(blackboard.read_if_changed(value, version) && version == n_writes &&
+            get(value) == n_writes,
+        name + " changed");
+  check(!blackboard.read_if_changed(value, version), name + " unchanged");
+  blackboard.modify([&](auto& v) { v = create(n_writes + 1); });
+  check(blackboard.read_if_changed(value, version) &&
+            get(value) == n_writes + 1,
+        name + " modify");
+  std::cout << name << " consistent\n";
+}
+
+struct Result {
+  double reads_per_second;
+  double writes_per_second;
+  std::chrono::nanoseconds max_write_duration;
+};
+
+// The readers read (and look at the value) at full speed. The writer
+// publishes at full speed (worst case) or once every write_interval (like the
+// wb stats thread).
+template <typename WRITE, typename READ>
+static Result run_contention(int n_readers,
+                             std::chrono::microseconds write_interval,
+                             WRITE write, READ read) {
+  const auto duration = std::chrono::milliseconds(500);
+  std::atomic_bool done = false;
+  std::atomic<int64_t> n_reads = 0;
+  std::vector<std::thread> readers;
+  for (int i = 0; i < n_readers; i++) {
+    readers.emplace_back([&] {
+      int64_t n = 0;
+      while (!done) {
+        read();
+        n++;
+      }
+      n_reads += n;
+    });
+  }
+  int64_t n_writes = 0;
+  std::chrono::nanoseconds max_write_duration{0};
+  const auto begin = Clock::now();
+  while (Clock::now() - begin < duration) {
+    const auto before = Clock::now();
+    write(n_writes);
+    max_write_duration = std::max(max_write_duration, Clock::now() - before);
+    n_writes++;
+    if (write_interval.count() > 0) std::this_thread::sleep_for(write_interval);
+  }
+  done = true;
+  for (auto& reader : readers) reader.join();
+  const double seconds = std::chrono::duration<double>(duration).count();
+  return {n_reads / seconds, n_writes / seconds, max_write_duration};
+}
+
+static void print(const std::string& name, const Result& result) {
+  std::cout << name << ": " << (int64_t)result.reads_per_second
+            << " reads/s, " << (int64_t)result.writes_per_second
+            << " writes/s, max write "
+            << std::chrono::duration_cast<std::chrono::microseconds>(
+                   result.max_write_duration)
+                   .count()
+            << "us\n";
+}
+
+static StatsAirGround create_stats(int64_t i) {
+  StatsAirGround stats{};
+  stats.ready = true;
+  stats.monitor_mode_link.curr_rx_bps = static_cast<int32_t>(i);
+  stats.stats_wb_video_air.resize(2);
+  stats.stats_wb_video_ground.resize(2);
+  return stats;
+}
+
+static void benchmark(int n_readers, std::chrono::microseconds write_interval) {
+  std::cout << "--- " << n_readers << " reader(s), write interval "
+            << write_interval.count() << "us\n";
+  std::atomic<int64_t> sink = 0;
+  {
+    std::mutex mutex;
+    StatsAirGround stats = create_stats(0);
+    print("link stats mutex",
+          run_contention(
+              n_readers, write_interval,
+              [&](int64_t i) {
+                auto tmp = create_stats(i);
+                std::lock_guard<std::mutex> guard(mutex);
+                stats = std::move(tmp);
+              },
+              [&] {
+                StatsAirGround copy;
+                {
+                  std::lock_guard<std::mutex> guard(mutex);
+                  copy = stats;
+                }
+                sink += copy.monitor_mode_link.curr_rx_bps;
+              }));
+  }
+  {
+    openhd::SnapshotValue<StatsAirGround> stats{create_stats(0)};
+    print("link stats blackboard",
+          run_contention(
+              n_readers, write_interval,
+              [&](int64_t i) { stats.publish(create_stats(i)); },
+              [&] {
+                sink += stats.read_ref()->monitor_mode_link.curr_rx_bps;
+              }));
+  }
+  {
+    // Readers that only look at the value when it changed
+    openhd::SnapshotValue<StatsAirGround> stats{create_stats(0)};
+    print("link stats blackboard, on change",
+          run_contention(
+              n_readers, write_interval,
+              [&](int64_t i) { stats.publish(create_stats(i)); },
+              [&] {
+                thread_local uint64_t version = 0;
+                if (stats.get_version() == version) return;
+                sink += stats.read_ref(&version)
+                            ->monitor_mode_link.curr_rx_bps;
+              }));
+  }
+  {
+    std::mutex mutex;
+    CamInfo info{};
+    print("cam info mutex",
+          run_contention(
+              n_readers, write_interval,
+              [&](int64_t i) {
+                std::lock_guard<std::mutex> guard(mutex);
+                info.encoding_bitrate_kbits = static_cast<uint16_t>(i);
+              },
+              [&] {
+                std::lock_guard<std::mutex> guard(mutex);
+                sink += info.encoding_bitrate_kbits;
+              }));
+  }
+  {
+    openhd::SeqlockValue<CamInfo> info{};
+    print("cam info blackboard",
+          run_contention(
+              n_readers, write_interval,
+              [&](int64_t i) {
+                info.modify([i](CamInfo& v) {
+                  v.encoding_bitrate_kbits = static_cast<uint16_t>(i);
+                });
+              },
+              [&] { sink += info.read().encoding_bitrate_kbits; }));
+  }
+  {
+    // What a reader polling for changes (e.g. at the telemetry rate) pays
+    // when nothing changed
+    openhd::SeqlockValue<CamInfo> info{};
+    CamInfo copy{};
+    uint64_t version = 0;
+    int64_t n_changed = 0;
+    const int n_polls = 10000000;
+    const auto begin = Clock::now();
+    for (int i = 0; i < n_polls; i++) {
+      if (info.read_if_changed(copy, version)) n_changed++;
+    }
+    const auto elapsed = Clock::now() - begin;
+    check(n_changed == 0, "Unchanged poll");
+    std::cout << "unchanged poll: "
+              << std::chrono::duration<double, std::nano>(elapsed).count() /
+                     n_polls
+              << "ns\n";
+  }
+}
+
+int main(int argc, char* argv[]) {
+  test_consistency<openhd::SeqlockValue<Words>>(
+      "Seqlock", create_words,
+      [](const Words& words) -> std::optional<uint64_t> {
+        if (!is_consistent(words)) return std::nullopt;
+        return words.values[0];
+      });
+  test_consistency<openhd::SnapshotValue<std::vector<uint64_t>>>(
+      "Snapshot",
+      [](uint64_t value) { return std::vector<uint64_t>(64, value); },
+      [](const std::vector<uint64_t>& values) -> std::optional<uint64_t> {
+        for (const auto& v : values) {
+          if (v != values[0]) return std::nullopt;
+        }
+        return values[0];
+      });
+  // Arming state / rc channels
+  auto& arming = openhd::ArmingStateHelper::instance();
+  int n_arming_cb = 0;
+  arming.register_listener("test", [&](bool armed) { n_arming_cb++; });
+  const auto arming_version = arming.get_arming_state_version();
+  arming.update_arming_state_if_changed(false);
+  arming.update_arming_state_if_changed(true);
+  arming.update_arming_state_if_changed(true);
+  check(arming.is_currently_armed() && n_arming_cb == 1 &&
+            arming.get_arming_state_version() == arming_version + 1,
+        "Arming");
+  arming.unregister_listener("test");
+  auto& rc_channels = openhd::FCRcChannelsHelper::instance();
+  openhd::FCRcChannelsHelper::RC_CHANNELS channels{};
+  channels[3] = 1500;
+  rc_channels.update_rc_channels(channels);
+  check(rc_channels.get_rc_channels().read()[3] == 1500 &&
+            rc_channels.get_rc_channels().get_version() == 1,
+        "RC channels");
+
+  const int n_cpus = static_cast<int>(std::thread::hardware_concurrency());
+  for (const auto write_interval :
+       {std::chrono::microseconds(0), std::chrono::microseconds(1000)}) {
+    benchmark(1, write_interval);
+    benchmark(std::max(2, n_cpus - 1), write_interval);
+  }
+  std::cout << "test_blackboard passed\n";
+  return 0;
+}
@@ -0,0 +1,122 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+#include "openhd_buffer_pool.h"
+#include "openhd_spdlog.h"
+
+// Buffers must be re-used once the last reference is dropped
+static void test_recycle() {
+  openhd::FragmentBufferPool pool{4};
+  std::vector<uint8_t> data(1024, 1);
+  const uint8_t* first_data_ptr;
+  {
+    auto buff = pool.acquire(data.data(), data.size());
+    first_data_ptr = buff->data();
+  }
+  auto buff = pool.acquire(data.data(), 100);
+  if (buff->data() != first_data_ptr || buff->size() != 100) {
+    throw std::runtime_error("Buffer was not recycled\n");
+  }
+  // Pool exhausted, still need to get a valid buffer
+  std::vector<std::shared_ptr<std::vector<uint8_t>>> in_use;
+  for (int i = 0; i < 10; i++) {
+    in_use.push_back(pool.acquire(data.data(), data.size()));
+  }
+  for (auto& el : in_use) {
+    if (*el != data) throw std::runtime_error("Data mismatch\n");
+  }
+  const auto stats = pool.get_stats();
+  openhd::log::get_default()->debug("{}", stats.to_string());
+  if (stats.n_buffers != 4) {
+    throw std::runtime_error("Pool grew over its limit\n");
+  }
+}
+
+// Buffers released on another thread (like the wb tx thread dropping a
+// fragment) go back to the thread that acquired them, buffers of a thread
+// that exited are taken over by the next one.
+static void test_threads() {
+  openhd::FragmentBufferPool pool{8};
+  std::vector<uint8_t> data(1024, 3);
+  std::vector<std::shared_ptr<std::vector<uint8_t>>> in_use;
+  for (int i = 0; i < 8; i++) {
+    in_use.push_back(pool.acquire(data.data(), data.size()));
+  }
+  std::thread releaser([&in_use]() { in_use.clear(); });
+  releaser.join();
+  for (int i = 0; i < 8; i++) {
+    in_use.push_back(pool.acquire(data.data(), data.size()));
+  }
+  in_use.clear();
+  auto stats = pool.get_stats();
+  if (stats.count_hit != 8 || stats.count_miss != 8 || stats.n_buffers != 8) {
+    throw std::runtime_error("Remote release not recycled " +
+                             stats.to_string());
+  }
+  for (int i = 0; i < 2; i++) {
+    std::thread producer([&]() {
+      for (int j = 0; j < 8; j++) {
+        in_use.push_back(pool.acquire(data.data(), data.size()));
+      }
+    });
+    producer.join();
+    in_use.clear();
+  }
+  stats = pool.get_stats();
+  openhd::log::get_default()->debug("{}", stats.to_string());
+  if (stats.n_buffers != 16) {
+    throw std::runtime_error("Buffers of exited thread not re-used " +
+                             stats.to_string());
+  }
+}
+
+// Mimics the video path - one thread produces, the other one drops the last
+// reference (bounded queue in between).
+static void benchmark_pool_vs_heap() {
+  static constexpr int N_PACKETS = 1000 * 1000;
+  std::vector<uint8_t> data(1440, 2);
+  auto run = [&data](bool use_pool) {
+    openhd::FragmentBufferPool pool{};
+    std::mutex mutex;
+    std::vector<std::shared_ptr<std::vector<uint8_t>>> queue;
+    std::atomic_bool done = false;
+    std::thread consumer([&]() {
+      while (!done) {
+        std::lock_guard<std::mutex> guard(mutex);
+        queue.clear();
+      }
+    });
+    const auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < N_PACKETS; i++) {
+      auto buff =
+          use_pool
+              ? pool.acquire(data.data(), data.size())
+              : std::make_shared<std::vector<uint8_t>>(data.begin(), data.end());
+      std::lock_guard<std::mutex> guard(mutex);
+      // Like the wb tx queue, drop if the consumer cannot keep up
+      if (queue.size() < 256) queue.push_back(std::move(buff));
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - begin;
+    done = true;
+    consumer.join();
+    openhd::log::get_default()->info(
+        "{} {} packets took {}ms {}", use_pool ? "Pool" : "Heap", N_PACKETS,
+        std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count(),
+        use_pool ? pool.get_stats().to_string() : "");
+  };
+  run(false);
+  run(true);
+}
+
+int main(int argc, char* argv[]) {
+  test_recycle();
+  test_threads();
+  benchmark_pool_vs_heap();
+  std::cout << "Done\n";
+  return 0;
+}
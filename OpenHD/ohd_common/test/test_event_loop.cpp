@@ -0,0 +1,145 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "openhd_event_loop.h"
+#include "openhd_spdlog.h"
+
+// Validates openhd::EventLoop - fd readiness, timer accuracy (compared to a
+// sleep_for loop doing the same work), posted tasks and removing a fd while
+// its callback is busy.
+
+using Clock = std::chrono::steady_clock;
+
+static int64_t to_us(std::chrono::nanoseconds t) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(t).count();
+}
+
+// Simulates the work done each iteration (e.g. generating telemetry)
+static void busy_work() {
+  const auto begin = Clock::now();
+  while (Clock::now() - begin < std::chrono::milliseconds(2)) {
+  }
+}
+
+// Returns the drift after n iterations
+static std::chrono::nanoseconds sleep_loop(
+    const std::chrono::milliseconds interval, const int n) {
+  const auto begin = Clock::now();
+  for (int i = 0; i < n; i++) {
+    std::this_thread::sleep_for(interval);
+    busy_work();
+  }
+  return (Clock::now() - begin) - interval * n;
+}
+
+static void test_timer() {
+  const auto interval = std::chrono::milliseconds(20);
+  const int n = 50;
+  openhd::EventLoop loop("test_loop");
+  std::atomic<int> count = 0;
+  std::chrono::nanoseconds max_jitter{0};
+  Clock::time_point last_expiration{};
+  Clock::time_point end{};
+  const auto begin = Clock::now();
+  loop.add_timer(interval, [&] {
+    const auto now = Clock::now();
+    if (last_expiration != Clock::time_point{}) {
+      const auto delta = now - last_expiration;
+      max_jitter = std::max(max_jitter, delta > interval ? delta - interval
+                                                         : interval - delta);
+    }
+    last_expiration = now;
+    busy_work();
+    if (++count == n) end = now;
+  });
+  loop.start();
+  while (count < n) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  loop.stop();
+  const auto timer_drift = (end - begin) - interval * n;
+  const auto sleep_drift = sleep_loop(interval, n);
+  std::cout << "Timer: drift " << to_us(timer_drift) << "us max jitter "
+            << to_us(max_jitter) << "us, sleep_for loop: drift "
+            << to_us(sleep_drift) << "us\n";
+  std::cout << loop.get_stats().to_string() << "\n";
+  // The sleep loop drifts by the work done each iteration, the timer doesn't
+  if (timer_drift > std::chrono::milliseconds(20)) {
+    throw std::runtime_error("Timer drifts");
+  }
+}
+
+static void test_fd_and_post() {
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK, 0, fds) != 0) {
+    throw std::runtime_error("Cannot create socketpair");
+  }
+  openhd::EventLoop loop("test_loop");
+  std::atomic<int> n_received = 0;
+  std::vector<int> order;
+  loop.add_fd(fds[1], EPOLLIN, [&](uint32_t events) {
+    uint8_t buff[64];
+    while (recv(fds[1], buff, sizeof(buff), 0) > 0) n_received++;
+  });
+  // Posted before start, runs once started
+  loop.post([&] { order.push_back(0); });
+  loop.start();
+  for (int i = 1; i < 100; i++) {
+    loop.post([&order, i] { order.push_back(i); });
+  }
+  const uint8_t data[8]{};
+  for (int i = 0; i < 100; i++) send(fds[0], data, sizeof(data), 0);
+  // Acts as a barrier for everything posted before
+  loop.run_sync([] {});
+  if (order.size() != 100) {
+    throw std::runtime_error("Posted tasks missing");
+  }
+  for (int i = 0; i < 100; i++) {
+    if (order[i] != i) throw std::runtime_error("Posted tasks out of order");
+  }
+  const auto begin = Clock::now();
+  while (n_received < 100 && Clock::now() - begin < std::chrono::seconds(1)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  if (n_received != 100) {
+    throw std::runtime_error("Received " + std::to_string(n_received));
+  }
+  // Removing while the callback is busy waits for the callback
+  std::atomic<bool> in_callback = false;
+  std::atomic<bool> callback_done = false;
+  loop.remove_fd(fds[1]);
+  loop.add_fd(fds[1], EPOLLIN, [&](uint32_t events) {
+    uint8_t buff[64];
+    while (recv(fds[1], buff, sizeof(buff), 0) > 0) {
+    }
+    in_callback = true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    callback_done = true;
+  });
+  send(fds[0], data, sizeof(data), 0);
+  while (!in_callback) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  loop.remove_fd(fds[1]);
+  if (!callback_done) {
+    throw std::runtime_error("remove_fd returned while callback running");
+  }
+  loop.stop();
+  close(fds[0]);
+  close(fds[1]);
+}
+
+int main(int argc, char* argv[]) {
+  test_fd_and_post();
+  test_timer();
+  std::cout << "test_event_loop passed\n";
+  return 0;
+}
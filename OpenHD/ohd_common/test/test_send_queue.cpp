@@ -0,0 +1,100 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#include "openhd_send_queue.h"
+#include "openhd_spdlog.h"
+
+// A consumer that doesn't read must neither block the sender nor corrupt the
+// stream - data is dropped (oldest first) in units of whole messages.
+
+static constexpr int MESSAGE_SIZE = 1000;
+static constexpr int MAX_N_QUEUED = 32;
+
+static std::vector<uint8_t> create_message(uint32_t seq_nr) {
+  std::vector<uint8_t> message(MESSAGE_SIZE, (uint8_t)seq_nr);
+  std::memcpy(message.data(), &seq_nr, sizeof(seq_nr));
+  return message;
+}
+
+int main(int argc, char* argv[]) {
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+    throw std::runtime_error("Cannot create socketpair");
+  }
+  // Small socket buffer, such that the stalled consumer fills it quickly
+  int sndbuf = 16 * 1024;
+  setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+  auto queue = openhd::NonBlockingSendQueue::create(fds[0], std::nullopt,
+                                                    "test", MAX_N_QUEUED);
+  // 1) Consumer stalled
+  const int n_messages = 5000;
+  std::chrono::nanoseconds max_send_duration{0};
+  for (uint32_t i = 0; i < n_messages; i++) {
+    const auto message = create_message(i);
+    const auto before = std::chrono::steady_clock::now();
+    queue->send(message.data(), message.size());
+    max_send_duration = std::max(max_send_duration,
+                                 std::chrono::steady_clock::now() - before);
+  }
+  auto stats = queue->get_stats();
+  std::cout << "Stalled consumer: " << stats.to_string() << " max send call "
+            << std::chrono::duration_cast<std::chrono::microseconds>(
+                   max_send_duration)
+                   .count()
+            << "us\n";
+  if (stats.n_packets_dropped == 0 || stats.queue_depth > MAX_N_QUEUED) {
+    throw std::runtime_error("Expected bounded queue with drops");
+  }
+  if (max_send_duration > std::chrono::milliseconds(50)) {
+    throw std::runtime_error("send() blocked");
+  }
+  // 2) Consumer starts reading - the backlog is drained by the I/O worker, and
+  // the stream consists of whole messages in order
+  std::vector<uint8_t> rx_stream;
+  std::vector<uint8_t> buff(64 * 1024);
+  const auto begin = std::chrono::steady_clock::now();
+  const size_t expected_n_bytes =
+      (stats.n_packets_sent + stats.n_packets_queued -
+       stats.n_packets_dropped) *
+      MESSAGE_SIZE;
+  while (rx_stream.size() < expected_n_bytes &&
+         std::chrono::steady_clock::now() - begin < std::chrono::seconds(5)) {
+    const auto len = recv(fds[1], buff.data(), buff.size(), MSG_DONTWAIT);
+    if (len > 0) {
+      rx_stream.insert(rx_stream.end(), buff.data(), buff.data() + len);
+    } else {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+  if (rx_stream.size() != expected_n_bytes) {
+    throw std::runtime_error(fmt::format("Got {} bytes, expected {}",
+                                         rx_stream.size(), expected_n_bytes));
+  }
+  int64_t last_seq_nr = -1;
+  for (size_t offset = 0; offset < rx_stream.size(); offset += MESSAGE_SIZE) {
+    uint32_t seq_nr;
+    std::memcpy(&seq_nr, &rx_stream[offset], sizeof(seq_nr));
+    if ((int64_t)seq_nr <= last_seq_nr ||
+        rx_stream[offset + MESSAGE_SIZE - 1] != (uint8_t)seq_nr) {
+      throw std::runtime_error(fmt::format("Corrupt stream at {}", offset));
+    }
+    last_seq_nr = seq_nr;
+  }
+  if (last_seq_nr != n_messages - 1) {
+    throw std::runtime_error("Newest message missing");
+  }
+  std::cout << "Drained: " << queue->get_stats().to_string() << "\n";
+  queue->shutdown();
+  close(fds[0]);
+  close(fds[1]);
+  return 0;
+}
@@ -8,14 +8,15 @@
 class TestServer:public openhd::TCPServer{
  public:
   explicit TestServer(): openhd::TCPServer("Test",openhd::TCPServer::Config{5760}){};
-  void on_external_device(std::string ip,int port, bool connected)override{
+  ~TestServer() override { stop(); }
+  void on_external_device(int client_id,std::string ip,int port, bool connected)override{
       if(connected){
         openhd::log::get_default()-> debug("Device {}:{} connected",ip,port);
       }else{
         openhd::log::get_default()-> debug("Device {}:{} disconnected",ip,port);
       }
   };
-  void on_packet_any_tcp_client(const uint8_t* data, int data_len)override{
+  void on_packet_any_tcp_client(int client_id,const uint8_t* data, int data_len)override{
       // do nothing
       openhd::log::get_default()-> debug("Got data {}",data_len);
   };
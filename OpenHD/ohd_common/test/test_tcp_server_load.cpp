@@ -0,0 +1,243 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "openhd_tcp.h"
+
+// Load test for openhd::TCPServer - many clients on one event loop thread,
+// broadcast framing, a stalled client not affecting the others and per-client
+// rx data.
+
+static constexpr int PORT = 5761;
+static constexpr int N_CLIENTS = 24;
+static constexpr uint32_t MAGIC = 0x4F48440A;
+
+using Clock = std::chrono::steady_clock;
+
+static int count_threads() {
+  int ret = 0;
+  DIR* dir = opendir("/proc/self/task");
+  if (dir == nullptr) return -1;
+  while (auto entry = readdir(dir)) {
+    if (entry->d_name[0] != '.') ret++;
+  }
+  closedir(dir);
+  return ret;
+}
+
+class TestServer : public openhd::TCPServer {
+ public:
+  TestServer() : openhd::TCPServer("TestLoad", Config{PORT}) {}
+  ~TestServer() override { stop(); }
+  void on_external_device(int client_id, std::string ip, int port,
+                          bool connected) override {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    if (connected) {
+      m_connected[client_id] = true;
+    } else {
+      m_connected.erase(client_id);
+    }
+  }
+  void on_packet_any_tcp_client(int client_id, const uint8_t* data,
+                                int data_len) override {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    auto& rx = m_rx[client_id];
+    rx.insert(rx.end(), data, data + data_len);
+  }
+  int n_connected() {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    return (int)m_connected.size();
+  }
+  std::map<int, std::vector<uint8_t>> get_rx() {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    return m_rx;
+  }
+
+ private:
+  std::mutex m_mutex;
+  std::map<int, bool> m_connected;
+  std::map<int, std::vector<uint8_t>> m_rx;
+};
+
+static int connect_client() {
+  const int fd = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(PORT);
+  inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+  // Small receive buffer (before connect, such that the window is small),
+  // such that the stalled client fills up quickly
+  int rcvbuf = 4096;
+  setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+  if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+    throw std::runtime_error("Cannot connect");
+  }
+  struct timeval tv {};
+  tv.tv_sec = 2;
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  return fd;
+}
+
+// Message: magic, seq, payload_len, payload (payload_len bytes of seq & 0xFF)
+static std::vector<uint8_t> create_message(uint32_t seq) {
+  const uint32_t payload_len = 16 + (seq % 1000);
+  std::vector<uint8_t> ret(12 + payload_len, (uint8_t)(seq & 0xFF));
+  std::memcpy(ret.data(), &MAGIC, 4);
+  std::memcpy(ret.data() + 4, &seq, 4);
+  std::memcpy(ret.data() + 8, &payload_len, 4);
+  return ret;
+}
+
+static bool read_exact(int fd, uint8_t* data, size_t len) {
+  size_t n = 0;
+  while (n < len) {
+    const ssize_t ret = recv(fd, data + n, len - n, 0);
+    if (ret <= 0) return false;
+    n += ret;
+  }
+  return true;
+}
+
+// Reads messages until @param last_seq has been received, validates each
+// message is whole and in order. @return n of received messages
+static int read_and_validate(int fd, uint32_t last_seq) {
+  int n_messages = 0;
+  int64_t prev_seq = -1;
+  while (true) {
+    uint8_t header[12];
+    if (!read_exact(fd, header, sizeof(header))) {
+      throw std::runtime_error("Client timed out");
+    }
+    uint32_t magic, seq, payload_len;
+    std::memcpy(&magic, header, 4);
+    std::memcpy(&seq, header + 4, 4);
+    std::memcpy(&payload_len, header + 8, 4);
+    if (magic != MAGIC || payload_len > 1024) {
+      throw std::runtime_error("Broken framing");
+    }
+    std::vector<uint8_t> payload(payload_len);
+    if (!read_exact(fd, payload.data(), payload_len)) {
+      throw std::runtime_error("Client timed out");
+    }
+    for (auto b : payload) {
+      if (b != (uint8_t)(seq & 0xFF)) throw std::runtime_error("Bad payload");
+    }
+    if ((int64_t)seq <= prev_seq) throw std::runtime_error("Out of order");
+    prev_seq = seq;
+    n_messages++;
+    if (seq == last_seq) return n_messages;
+  }
+}
+
+static void wait_for(const std::function<bool()>& condition,
+                     const std::string& what) {
+  const auto begin = Clock::now();
+  while (!condition()) {
+    if (Clock::now() - begin > std::chrono::seconds(5)) {
+      throw std::runtime_error("Timeout waiting for " + what);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+}
+
+int main(int argc, char* argv[]) {
+  auto server = std::make_unique<TestServer>();
+  const int n_threads_before = count_threads();
+  std::vector<int> clients;
+  for (int i = 0; i < N_CLIENTS; i++) clients.push_back(connect_client());
+  wait_for([&] { return server->n_connected() == N_CLIENTS; },
+           "clients to connect");
+  const int n_threads_after = count_threads();
+  std::cout << "Threads before:" << n_threads_before
+            << " after:" << n_threads_after << "\n";
+  if (n_threads_after != n_threads_before) {
+    throw std::runtime_error("Thread count grows with n clients");
+  }
+  // Client 0 is stalled (never reads), all the others read in parallel
+  const uint32_t n_messages = 10000;
+  std::atomic<int> n_failed = 0;
+  std::vector<int> n_received(N_CLIENTS, 0);
+  std::vector<std::thread> readers;
+  for (int i = 1; i < N_CLIENTS; i++) {
+    readers.emplace_back([&, i] {
+      try {
+        n_received[i] = read_and_validate(clients[i], n_messages - 1);
+      } catch (const std::exception& e) {
+        std::cerr << "Client " << i << " " << e.what() << "\n";
+        n_failed++;
+      }
+    });
+  }
+  const auto begin = Clock::now();
+  for (uint32_t seq = 0; seq < n_messages; seq++) {
+    const auto message = create_message(seq);
+    server->send_message_to_all_clients(message.data(), (int)message.size());
+    // Give the readers a chance to keep up, telemetry is not a bulk transfer
+    if (seq % 100 == 0) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  const auto send_duration = Clock::now() - begin;
+  for (auto& reader : readers) reader.join();
+  if (n_failed > 0) throw std::runtime_error("Reader failed");
+  const auto stats = server->get_stats();
+  std::cout << "Sent " << n_messages << " messages to " << N_CLIENTS
+            << " clients in "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(
+                   send_duration)
+                   .count()
+            << "ms, " << stats.to_string() << "\n";
+  for (int i = 1; i < N_CLIENTS; i++) {
+    std::cout << "Client " << i << " received " << n_received[i] << "\n";
+  }
+  // The stalled client cannot have taken all the data
+  if (stats.n_messages_dropped == 0) {
+    throw std::runtime_error("Stalled client did not drop");
+  }
+  // The stalled client still receives whole messages only once it reads again
+  read_and_validate(clients[0], n_messages - 1);
+  // Per-client rx
+  int expected_rx_bytes = 0;
+  for (int i = 0; i < N_CLIENTS; i++) {
+    const std::string data = "client" + std::to_string(i);
+    send(clients[i], data.data(), data.size(), 0);
+    expected_rx_bytes += (int)data.size();
+  }
+  wait_for(
+      [&] {
+        int n = 0;
+        for (const auto& [id, rx] : server->get_rx()) n += (int)rx.size();
+        return n == expected_rx_bytes;
+      },
+      "rx data");
+  for (const auto& [id, rx] : server->get_rx()) {
+    const std::string data(rx.begin(), rx.end());
+    // client ids are assigned in order of connection
+    if (data != "client" + std::to_string(id)) {
+      throw std::runtime_error("Wrong client rx " + data);
+    }
+  }
+  // Disconnect is detected
+  for (int i = 0; i < N_CLIENTS / 2; i++) close(clients[i]);
+  wait_for([&] { return server->n_connected() == N_CLIENTS - N_CLIENTS / 2; },
+           "clients to disconnect");
+  server->stop();
+  for (int i = N_CLIENTS / 2; i < N_CLIENTS; i++) close(clients[i]);
+  std::cout << server->get_stats().to_string() << "\n";
+  std::cout << "test_tcp_server_load passed\n";
+  return 0;
+}
@@ -0,0 +1,343 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <thread>
+
+#include "openhd_telemetry_fec.h"
+#include "openhd_test_util.h"
+
+// Validates the telemetry FEC and compares it to duplicate injection on a
+// lossy loopback link (the dummy link with simulated loss) - delivery ratio
+// and airtime per delivered byte at several loss rates.
+
+using openhd::test::check;
+using namespace openhd::telemetry_fec;
+using Clock = std::chrono::steady_clock;
+
+static std::vector<uint8_t> random_packet(std::mt19937& rng, int len) {
+  std::vector<uint8_t> ret(len);
+  for (auto& b : ret) b = (uint8_t)rng();
+  // Like a mavlink frame
+  ret[0] = 0xFD;
+  return ret;
+}
+
+// Every combination of lost data / parity packets the code can handle must be
+// recovered exactly
+static void test_recovery() {
+  std::mt19937 rng(42);
+  Config config{};
+  for (int k = 1; k <= 8; k++) {
+    for (int n_injections = 1; n_injections <= 4; n_injections++) {
+      std::vector<std::shared_ptr<std::vector<uint8_t>>> packets;
+      Encoder encoder(config, [&packets](auto packet) {
+        packets.push_back(std::move(packet));
+      });
+      std::vector<std::vector<uint8_t>> data;
+      // Low priority first, such that the last packet closes the block
+      for (int i = 0; i < k; i++) {
+        data.push_back(random_packet(rng, 1 + (int)(rng() % 300)));
+        const bool last = i == k - 1;
+        encoder.add_packet(data[i].data(), (int)data[i].size(),
+                           last ? n_injections : 1);
+      }
+      encoder.flush_if_expired(Clock::now() + std::chrono::seconds(1));
+      const int n = (int)packets.size();
+      const int n_parity = n - k;
+      check(n_parity == get_n_parity(config, k, n_injections - 1),
+            "N parity");
+      // Drop up to n_parity packets - all 2^n patterns
+      for (uint32_t pattern = 0; pattern < (1u << n); pattern++) {
+        if (__builtin_popcount(pattern) > n_parity) continue;
+        std::set<std::vector<uint8_t>> received;
+        Decoder decoder([&received](const uint8_t* payload, int len) {
+          check(received.insert({payload, payload + len}).second,
+                "Duplicate output");
+        });
+        for (int i = 0; i < n; i++) {
+          if (pattern & (1u << i)) continue;
+          decoder.process_packet(packets[i]->data(), (int)packets[i]->size());
+        }
+        check(received.size() == data.size(), "Not recovered");
+        for (const auto& d : data) {
+          check(received.count(d) == 1, "Wrong data");
+        }
+      }
+    }
+  }
+  std::cout << "Recovery ok\n";
+}
+
+static void test_tail_flush() {
+  Config config{};
+  const auto latency = config.priority_classes[1].max_block_latency;
+  const auto command_latency = config.priority_classes[3].max_block_latency;
+  std::atomic<int> n_out = 0;
+  Encoder encoder(config, [&n_out](auto) { n_out++; });
+  const auto packet = std::vector<uint8_t>(40, 0xFD);
+  const auto start = Clock::now();
+  // A lone (default priority) packet is sent right away, its parity follows
+  // after the block latency
+  encoder.add_packet(packet.data(), (int)packet.size(), 2, start);
+  check(n_out == 1, "Data sent right away");
+  check(encoder.get_flush_deadline() == start + latency, "Deadline");
+  encoder.flush_if_expired(start + latency / 2);
+  check(n_out == 1, "Early flush");
+  encoder.flush_if_expired(start + latency);
+  check(n_out == 2 && !encoder.get_flush_deadline().has_value(), "Tail flush");
+  // A command shortens the latency of the whole block
+  encoder.add_packet(packet.data(), (int)packet.size(), 2, start);
+  encoder.add_packet(packet.data(), (int)packet.size(), 4, start);
+  check(n_out == 4 &&
+            encoder.get_flush_deadline() == start + command_latency,
+        "Command deadline");
+  encoder.flush_if_expired(start + command_latency);
+  check(n_out == 4 + 3, "Command flush");
+  // And the thread does the tail flush
+  encoder.start_tail_flush_thread();
+  encoder.add_packet(packet.data(), (int)packet.size(), 2);
+  std::this_thread::sleep_for(latency * 3);
+  const auto stats = encoder.get_stats();
+  check(n_out == 7 + 2 && stats.n_tail_flushes == 3, "Tail flush thread");
+  // Stopped (FEC disabled) - nothing flushes the block until it is restarted
+  encoder.stop_tail_flush_thread();
+  encoder.add_packet(packet.data(), (int)packet.size(), 2);
+  std::this_thread::sleep_for(latency * 3);
+  check(n_out == 9 + 1, "Stopped tail flush thread");
+  encoder.start_tail_flush_thread();
+  std::this_thread::sleep_for(latency);
+  check(n_out == 10 + 1, "Restarted tail flush thread");
+  std::cout << "Tail flush ok " << stats.to_string() << "\n";
+}
+
+// Per injected packet: radiotap, 802.11, wifibroadcast header and FCS
+static constexpr int AIR_OVERHEAD = 64;
+
+struct TxPacket {
+  Clock::duration time;
+  std::vector<uint8_t> data;
+  int n_injections;
+};
+
+// Uplink like the ground unit sends it: Heartbeat (1 injection), default
+// messages like MANUAL_CONTROL (2), commands and parameter bursts (4)
+static std::vector<TxPacket> create_traffic(std::mt19937& rng) {
+  std::vector<TxPacket> ret;
+  const auto duration = std::chrono::seconds(60);
+  auto add = [&](Clock::duration time, int len, int n_injections) {
+    auto data = random_packet(rng, len);
+    const auto seq = (uint32_t)ret.size();
+    std::memcpy(data.data() + 1, &seq, sizeof(seq));
+    ret.push_back(TxPacket{time, std::move(data), n_injections});
+  };
+  for (auto t = Clock::duration{}; t < duration;
+       t += std::chrono::milliseconds(1)) {
+    const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(t)
+                        .count();
+    if (ms % 1000 == 0) add(t, 21, 1);
+    if (ms % 20 == 7) add(t, 50, 2);
+    if (ms % 500 == 250) add(t, 45, 4);
+    // Parameter burst
+    if (ms % 10000 >= 5000 && ms % 10000 < 5060 && ms % 2 == 0) add(t, 32, 4);
+  }
+  std::sort(ret.begin(), ret.end(), [](const auto& a, const auto& b) {
+    return a.time < b.time;
+  });
+  for (uint32_t i = 0; i < ret.size(); i++) {
+    std::memcpy(ret[i].data.data() + 1, &i, sizeof(i));
+  }
+  return ret;
+}
+
+// Gilbert-Elliott with the given mean burst length, independent loss if
+// mean_burst_length is 0
+class LossyLink {
+ public:
+  LossyLink(double loss_rate, double mean_burst_length, uint32_t seed)
+      : m_rng(seed), m_loss_rate(loss_rate) {
+    m_independent = mean_burst_length <= 0;
+    m_p_bad_to_good = m_independent ? 1.0 : 1.0 / mean_burst_length;
+    m_p_good_to_bad =
+        loss_rate * m_p_bad_to_good / std::max(1e-9, 1.0 - loss_rate);
+  }
+  bool is_lost() {
+    const double r = m_dist(m_rng);
+    if (m_independent) return r < m_loss_rate;
+    if (m_bad) {
+      if (r < m_p_bad_to_good) m_bad = false;
+    } else {
+      if (r < m_p_good_to_bad) m_bad = true;
+    }
+    return m_bad;
+  }
+
+ private:
+  std::mt19937 m_rng;
+  std::uniform_real_distribution<double> m_dist{0.0, 1.0};
+  double m_loss_rate;
+  bool m_independent;
+  double m_p_good_to_bad;
+  double m_p_bad_to_good;
+  bool m_bad = false;
+};
+
+struct Result {
+  // Per n of injections (priority class)
+  std::array<uint64_t, 4> n_sent{};
+  std::array<uint64_t, 4> n_delivered{};
+  uint64_t n_delivered_bytes = 0;
+  uint64_t n_air_bytes = 0;
+  Clock::duration max_recovery_latency{};
+  [[nodiscard]] double delivery_ratio(int cls = -1) const {
+    uint64_t sent = 0, delivered = 0;
+    for (int i = 0; i < 4; i++) {
+      if (cls >= 0 && i != cls) continue;
+      sent += n_sent[i];
+      delivered += n_delivered[i];
+    }
+    return sent == 0 ? 1.0 : (double)delivered / (double)sent;
+  }
+  [[nodiscard]] double airtime_per_byte() const {
+    return (double)n_air_bytes /
+           (double)std::max<uint64_t>(1, n_delivered_bytes);
+  }
+};
+
+static uint32_t get_seq(const uint8_t* data) {
+  uint32_t seq;
+  std::memcpy(&seq, data + 1, sizeof(seq));
+  return seq;
+}
+
+static void inject_duplicate(const TxPacket& packet, LossyLink& link,
+                             Result& result) {
+  result.n_sent[packet.n_injections - 1]++;
+  bool delivered = false;
+  for (int i = 0; i < packet.n_injections; i++) {
+    result.n_air_bytes += packet.data.size() + AIR_OVERHEAD;
+    if (!link.is_lost()) delivered = true;
+  }
+  if (delivered) {
+    result.n_delivered[packet.n_injections - 1]++;
+    result.n_delivered_bytes += packet.data.size();
+  }
+}
+
+static Result run_duplicate(const std::vector<TxPacket>& traffic,
+                            LossyLink link) {
+  Result result{};
+  for (const auto& packet : traffic) inject_duplicate(packet, link, result);
+  return result;
+}
+
+static Result run_fec(const std::vector<TxPacket>& traffic, LossyLink link) {
+  Result result{};
+  const auto start = Clock::now();
+  Clock::time_point now = start;
+  std::vector<int> n_injections;
+  for (const auto& packet : traffic) {
+    n_injections.push_back(packet.n_injections);
+  }
+  std::vector<Clock::time_point> sent_time(traffic.size());
+  Decoder decoder([&](const uint8_t* data, int len) {
+    const auto seq = get_seq(data);
+    check(seq < traffic.size() && (int)traffic[seq].data.size() == len &&
+              std::memcmp(traffic[seq].data.data(), data, len) == 0,
+          "Corrupted output");
+    result.n_delivered[n_injections[seq] - 1]++;
+    result.n_delivered_bytes += len;
+    result.max_recovery_latency =
+        std::max(result.max_recovery_latency, now - sent_time[seq]);
+  });
+  Encoder encoder(Config{}, [&](std::shared_ptr<std::vector<uint8_t>> packet) {
+    result.n_air_bytes += packet->size() + AIR_OVERHEAD;
+    if (!link.is_lost()) {
+      decoder.process_packet(packet->data(), (int)packet->size());
+    }
+  });
+  for (size_t i = 0; i < traffic.size(); i++) {
+    const auto& packet = traffic[i];
+    const auto time = start + packet.time;
+    // The tail flush timer
+    auto deadline = encoder.get_flush_deadline();
+    while (deadline.has_value() && deadline.value() <= time) {
+      now = deadline.value();
+      encoder.flush_if_expired(now);
+      deadline = encoder.get_flush_deadline();
+    }
+    now = time;
+    // Like WBLink
+    if (!encoder.uses_fec(packet.n_injections)) {
+      inject_duplicate(packet, link, result);
+      continue;
+    }
+    sent_time[i] = time;
+    result.n_sent[packet.n_injections - 1]++;
+    encoder.add_packet(packet.data.data(), (int)packet.data.size(),
+                       packet.n_injections, now);
+  }
+  const auto deadline = encoder.get_flush_deadline();
+  if (deadline.has_value()) {
+    now = deadline.value();
+    encoder.flush_if_expired(now);
+  }
+  return result;
+}
+
+static void compare_to_duplicate_injection() {
+  std::mt19937 rng(1234);
+  const auto traffic = create_traffic(rng);
+  std::cout << "Traffic: " << traffic.size() << " packets\n";
+  std::cout << "loss  burst | delivery dup / fec | commands dup / fec | "
+               "airtime per byte dup / fec | fec max recovery latency\n";
+  for (const double burst : {0.0, 3.0}) {
+    for (const double loss : {0.0, 0.05, 0.1, 0.2, 0.3}) {
+      const uint32_t seed = 7;
+      const auto dup = run_duplicate(traffic, LossyLink(loss, burst, seed));
+      const auto fec = run_fec(traffic, LossyLink(loss, burst, seed));
+      std::cout << loss << "  " << burst << " | " << dup.delivery_ratio()
+                << " / " << fec.delivery_ratio() << " | "
+                << dup.delivery_ratio(3) << " / " << fec.delivery_ratio(3)
+                << " | " << dup.airtime_per_byte() << " / "
+                << fec.airtime_per_byte() << " | "
+                << std::chrono::duration_cast<std::chrono::milliseconds>(
+                       fec.max_recovery_latency)
+                       .count()
+                << "ms" << std::endl;
+      check(fec.airtime_per_byte() < dup.airtime_per_byte(),
+            "FEC uses more airtime per delivered byte");
+      // Recovered packets are never held back for longer than the block
+      // latency
+      check(fec.max_recovery_latency <=
+                Config{}.priority_classes[0].max_block_latency,
+            "Recovery latency");
+      if (loss == 0.0) {
+        check(fec.delivery_ratio() == 1.0 && dup.delivery_ratio() == 1.0,
+              "Lossless");
+      }
+      if (burst == 0.0 && loss <= 0.1) {
+        check(fec.delivery_ratio() >= dup.delivery_ratio() - 0.01,
+              "FEC delivery ratio");
+      }
+      // Commands must not be worse off than before, at any loss
+      check(fec.delivery_ratio(3) >= dup.delivery_ratio(3),
+            "FEC command delivery ratio");
+    }
+  }
+}
+
+int main(int argc, char* argv[]) {
+  test_recovery();
+  test_tail_flush();
+  compare_to_duplicate_injection();
+  std::cout << "test_telemetry_fec passed\n";
+  return 0;
+}
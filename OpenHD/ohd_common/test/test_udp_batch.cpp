@@ -0,0 +1,139 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#include "openhd_spdlog.h"
+#include "openhd_udp.h"
+
+// Validates the batched (sendmmsg) udp egress and compares it against
+// forwarding each packet individually (sendto per packet per destination).
+
+static constexpr int N_DESTINATIONS = 4;
+static constexpr int BASE_PORT = 6700;
+static constexpr int PACKET_SIZE = 1446;
+// ~ a FEC block worth of rtp fragments
+static constexpr int BLOCK_SIZE = 20;
+
+static int open_rx_socket(int port) {
+  const int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  int enable = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(int));
+  struct sockaddr_in saddr {};
+  saddr.sin_family = AF_INET;
+  saddr.sin_port = htons(port);
+  inet_aton("127.0.0.1", &saddr.sin_addr);
+  if (bind(fd, (struct sockaddr*)&saddr, sizeof(saddr)) < 0) {
+    throw std::runtime_error(fmt::format("Cannot bind port {}", port));
+  }
+  int rcvbuf = 8 * 1024 * 1024;
+  setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+  struct timeval tv {};
+  tv.tv_usec = 100 * 1000;
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  return fd;
+}
+
+static void add_forwarders(openhd::UDPMultiForwarder& forwarder) {
+  for (int i = 0; i < N_DESTINATIONS; i++) {
+    forwarder.addForwarder("127.0.0.1", BASE_PORT + i);
+  }
+}
+
+// Each destination has to receive all packets, in order
+static void test_correctness() {
+  std::vector<int> rx_fds;
+  for (int i = 0; i < N_DESTINATIONS; i++) {
+    rx_fds.push_back(open_rx_socket(BASE_PORT + i));
+  }
+  openhd::UDPMultiForwarder forwarder{};
+  add_forwarders(forwarder);
+  const int n_packets = 100;
+  for (int i = 0; i < n_packets; i++) {
+    std::vector<uint8_t> packet(PACKET_SIZE, (uint8_t)i);
+    forwarder.enqueuePacket(packet.data(), packet.size());
+    if ((i + 1) % BLOCK_SIZE == 0) forwarder.flush();
+  }
+  forwarder.flush();
+  for (const auto& destination : forwarder.getForwarders()) {
+    const auto stats = destination->get_stats();
+    if (stats.n_packets_sent != n_packets) {
+      throw std::runtime_error(
+          fmt::format("Unexpected stats {}", stats.to_string()));
+    }
+  }
+  std::vector<uint8_t> buff(2000);
+  for (auto fd : rx_fds) {
+    for (int i = 0; i < n_packets; i++) {
+      const auto len = recv(fd, buff.data(), buff.size(), 0);
+      if (len != PACKET_SIZE || buff[0] != (uint8_t)i) {
+        throw std::runtime_error(
+            fmt::format("Invalid packet {} len:{}", i, (int)len));
+      }
+    }
+    close(fd);
+  }
+  std::cout << "Correctness test passed\n";
+}
+
+template <class F>
+static void benchmark(const std::string& name, F send_n_packets) {
+  std::atomic_bool running = true;
+  std::vector<std::thread> rx_threads;
+  std::atomic<int64_t> n_received = 0;
+  for (int i = 0; i < N_DESTINATIONS; i++) {
+    rx_threads.emplace_back([&running, &n_received, i] {
+      const int fd = open_rx_socket(BASE_PORT + i);
+      std::vector<uint8_t> buff(2000);
+      while (running) {
+        if (recv(fd, buff.data(), buff.size(), 0) > 0) n_received++;
+      }
+      close(fd);
+    });
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  const int n_packets = 100000;
+  const auto begin = std::chrono::steady_clock::now();
+  send_n_packets(n_packets);
+  const auto elapsed = std::chrono::steady_clock::now() - begin;
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  running = false;
+  for (auto& t : rx_threads) t.join();
+  const auto elapsed_us =
+      std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+  std::cout << fmt::format(
+      "{}: {} packets x {} destinations in {}ms ({:.2f}us per packet), "
+      "received {}\n",
+      name, n_packets, N_DESTINATIONS, elapsed_us / 1000,
+      (double)elapsed_us / n_packets, n_received.load());
+}
+
+int main(int argc, char* argv[]) {
+  test_correctness();
+  std::vector<uint8_t> packet(PACKET_SIZE, 0);
+  benchmark("sendto", [&packet](int n_packets) {
+    openhd::UDPMultiForwarder forwarder{};
+    add_forwarders(forwarder);
+    for (int i = 0; i < n_packets; i++) {
+      forwarder.forwardPacketViaUDP(packet.data(), packet.size());
+    }
+  });
+  benchmark("sendmmsg", [&packet](int n_packets) {
+    openhd::UDPMultiForwarder forwarder{};
+    add_forwarders(forwarder);
+    for (int i = 0; i < n_packets; i++) {
+      forwarder.enqueuePacket(packet.data(), packet.size());
+      if ((i + 1) % BLOCK_SIZE == 0) forwarder.flush();
+    }
+    forwarder.flush();
+  });
+  return 0;
+}
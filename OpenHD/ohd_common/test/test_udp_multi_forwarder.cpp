@@ -0,0 +1,92 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+#include "openhd_spdlog.h"
+#include "openhd_udp.h"
+
+// Stress test: add / remove destinations while forwarding at full rate.
+// The forward path must neither crash (use after close) nor stall while
+// destinations are modified.
+
+static constexpr int STABLE_PORT = 6800;
+static constexpr int CHURN_BASE_PORT = 6810;
+static constexpr int N_CHURN_PORTS = 8;
+
+int main(int argc, char* argv[]) {
+  const int rx_fd = socket(AF_INET, SOCK_DGRAM, 0);
+  struct sockaddr_in saddr {};
+  saddr.sin_family = AF_INET;
+  saddr.sin_port = htons(STABLE_PORT);
+  inet_aton("127.0.0.1", &saddr.sin_addr);
+  if (bind(rx_fd, (struct sockaddr*)&saddr, sizeof(saddr)) < 0) {
+    throw std::runtime_error("Cannot bind rx port");
+  }
+  struct timeval tv {};
+  tv.tv_usec = 100 * 1000;
+  setsockopt(rx_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+  openhd::UDPMultiForwarder forwarder{};
+  forwarder.addForwarder("127.0.0.1", STABLE_PORT);
+  std::atomic_bool running = true;
+  std::atomic<int64_t> n_received = 0;
+  std::thread rx_thread([&] {
+    std::vector<uint8_t> buff(2000);
+    while (running) {
+      if (recv(rx_fd, buff.data(), buff.size(), 0) > 0) n_received++;
+    }
+  });
+  int64_t n_churn_ops = 0;
+  std::thread churn_thread([&] {
+    while (running) {
+      for (int i = 0; i < N_CHURN_PORTS; i++) {
+        forwarder.addForwarder("127.0.0.1", CHURN_BASE_PORT + i);
+      }
+      for (int i = 0; i < N_CHURN_PORTS; i++) {
+        forwarder.removeForwarder("127.0.0.1", CHURN_BASE_PORT + i);
+      }
+      n_churn_ops += 2 * N_CHURN_PORTS;
+    }
+  });
+  std::vector<uint8_t> packet(1024, 0);
+  int64_t n_forwarded = 0;
+  std::chrono::nanoseconds max_forward_duration{0};
+  const auto begin = std::chrono::steady_clock::now();
+  while (std::chrono::steady_clock::now() - begin < std::chrono::seconds(3)) {
+    const auto before = std::chrono::steady_clock::now();
+    forwarder.forwardPacketViaUDP(packet.data(), packet.size());
+    max_forward_duration = std::max(
+        max_forward_duration, std::chrono::steady_clock::now() - before);
+    n_forwarded++;
+  }
+  running = false;
+  churn_thread.join();
+  rx_thread.join();
+  close(rx_fd);
+  const auto destinations = forwarder.getForwarders();
+  if (destinations.size() != 1 ||
+      destinations.at(0)->client_udp_port != STABLE_PORT) {
+    throw std::runtime_error("Unexpected destinations after churn");
+  }
+  if (n_received == 0) {
+    throw std::runtime_error("Stable destination did not receive any data");
+  }
+  std::cout << fmt::format(
+      "Forwarded {} packets, {} add/remove ops, stable destination received "
+      "{}, max forward call {}us\n",
+      n_forwarded, n_churn_ops, n_received.load(),
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          max_forward_duration)
+          .count());
+  // Removing an unknown destination must be a no-op
+  forwarder.removeForwarder("127.0.0.1", 1);
+  return 0;
+}
@@ -18,6 +18,7 @@
 #include "openhd_profile.h"
 #include "openhd_settings_imp.h"
 #include "openhd_spdlog.h"
+#include "openhd_telemetry_fec.h"
 #include "wb_link_helper.h"
 #include "wb_link_manager.h"
 #include "wb_link_settings.h"
@@ -94,6 +95,7 @@ class WBLink : public OHDLink {
   bool set_air_max_fec_block_size_for_platform(int value);
   bool set_air_wb_video_rate_for_mcs_adjustment_percent(int value);
   bool set_dev_air_set_high_retransmit_count(int value);
+  bool set_enable_telemetry_fec(int value);
   // Initiate channel scan / channel analyze.
   // Those operations run asynchronous until completed, and during this time
   // all other "request_" setting changes are rejected (since the work thread
@@ -137,6 +139,7 @@ class WBLink : public OHDLink {
   bool try_schedule_work_item(const std::shared_ptr<WorkItem>& work_item);
   // Called by telemetry on both air and ground (send to opposite, respective)
   void transmit_telemetry_data(TelemetryTxPacket packet) override;
+  int get_telemetry_tx_queue_depth() override;
   // Called by the camera stream on the air unit only
   // transmit video data via wifibradcast
   void transmit_video_data(
@@ -174,6 +177,12 @@ class WBLink : public OHDLink {
   // For telemetry, bidirectional in opposite directions
   std::unique_ptr<WBStreamTx> m_wb_tele_tx;
   std::unique_ptr<WBStreamRx> m_wb_tele_rx;
+  // Optional FEC for telemetry (wb_enable_telemetry_fec) on top of the non-FEC
+  // telemetry streams. The decoder is always active (only used from the
+  // telemetry rx thread), such that the other side can enable it any time.
+  std::atomic<bool> m_tele_fec_enabled = false;
+  std::unique_ptr<openhd::telemetry_fec::Encoder> m_tele_fec_encoder;
+  std::unique_ptr<openhd::telemetry_fec::Decoder> m_tele_fec_decoder;
   // For video, on air there are only tx instances, on ground there are only rx
   // instances.
   std::vector<std::unique_ptr<WBStreamTx>> m_wb_video_tx_list;
@@ -115,12 +115,21 @@ struct WBLinkSettings {
   bool wb_enable_listen_only_mode = false;
   // NOTE: Really complicated, for developers only
   bool wb_dev_air_set_high_retransmit_count = false;
+  // Protect outgoing telemetry with FEC instead of injecting packets multiple
+  // times (commands still are). The receiving side detects FEC packets
+  // automatically, air and ground can enable it independently.
+  bool wb_enable_telemetry_fec = false;
 };
 
 WBLinkSettings create_default_wb_stream_settings(
     const OHDPlatform& platform,
     const std::vector<WiFiCard>& wifibroadcast_cards);
 
+// Keys missing in @param json (e.g. settings written by an older release) keep
+// their WBLinkSettings default value instead of discarding the whole file
+std::optional<WBLinkSettings> wb_link_settings_from_json(
+    const std::string& json);
+
 static bool validate_wb_rtl8812au_tx_pwr_idx_override(int value) {
   if (value >= 0 && value <= 63) return true;
   openhd::log::get_default()->warn(
@@ -189,6 +198,7 @@ static constexpr auto WB_MCS_INDEX_VIA_RC_CHANNEL = "MCS_VIA_RC";
 static constexpr auto WB_BW_VIA_RC_CHANNEL = "BW_VIA_RC";
 static constexpr auto WB_PASSIVE_MODE = "WB_PASSIVE_MODE";
 static constexpr auto WB_DEV_AIR_SET_HIGH_RETRANSMIT_COUNT = "DEV_HIGH_RETR";
+static constexpr auto WB_ENABLE_TELEMETRY_FEC = "WB_TELE_FEC";
 
 }  // namespace openhd
 
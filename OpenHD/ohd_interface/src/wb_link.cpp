@@ -6,8 +6,10 @@
 #include <utility>
 
 #include "openhd_bitrate_conversions.hpp"
+#include "openhd_buffer_pool.h"
 #include "openhd_config.h"
 #include "openhd_global_constants.hpp"
+#include "openhd_latency_trace.h"
 #include "openhd_platform.h"
 #include "openhd_reboot_util.h"
 #include "openhd_spdlog.h"
@@ -142,11 +144,21 @@ WBLink::WBLink(OHDProfile profile, OHDPlatform platform,
     const auto radio_port_tx =
         m_profile.is_air ? openhd::TELEMETRY_WIFIBROADCAST_TX_RADIO_PORT
                          : openhd::TELEMETRY_WIFIBROADCAST_RX_RADIO_PORT;
+    m_tele_fec_decoder = std::make_unique<openhd::telemetry_fec::Decoder>(
+        [this](const uint8_t* data, int data_len) {
+          auto shared =
+              openhd::FragmentBufferPool::instance().acquire(data, data_len);
+          on_receive_telemetry_data(std::move(shared));
+        });
     auto cb_rx = [this](const uint8_t* data, int data_len) {
       m_last_received_packet_ts_ms = OHDUtil::steady_clock_time_epoch_ms();
+      if (openhd::telemetry_fec::Decoder::is_fec_packet(data, data_len)) {
+        m_tele_fec_decoder->process_packet(data, data_len);
+        return;
+      }
       auto shared =
-          std::make_shared<std::vector<uint8_t>>(data, data + data_len);
-      on_receive_telemetry_data(shared);
+          openhd::FragmentBufferPool::instance().acquire(data, data_len);
+      on_receive_telemetry_data(std::move(shared));
     };
     WBStreamRx::Options options_tele_rx{};
     options_tele_rx.enable_fec = false;
@@ -166,6 +178,20 @@ WBLink::WBLink(OHDProfile profile, OHDPlatform platform,
     m_wb_tele_tx =
         std::make_unique<WBStreamTx>(m_wb_txrx, options_tele_tx, m_tx_header_1);
     m_wb_tele_tx->set_encryption(true);
+    // Each FEC packet is injected once
+    m_tele_fec_encoder = std::make_unique<openhd::telemetry_fec::Encoder>(
+        openhd::telemetry_fec::Config{},
+        [this](std::shared_ptr<std::vector<uint8_t>> packet) {
+          const auto n_dropped =
+              m_wb_tele_tx->enqueue_packet_dropping(std::move(packet), 1);
+          if (n_dropped > 0) {
+            m_console->debug("Telemetry queue jam, dropped {}", n_dropped);
+          }
+        });
+    if (m_settings->get_settings().wb_enable_telemetry_fec) {
+      m_tele_fec_encoder->start_tail_flush_thread();
+      m_tele_fec_enabled = true;
+    }
   }
   {
     // Video is unidirectional, aka always goes from air pi to ground pi
@@ -219,6 +245,7 @@ WBLink::WBLink(OHDProfile profile, OHDPlatform platform,
           // m_console->debug("Got {} {}
           // {}",block_idx,n_fragments_total,n_fragments_forwarded);
           last_block = block_idx;
+          on_receive_video_block_done(0);
           // m_console->debug("Got {} {}
           // {}",block_idx,n_fragments_total,n_fragments_forwarded);
           /*if(n_fragments_forwarded>2){
@@ -228,6 +255,11 @@ WBLink::WBLink(OHDProfile profile, OHDPlatform platform,
         };
         primary->set_on_fec_block_done_cb(block_cb);
       }
+      secondary->set_on_fec_block_done_cb(
+          [this](uint64_t block_idx, int n_fragments_total,
+                 int n_fragments_forwarded) {
+            on_receive_video_block_done(1);
+          });
       m_wb_video_rx_list.push_back(std::move(primary));
       m_wb_video_rx_list.push_back(std::move(secondary));
     }
@@ -302,8 +334,10 @@ WBLink::~WBLink() {
   m_wb_txrx->stop_receiving();
   // stop all the receiver/transmitter instances, after that, give card back to
   // network manager
+  m_tele_fec_encoder.reset();
   m_wb_tele_rx.reset();
   m_wb_tele_tx.reset();
+  m_tele_fec_decoder.reset();
   m_wb_video_tx_list.resize(0);
   m_wb_video_rx_list.resize(0);
   m_wb_txrx = nullptr;
@@ -477,6 +511,23 @@ bool WBLink::set_dev_air_set_high_retransmit_count(int value) {
   m_tx_header_1->update_set_flag_tx_no_ack(!value);
   return true;
 }
+bool WBLink::set_enable_telemetry_fec(int value) {
+  if (!openhd::validate_yes_or_no(value)) return false;
+  m_settings->unsafe_get_settings().wb_enable_telemetry_fec = value;
+  m_settings->persist();
+  // The tail flush thread only runs while FEC is enabled
+  if (value) {
+    m_tele_fec_encoder->start_tail_flush_thread();
+    m_tele_fec_enabled = true;
+  } else {
+    m_tele_fec_enabled = false;
+    m_tele_fec_encoder->stop_tail_flush_thread();
+    // Parity for the packets of the last (open) block
+    m_tele_fec_encoder->flush_if_expired(
+        std::chrono::steady_clock::time_point::max());
+  }
+  return true;
+}
 bool WBLink::request_start_scan_channels(
     openhd::LinkActionHandler::ScanChannelsParam scan_channels_params) {
   auto work_item = std::make_shared<WorkItem>(
@@ -575,9 +626,6 @@ std::vector<openhd::Setting> WBLink::get_all_settings() {
   auto change_freq = openhd::IntSetting{
       (int)settings.wb_frequency,
       [this](std::string, int value) { return request_set_frequency(value); }};
-  change_freq.get_callback = [this]() {
-    return m_settings->unsafe_get_settings().wb_frequency;
-  };
   ret.push_back(Setting{WB_FREQUENCY, change_freq});
   if (m_profile.is_air) {
     // MCS is only changeable on air
@@ -591,9 +639,6 @@ std::vector<openhd::Setting> WBLink::get_all_settings() {
         (int)settings.wb_air_tx_channel_width, [this](std::string, int value) {
           return request_set_air_tx_channel_width(value);
         }};
-    change_wb_channel_width.get_callback = [this]() {
-      return m_settings->unsafe_get_settings().wb_air_tx_channel_width;
-    };
     ret.push_back(Setting{WB_CHANNEL_WIDTH, change_wb_channel_width});
     auto cb_change_video_fec_percentage = [this](std::string, int value) {
       return set_air_video_fec_percentage(value);
@@ -684,6 +729,13 @@ std::vector<openhd::Setting> WBLink::get_all_settings() {
                 openhd::IntSetting{(int)settings.wb_enable_listen_only_mode,
                                    cb_passive}});
   }
+  auto cb_enable_telemetry_fec = [this](std::string, int value) {
+    return set_enable_telemetry_fec(value);
+  };
+  ret.push_back(
+      Setting{WB_ENABLE_TELEMETRY_FEC,
+              openhd::IntSetting{(int)settings.wb_enable_telemetry_fec,
+                                 cb_enable_telemetry_fec}});
   const bool any_card_supports_stbc_ldpc_sgi =
       openhd::wb::any_card_supports_stbc_ldpc_sgi(m_broadcast_cards);
   // These 3 are only supported / known to work on rtl8812au (yet), therefore
@@ -1004,8 +1056,19 @@ void WBLink::wt_update_statistics() {
     card_stats.card_type = wifi_card_type_to_int(card.type);
     // m_console->debug("Signal quality {}",card_stats.signal_quality);
   }
+  {
+    const auto pool_stats = openhd::FragmentBufferPool::instance().get_stats();
+    stats.buffer_pool.count_hit = pool_stats.count_hit;
+    stats.buffer_pool.count_miss = pool_stats.count_miss;
+    stats.buffer_pool.count_oversize = pool_stats.count_oversize;
+    stats.buffer_pool.n_buffers = pool_stats.n_buffers;
+    // m_console->debug("{}",pool_stats.to_string());
+  }
   stats.is_air = m_profile.is_air;
   stats.ready = true;
+  // Local dump of the per-stage video latency
+  openhd::latency::LatencyTracer::instance().log_and_reset_if_elapsed(
+      std::chrono::seconds(10));
   openhd::LinkActionHandler::instance().update_link_stats(stats);
   if (m_profile.is_ground()) {
     if (rxStats.likely_mismatching_encryption_key) {
@@ -1137,6 +1200,14 @@ bool WBLink::try_schedule_work_item(
 void WBLink::transmit_telemetry_data(TelemetryTxPacket packet) {
   assert(packet.n_injections >= 1);
   // m_console->debug("N injections:{}",packet.n_injections);
+  if (m_tele_fec_enabled &&
+      m_tele_fec_encoder->uses_fec(packet.n_injections)) {
+    // The n of injections selects the priority class (amount of parity)
+    m_tele_fec_encoder->add_packet(packet.data->data(),
+                                   (int)packet.data->size(),
+                                   packet.n_injections);
+    return;
+  }
   const auto n_dropped =
       m_wb_tele_tx->enqueue_packet_dropping(packet.data, packet.n_injections);
   if (n_dropped > 0) {
@@ -1144,6 +1215,10 @@ void WBLink::transmit_telemetry_data(TelemetryTxPacket packet) {
   }
 }
 
+int WBLink::get_telemetry_tx_queue_depth() {
+  return m_wb_tele_tx->get_tx_queue_available_size_approximate();
+}
+
 void WBLink::transmit_video_data(
     int stream_index,
     const openhd::FragmentedVideoFrame& fragmented_video_frame) {
@@ -1198,6 +1273,8 @@ void WBLink::transmit_video_data(
       }
     }
   }
+  openhd::latency::record_since(openhd::latency::Stage::AIR_LINK_ENQUEUE,
+                                fragmented_video_frame.creation_time);
   if (n_dropped_frames != 0) {
     m_frame_drop_helper.notify_dropped_frame(n_dropped_frames);
     if (stream_index == 0) {
@@ -1240,9 +1317,10 @@ void WBLink::perform_channel_scan(
   //  We only scan 40Mhz, this way we get both 20Mhz and 40Mhz air unit(s)
   const std::vector<uint16_t> channel_widths_to_scan = {40};
 
-  auto stats_current = openhd::LinkActionHandler::instance().get_link_stats();
-  stats_current.gnd_operating_mode.operating_mode = 1;
-  openhd::LinkActionHandler::instance().update_link_stats(stats_current);
+  openhd::LinkActionHandler::instance().link_stats().modify(
+      [](openhd::link_statistics::StatsAirGround& stats) {
+        stats.gnd_operating_mode.operating_mode = 1;
+      });
 
   struct ScanResult {
     bool success = false;
@@ -1350,6 +1428,8 @@ void WBLink::perform_channel_scan(
                      result.channel_width);
     m_settings->unsafe_get_settings().wb_frequency = result.frequency;
     m_settings->persist();
+    openhd::ParamChangedHelper::instance().notify_int_param_changed(
+        openhd::WB_FREQUENCY, (int)result.frequency);
     m_gnd_curr_rx_channel_width = result.channel_width;
     apply_frequency_and_channel_width_from_settings();
   }
@@ -1370,9 +1450,10 @@ void WBLink::perform_channel_analyze(int channels_to_scan) {
   const WiFiCard& card = m_broadcast_cards.at(0);
   const auto channels_to_analyze =
       openhd::wb::get_analyze_channels_frequencies(card, channels_to_scan);
-  auto stats_current = openhd::LinkActionHandler::instance().get_link_stats();
-  stats_current.gnd_operating_mode.operating_mode = 2;
-  openhd::LinkActionHandler::instance().update_link_stats(stats_current);
+  openhd::LinkActionHandler::instance().link_stats().modify(
+      [](openhd::link_statistics::StatsAirGround& stats) {
+        stats.gnd_operating_mode.operating_mode = 2;
+      });
   std::vector<AnalyzeResult> results{};
   for (int i = 0; i < channels_to_analyze.size(); i++) {
     const auto channel = channels_to_analyze[i];
@@ -1464,6 +1545,8 @@ void WBLink::wt_perform_bw_via_rc_channel_if_enabled() {
                      settings.wb_air_tx_channel_width, rc_bw);
     m_settings->unsafe_get_settings().wb_air_tx_channel_width = rc_bw;
     m_settings->persist();
+    openhd::ParamChangedHelper::instance().notify_int_param_changed(
+        openhd::WB_CHANNEL_WIDTH, rc_bw);
     m_request_apply_air_bw = true;
   }
 }
@@ -1498,6 +1581,8 @@ void WBLink::wt_gnd_perform_channel_management() {
         m_gnd_curr_rx_channel_width = air_reported_channel_width;
         m_settings->unsafe_get_settings().wb_frequency = air_reported_frequency;
         m_settings->persist(false);
+        openhd::ParamChangedHelper::instance().notify_int_param_changed(
+            openhd::WB_FREQUENCY, air_reported_frequency);
         apply_frequency_and_channel_width(air_reported_frequency,
                                           air_reported_channel_width, 20);
       }
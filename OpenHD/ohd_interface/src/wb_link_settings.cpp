@@ -7,7 +7,7 @@
 
 namespace openhd {
 
-NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE_WITH_DEFAULT(
     WBLinkSettings, wb_frequency, wb_air_tx_channel_width, wb_air_mcs_index,
     wb_enable_stbc, wb_enable_ldpc, wb_enable_short_guard,
     wb_tx_power_milli_watt, wb_tx_power_milli_watt_armed,
@@ -15,11 +15,16 @@ NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(
     wb_video_fec_percentage, wb_video_rate_for_mcs_adjustment_percent,
     wb_max_fec_block_size, wb_mcs_index_via_rc_channel, wb_bw_via_rc_channel,
     enable_wb_video_variable_bitrate, wb_enable_listen_only_mode,
-    wb_dev_air_set_high_retransmit_count);
+    wb_dev_air_set_high_retransmit_count, wb_enable_telemetry_fec);
+
+std::optional<WBLinkSettings> wb_link_settings_from_json(
+    const std::string &json) {
+  return openhd_json_parse<WBLinkSettings>(json);
+}
 
 std::optional<WBLinkSettings> openhd::WBLinkSettingsHolder::impl_deserialize(
     const std::string &file_as_string) const {
-  return openhd_json_parse<WBLinkSettings>(file_as_string);
+  return wb_link_settings_from_json(file_as_string);
 }
 
 std::string WBLinkSettingsHolder::imp_serialize(
@@ -0,0 +1,53 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#include <iostream>
+
+#include "openhd_test_util.h"
+#include "wb_link_settings.h"
+
+using openhd::test::check;
+
+// Written by a release before wb_enable_telemetry_fec was added
+static constexpr auto OLD_FORMAT = R"({
+    "enable_wb_video_variable_bitrate": false,
+    "wb_air_mcs_index": 2,
+    "wb_air_tx_channel_width": 40,
+    "wb_bw_via_rc_channel": 0,
+    "wb_dev_air_set_high_retransmit_count": false,
+    "wb_enable_ldpc": false,
+    "wb_enable_listen_only_mode": false,
+    "wb_enable_short_guard": false,
+    "wb_enable_stbc": 0,
+    "wb_frequency": 5745,
+    "wb_max_fec_block_size": -1,
+    "wb_mcs_index_via_rc_channel": 0,
+    "wb_rtl8812au_tx_pwr_idx_override": 22,
+    "wb_rtl8812au_tx_pwr_idx_override_armed": 0,
+    "wb_tx_power_milli_watt": 25,
+    "wb_tx_power_milli_watt_armed": 0,
+    "wb_video_fec_percentage": 30,
+    "wb_video_rate_for_mcs_adjustment_percent": 100
+})";
+
+int main(int argc, char *argv[]) {
+  const auto settings = openhd::wb_link_settings_from_json(OLD_FORMAT);
+  check(settings.has_value(), "old settings file rejected");
+  // What the user configured is kept ...
+  check(settings->wb_frequency == 5745, "wb_frequency");
+  check(settings->wb_air_mcs_index == 2, "wb_air_mcs_index");
+  check(settings->wb_air_tx_channel_width == 40, "wb_air_tx_channel_width");
+  check(settings->wb_rtl8812au_tx_pwr_idx_override == 22,
+        "wb_rtl8812au_tx_pwr_idx_override");
+  check(settings->wb_video_fec_percentage == 30, "wb_video_fec_percentage");
+  check(!settings->enable_wb_video_variable_bitrate,
+        "enable_wb_video_variable_bitrate");
+  // ... and what the file doesn't know about yet uses the default
+  check(!settings->wb_enable_telemetry_fec, "wb_enable_telemetry_fec");
+  // Garbage is still rejected (-> create_default())
+  check(!openhd::wb_link_settings_from_json("{\"wb_frequency\":").has_value(),
+        "invalid json accepted");
+  std::cout << "test_wb_link_settings passed" << std::endl;
+  return 0;
+}
@@ -4,26 +4,45 @@
 
 #include "AirTelemetry.h"
 
+#include <algorithm>
 #include <chrono>
 
 #include "mav_helper.h"
 #include "mavsdk_temporary/XMavlinkParamProvider.h"
+#include "openhd_config.h"
 #include "openhd_temporary_air_or_ground.h"
 #include "openhd_util.h"
 
-AirTelemetry::AirTelemetry(OHDPlatform platform)
-    : m_platform(platform), MavlinkSystem(OHD_SYS_ID_AIR) {
+AirTelemetry::AirTelemetry(OHDPlatform platform,
+                           std::shared_ptr<openhd::EventLoop> event_loop,
+                           bool enableExtendedLogging)
+    : m_platform(platform),
+      MavlinkSystem(OHD_SYS_ID_AIR),
+      m_event_loop(std::move(event_loop)),
+      m_enable_extended_logging(enableExtendedLogging) {
   m_console = openhd::log::create_or_get("air_tele");
   assert(m_console);
   m_air_settings =
       std::make_unique<openhd::telemetry::air::SettingsHolder>(platform);
-  m_fc_serial = std::make_unique<SerialEndpointManager>();
+  m_fc_serial = std::make_unique<SerialEndpointManager>(m_event_loop);
+  update_fc_rates();
+  if (openhd::load_config().GEN_ENABLE_TELEMETRY_RECORDER) {
+    m_recorder = TelemetryRecorder::create(
+        TelemetryRecorder::Config{TelemetryRecorder::DEFAULT_DIRECTORY, "air",
+                                  8, 4 * 1024 * 1024,
+                                  {"fc", "ground", "tcp", "local"}});
+    if (!m_recorder) m_console->warn("Cannot create telemetry recorder");
+  }
   m_ohd_main_component =
       std::make_shared<OHDMainComponent>(m_platform, _sys_id, true);
-  m_components.push_back(m_ohd_main_component);
+  m_ohd_main_component->set_stats_filter_config(
+      m_air_settings->get_stats_filter_config());
+  m_components.add_component(m_ohd_main_component);
   //
   m_generic_mavlink_param_provider = std::make_shared<XMavlinkParamProvider>(
       _sys_id, MAV_COMP_ID_ONBOARD_COMPUTER);
+  m_generic_mavlink_param_provider->set_tx_budget_bytes_per_second(
+      PARAM_PROVIDER_TX_BUDGET_BYTES_PER_SECOND);
   if (m_platform.is_rpi()) {
     m_opt_gpio_control =
         std::make_unique<openhd::telemetry::rpi::GPIOControl>();
@@ -31,62 +50,108 @@ AirTelemetry::AirTelemetry(OHDPlatform platform)
   // NOTE: We don't call set ready yet, since we have to wait until other
   // modules have provided all their paramters.
   m_generic_mavlink_param_provider->add_params(get_all_settings());
-  m_components.push_back(m_generic_mavlink_param_provider);
+  m_components.add_component(m_generic_mavlink_param_provider);
+  m_ftp_server = std::make_shared<MavlinkFTPServer>(
+      _sys_id, MAV_COMP_ID_ONBOARD_COMPUTER,
+      std::vector<MavlinkFTPServer::Root>{
+          {"recordings", "/home/openhd/Videos/"},
+          {"telemetry", TelemetryRecorder::DEFAULT_DIRECTORY},
+          {"config", "/boot/openhd/"},
+          {"settings", openhd::SETTINGS_BASE_PATH}});
+  m_ftp_server->set_tx_budget_bytes_per_second(
+      m_air_settings->get_settings().ftp_max_kbytes_per_second * 1024);
+  m_components.add_component(m_ftp_server);
   m_tcp_server = std::make_unique<TCPEndpoint>(
-      openhd::TCPServer::Config{TCPEndpoint::DEFAULT_PORT});  // 1445
+      openhd::TCPServer::Config{TCPEndpoint::DEFAULT_PORT},
+      m_event_loop);  // 1445
   if (m_tcp_server) {
     m_tcp_server->registerCallback(
-        [this](std::vector<MavlinkMessage> messages) {
+        [this](MavlinkMessageSpan messages) {
           // Technically not correct, but works
-          on_messages_ground_unit(messages);
+          on_messages_ground_unit(messages, LINK_TCP);
         });
   }
   setup_uart();
+  // send messages to the ground pi in regular intervals, includes heartbeat.
+  // everything else is handled by the callbacks
+  m_generate_messages_timer = m_event_loop->add_timer(
+      std::chrono::milliseconds(100), [this] { on_generate_messages_timer(); });
+  m_log_timer = m_event_loop->add_timer(std::chrono::seconds(5),
+                                        [this] { on_log_timer(); });
   m_console->debug("Created AirTelemetry");
 }
 
-AirTelemetry::~AirTelemetry() {}
+AirTelemetry::~AirTelemetry() {
+  m_event_loop->remove_timer(m_generate_messages_timer);
+  m_event_loop->remove_timer(m_log_timer);
+  // Before the members they use are gone
+  m_fc_serial->disable();
+  m_event_loop->run_sync([this] { m_wb_endpoint = nullptr; });
+}
 
-void AirTelemetry::send_messages_fc(std::vector<MavlinkMessage>& messages) {
+void AirTelemetry::send_messages_fc(MavlinkMessageSpan messages,
+                                    const MavlinkRoutingTable::LinkId source) {
   auto [generic, local_only] =
       split_into_generic_and_local_only(messages, OHD_SYS_ID_AIR);
   // NOTE: Remember there is a hack in place for rc channels override in regards
   // to the sender sys id
-  m_fc_serial->send_messages_if_enabled(generic);
+  std::vector<MavlinkMessage> storage;
+  const auto messages_fc = m_routing.filter(generic, source, LINK_FC, storage);
+  record(LINK_FC, TelemetryRecorder::Direction::TX, messages_fc);
+  m_fc_serial->send_messages_if_enabled(messages_fc);
+}
+
+static bool is_param_value(const MavlinkMessage& msg) {
+  const auto msg_id = msg.m.msgid;
+  return msg_id == MAVLINK_MSG_ID_PARAM_EXT_VALUE ||
+         msg_id == MAVLINK_MSG_ID_PARAM_VALUE;
 }
 
 void AirTelemetry::send_messages_ground_unit(
-    std::vector<MavlinkMessage>& messages) {
+    MavlinkMessageSpan messages, const MavlinkRoutingTable::LinkId source) {
+  std::vector<MavlinkMessage> storage;
+  if (m_tcp_server) {
+    // Not technically correct, but works
+    const auto messages_tcp =
+        m_routing.filter(messages, source, LINK_TCP, storage);
+    record(LINK_TCP, TelemetryRecorder::Direction::TX, messages_tcp);
+    m_tcp_server->sendMessages(messages_tcp);
+  }
+  messages = m_routing.filter(messages, source, LINK_GROUND, storage);
   if (m_wb_endpoint) {
+    record(LINK_GROUND, TelemetryRecorder::Direction::TX, messages);
     // Optimization: Increase reliability of responding to mavlink (extended)
-    // parameter set responses
-    for (auto& msg : messages) {
-      const auto msg_id = msg.m.msgid;
-      if (msg_id == MAVLINK_MSG_ID_PARAM_EXT_VALUE ||
-          msg_id == MAVLINK_MSG_ID_PARAM_VALUE) {
-        msg.recommended_n_injections = 2;
+    // parameter set responses. Messages are not owned by us, copy only if we
+    // need to change them (rare).
+    if (std::any_of(messages.begin(), messages.end(), is_param_value)) {
+      std::vector<MavlinkMessage> copy(messages.begin(), messages.end());
+      for (auto& msg : copy) {
+        if (is_param_value(msg)) msg.recommended_n_injections = 2;
       }
+      m_wb_endpoint->sendMessages(copy);
+    } else {
+      m_wb_endpoint->sendMessages(messages);
     }
-    m_wb_endpoint->sendMessages(messages);
-  }
-  // Not technically correct, but works
-  if (m_tcp_server) {
-    m_tcp_server->sendMessages(messages);
   }
 }
 
-void AirTelemetry::on_messages_fc(std::vector<MavlinkMessage>& messages) {
+void AirTelemetry::on_messages_fc(MavlinkMessageSpan messages) {
   // openhd::log::get_default()->debug("on_messages_fc {}",messages.size());
   // debugMavlinkMessage(message.m,"AirTelemetry::onMessageFC");
   //  Note: No OpenHD component ever talks to the FC, FC is completely passed
   //  through
   // debugMavlinkMessages(messages,"FC");
-  send_messages_ground_unit(messages);
+  m_routing.learn(LINK_FC, messages);
+  record(LINK_FC, TelemetryRecorder::Direction::RX, messages);
+  m_fc_rate_negotiator.on_fc_messages(messages);
+  send_messages_ground_unit(m_fc_rate_coalescer.process(messages), LINK_FC);
   m_ohd_main_component->check_fc_messages_for_actions(messages);
 }
 
 void AirTelemetry::on_messages_ground_unit(
-    std::vector<MavlinkMessage>& messages) {
+    MavlinkMessageSpan messages, const MavlinkRoutingTable::LinkId source) {
+  m_routing.learn(source, messages);
+  record(source, TelemetryRecorder::Direction::RX, messages);
   // openhd::log::get_default()->debug("on_messages_ground_unit
   // {}",messages.size());
   //  filter out heartbeats from the openhd ground unit,we do not need to send
@@ -99,55 +164,93 @@ void AirTelemetry::on_messages_ground_unit(
       continue;
     filtered_messages_fc.push_back(msg);
   }
-  send_messages_fc(filtered_messages_fc);
+  send_messages_fc(filtered_messages_fc, source);
   // any data created by an OpenHD component on the air pi only needs to be sent
   // to the ground pi, the FC cannot do anything with it anyways.
   std::lock_guard<std::mutex> guard(m_components_lock);
-  for (auto& component : m_components) {
-    std::vector<MavlinkMessage> responses{};
-    OHDUtil::vec_append(responses,
-                        component->process_mavlink_messages(messages));
-    send_messages_ground_unit(responses);
+  const auto responses = m_components.dispatch(messages);
+  send_messages_ground_unit(responses, LINK_LOCAL);
+}
+
+void AirTelemetry::on_generate_messages_timer() {
+  // Latest value of FC message(s) that were held back and not replaced
+  const auto held_back = m_fc_rate_coalescer.flush();
+  send_messages_ground_unit(held_back, LINK_FC);
+  negotiate_fc_rates();
+  // NOTE: No component on the air unit ever needs to talk to the FC himself
+  std::lock_guard<std::mutex> guard(m_components_lock);
+  for (auto& component : m_components.get_components()) {
+    auto messages = component->generate_mavlink_messages();
+    m_routing.learn(LINK_LOCAL, messages);
+    record(LINK_LOCAL, TelemetryRecorder::Direction::RX, messages);
+    send_messages_ground_unit(messages, LINK_LOCAL);
   }
 }
 
-void AirTelemetry::loop_infinite(bool& terminate,
-                                 const bool enableExtendedLogging) {
-  const auto log_intervall = std::chrono::seconds(5);
-  const auto loop_intervall = std::chrono::milliseconds(100);
-  auto last_log = std::chrono::steady_clock::now();
-  while (!terminate) {
-    const auto loopBegin = std::chrono::steady_clock::now();
-    if (std::chrono::steady_clock::now() - last_log >= log_intervall) {
-      // State debug logging
-      last_log = std::chrono::steady_clock::now();
-      // m_console->debug("AirTelemetry::loopInfinite()");
-      //  for debugging, check if any of the endpoints is not alive
-      if (enableExtendedLogging && m_wb_endpoint) {
-        m_console->debug(m_wb_endpoint->createInfo());
-      }
-    }
-    // send messages to the ground pi in regular intervals, includes heartbeat.
-    // everything else is handled by the callbacks and their threads
-    {
-      // NOTE: No component on the air unit ever needs to talk to the FC himself
-      std::lock_guard<std::mutex> guard(m_components_lock);
-      for (auto& component : m_components) {
-        auto messages = component->generate_mavlink_messages();
-        send_messages_ground_unit(messages);
-      }
+void AirTelemetry::update_fc_rates() {
+  const auto profile = m_air_settings->get_fc_max_rates();
+  m_fc_rate_negotiator.set_profile(profile);
+  m_fc_rate_negotiator.set_enabled(
+      m_air_settings->get_settings().fc_rate_negotiate);
+  m_fc_rate_coalescer.set_max_rates(profile);
+  // Re-applied by negotiate_fc_rates() if the link is degraded
+  m_fc_rate_scale_percent = 100;
+}
+
+void AirTelemetry::negotiate_fc_rates() {
+  FCStreamRateNegotiator::LinkCondition condition{};
+  if (m_wb_endpoint) {
+    const auto tx_stats = m_wb_endpoint->get_tx_scheduler_stats();
+    for (const auto& class_stats : tx_stats.classes) {
+      condition.n_tx_dropped +=
+          class_stats.n_dropped_stale + class_stats.n_dropped_overflow;
     }
-    const auto loopDelta = std::chrono::steady_clock::now() - loopBegin;
-    if (loopDelta > loop_intervall) {
-      // We can't keep up with the wanted loop interval
-      m_console->debug(
-          "Warning AirTelemetry cannot keep up with the wanted loop interval. "
-          "Took {}",
-          OHDUtil::time_readable(loopDelta));
-    } else {
-      const auto sleepTime = loop_intervall - loopDelta;
-      // send out in X second intervals
-      std::this_thread::sleep_for(loop_intervall);
+  }
+  const auto link_stats =
+      openhd::LinkActionHandler::instance().link_stats().read_ref();
+  if (link_stats->ready) {
+    condition.link_rate_kbits =
+        static_cast<int>(link_stats->monitor_mode_link.curr_rate_kbits);
+    condition.n_rate_adjustments =
+        link_stats->monitor_mode_link.curr_n_rate_adjustments;
+  }
+  const auto messages = m_fc_rate_negotiator.update(condition);
+  if (!messages.empty()) send_messages_fc(messages, LINK_LOCAL);
+  if (!m_air_settings->get_settings().fc_rate_negotiate) return;
+  const int scale_percent = m_fc_rate_negotiator.get_scale_percent();
+  if (scale_percent != m_fc_rate_scale_percent) {
+    // Also hold back whatever the FC (or a GCS request) still sends faster
+    m_fc_rate_scale_percent = scale_percent;
+    m_fc_rate_coalescer.set_max_rates(m_fc_rate_negotiator.get_target_rates());
+  }
+}
+
+void AirTelemetry::record(const MavlinkRoutingTable::LinkId link,
+                          const TelemetryRecorder::Direction direction,
+                          MavlinkMessageSpan messages) {
+  if (m_recorder && !messages.empty()) {
+    m_recorder->record(link, direction, messages);
+  }
+}
+
+void AirTelemetry::on_log_timer() {
+  // State debug logging
+  //  for debugging, check if any of the endpoints is not alive
+  if (m_enable_extended_logging && m_wb_endpoint) {
+    m_console->debug(m_wb_endpoint->createInfo());
+    m_console->debug("FC rate coalescer: {}",
+                     MavlinkRateCoalescer::stats_as_string(
+                         m_fc_rate_coalescer.get_stats()));
+    m_console->debug(m_fc_rate_negotiator.to_string());
+    m_console->debug(m_ftp_server->get_stats().to_string());
+    m_console->debug(
+        m_ohd_main_component->get_stats_filter_stats().to_string());
+    m_console->debug("Event loop: {}",
+                     m_event_loop->get_stats().to_string());
+    m_console->debug(m_fc_serial->create_info());
+    m_console->debug(m_routing.to_string());
+    if (m_recorder) {
+      m_console->debug(m_recorder->get_stats().to_string());
     }
   }
 }
@@ -158,6 +261,18 @@ std::string AirTelemetry::create_debug() {
   if (m_wb_endpoint) {
     ss << m_wb_endpoint->createInfo();
   }
+  ss << "FC rate coalescer: "
+     << MavlinkRateCoalescer::stats_as_string(m_fc_rate_coalescer.get_stats())
+     << "\n";
+  ss << m_fc_rate_negotiator.to_string() << "\n";
+  ss << m_ftp_server->get_stats().to_string() << "\n";
+  ss << m_ohd_main_component->get_stats_filter_stats().to_string() << "\n";
+  ss << "Event loop: " << m_event_loop->get_stats().to_string() << "\n";
+  ss << m_fc_serial->create_info();
+  ss << m_routing.to_string() << "\n";
+  if (m_recorder) {
+    ss << m_recorder->get_stats().to_string() << "\n";
+  }
   return ss.str();
 }
 
@@ -178,10 +293,12 @@ void AirTelemetry::add_settings_camera_component(
   const auto cam_comp_id = MAV_COMP_ID_CAMERA + camera_index;
   auto param_server = std::make_shared<XMavlinkParamProvider>(
       _sys_id, cam_comp_id, std::chrono::seconds(1));
+  param_server->set_tx_budget_bytes_per_second(
+      PARAM_PROVIDER_TX_BUDGET_BYTES_PER_SECOND);
   param_server->add_params(settings);
   param_server->set_ready();
   std::lock_guard<std::mutex> guard(m_components_lock);
-  m_components.push_back(param_server);
+  m_components.add_component(param_server);
   m_console->debug("Added camera component");
 }
 
@@ -220,6 +337,29 @@ std::vector<openhd::Setting> AirTelemetry::get_all_settings() {
     m_air_settings->persist(false);
     return true;
   };
+  // All FC max rate params work the same way
+  auto fc_rate_setting = [this](const std::string& id,
+                                int air::Settings::*field) {
+    auto cb = [this, field](std::string, int value) {
+      if (value < 0) return false;
+      m_air_settings->unsafe_get_settings().*field = value;
+      m_air_settings->persist(false);
+      update_fc_rates();
+      return true;
+    };
+    return openhd::Setting{
+        id, openhd::IntSetting{m_air_settings->get_settings().*field, cb}};
+  };
+  auto c_fc_rate_custom = [this](std::string, std::string value) {
+    if (!MavlinkRateCoalescer::parse_max_rates(value).has_value()) {
+      m_console->warn("Invalid {}: {}", air::FC_RATE_CUSTOM, value);
+      return false;
+    }
+    m_air_settings->unsafe_get_settings().fc_rate_custom = value;
+    m_air_settings->persist(false);
+    update_fc_rates();
+    return true;
+  };
   ret.push_back(openhd::Setting{
       air::FC_UART_CONNECTION_TYPE,
       openhd::StringSetting{
@@ -240,6 +380,89 @@ std::vector<openhd::Setting> AirTelemetry::get_all_settings() {
       openhd::IntSetting{
           static_cast<int>(m_air_settings->get_settings().fc_battery_n_cells),
           c_fc_battery_n_cells}});
+  ret.push_back(
+      fc_rate_setting(air::FC_RATE_ATTITUDE, &air::Settings::fc_rate_attitude));
+  ret.push_back(fc_rate_setting(air::FC_RATE_ATTITUDE_QUATERNION,
+                                &air::Settings::fc_rate_attitude_quaternion));
+  ret.push_back(fc_rate_setting(air::FC_RATE_GLOBAL_POSITION,
+                                &air::Settings::fc_rate_global_position));
+  ret.push_back(fc_rate_setting(air::FC_RATE_LOCAL_POSITION,
+                                &air::Settings::fc_rate_local_position));
+  ret.push_back(
+      fc_rate_setting(air::FC_RATE_VFR_HUD, &air::Settings::fc_rate_vfr_hud));
+  ret.push_back(fc_rate_setting(air::FC_RATE_RC_CHANNELS,
+                                &air::Settings::fc_rate_rc_channels));
+  ret.push_back(fc_rate_setting(air::FC_RATE_SERVO_OUTPUT,
+                                &air::Settings::fc_rate_servo_output));
+  ret.push_back(openhd::Setting{
+      air::FC_RATE_CUSTOM,
+      openhd::StringSetting{m_air_settings->get_settings().fc_rate_custom,
+                            c_fc_rate_custom}});
+  auto c_fc_rate_negotiate = [this](std::string, int value) {
+    if (!openhd::validate_yes_or_no(value)) return false;
+    m_air_settings->unsafe_get_settings().fc_rate_negotiate = value;
+    m_air_settings->persist(false);
+    update_fc_rates();
+    return true;
+  };
+  ret.push_back(openhd::Setting{
+      air::FC_RATE_NEGOTIATE,
+      openhd::IntSetting{
+          static_cast<int>(m_air_settings->get_settings().fc_rate_negotiate),
+          c_fc_rate_negotiate}});
+  auto c_tele_aggregation_window_ms = [this](std::string, int value) {
+    if (value < 0 || value > 50) return false;
+    m_air_settings->unsafe_get_settings().tele_aggregation_window_ms = value;
+    m_air_settings->persist(false);
+    if (m_wb_endpoint) {
+      m_wb_endpoint->set_aggregation_window(std::chrono::milliseconds(value));
+    }
+    return true;
+  };
+  ret.push_back(openhd::Setting{
+      air::TELE_AGGREGATION_WINDOW_MS,
+      openhd::IntSetting{
+          m_air_settings->get_settings().tele_aggregation_window_ms,
+          c_tele_aggregation_window_ms}});
+  auto c_ftp_max_kbytes_per_second = [this](std::string, int value) {
+    if (value < 1 || value > 1024) return false;
+    m_air_settings->unsafe_get_settings().ftp_max_kbytes_per_second = value;
+    m_air_settings->persist(false);
+    m_ftp_server->set_tx_budget_bytes_per_second(value * 1024);
+    return true;
+  };
+  ret.push_back(openhd::Setting{
+      air::FTP_MAX_KBYTES_PER_SECOND,
+      openhd::IntSetting{
+          m_air_settings->get_settings().ftp_max_kbytes_per_second,
+          c_ftp_max_kbytes_per_second}});
+  auto c_stats_keep_alive_ms = [this](std::string, int value) {
+    if (value < 0 || value > 10000) return false;
+    m_air_settings->unsafe_get_settings().stats_keep_alive_ms = value;
+    m_air_settings->persist(false);
+    m_ohd_main_component->set_stats_filter_config(
+        m_air_settings->get_stats_filter_config());
+    return true;
+  };
+  ret.push_back(openhd::Setting{
+      air::STATS_KEEP_ALIVE_MS,
+      openhd::IntSetting{m_air_settings->get_settings().stats_keep_alive_ms,
+                         c_stats_keep_alive_ms}});
+  auto c_stats_thresholds = [this](std::string, std::string value) {
+    if (!StatsChangeFilter::parse_thresholds(value).has_value()) {
+      m_console->warn("Invalid {}: {}", air::STATS_THRESHOLDS, value);
+      return false;
+    }
+    m_air_settings->unsafe_get_settings().stats_thresholds = value;
+    m_air_settings->persist(false);
+    m_ohd_main_component->set_stats_filter_config(
+        m_air_settings->get_stats_filter_config());
+    return true;
+  };
+  ret.push_back(openhd::Setting{
+      air::STATS_THRESHOLDS,
+      openhd::StringSetting{m_air_settings->get_settings().stats_thresholds,
+                            c_stats_thresholds}});
   // and this allows an advanced user to change its air unit to a ground unit
   // only expose this setting if OpenHD uses the file workaround to figure out
   // air or ground.
@@ -271,7 +494,7 @@ void AirTelemetry::setup_uart() {
     options.flow_control = m_air_settings->get_settings().fc_uart_flow_control;
     options.enable_reading = true;
     m_fc_serial->configure(options, "fc_ser",
-                           [this](std::vector<MavlinkMessage> messages) {
+                           [this](MavlinkMessageSpan messages) {
                              this->on_messages_fc(messages);
                            });
   } else {
@@ -280,8 +503,13 @@ void AirTelemetry::setup_uart() {
 }
 
 void AirTelemetry::set_link_handle(std::shared_ptr<OHDLink> link) {
-  m_wb_endpoint = std::make_unique<WBEndpoint>(link, "wb_tx");
-  m_wb_endpoint->registerCallback([this](std::vector<MavlinkMessage> messages) {
-    on_messages_ground_unit(messages);
+  auto wb_endpoint = std::make_unique<WBEndpoint>(link, "wb_tx", m_event_loop);
+  wb_endpoint->set_aggregation_window(std::chrono::milliseconds(
+      m_air_settings->get_settings().tele_aggregation_window_ms));
+  wb_endpoint->registerCallback([this](MavlinkMessageSpan messages) {
+    on_messages_ground_unit(messages, LINK_GROUND);
   });
+  // The loop thread uses it
+  m_event_loop->run_sync(
+      [this, &wb_endpoint] { m_wb_endpoint = std::move(wb_endpoint); });
 }
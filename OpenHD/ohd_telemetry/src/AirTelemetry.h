@@ -5,6 +5,7 @@
 #ifndef OPENHD_TELEMETRY_AIRTELEMETRY_H
 #define OPENHD_TELEMETRY_AIRTELEMETRY_H
 
+#include <atomic>
 #include <string>
 
 #include "endpoints/SerialEndpoint.h"
@@ -17,27 +18,34 @@
 #include "AirTelemetrySettings.h"
 #include "endpoints/TCPEndpoint.h"
 #include "endpoints/WBEndpoint.h"
+#include "ftp/MavlinkFTPServer.h"
 #include "gpio_control/RaspberryPiGPIOControl.h"
 #include "mavsdk_temporary/XMavlinkParamProvider.h"
 #include "openhd_action_handler.h"
+#include "openhd_event_loop.h"
 #include "openhd_link.hpp"
 #include "openhd_spdlog.h"
+#include "recorder/TelemetryRecorder.h"
+#include "routing/FCStreamRateNegotiator.h"
+#include "routing/MavlinkComponentDispatcher.h"
+#include "routing/MavlinkRateCoalescer.h"
+#include "routing/MavlinkRoutingTable.h"
 
 /**
  * OpenHD Air telemetry. Assumes a Ground instance running on the ground pi.
+ * Endpoints and periodic work (e.g. heartbeats) run on the given event loop.
  */
 class AirTelemetry : public MavlinkSystem {
  public:
-  explicit AirTelemetry(OHDPlatform platform);
-  AirTelemetry(const AirTelemetry&) = delete;
-  AirTelemetry(const AirTelemetry&&) = delete;
-  ~AirTelemetry();
   /**
-   * Telemetry will run infinite in its own threads until terminate is set to
-   * true
    * @param enableExtendedLogging be really verbose on logging.
    */
-  void loop_infinite(bool& terminate, bool enableExtendedLogging = false);
+  explicit AirTelemetry(OHDPlatform platform,
+                        std::shared_ptr<openhd::EventLoop> event_loop,
+                        bool enableExtendedLogging = false);
+  AirTelemetry(const AirTelemetry&) = delete;
+  AirTelemetry(const AirTelemetry&&) = delete;
+  ~AirTelemetry();
   /**
    * @return verbose string about the current state, for debugging
    */
@@ -68,31 +76,72 @@ class AirTelemetry : public MavlinkSystem {
   void set_link_handle(std::shared_ptr<OHDLink> link);
 
  private:
-  // send a mavlink message to the flight controller connected to the air unit
-  // via UART, if connected.
-  void send_messages_fc(std::vector<MavlinkMessage>& messages);
-  // send mavlink messages to the ground unit, lossy
-  void send_messages_ground_unit(std::vector<MavlinkMessage>& messages);
+  // Links of the routing table
+  static constexpr MavlinkRoutingTable::LinkId LINK_FC = 0;
+  static constexpr MavlinkRoutingTable::LinkId LINK_GROUND = 1;
+  static constexpr MavlinkRoutingTable::LinkId LINK_TCP = 2;
+  // OpenHD components running on the air unit
+  static constexpr MavlinkRoutingTable::LinkId LINK_LOCAL = 3;
+  // send a mavlink message (that came in via the given link) to the flight
+  // controller connected to the air unit via UART, if connected.
+  void send_messages_fc(MavlinkMessageSpan messages,
+                        MavlinkRoutingTable::LinkId source);
+  // send mavlink messages (that came in via the given link) to the ground
+  // unit, lossy. Targeted messages only go where their target has been seen.
+  void send_messages_ground_unit(MavlinkMessageSpan messages,
+                                 MavlinkRoutingTable::LinkId source);
   // called every time one or more messages from the flight controller are
   // received
-  void on_messages_fc(std::vector<MavlinkMessage>& messages);
-  // called every time one or more messages from the ground unit are received
-  void on_messages_ground_unit(std::vector<MavlinkMessage>& messages);
+  void on_messages_fc(MavlinkMessageSpan messages);
+  // called every time one or more messages from the ground unit (or a TCP
+  // client) are received
+  void on_messages_ground_unit(MavlinkMessageSpan messages,
+                               MavlinkRoutingTable::LinkId source);
+  // Add the given messages to the flight recorder, if enabled
+  void record(MavlinkRoutingTable::LinkId link,
+              TelemetryRecorder::Direction direction,
+              MavlinkMessageSpan messages);
   // R.N only on air, and only FC uart settings
   std::vector<openhd::Setting> get_all_settings();
   void setup_uart();
+  // Called by the event loop in regular intervals
+  void on_generate_messages_timer();
+  void on_log_timer();
+  // Profile changed / negotiation enabled or disabled
+  void update_fc_rates();
+  // Rates the FC streams with, scaled to what the link can carry
+  void negotiate_fc_rates();
 
  private:
   const OHDPlatform m_platform;
+  const std::shared_ptr<openhd::EventLoop> m_event_loop;
+  const bool m_enable_extended_logging;
+  openhd::EventLoop::TimerId m_generate_messages_timer = -1;
+  openhd::EventLoop::TimerId m_log_timer = -1;
   std::unique_ptr<openhd::telemetry::air::SettingsHolder> m_air_settings;
   std::unique_ptr<SerialEndpointManager> m_fc_serial;
+  // Downsamples high-rate FC messages before they are sent to the ground
+  MavlinkRateCoalescer m_fc_rate_coalescer;
+  FCStreamRateNegotiator m_fc_rate_negotiator{OHD_SYS_ID_AIR,
+                                              MAV_COMP_ID_ONBOARD_COMPUTER};
+  // Scale the coalescer max rates were last set for
+  std::atomic<int> m_fc_rate_scale_percent = 100;
+  MavlinkRoutingTable m_routing{{"fc", "ground", "tcp", "local"}};
+  // nullptr if disabled
+  std::unique_ptr<TelemetryRecorder> m_recorder;
   // send/receive data via wb
   std::unique_ptr<WBEndpoint> m_wb_endpoint;
   // shared because we also push it onto our components list
   std::shared_ptr<OHDMainComponent> m_ohd_main_component;
   std::mutex m_components_lock;
-  std::vector<std::shared_ptr<MavlinkComponent>> m_components;
+  MavlinkComponentDispatcher m_components;
   std::shared_ptr<XMavlinkParamProvider> m_generic_mavlink_param_provider;
+  // Recordings, logs and config files can be pulled via MAVLink FTP
+  std::shared_ptr<MavlinkFTPServer> m_ftp_server;
+  // Max rate each param provider sends with (e.g. on a param list request), to
+  // not starve the FC telemetry on the downlink (the wb telemetry tx queue is
+  // only 32 packets deep).
+  static constexpr int PARAM_PROVIDER_TX_BUDGET_BYTES_PER_SECOND = 16 * 1024;
   // rpi only, allow changing gpios via settings
   std::unique_ptr<openhd::telemetry::rpi::GPIOControl> m_opt_gpio_control =
       nullptr;
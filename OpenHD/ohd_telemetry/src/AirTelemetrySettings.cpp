@@ -4,16 +4,53 @@
 #include "AirTelemetrySettings.h"
 
 #include "include_json.hpp"
+#include "routing/MavlinkRateCoalescer.h"
 
 namespace openhd::telemetry::air {
 
-NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(Settings, fc_uart_connection_type,
-                                   fc_uart_baudrate, fc_uart_flow_control,
-                                   fc_battery_n_cells);
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE_WITH_DEFAULT(
+    Settings, fc_uart_connection_type, fc_uart_baudrate, fc_uart_flow_control,
+    fc_battery_n_cells, fc_rate_attitude, fc_rate_attitude_quaternion,
+    fc_rate_global_position, fc_rate_local_position, fc_rate_vfr_hud,
+    fc_rate_rc_channels, fc_rate_servo_output, fc_rate_custom,
+    fc_rate_negotiate, tele_aggregation_window_ms, ftp_max_kbytes_per_second,
+    stats_keep_alive_ms, stats_thresholds);
+
+std::map<uint32_t, int> SettingsHolder::get_fc_max_rates() {
+  const auto& settings = get_settings();
+  // Validated when set
+  auto ret = MavlinkRateCoalescer::parse_max_rates(settings.fc_rate_custom)
+                 .value_or(std::map<uint32_t, int>{});
+  ret[MAVLINK_MSG_ID_ATTITUDE] = settings.fc_rate_attitude;
+  ret[MAVLINK_MSG_ID_ATTITUDE_QUATERNION] =
+      settings.fc_rate_attitude_quaternion;
+  ret[MAVLINK_MSG_ID_GLOBAL_POSITION_INT] = settings.fc_rate_global_position;
+  ret[MAVLINK_MSG_ID_LOCAL_POSITION_NED] = settings.fc_rate_local_position;
+  ret[MAVLINK_MSG_ID_VFR_HUD] = settings.fc_rate_vfr_hud;
+  ret[MAVLINK_MSG_ID_RC_CHANNELS] = settings.fc_rate_rc_channels;
+  ret[MAVLINK_MSG_ID_SERVO_OUTPUT_RAW] = settings.fc_rate_servo_output;
+  return ret;
+}
+
+StatsChangeFilter::Config SettingsHolder::get_stats_filter_config() {
+  const auto& settings = get_settings();
+  StatsChangeFilter::Config ret;
+  ret.keep_alive_interval =
+      std::chrono::milliseconds(settings.stats_keep_alive_ms);
+  // Validated when set
+  ret.thresholds =
+      StatsChangeFilter::parse_thresholds(settings.stats_thresholds)
+          .value_or(std::map<std::string, int>{});
+  return ret;
+}
+
+std::optional<Settings> settings_from_json(const std::string &json) {
+  return openhd_json_parse<Settings>(json);
+}
 
 std::optional<Settings> SettingsHolder::impl_deserialize(
     const std::string &file_as_string) const {
-  return openhd_json_parse<Settings>(file_as_string);
+  return settings_from_json(file_as_string);
 }
 
 std::string SettingsHolder::imp_serialize(
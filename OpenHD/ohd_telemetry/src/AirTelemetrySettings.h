@@ -7,6 +7,7 @@
 
 #include <map>
 
+#include "internal/StatsChangeFilter.h"
 #include "openhd_platform.h"
 #include "openhd_settings_directories.hpp"
 #include "openhd_settings_persistent.h"
@@ -41,6 +42,30 @@ struct Settings {
   // DANG ardupilot why do we have to make this an extra param ...
   // 0 means not configured (do not use)
   int fc_battery_n_cells = 0;
+  // Max rate (Hz) the most common high-rate FC messages are forwarded to the
+  // ground with, 0 means no limit. Ground stations render at 10-20Hz anyways.
+  int fc_rate_attitude = 20;
+  int fc_rate_attitude_quaternion = 20;
+  int fc_rate_global_position = 20;
+  int fc_rate_local_position = 20;
+  int fc_rate_vfr_hud = 10;
+  int fc_rate_rc_channels = 10;
+  int fc_rate_servo_output = 10;
+  // Any other message(s), see MavlinkRateCoalescer::parse_max_rates
+  std::string fc_rate_custom;
+  // Tell the FC to stream the messages above with exactly these rates (instead
+  // of whatever its SRx params say), reduced while the link cannot carry them.
+  bool fc_rate_negotiate = false;
+  // Time window (ms) telemetry to the ground is aggregated over, to fill wb
+  // packets. 0 = disabled (send as soon as possible)
+  int tele_aggregation_window_ms = 5;
+  // Max rate (KiB/s) files are sent to the ground with via MAVLink FTP
+  int ftp_max_kbytes_per_second = 64;
+  // The OpenHD stats messages are only sent on change, but at least once per
+  // keep-alive interval (ms). 0 = disabled (always sent).
+  int stats_keep_alive_ms = 2000;
+  // Per field change thresholds, see StatsChangeFilter::parse_thresholds
+  std::string stats_thresholds;
 };
 
 // 16 chars limit !
@@ -48,6 +73,23 @@ static constexpr auto FC_UART_CONNECTION_TYPE = "FC_UART_CONN";
 static constexpr auto FC_UART_BAUD_RATE = "FC_UART_BAUD";
 static constexpr auto FC_UART_FLOW_CONTROL = "FC_UART_FLWCTL";
 static constexpr auto FC_BATT_N_CELLS = "FC_BATT_N_CELLS";
+static constexpr auto FC_RATE_ATTITUDE = "FC_RATE_ATT";
+static constexpr auto FC_RATE_ATTITUDE_QUATERNION = "FC_RATE_ATT_Q";
+static constexpr auto FC_RATE_GLOBAL_POSITION = "FC_RATE_GPOS";
+static constexpr auto FC_RATE_LOCAL_POSITION = "FC_RATE_LPOS";
+static constexpr auto FC_RATE_VFR_HUD = "FC_RATE_HUD";
+static constexpr auto FC_RATE_RC_CHANNELS = "FC_RATE_RC";
+static constexpr auto FC_RATE_SERVO_OUTPUT = "FC_RATE_SERVO";
+static constexpr auto FC_RATE_CUSTOM = "FC_RATE_CUSTOM";
+static constexpr auto FC_RATE_NEGOTIATE = "FC_RATE_NEG";
+static constexpr auto TELE_AGGREGATION_WINDOW_MS = "TELE_AGG_MS";
+static constexpr auto FTP_MAX_KBYTES_PER_SECOND = "FTP_MAX_KBYTES";
+static constexpr auto STATS_KEEP_ALIVE_MS = "STATS_KEEPALIVE";
+static constexpr auto STATS_THRESHOLDS = "STATS_THRESH";
+
+// Keys missing in @param json (e.g. settings written by an older release) keep
+// their Settings default value instead of discarding the whole file
+std::optional<Settings> settings_from_json(const std::string& json);
 
 class SettingsHolder : public openhd::PersistentSettings<Settings> {
  public:
@@ -60,6 +102,9 @@ class SettingsHolder : public openhd::PersistentSettings<Settings> {
   bool is_serial_enabled() {
     return !get_settings().fc_uart_connection_type.empty();
   }
+  // msg id -> max rate (Hz) for messages from the FC to the ground
+  std::map<uint32_t, int> get_fc_max_rates();
+  StatsChangeFilter::Config get_stats_filter_config();
 
  private:
   OHDPlatform m_platform;
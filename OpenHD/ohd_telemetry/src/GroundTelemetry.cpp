@@ -8,39 +8,52 @@
 #include <iostream>
 
 #include "mav_helper.h"
+#include "openhd_config.h"
 #include "openhd_temporary_air_or_ground.h"
 #include "openhd_util.h"
 
-GroundTelemetry::GroundTelemetry(OHDPlatform platform)
-    : _platform(platform), MavlinkSystem(OHD_SYS_ID_GROUND) {
+GroundTelemetry::GroundTelemetry(OHDPlatform platform,
+                                 std::shared_ptr<openhd::EventLoop> event_loop,
+                                 bool enableExtendedLogging)
+    : _platform(platform),
+      MavlinkSystem(OHD_SYS_ID_GROUND),
+      m_event_loop(std::move(event_loop)),
+      m_enable_extended_logging(enableExtendedLogging) {
   m_console = openhd::log::create_or_get("ground_tele");
   assert(m_console);
   m_gnd_settings =
       std::make_unique<openhd::telemetry::ground::SettingsHolder>();
-  m_endpoint_tracker = std::make_unique<SerialEndpointManager>();
+  if (openhd::load_config().GEN_ENABLE_TELEMETRY_RECORDER) {
+    m_recorder = TelemetryRecorder::create(TelemetryRecorder::Config{
+        TelemetryRecorder::DEFAULT_DIRECTORY, "ground", 8, 4 * 1024 * 1024,
+        {"air", "gcs_udp", "tcp", "local"}});
+    if (!m_recorder) m_console->warn("Cannot create telemetry recorder");
+  }
+  m_endpoint_tracker = std::make_unique<SerialEndpointManager>(m_event_loop);
   m_gcs_endpoint = std::make_unique<UDPEndpoint>(
       "GroundStationUDP", OHD_GROUND_CLIENT_UDP_PORT_OUT,
-      OHD_GROUND_CLIENT_UDP_PORT_IN,
+      OHD_GROUND_CLIENT_UDP_PORT_IN, m_event_loop,
       // We send data to localhost::14550 and any other external device IPs
       "127.0.0.1",
       // and we accept udp data from anybody on 14551
       "0.0.0.0");
   m_gcs_endpoint->registerCallback(
-      [this](std::vector<MavlinkMessage> messages) {
-        on_messages_ground_station_clients(messages);
+      [this](MavlinkMessageSpan messages) {
+        on_messages_ground_station_clients(messages, LINK_GCS_UDP);
       });
   m_tcp_server = std::make_unique<TCPEndpoint>(
-      openhd::TCPServer::Config{TCPEndpoint::DEFAULT_PORT});  // 1445
+      openhd::TCPServer::Config{TCPEndpoint::DEFAULT_PORT},
+      m_event_loop);  // 1445
   // m_tcp_server= nullptr;
   if (m_tcp_server) {
     m_tcp_server->registerCallback(
-        [this](std::vector<MavlinkMessage> messages) {
-          on_messages_ground_station_clients(messages);
+        [this](MavlinkMessageSpan messages) {
+          on_messages_ground_station_clients(messages, LINK_TCP);
         });
   }
   m_ohd_main_component =
       std::make_shared<OHDMainComponent>(_platform, _sys_id, false);
-  m_components.push_back(m_ohd_main_component);
+  m_components.add_component(m_ohd_main_component);
 #ifdef OPENHD_TELEMETRY_SDL_FOR_JOYSTICK_FOUND
   if (m_gnd_settings->get_settings().enable_rc_over_joystick) {
     enable_joystick();
@@ -56,7 +69,7 @@ GroundTelemetry::GroundTelemetry(OHDPlatform platform)
   m_generic_mavlink_param_provider = std::make_shared<XMavlinkParamProvider>(
       _sys_id, MAV_COMP_ID_ONBOARD_COMPUTER);
   m_generic_mavlink_param_provider->add_params(get_all_settings());
-  m_components.push_back(m_generic_mavlink_param_provider);
+  m_components.add_component(m_generic_mavlink_param_provider);
   setup_uart();
   openhd::ExternalDeviceManager::instance().register_listener(
       [this](openhd::ExternalDevice external_device, bool connected) {
@@ -68,12 +81,21 @@ GroundTelemetry::GroundTelemetry(OHDPlatform platform)
           }
         }
       });
+  // send messages to the ground station in regular intervals, includes
+  // heartbeat. everything else is handled by the callbacks
+  m_generate_messages_timer = m_event_loop->add_timer(
+      std::chrono::milliseconds(100), [this] { on_generate_messages_timer(); });
+  m_log_timer = m_event_loop->add_timer(std::chrono::seconds(5),
+                                        [this] { on_log_timer(); });
   m_console->debug("Created GroundTelemetry");
 }
 
 GroundTelemetry::~GroundTelemetry() {
-  // first, stop all the endpoints that have their own threads
-  m_wb_endpoint = nullptr;
+  m_event_loop->remove_timer(m_generate_messages_timer);
+  m_event_loop->remove_timer(m_log_timer);
+  // first, stop all the endpoints that receive data
+  m_endpoint_tracker->disable();
+  m_event_loop->run_sync([this] { m_wb_endpoint = nullptr; });
   m_gcs_endpoint = nullptr;
   if (m_gcs_endpoint) {
     m_gcs_endpoint = nullptr;
@@ -84,11 +106,13 @@ GroundTelemetry::~GroundTelemetry() {
 }
 
 void GroundTelemetry::on_messages_air_unit(
-    const std::vector<MavlinkMessage>& messages) {
+    MavlinkMessageSpan messages) {
   // All messages we get from the Air pi (they might come from the AirPi itself
-  // or the FC connected to the air pi) get forwarded straight to all the
-  // client(s) connected to the ground station.
-  send_messages_ground_station_clients(messages);
+  // or the FC connected to the air pi) get forwarded to the client(s)
+  // connected to the ground station (targeted ones only to their target).
+  m_routing.learn(LINK_AIR, messages);
+  record(LINK_AIR, TelemetryRecorder::Direction::RX, messages);
+  send_messages_ground_station_clients(messages, LINK_AIR);
   // Note: No OpenHD component ever talks to another OpenHD component or the FC,
   // so we do not need to do anything else here. tracker serial out - we are
   // only interested in message(s) coming from the FC
@@ -106,10 +130,13 @@ void GroundTelemetry::on_messages_air_unit(
 }
 
 void GroundTelemetry::on_messages_ground_station_clients(
-    const std::vector<MavlinkMessage>& messages) {
+    MavlinkMessageSpan messages, const MavlinkRoutingTable::LinkId source) {
   // debugMavlinkMessages(messages,"GSC");
   //  All messages from the ground station(s) are forwarded to the air unit,
-  //  unless they have a target sys id of the ohd ground unit itself
+  //  unless they have a target sys id of the ohd ground unit itself or of
+  //  another system that doesn't live behind the air unit.
+  m_routing.learn(source, messages);
+  record(source, TelemetryRecorder::Direction::RX, messages);
   auto [generic, local_only] =
       split_into_generic_and_local_only(messages, OHD_SYS_ID_GROUND);
   for (auto& msg_generic : generic) {
@@ -141,79 +168,80 @@ void GroundTelemetry::on_messages_ground_station_clients(
       msg_generic.recommended_n_injections = 4;
     }
   }
-  send_messages_air_unit(generic);
+  std::vector<MavlinkMessage> storage;
+  send_messages_air_unit(
+      m_routing.filter(generic, source, LINK_AIR, storage));
   // OpenHD components running on the ground station don't need to talk to the
   // air unit. This is not exactly following the mavlink routing standard, but
   // saves a lot of bandwidth.
   std::lock_guard<std::mutex> guard(m_components_lock);
-  for (auto& component : m_components) {
-    const auto responses = component->process_mavlink_messages(messages);
-    // for now, send to the ground station clients only
-    send_messages_ground_station_clients(responses);
-  }
+  const auto responses = m_components.dispatch(messages);
+  // for now, send to the ground station clients only
+  send_messages_ground_station_clients(responses, LINK_LOCAL);
 }
 
 void GroundTelemetry::send_messages_ground_station_clients(
-    const std::vector<MavlinkMessage>& messages) {
+    MavlinkMessageSpan messages, const MavlinkRoutingTable::LinkId source) {
+  std::vector<MavlinkMessage> storage;
   if (m_gcs_endpoint) {
-    m_gcs_endpoint->sendMessages(messages);
+    const auto messages_udp =
+        m_routing.filter(messages, source, LINK_GCS_UDP, storage);
+    record(LINK_GCS_UDP, TelemetryRecorder::Direction::TX, messages_udp);
+    m_gcs_endpoint->sendMessages(messages_udp);
   }
   if (m_tcp_server) {
-    m_tcp_server->sendMessages(messages);
+    const auto messages_tcp =
+        m_routing.filter(messages, source, LINK_TCP, storage);
+    record(LINK_TCP, TelemetryRecorder::Direction::TX, messages_tcp);
+    m_tcp_server->sendMessages(messages_tcp);
   }
 }
 
 void GroundTelemetry::send_messages_air_unit(
-    const std::vector<MavlinkMessage>& messages) {
+    MavlinkMessageSpan messages) {
   // transmit via wb / the abstract link we use for sending message(s) to the
   // air unit
   if (m_wb_endpoint) {
+    record(LINK_AIR, TelemetryRecorder::Direction::TX, messages);
     m_wb_endpoint->sendMessages(messages);
   }
 }
 
-void GroundTelemetry::loop_infinite(bool& terminate,
-                                    const bool enableExtendedLogging) {
-  const auto log_intervall = std::chrono::seconds(5);
-  const auto loop_intervall = std::chrono::milliseconds(100);
-  auto last_log = std::chrono::steady_clock::now();
-  while (!terminate) {
-    const auto loopBegin = std::chrono::steady_clock::now();
-    if (std::chrono::steady_clock::now() - last_log >= log_intervall) {
-      last_log = std::chrono::steady_clock::now();
-      // m_console->debug("GroundTelemetry::loopInfinite()");
-      //  for debugging, check if any of the endpoints is not alive
-      if (enableExtendedLogging && m_wb_endpoint) {
-        m_console->debug(m_wb_endpoint->createInfo());
-      }
-      if (enableExtendedLogging && m_gcs_endpoint) {
-        m_console->debug(m_gcs_endpoint->createInfo());
-      }
-    }
-    // send messages to the ground station in regular intervals, includes
-    // heartbeat. everything else is handled by the callbacks and their threads
-    {
-      // NOTE: No component from the ground station ever needs to talk to the
-      // air unit / FC itself
-      std::lock_guard<std::mutex> guard(m_components_lock);
-      for (auto& component : m_components) {
-        assert(component);
-        const auto messages = component->generate_mavlink_messages();
-        send_messages_ground_station_clients(messages);
-      }
-    }
-    const auto loopDelta = std::chrono::steady_clock::now() - loopBegin;
-    if (loopDelta > loop_intervall) {
-      // We can't keep up with the wanted loop interval
-      // We can't keep up with the wanted loop interval
-      m_console->debug(
-          "Warning GroundTelemetry cannot keep up with the wanted loop "
-          "interval. Took {}",
-          OHDUtil::time_readable(loopDelta));
-    } else {
-      const auto sleepTime = loop_intervall - loopDelta;
-      // send out in X second intervals
-      std::this_thread::sleep_for(loop_intervall);
+void GroundTelemetry::record(const MavlinkRoutingTable::LinkId link,
+                             const TelemetryRecorder::Direction direction,
+                             MavlinkMessageSpan messages) {
+  if (m_recorder && !messages.empty()) {
+    m_recorder->record(link, direction, messages);
+  }
+}
+
+void GroundTelemetry::on_generate_messages_timer() {
+  // NOTE: No component from the ground station ever needs to talk to the
+  // air unit / FC itself
+  std::lock_guard<std::mutex> guard(m_components_lock);
+  for (auto& component : m_components.get_components()) {
+    assert(component);
+    const auto messages = component->generate_mavlink_messages();
+    m_routing.learn(LINK_LOCAL, messages);
+    record(LINK_LOCAL, TelemetryRecorder::Direction::RX, messages);
+    send_messages_ground_station_clients(messages, LINK_LOCAL);
+  }
+}
+
+void GroundTelemetry::on_log_timer() {
+  //  for debugging, check if any of the endpoints is not alive
+  if (m_enable_extended_logging && m_wb_endpoint) {
+    m_console->debug(m_wb_endpoint->createInfo());
+  }
+  if (m_enable_extended_logging && m_gcs_endpoint) {
+    m_console->debug(m_gcs_endpoint->createInfo());
+  }
+  if (m_enable_extended_logging) {
+    m_console->debug("Event loop: {}",
+                     m_event_loop->get_stats().to_string());
+    m_console->debug(m_routing.to_string());
+    if (m_recorder) {
+      m_console->debug(m_recorder->get_stats().to_string());
     }
   }
 }
@@ -227,6 +255,11 @@ std::string GroundTelemetry::create_debug() const {
   if (m_gcs_endpoint) {
     ss << m_gcs_endpoint->createInfo();
   }
+  ss << "Event loop: " << m_event_loop->get_stats().to_string() << "\n";
+  ss << m_routing.to_string() << "\n";
+  if (m_recorder) {
+    ss << m_recorder->get_stats().to_string() << "\n";
+  }
   return ss.str();
 }
 
@@ -359,7 +392,7 @@ void GroundTelemetry::setup_uart() {
     options.flow_control = false;
     options.enable_reading = false;
     m_endpoint_tracker->configure(options, "gnd_ser",
-                                  [this](std::vector<MavlinkMessage> messages) {
+                                  [this](MavlinkMessageSpan messages) {
                                     // We ignore any incoming messages here for
                                     // now, since it is only for mavlink out via
                                     // serial
@@ -372,10 +405,13 @@ void GroundTelemetry::setup_uart() {
 void GroundTelemetry::set_link_handle(std::shared_ptr<OHDLink> link) {
   // only call this once, we do not support changing the link handle at run time
   assert(m_wb_endpoint == nullptr);
-  m_wb_endpoint = std::make_unique<WBEndpoint>(link, "wb_tx");
-  m_wb_endpoint->registerCallback([this](std::vector<MavlinkMessage> messages) {
+  auto wb_endpoint = std::make_unique<WBEndpoint>(link, "wb_tx", m_event_loop);
+  wb_endpoint->registerCallback([this](MavlinkMessageSpan messages) {
     on_messages_air_unit(messages);
   });
+  // The loop thread uses it
+  m_event_loop->run_sync(
+      [this, &wb_endpoint] { m_wb_endpoint = std::move(wb_endpoint); });
 }
 
 #ifdef OPENHD_TELEMETRY_SDL_FOR_JOYSTICK_FOUND
@@ -398,7 +434,7 @@ void GroundTelemetry::enable_joystick() {
     // to the GCS stations
     auto msg_for_gcs =
         rc_channels_override_from_array(OHD_SYS_ID_GROUND, 0, channels, 0, 0);
-    send_messages_ground_station_clients({msg_for_gcs});
+    send_messages_ground_station_clients({msg_for_gcs}, LINK_LOCAL);
   };
   auto mapping_parsed = openhd::convert_string_to_channel_mapping_or_default(
       m_gnd_settings->get_settings().rc_channel_mapping);
@@ -13,10 +13,14 @@
 #include "internal/OHDMainComponent.h"
 #include "mavsdk_temporary/XMavlinkParamProvider.h"
 #include "openhd_action_handler.h"
+#include "openhd_event_loop.h"
 #include "openhd_external_device.h"
 #include "openhd_link.hpp"
 #include "openhd_settings_imp.h"
 #include "openhd_spdlog.h"
+#include "recorder/TelemetryRecorder.h"
+#include "routing/MavlinkComponentDispatcher.h"
+#include "routing/MavlinkRoutingTable.h"
 
 #ifdef OPENHD_TELEMETRY_SDL_FOR_JOYSTICK_FOUND
 #include "rc/JoystickReader.h"
@@ -25,19 +29,19 @@
 
 /**
  * OpenHD Ground telemetry. Assumes a air instance running on the air pi.
+ * Endpoints and periodic work (e.g. heartbeats) run on the given event loop.
  */
 class GroundTelemetry : public MavlinkSystem {
  public:
-  explicit GroundTelemetry(OHDPlatform platform);
-  GroundTelemetry(const GroundTelemetry&) = delete;
-  GroundTelemetry(const GroundTelemetry&&) = delete;
-  ~GroundTelemetry();
   /**
-   * Telemetry will run infinite in its own threads until terminate is set to
-   * true
    * @param enableExtendedLogging be really verbose on logging.
    */
-  void loop_infinite(bool& terminate, bool enableExtendedLogging = false);
+  explicit GroundTelemetry(OHDPlatform platform,
+                           std::shared_ptr<openhd::EventLoop> event_loop,
+                           bool enableExtendedLogging = false);
+  GroundTelemetry(const GroundTelemetry&) = delete;
+  GroundTelemetry(const GroundTelemetry&&) = delete;
+  ~GroundTelemetry();
   /**
    * @return verbose string about the current state, for debugging
    */
@@ -67,26 +71,46 @@ class GroundTelemetry : public MavlinkSystem {
  private:
   const OHDPlatform _platform;
   // called every time one or more messages from the air unit are received
-  void on_messages_air_unit(const std::vector<MavlinkMessage>& messages);
+  void on_messages_air_unit(MavlinkMessageSpan messages);
   // send messages to the air unit, lossy
-  void send_messages_air_unit(const std::vector<MavlinkMessage>& messages);
+  void send_messages_air_unit(MavlinkMessageSpan messages);
+  // Links of the routing table
+  static constexpr MavlinkRoutingTable::LinkId LINK_AIR = 0;
+  static constexpr MavlinkRoutingTable::LinkId LINK_GCS_UDP = 1;
+  static constexpr MavlinkRoutingTable::LinkId LINK_TCP = 2;
+  // OpenHD components running on the ground unit
+  static constexpr MavlinkRoutingTable::LinkId LINK_LOCAL = 3;
   // called every time one or more messages are received from any of the clients
-  // connected to the Ground Station (For Example QOpenHD)
-  void on_messages_ground_station_clients(
-      const std::vector<MavlinkMessage>& messages);
-  // send one or more messages to all clients connected to the ground station,
-  // for example QOpenHD
+  // connected to the Ground Station (For Example QOpenHD) via the given link
+  void on_messages_ground_station_clients(MavlinkMessageSpan messages,
+                                          MavlinkRoutingTable::LinkId source);
+  // send one or more messages (that came in via the given link) to the
+  // clients connected to the ground station, for example QOpenHD. Targeted
+  // messages only go to the endpoint their target has been seen on.
   void send_messages_ground_station_clients(
-      const std::vector<MavlinkMessage>& messages);
+      MavlinkMessageSpan messages, MavlinkRoutingTable::LinkId source);
+  // Add the given messages to the flight recorder, if enabled
+  void record(MavlinkRoutingTable::LinkId link,
+              TelemetryRecorder::Direction direction,
+              MavlinkMessageSpan messages);
   std::vector<openhd::Setting> get_all_settings();
   void setup_uart();
+  // Called by the event loop in regular intervals
+  void on_generate_messages_timer();
+  void on_log_timer();
 #ifdef OPENHD_TELEMETRY_SDL_FOR_JOYSTICK_FOUND
   void enable_joystick();
   void disable_joystick();
 #endif  // OPENHD_TELEMETRY_SDL_FOR_JOYSTICK_FOUND
  private:
   std::shared_ptr<spdlog::logger> m_console;
+  const std::shared_ptr<openhd::EventLoop> m_event_loop;
+  const bool m_enable_extended_logging;
+  openhd::EventLoop::TimerId m_generate_messages_timer = -1;
+  openhd::EventLoop::TimerId m_log_timer = -1;
   std::unique_ptr<openhd::telemetry::ground::SettingsHolder> m_gnd_settings;
+  // nullptr if disabled
+  std::unique_ptr<TelemetryRecorder> m_recorder;
   // Mavlink to / from gcs station(s)
   std::unique_ptr<UDPEndpoint> m_gcs_endpoint = nullptr;
   // mavlink out via serial for tracker or similar
@@ -97,7 +121,8 @@ class GroundTelemetry : public MavlinkSystem {
   std::unique_ptr<WBEndpoint> m_wb_endpoint;
   std::shared_ptr<OHDMainComponent> m_ohd_main_component;
   std::mutex m_components_lock;
-  std::vector<std::shared_ptr<MavlinkComponent>> m_components;
+  MavlinkComponentDispatcher m_components;
+  MavlinkRoutingTable m_routing{{"air", "gcs_udp", "tcp", "local"}};
   std::shared_ptr<XMavlinkParamProvider> m_generic_mavlink_param_provider;
   //
 #ifdef OPENHD_TELEMETRY_SDL_FOR_JOYSTICK_FOUND
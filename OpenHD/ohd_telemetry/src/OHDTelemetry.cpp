@@ -6,34 +6,31 @@
 
 #include "AirTelemetry.h"
 #include "GroundTelemetry.h"
+#include "openhd_config.h"
 
 OHDTelemetry::OHDTelemetry(OHDPlatform platform1, OHDProfile profile1,
                            bool enableExtendedLogging)
     : m_platform(platform1),
       m_profile(std::move(profile1)),
       m_enableExtendedLogging(enableExtendedLogging) {
+  m_event_loop = std::make_shared<openhd::EventLoop>("tele_loop");
   if (this->m_profile.is_air) {
-    m_air_telemetry = std::make_unique<AirTelemetry>(m_platform);
+    m_air_telemetry = std::make_unique<AirTelemetry>(
+        m_platform, m_event_loop, m_enableExtendedLogging);
     assert(m_air_telemetry);
-    m_loop_thread = std::make_unique<std::thread>([this] {
-      assert(m_air_telemetry);
-      m_air_telemetry->loop_infinite(m_loop_thread_terminate,
-                                     this->m_enableExtendedLogging);
-    });
   } else {
-    m_ground_telemetry = std::make_unique<GroundTelemetry>(m_platform);
+    m_ground_telemetry = std::make_unique<GroundTelemetry>(
+        m_platform, m_event_loop, m_enableExtendedLogging);
     assert(m_ground_telemetry);
-    m_loop_thread = std::make_unique<std::thread>([this] {
-      assert(m_ground_telemetry);
-      m_ground_telemetry->loop_infinite(m_loop_thread_terminate,
-                                        this->m_enableExtendedLogging);
-    });
   }
+  m_event_loop->start(openhd::load_config().GEN_TELEMETRY_CPU_CORE);
 }
 
 OHDTelemetry::~OHDTelemetry() {
-  m_loop_thread_terminate = true;
-  m_loop_thread->join();
+  // They remove their fds / timers from the (still running) loop
+  m_air_telemetry = nullptr;
+  m_ground_telemetry = nullptr;
+  m_event_loop->stop();
 }
 
 std::string OHDTelemetry::createDebug() const {
@@ -10,6 +10,7 @@
 #include <utility>
 
 #include "openhd_action_handler.h"
+#include "openhd_event_loop.h"
 #include "openhd_external_device.h"
 #include "openhd_link.hpp"
 #include "openhd_link_statistics.hpp"
@@ -58,15 +59,14 @@ class OHDTelemetry {
   void set_link_handle(std::shared_ptr<OHDLink> link);
 
  private:
+  // All telemetry I/O (except the TCP server) and the periodic work runs on
+  // this single thread
+  std::shared_ptr<openhd::EventLoop> m_event_loop;
   // only either one of them both is active at a time.
   // active when air
   std::unique_ptr<AirTelemetry> m_air_telemetry;
   // active when ground
   std::unique_ptr<GroundTelemetry> m_ground_telemetry;
-  // Main telemetry thread. Note that the endpoints also might have their own
-  // Receive threads
-  std::unique_ptr<std::thread> m_loop_thread;
-  bool m_loop_thread_terminate = false;
   const OHDPlatform m_platform;
   const OHDProfile m_profile;
   const bool m_enableExtendedLogging;
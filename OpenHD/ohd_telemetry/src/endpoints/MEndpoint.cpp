@@ -9,14 +9,12 @@
 
 MEndpoint::MEndpoint(std::string tag, bool debug_mavlink_msg_packet_loss)
     : TAG(std::move(tag)),
-      m_mavlink_channel(checkoutFreeChannel()),
       m_debug_mavlink_msg_packet_loss(debug_mavlink_msg_packet_loss) {
-  openhd::log::get_default()->debug(
-      "{} using channel:{} debug_mavlink_msg_packet_los:{}", TAG,
-      m_mavlink_channel, m_debug_mavlink_msg_packet_loss);
+  openhd::log::get_default()->debug("{} debug_mavlink_msg_packet_los:{}", TAG,
+                                    m_debug_mavlink_msg_packet_loss);
 }
 
-void MEndpoint::sendMessages(const std::vector<MavlinkMessage>& messages) {
+void MEndpoint::sendMessages(MavlinkMessageSpan messages) {
   if (messages.empty()) return;
   m_tx_n_bytes += get_size(messages);
   /*for(const auto& msg: messages){
@@ -57,31 +55,24 @@ std::string MEndpoint::createInfo() const {
 }
 
 void MEndpoint::parseNewData(const uint8_t* data, const int data_len) {
+  parseNewData(m_parser, data, data_len);
+}
+
+void MEndpoint::parseNewData(MavlinkFrameParser& parser, const uint8_t* data,
+                             const int data_len) {
   //<<TAG<<" received data:"<<data_len<<"
   //"<<MavlinkHelpers::raw_content(data,data_len)<<"\n";
   m_rx_n_bytes += data_len;
-  std::vector<MavlinkMessage> messages;
-  mavlink_message_t msg;
-  for (int i = 0; i < data_len; i++) {
-    uint8_t res = mavlink_parse_char(m_mavlink_channel, (uint8_t)data[i], &msg,
-                                     &receiveMavlinkStatus);
-    if (res) {
-      messages.push_back(MavlinkMessage{msg});
-      // From
-      // https://github.com/mavlink/c_uart_interface_example/blob/master/serial_port.cpp
-      if ((m_last_status.packet_rx_drop_count !=
-           receiveMavlinkStatus.packet_rx_drop_count) &&
-          m_debug_mavlink_msg_packet_loss) {
-        openhd::log::get_default()->warn(
-            "DROPPED {} PACKETS", receiveMavlinkStatus.packet_rx_drop_count);
-      }
-      m_last_status = receiveMavlinkStatus;
-    }
+  const auto last_n_bad_frames = parser.get_stats().n_bad_frames;
+  const auto messages = parser.parse(data, data_len);
+  const auto n_bad_frames = parser.get_stats().n_bad_frames;
+  if (n_bad_frames != last_n_bad_frames && m_debug_mavlink_msg_packet_loss) {
+    openhd::log::get_default()->warn("DROPPED {} PACKETS", n_bad_frames);
   }
   onNewMavlinkMessages(messages);
 }
 
-void MEndpoint::onNewMavlinkMessages(std::vector<MavlinkMessage> messages) {
+void MEndpoint::onNewMavlinkMessages(MavlinkMessageSpan messages) {
   if (messages.empty()) return;
   // openhd::log::create_or_get(TAG)->debug("N messages
   // receive:{}",messages.size());
@@ -94,12 +85,3 @@ void MEndpoint::onNewMavlinkMessages(std::vector<MavlinkMessage> messages) {
         "No callback set,did you forget to add it ?");
   }
 }
-
-int MEndpoint::checkoutFreeChannel() {
-  static std::mutex _channels_used_mutex;
-  static int channel_idx = 0;
-  std::lock_guard<std::mutex> lock(_channels_used_mutex);
-  int ret = channel_idx;
-  channel_idx++;
-  return ret;
-}
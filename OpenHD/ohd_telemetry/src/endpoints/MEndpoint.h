@@ -14,6 +14,7 @@
 
 #include "../mav_helper.h"
 #include "../mav_include.h"
+#include "../mav_parser.h"
 #include "openhd_spdlog.h"
 
 // Mavlink Endpoint
@@ -38,7 +39,6 @@ class MEndpoint {
    * connection as soon as possible And re-establish the connection when
    * disconnected.
    * @param tag a tag for debugging.
-   * @param mavlink_channel the mavlink channel to use for parsing.
    */
   explicit MEndpoint(std::string tag,
                      bool debug_mavlink_msg_packet_loss = false);
@@ -49,7 +49,7 @@ class MEndpoint {
    * virtual) and increases the sent message count
    * @param messages the messages to send
    */
-  void sendMessages(const std::vector<MavlinkMessage>& messages);
+  void sendMessages(MavlinkMessageSpan messages);
   /**
    * register a callback that is called every time
    * this endpoint has received a new message
@@ -65,41 +65,42 @@ class MEndpoint {
   /**
    * @return info about this endpoint, for debugging
    */
-  [[nodiscard]] std::string createInfo() const;
+  [[nodiscard]] virtual std::string createInfo() const;
   // can be public since immutable
   const std::string TAG;
 
  protected:
   // parse new data as it comes in, extract mavlink messages and forward them on
   // the registered callback (if it has been registered)
+  // Not thread-safe (must be called by one thread at a time)
   void parseNewData(const uint8_t* data, int data_len);
+  // Same, but for endpoints that receive multiple independent streams (e.g. one
+  // per TCP client) - each stream needs its own parser, otherwise partial
+  // frames of different streams are mixed up.
+  void parseNewData(MavlinkFrameParser& parser, const uint8_t* data,
+                    int data_len);
   // this one is special, since mavsdk in this case has already done the message
   // parsing
   void parseNewDataEmulateForMavsdk(mavlink_message_t msg) {
-    onNewMavlinkMessages({MavlinkMessage{msg}});
+    const MavlinkMessage message{msg};
+    onNewMavlinkMessages(MavlinkMessageSpan(&message, 1));
   }
   // Must be overridden by the implementation
   // Returns true if the message(s) have been properly sent (e.g. a connection
   // exists on connection-based endpoints) false otherwise
-  virtual bool sendMessagesImpl(
-      const std::vector<MavlinkMessage>& messages) = 0;
+  virtual bool sendMessagesImpl(MavlinkMessageSpan messages) = 0;
 
  private:
   MAV_MSG_CALLBACK m_callback = nullptr;
   // increases message count and forwards the messages via the callback if
   // registered.
-  void onNewMavlinkMessages(std::vector<MavlinkMessage> messages);
-  mavlink_status_t receiveMavlinkStatus{};
-  const uint8_t m_mavlink_channel;
+  void onNewMavlinkMessages(MavlinkMessageSpan messages);
+  MavlinkFrameParser m_parser;
   std::chrono::steady_clock::time_point lastMessage{};
   int m_n_messages_received = 0;
   // sendMessage() might be called by different threads.
   std::atomic<int> m_n_messages_sent = 0;
   std::atomic<int> m_n_messages_send_failed = 0;
-  // I think mavlink channels are static, so each endpoint should use his own
-  // channel. Based on mavsdk::mavlink_channels It is not clear what the limit
-  // of the number of channels is, except UINT8_MAX.
-  static int checkoutFreeChannel();
 
  private:
   // Used to measure incoming / outgoing bits per second
@@ -108,7 +109,6 @@ class MEndpoint {
 
  private:
   const bool m_debug_mavlink_msg_packet_loss;
-  mavlink_status_t m_last_status;
 };
 
 #endif  // XMAVLINKSERVICE_MENDPOINT_H
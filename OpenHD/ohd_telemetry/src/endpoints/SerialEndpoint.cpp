@@ -6,14 +6,17 @@
 
 #include <fcntl.h>
 #include <poll.h>
+#include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <termios.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cassert>
 #include <map>
 #include <utility>
 
+#include "TelemetryTxScheduler.h"
 #include "openhd_util_filesystem.h"
 
 static std::string GET_ERROR() { return {strerror(errno)}; }
@@ -45,11 +48,27 @@ static bool is_serial_fd_still_connected(const int fd) {
   return true;
 }
 
+// 8N1 - 10 bits per byte
+static int bytes_per_second(const int baud_rate) { return baud_rate / 10; }
+
 SerialEndpoint::SerialEndpoint(std::string TAG1,
-                               SerialEndpoint::HWOptions options1)
-    : MEndpoint(std::move(TAG1)), m_options(std::move(options1)) {
+                               SerialEndpoint::HWOptions options1,
+                               std::shared_ptr<openhd::EventLoop> event_loop)
+    : MEndpoint(std::move(TAG1)),
+      m_options(std::move(options1)),
+      m_event_loop(std::move(event_loop)),
+      m_tx_kernel_queue_target(std::max(
+          TX_MIN_KERNEL_QUEUE_BYTES,
+          (int)(bytes_per_second(m_options.baud_rate) *
+                TX_KERNEL_QUEUE_TARGET.count() / 1000))) {
   m_console = openhd::log::create_or_get(TAG);
   assert(m_console);
+  // ~500ms of data at the baud rate - everything older is stale anyways
+  SerialTxQueue::Config tx_queue_config{};
+  tx_queue_config.capacity_bytes = std::clamp(
+      bytes_per_second(m_options.baud_rate) / 2, 2048, 16 * 1024);
+  tx_queue_config.drop_policy = m_options.tx_drop_policy;
+  m_tx_queue = std::make_unique<SerialTxQueue>(tx_queue_config);
   // m_limited_rate_logger=std::make_unique<openhd::log::LimitedRateLogger>(m_console,std::chrono::milliseconds(1000));
   m_console->info("created with {}", m_options.to_string());
   start();
@@ -57,20 +76,7 @@ SerialEndpoint::SerialEndpoint(std::string TAG1,
 
 SerialEndpoint::~SerialEndpoint() { stop(); }
 
-bool SerialEndpoint::sendMessagesImpl(
-    const std::vector<MavlinkMessage>& messages) {
-  auto message_buffers = aggregate_pack_messages(messages);
-  bool success = true;
-  for (const auto& message_buffer : message_buffers) {
-    if (!write_data_serial(*message_buffer.aggregated_data)) {
-      success = false;
-    }
-  }
-  return success;
-}
-
-bool SerialEndpoint::write_data_serial(const std::vector<uint8_t>& data) {
-  // m_console->debug("Write data serial:{} bytes",data.size());
+bool SerialEndpoint::sendMessagesImpl(MavlinkMessageSpan messages) {
   if (m_fd == -1) {
     // cannot send data at the time, UART not setup / doesn't exist. Limit
     // message to once per second
@@ -82,34 +88,119 @@ bool SerialEndpoint::write_data_serial(const std::vector<uint8_t>& data) {
     }
     return false;
   }
-  const auto before = std::chrono::steady_clock::now();
-  // If we have a fd, but the write fails, most likely the UART disconnected
-  // but the linux driver hasn't noticed it yet.
-  const auto send_len = static_cast<int>(write(m_fd, data.data(), data.size()));
-  const auto send_delta = std::chrono::steady_clock::now() - before;
-  if (send_delta > std::chrono::milliseconds(100)) {
-    const auto send_delta_ms =
-        static_cast<float>(
-            std::chrono::duration_cast<std::chrono::microseconds>(send_delta)
-                .count()) /
-        1000.0f;
-    m_console->warn("UART sending data took {}ms", send_delta_ms);
-  }
-  // m_console->debug("Written {} bytes",send_len);
-  // m_console->debug("{}",MEndpoint::get_tx_rx_stats());
-  if (send_len != data.size()) {
-    m_n_failed_writes++;
-    const auto elapsed_since_last_log =
-        std::chrono::steady_clock::now() - m_last_log_serial_write_failed;
-    if (elapsed_since_last_log >
-        MIN_DELAY_BETWEEN_SERIAL_WRITE_FAILED_LOG_MESSAGES) {
-      m_console->warn("wrote {} instead of {} bytes,n failed:{}", send_len,
-                      data.size(), m_n_failed_writes);
-      m_last_log_serial_write_failed = std::chrono::steady_clock::now();
+  bool success = true;
+  std::array<uint8_t, MAVLINK_MAX_PACKET_LEN> buff{};
+  for (const auto& msg : messages) {
+    const int len = msg.pack_into(buff.data());
+    const bool high_priority =
+        TelemetryTxScheduler::classify(msg.m.msgid) <=
+        TelemetryTxScheduler::Priority::COMMAND;
+    if (!m_tx_queue->enqueue(buff.data(), len, high_priority)) {
+      success = false;
     }
-    return false;
   }
-  return true;
+  // The loop writes everything queued until then, one flush is enough
+  if (!m_tx_flush_posted.exchange(true)) {
+    m_event_loop->post([this] { flush_tx(); });
+  }
+  return success;
+}
+
+void SerialEndpoint::flush_tx() {
+  m_tx_flush_posted = false;
+  if (m_fd == -1) return;
+  while (true) {
+    if (m_tx_pending_offset >= m_tx_pending.size()) {
+      m_tx_pending.clear();
+      m_tx_pending_offset = 0;
+      const int budget = get_tx_budget();
+      if (budget == 0) {
+        // The UART is busy, continue once it has sent some data
+        set_tx_pacing_timer(!m_tx_queue->is_empty());
+        return;
+      }
+      // Coalesce as many messages as we are allowed to write into one write()
+      const uint32_t max_bytes = budget < 0 ? TX_MAX_WRITE_BYTES : budget;
+      if (m_tx_queue->dequeue(m_tx_pending, max_bytes) == 0) {
+        set_tx_pacing_timer(false);
+        return;
+      }
+    }
+    const ssize_t ret =
+        write(m_fd, m_tx_pending.data() + m_tx_pending_offset,
+              m_tx_pending.size() - m_tx_pending_offset);
+    if (ret < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        set_want_writable(true);
+        return;
+      }
+      // If we have a fd, but the write fails, most likely the UART
+      // disconnected but the linux driver hasn't noticed it yet.
+      m_n_failed_writes++;
+      const auto elapsed_since_last_log =
+          std::chrono::steady_clock::now() - m_last_log_serial_write_failed;
+      if (elapsed_since_last_log >
+          MIN_DELAY_BETWEEN_SERIAL_WRITE_FAILED_LOG_MESSAGES) {
+        m_console->warn("write failed {},n failed:{}", GET_ERROR(),
+                        m_n_failed_writes);
+        m_last_log_serial_write_failed = std::chrono::steady_clock::now();
+      }
+      m_tx_pending.clear();
+      m_tx_pending_offset = 0;
+      return;
+    }
+    m_tx_pending_offset += ret;
+    m_tx_n_writes++;
+    m_tx_n_bytes += ret;
+  }
+}
+
+int SerialEndpoint::get_tx_budget() {
+  int n_queued = 0;
+  if (ioctl(m_fd, TIOCOUTQ, &n_queued) != 0) {
+    return -1;
+  }
+  return std::max(0, m_tx_kernel_queue_target - n_queued);
+}
+
+void SerialEndpoint::set_tx_pacing_timer(const bool enable) {
+  if (enable && m_tx_pacing_timer == -1) {
+    m_tx_pacing_timer =
+        m_event_loop->add_timer(TX_PACING_INTERVAL, [this] { flush_tx(); });
+  } else if (!enable && m_tx_pacing_timer != -1) {
+    m_event_loop->remove_timer(m_tx_pacing_timer);
+    m_tx_pacing_timer = -1;
+  }
+}
+
+void SerialEndpoint::set_want_writable(const bool want_writable) {
+  if (m_tx_want_writable == want_writable || m_fd == -1) return;
+  m_tx_want_writable = want_writable;
+  m_event_loop->modify_fd(m_fd, want_writable ? (EPOLLIN | EPOLLOUT) : EPOLLIN);
+}
+
+void SerialEndpoint::log_tx_drops() {
+  const auto stats = m_tx_queue->get_stats();
+  const auto n_dropped = stats.n_dropped + stats.n_dropped_priority;
+  if (n_dropped == m_tx_last_logged_n_dropped) return;
+  const auto elapsed_since_last_log =
+      std::chrono::steady_clock::now() - m_last_log_serial_write_failed;
+  if (elapsed_since_last_log <
+      MIN_DELAY_BETWEEN_SERIAL_WRITE_FAILED_LOG_MESSAGES) {
+    return;
+  }
+  m_console->warn("UART saturated, dropped {} messages ({})",
+                  n_dropped - m_tx_last_logged_n_dropped, stats.to_string());
+  m_tx_last_logged_n_dropped = n_dropped;
+  m_last_log_serial_write_failed = std::chrono::steady_clock::now();
+}
+
+std::string SerialEndpoint::createInfo() const {
+  std::stringstream ss;
+  ss << MEndpoint::createInfo();
+  ss << TAG << " tx {" << m_tx_queue->get_stats().to_string()
+     << " writes:" << m_tx_n_writes << " bytes:" << m_tx_n_bytes << "}\n";
+  return ss.str();
 }
 
 int SerialEndpoint::define_from_baudrate(int baudrate) {
@@ -172,13 +263,9 @@ int SerialEndpoint::setup_port(const SerialEndpoint::HWOptions& options,
     m_console->warn("open failed: {}", GET_ERROR());
     return -1;
   }
-  // We need to clear the O_NONBLOCK again because we can block while reading
-  // as we do it in a separate thread.
-  if (fcntl(fd, F_SETFL, 0) == -1) {
-    m_console->warn("fcntl failed: {}", GET_ERROR());
-    close(fd);
-    return -1;
-  }
+  // We keep O_NONBLOCK - we only read once the event loop reports data, and
+  // write (paced) from the event loop, continuing on EPOLLOUT if the UART is
+  // busy.
   // From
   // https://github.com/mavlink/c_uart_interface_example/blob/master/serial_port.cpp
   if (!isatty(fd)) {
@@ -226,112 +313,122 @@ int SerialEndpoint::setup_port(const SerialEndpoint::HWOptions& options,
   return fd;
 }
 
-void SerialEndpoint::connect_and_read_loop() {
-  while (!_stop_requested) {
-    if (!OHDFilesystemUtil::exists(m_options.linux_filename)) {
-      m_console->warn("UART file does not exist");
-      std::this_thread::sleep_for(std::chrono::seconds(1));
-      continue;
-    }
-    // The file exists, so creating the FD should be no problem
-    m_fd = setup_port(m_options, m_console);
-    if (m_fd == -1) {
-      // But if it fails, we start over again, checking if at least the linux fd
-      // exists
-      m_console->warn("Cannot create uart fd " + m_options.to_string());
-      std::this_thread::sleep_for(std::chrono::seconds(1));
-      continue;
-    }
-    m_console->debug("Successfully created UART fd for: {}",
-                     m_options.to_string());
-    receive_data_until_error();
-    // cleanup and start over again
-    close(m_fd);
-    m_fd = -1;
+void SerialEndpoint::try_connect() {
+  if (!OHDFilesystemUtil::exists(m_options.linux_filename)) {
+    m_console->warn("UART file does not exist");
+    return;
+  }
+  // The file exists, so creating the FD should be no problem
+  const int fd = setup_port(m_options, m_console);
+  if (fd == -1) {
+    // But if it fails, we start over again, checking if at least the linux fd
+    // exists
+    m_console->warn("Cannot create uart fd " + m_options.to_string());
+    return;
+  }
+  if (!m_event_loop->add_fd(fd, EPOLLIN, [this](uint32_t events) {
+        on_fd_event(events);
+      })) {
+    close(fd);
+    return;
   }
+  m_fd = fd;
+  m_n_failed_reads = 0;
+  m_last_rx = std::chrono::steady_clock::now();
+  m_console->debug("Successfully created UART fd for: {}",
+                   m_options.to_string());
 }
 
-void SerialEndpoint::receive_data_until_error() {
-  m_console->debug("receive_data_until_error() begin");
-  // Enough for MTU 1500 bytes.
-  uint8_t buffer[2048];
+void SerialEndpoint::disconnect() {
+  set_tx_pacing_timer(false);
+  m_tx_pending.clear();
+  m_tx_pending_offset = 0;
+  m_tx_want_writable = false;
+  if (m_fd == -1) return;
+  m_event_loop->remove_fd(m_fd);
+  close(m_fd);
+  m_fd = -1;
+}
 
-  struct pollfd fds[1];
-  fds[0].fd = m_fd;
-  fds[0].events = POLLIN;
-  m_n_failed_reads = 0;
+void SerialEndpoint::on_connect_timer() {
+  if (m_fd == -1) {
+    try_connect();
+    return;
+  }
+  // on my ubuntu laptop, with usb serial, if the device disconnects I don't
+  // get any error results, but poll suddenly never blocks anymore. Therefore,
+  // we regularly check if the fd is still valid and start over if not
+  if (!is_serial_fd_still_connected(m_fd)) {
+    m_console->debug("Exiting serial, not connected");
+    disconnect();
+    return;
+  }
+  log_tx_drops();
+  if (std::chrono::steady_clock::now() - m_last_rx < std::chrono::seconds(1)) {
+    return;
+  }
+  // if we land here, no data has become available for a while. Not strictly
+  // an error, but on a FC which constantly provides a data stream it most
+  // likely is an error.
+  m_n_failed_reads++;
+  const auto elapsed_since_last_log =
+      std::chrono::steady_clock::now() - m_last_log_serial_read_failed;
+  if (elapsed_since_last_log >=
+          MIN_DELAY_BETWEEN_SERIAL_READ_FAILED_LOG_MESSAGES &&
+      m_options.enable_reading) {
+    m_last_log_serial_read_failed = std::chrono::steady_clock::now();
+    m_console->warn("{} failed reads - FC connected ?", m_n_failed_reads);
+  }
+}
 
-  while (!_stop_requested) {
-    const auto before = std::chrono::steady_clock::now();
-    const int pollrc = poll(fds, 1, 1000);
-    // on my ubuntu laptop, with usb serial, if the device disconnects I don't
-    // get any error results, but poll suddenly never blocks anymore. Therefore,
-    // every time we time out we check if the fd is still valid and exit if not
-    // (which will lead to a re-start)
-    const auto valid = is_serial_fd_still_connected(m_fd);
-    if (!valid) {
+void SerialEndpoint::on_fd_event(const uint32_t events) {
+  if (events & (EPOLLERR | EPOLLHUP)) {
+    m_console->warn("read poll failure: {}", events);
+    // The UART most likely disconnected.
+    disconnect();
+    return;
+  }
+  if (events & EPOLLOUT) {
+    set_want_writable(false);
+    flush_tx();
+    if (m_fd == -1 || !(events & EPOLLIN)) return;
+  }
+  const int recv_len =
+      static_cast<int>(read(m_fd, m_rx_buffer.data(), m_rx_buffer.size()));
+  if (recv_len > 0) {
+    m_last_rx = std::chrono::steady_clock::now();
+    MEndpoint::parseNewData(m_rx_buffer.data(), recv_len);
+  } else if (recv_len == 0) {
+    // Readable but no data - the device is most likely gone (otherwise, we'd
+    // be woken up again right away)
+    if (!is_serial_fd_still_connected(m_fd)) {
       m_console->debug("Exiting serial, not connected");
-      return;
-    }
-    // const auto
-    // delta=std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now()-before).count();
-    // std::cout<<"Poll res:"<<pollrc<<" took:"<<delta<<" ms\n";
-    // debug_poll_fd(fds[0]);
-    if (pollrc == 0 || !(fds[0].revents & POLLIN)) {
-      // if we land here, no data has become available after X ms. Not strictly
-      // an error, but on a FC which constantly provides a data stream it most
-      // likely is an error.
-      m_n_failed_reads++;
-      const auto elapsed_since_last_log =
-          std::chrono::steady_clock::now() - m_last_log_serial_read_failed;
-      if (elapsed_since_last_log >=
-              MIN_DELAY_BETWEEN_SERIAL_READ_FAILED_LOG_MESSAGES &&
-          m_options.enable_reading) {
-        m_last_log_serial_read_failed = std::chrono::steady_clock::now();
-        m_console->warn("{} failed reads - FC connected ?", m_n_failed_reads);
-      } else {
-        // m_console->debug("poll probably timeout {}",m_n_failed_reads);
-      }
-      continue;
-    } else if (pollrc == -1) {
-      m_console->warn("read poll failure: {}", GET_ERROR());
-      // The UART most likely disconnected.
-      return;
-    }
-    // We enter here if (fds[0].revents & POLLIN) == true
-    const int recv_len = static_cast<int>(read(m_fd, buffer, sizeof(buffer)));
-    if (recv_len > 0) {
-      MEndpoint::parseNewData(buffer, recv_len);
-    } else if (recv_len == 0) {
-      // timeout
-    } else {
-      m_console->warn("read failure: {} {}", recv_len, GET_ERROR());
+      disconnect();
     }
+  } else {
+    m_console->warn("read failure: {} {}", recv_len, GET_ERROR());
   }
-  m_console->debug("receive_data_until_error() end");
 }
 
 void SerialEndpoint::start() {
-  std::lock_guard<std::mutex> lock(m_connect_receive_thread_mutex);
+  std::lock_guard<std::mutex> lock(m_start_stop_mutex);
   m_console->debug("start()-begin");
-  if (m_connect_receive_thread != nullptr) {
+  if (m_connect_timer != -1) {
     m_console->debug("Already started");
     return;
   }
-  _stop_requested = false;
-  m_connect_receive_thread = std::make_unique<std::thread>(
-      &SerialEndpoint::connect_and_read_loop, this);
+  m_event_loop->run_sync([this] { try_connect(); });
+  m_connect_timer = m_event_loop->add_timer(std::chrono::seconds(1),
+                                            [this] { on_connect_timer(); });
   m_console->debug("start()-end");
 }
 
 void SerialEndpoint::stop() {
-  std::lock_guard<std::mutex> lock(m_connect_receive_thread_mutex);
+  std::lock_guard<std::mutex> lock(m_start_stop_mutex);
   m_console->debug("stop()-begin");
-  _stop_requested = true;
-  if (m_connect_receive_thread && m_connect_receive_thread->joinable()) {
-    m_connect_receive_thread->join();
-  }
-  m_connect_receive_thread = nullptr;
+  m_event_loop->remove_timer(m_connect_timer);
+  m_connect_timer = -1;
+  m_event_loop->run_sync([this] { disconnect(); });
   m_console->debug("stop()-end");
 }
 
@@ -362,14 +459,26 @@ bool SerialEndpoint::is_valid_linux_baudrate(int baudrate) {
   return false;
 }
 
+SerialEndpointManager::SerialEndpointManager(
+    std::shared_ptr<openhd::EventLoop> event_loop)
+    : m_event_loop(std::move(event_loop)) {}
+
 void SerialEndpointManager::send_messages_if_enabled(
-    const std::vector<MavlinkMessage>& messages) {
+    MavlinkMessageSpan messages) {
   std::lock_guard<std::mutex> guard(m_serial_endpoint_mutex);
   if (m_serial_endpoint) {
     m_serial_endpoint->sendMessages(messages);
   }
 }
 
+std::string SerialEndpointManager::create_info() {
+  std::lock_guard<std::mutex> guard(m_serial_endpoint_mutex);
+  if (m_serial_endpoint) {
+    return m_serial_endpoint->createInfo();
+  }
+  return "";
+}
+
 void SerialEndpointManager::disable() {
   std::lock_guard<std::mutex> guard(m_serial_endpoint_mutex);
   if (m_serial_endpoint != nullptr) {
@@ -391,6 +500,7 @@ void SerialEndpointManager::configure(const SerialEndpoint::HWOptions& options,
     m_serial_endpoint.reset();
     m_serial_endpoint = nullptr;
   }
-  m_serial_endpoint = std::make_unique<SerialEndpoint>(tag, options);
+  m_serial_endpoint =
+      std::make_unique<SerialEndpoint>(tag, options, m_event_loop);
   m_serial_endpoint->registerCallback(std::move(cb));
 }
@@ -5,6 +5,7 @@
 #ifndef OPENHD_OPENHD_OHD_TELEMETRY_SRC_ENDPOINTS_SERIALENDPOINT_H_
 #define OPENHD_OPENHD_OHD_TELEMETRY_SRC_ENDPOINTS_SERIALENDPOINT_H_
 
+#include <array>
 #include <atomic>
 #include <chrono>
 #include <memory>
@@ -12,8 +13,11 @@
 #include <optional>
 #include <thread>
 #include <utility>
+#include <vector>
 
 #include "MEndpoint.h"
+#include "SerialTxQueue.h"
+#include "openhd_event_loop.h"
 #include "openhd_spdlog.h"
 
 /**
@@ -23,6 +27,13 @@
  * mistakes like a wrong serial fd - In this case, this will constantly log some
  * "warning messages" until the issue is fixed (for example by the user
  * connecting the serial wires, or selecting another type of fd)
+ * Receiving, writing and (re-) connecting runs on the given event loop, no
+ * thread of its own.
+ * Writing never blocks the caller: Messages are queued (bounded, see
+ * SerialTxQueue) and written by the event loop, paced to the baud rate such
+ * that the kernel's tx buffer never holds more than a few ms of data - which
+ * keeps latency low for RC / commands on slow (e.g. 57600 baud) links and
+ * drops stale telemetry (instead of queueing it) when the UART is saturated.
  */
 class SerialEndpoint : public MEndpoint {
  public:
@@ -35,11 +46,15 @@ class SerialEndpoint : public MEndpoint {
     // ground)
     bool enable_reading = true;
     bool enable_debug = false;  // enable / disable extra debug logging
+    // what to drop (normal priority messages) if the UART cannot keep up
+    SerialTxQueue::DropPolicy tx_drop_policy =
+        SerialTxQueue::DropPolicy::DROP_OLDEST;
     [[nodiscard]] std::string to_string() const {
       std::stringstream ss;
       ss << "HWOptions{" << linux_filename << ", baud:" << baud_rate
          << ", flow_control:" << flow_control
-         << ",  enable_debug:" << enable_debug << "}";
+         << ",  enable_debug:" << enable_debug << ", tx_drop_policy:"
+         << SerialTxQueue::drop_policy_as_string(tx_drop_policy) << "}";
       return ss.str();
     }
   };
@@ -48,7 +63,8 @@ class SerialEndpoint : public MEndpoint {
   /**
    * See @param options1 HWOptions for configurable serial params
    */
-  explicit SerialEndpoint(std::string TAG1, HWOptions options1);
+  explicit SerialEndpoint(std::string TAG1, HWOptions options1,
+                          std::shared_ptr<openhd::EventLoop> event_loop);
   // No copy and move
   SerialEndpoint(const SerialEndpoint&) = delete;
   SerialEndpoint(const SerialEndpoint&&) = delete;
@@ -56,32 +72,66 @@ class SerialEndpoint : public MEndpoint {
   // Start sending and receiving UART data.
   // Does nothing if already started.
   void start();
-  // Stop any UART communication (read and write). Might block for up to 1
-  // second. Does nothing if already stopped.
+  // Stop any UART communication (read and write). Does nothing if already
+  // stopped.
   void stop();
   // Linux defines what baud rates are available - this does not check if the
   // given baud rate is actually supported by the HW, but checks if it is at
   // least a somewhat sane value
   static bool is_valid_linux_baudrate(int baudrate);
+  // Includes the tx queue stats
+  [[nodiscard]] std::string createInfo() const override;
 
  private:
-  bool sendMessagesImpl(const std::vector<MavlinkMessage>& messages) override;
+  bool sendMessagesImpl(MavlinkMessageSpan messages) override;
   static int define_from_baudrate(int baudrate);
   static int setup_port(const HWOptions& options,
                         std::shared_ptr<spdlog::logger> m_console);
-  void connect_and_read_loop();
-  // Receive data until either an error occurs (in this case, the UART most
-  // likely disconnected) Or a stop was requested.
-  void receive_data_until_error();
-  // Write serial data, returns true on success, false otherwise.
-  [[nodiscard]] bool write_data_serial(const std::vector<uint8_t>& data);
+  // All called on the event loop thread
+  // Called every second - (re-) connects, or checks if the UART is still
+  // connected and logs if no data is coming in
+  void on_connect_timer();
+  void try_connect();
+  void on_fd_event(uint32_t events);
+  // Cleanup, we start over again on the next connect timer
+  void disconnect();
+  // Write as much queued data as the UART can take without building up a
+  // backlog in the kernel tx buffer
+  void flush_tx();
+  // n of bytes that can be written right now (TIOCOUTQ), -1 if unknown
+  int get_tx_budget();
+  void set_tx_pacing_timer(bool enable);
+  void set_want_writable(bool want_writable);
+  void log_tx_drops();
 
  private:
   const HWOptions m_options;
-  int m_fd = -1;
-  std::mutex m_connect_receive_thread_mutex;
-  std::unique_ptr<std::thread> m_connect_receive_thread = nullptr;
-  bool _stop_requested = false;
+  const std::shared_ptr<openhd::EventLoop> m_event_loop;
+  std::atomic<int> m_fd = -1;
+  std::mutex m_start_stop_mutex;
+  openhd::EventLoop::TimerId m_connect_timer = -1;
+  // Enough for MTU 1500 bytes.
+  std::array<uint8_t, 2048> m_rx_buffer{};
+  std::chrono::steady_clock::time_point m_last_rx =
+      std::chrono::steady_clock::now();
+  // Don't queue more than ~20ms of data in the kernel (at the baud rate)
+  static constexpr auto TX_KERNEL_QUEUE_TARGET = std::chrono::milliseconds(20);
+  static constexpr int TX_MIN_KERNEL_QUEUE_BYTES = 128;
+  // Used if the driver doesn't support TIOCOUTQ
+  static constexpr uint32_t TX_MAX_WRITE_BYTES = 1024;
+  static constexpr auto TX_PACING_INTERVAL = std::chrono::milliseconds(10);
+  const int m_tx_kernel_queue_target;
+  std::unique_ptr<SerialTxQueue> m_tx_queue;
+  std::atomic<bool> m_tx_flush_posted = false;
+  // Only accessed on the event loop thread
+  // Dequeued, but not (completely) written yet
+  std::vector<uint8_t> m_tx_pending;
+  size_t m_tx_pending_offset = 0;
+  openhd::EventLoop::TimerId m_tx_pacing_timer = -1;
+  bool m_tx_want_writable = false;
+  uint64_t m_tx_last_logged_n_dropped = 0;
+  std::atomic<uint64_t> m_tx_n_writes = 0;
+  std::atomic<uint64_t> m_tx_n_bytes = 0;
   std::shared_ptr<spdlog::logger> m_console;
   // Limit warning console logs to not spam the console
   static constexpr auto MIN_DELAY_BETWEEN_SERIAL_WRITE_FAILED_LOG_MESSAGES =
@@ -109,7 +159,8 @@ class SerialEndpointManager {
   /**
    * Send messages if serial is currently enabled, otherwise, do nothing
    */
-  void send_messages_if_enabled(const std::vector<MavlinkMessage>& messages);
+  void send_messages_if_enabled(MavlinkMessageSpan messages);
+  explicit SerialEndpointManager(std::shared_ptr<openhd::EventLoop> event_loop);
   /**
    * (Re-)configure the wrapped serial endpoint. Stops then restarts if serial
    * already exists
@@ -121,8 +172,11 @@ class SerialEndpointManager {
    * Disable (delete) serial, if already existing
    */
   void disable();
+  // Info of the serial endpoint, empty if disabled
+  std::string create_info();
 
  private:
+  const std::shared_ptr<openhd::EventLoop> m_event_loop;
   std::unique_ptr<SerialEndpoint> m_serial_endpoint;
   std::mutex m_serial_endpoint_mutex;
   std::shared_ptr<spdlog::logger> m_console =
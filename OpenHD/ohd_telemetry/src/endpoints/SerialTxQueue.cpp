@@ -0,0 +1,124 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#include "SerialTxQueue.h"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+SerialTxQueue::Ring::Ring(const uint32_t capacity) : m_buff(capacity) {}
+
+void SerialTxQueue::Ring::push(const uint8_t* data, const uint32_t data_len) {
+  const uint32_t tail = (m_head + m_size) % m_buff.size();
+  const uint32_t first = std::min(data_len, (uint32_t)m_buff.size() - tail);
+  std::memcpy(m_buff.data() + tail, data, first);
+  std::memcpy(m_buff.data(), data + first, data_len - first);
+  m_size += data_len;
+  m_msg_sizes.push_back(data_len);
+}
+
+void SerialTxQueue::Ring::pop_into(std::vector<uint8_t>& out) {
+  const uint32_t msg_size = m_msg_sizes.front();
+  const uint32_t first = std::min(msg_size, (uint32_t)m_buff.size() - m_head);
+  out.insert(out.end(), m_buff.data() + m_head, m_buff.data() + m_head + first);
+  out.insert(out.end(), m_buff.data(), m_buff.data() + (msg_size - first));
+  pop();
+}
+
+void SerialTxQueue::Ring::pop() {
+  const uint32_t msg_size = m_msg_sizes.front();
+  m_msg_sizes.pop_front();
+  m_head = (m_head + msg_size) % m_buff.size();
+  m_size -= msg_size;
+}
+
+SerialTxQueue::SerialTxQueue(SerialTxQueue::Config config)
+    : m_config(config),
+      m_priority_ring(config.priority_capacity_bytes),
+      m_ring(config.capacity_bytes) {}
+
+bool SerialTxQueue::enqueue(const uint8_t* data, const int data_len,
+                            const bool high_priority) {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  auto& ring = high_priority ? m_priority_ring : m_ring;
+  // RC / commands: the newest is always the most valuable
+  const auto policy =
+      high_priority ? DropPolicy::DROP_OLDEST : m_config.drop_policy;
+  auto& n_dropped =
+      high_priority ? m_stats.n_dropped_priority : m_stats.n_dropped;
+  if (data_len <= 0 || (uint32_t)data_len > ring.capacity()) {
+    n_dropped++;
+    return false;
+  }
+  while (ring.size() + data_len > ring.capacity()) {
+    if (policy == DropPolicy::DROP_NEWEST) {
+      n_dropped++;
+      return false;
+    }
+    ring.pop();
+    n_dropped++;
+  }
+  ring.push(data, data_len);
+  m_stats.n_enqueued++;
+  m_stats.queued_bytes = m_priority_ring.size() + m_ring.size();
+  m_stats.max_queued_bytes =
+      std::max(m_stats.max_queued_bytes, m_stats.queued_bytes);
+  return true;
+}
+
+int SerialTxQueue::dequeue(std::vector<uint8_t>& out, const uint32_t max_bytes) {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  int n_messages = 0;
+  uint32_t n_bytes = 0;
+  for (auto* ring : {&m_priority_ring, &m_ring}) {
+    while (!ring->empty()) {
+      const uint32_t msg_size = ring->front_msg_size();
+      if (n_messages > 0 && n_bytes + msg_size > max_bytes) break;
+      ring->pop_into(out);
+      n_bytes += msg_size;
+      n_messages++;
+    }
+    // Don't let a normal priority message overtake a high priority one that
+    // didn't fit anymore
+    if (!ring->empty()) break;
+  }
+  m_stats.n_dequeued += n_messages;
+  m_stats.queued_bytes = m_priority_ring.size() + m_ring.size();
+  return n_messages;
+}
+
+bool SerialTxQueue::is_empty() const {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  return m_priority_ring.empty() && m_ring.empty();
+}
+
+uint32_t SerialTxQueue::get_queued_bytes() const {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  return m_priority_ring.size() + m_ring.size();
+}
+
+SerialTxQueue::Stats SerialTxQueue::get_stats() const {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  return m_stats;
+}
+
+std::string SerialTxQueue::Stats::to_string() const {
+  std::stringstream ss;
+  ss << "enqueued:" << n_enqueued << " dequeued:" << n_dequeued
+     << " dropped:" << n_dropped << " dropped_prio:" << n_dropped_priority
+     << " queued:" << queued_bytes << "B max_queued:" << max_queued_bytes
+     << "B";
+  return ss.str();
+}
+
+std::string SerialTxQueue::drop_policy_as_string(const DropPolicy policy) {
+  switch (policy) {
+    case DropPolicy::DROP_OLDEST:
+      return "DROP_OLDEST";
+    case DropPolicy::DROP_NEWEST:
+      return "DROP_NEWEST";
+  }
+  return "UNKNOWN";
+}
@@ -0,0 +1,96 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#ifndef OPENHD_OPENHD_OHD_TELEMETRY_SRC_ENDPOINTS_SERIALTXQUEUE_H_
+#define OPENHD_OPENHD_OHD_TELEMETRY_SRC_ENDPOINTS_SERIALTXQUEUE_H_
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * Bounded tx queue between the telemetry producers and the (slow) UART
+ * writer. Producers never block - if the UART cannot keep up, messages are
+ * dropped according to the drop policy, instead of piling up (minutes of
+ * stale telemetry) or stalling the producer.
+ * Stores whole (packed) mavlink messages in a byte ring buffer, there are two
+ * rings: high priority (RC / commands) messages are always dequeued first and
+ * never dropped in favour of normal priority ones.
+ * The writer dequeues as many whole messages as fit into one write()
+ * (coalescing).
+ * Thread-safe.
+ */
+class SerialTxQueue {
+ public:
+  enum class DropPolicy {
+    // Drop the oldest queued messages to make space for the new one - for
+    // telemetry, the newest data is the most valuable.
+    DROP_OLDEST,
+    // Drop the new message - keeps what has been queued intact.
+    DROP_NEWEST
+  };
+  struct Config {
+    uint32_t capacity_bytes = 4096;
+    uint32_t priority_capacity_bytes = 1024;
+    DropPolicy drop_policy = DropPolicy::DROP_OLDEST;
+  };
+  explicit SerialTxQueue(Config config);
+  /**
+   * Never blocks.
+   * @return false if the message has been dropped (queue full / too big)
+   */
+  bool enqueue(const uint8_t* data, int data_len, bool high_priority);
+  /**
+   * Appends whole messages (high priority ones first) to @param out as long as
+   * they fit into @param max_bytes - but at least one (if any), otherwise a
+   * message bigger than max_bytes would never be sent.
+   * @return the n of dequeued messages
+   */
+  int dequeue(std::vector<uint8_t>& out, uint32_t max_bytes);
+  [[nodiscard]] bool is_empty() const;
+  [[nodiscard]] uint32_t get_queued_bytes() const;
+  struct Stats {
+    uint64_t n_enqueued = 0;
+    uint64_t n_dequeued = 0;
+    uint64_t n_dropped = 0;
+    uint64_t n_dropped_priority = 0;
+    uint32_t queued_bytes = 0;
+    uint32_t max_queued_bytes = 0;
+    [[nodiscard]] std::string to_string() const;
+  };
+  [[nodiscard]] Stats get_stats() const;
+  static std::string drop_policy_as_string(DropPolicy policy);
+
+ private:
+  // Whole messages in a contiguous (wrapping) byte buffer
+  class Ring {
+   public:
+    explicit Ring(uint32_t capacity);
+    [[nodiscard]] uint32_t capacity() const { return m_buff.size(); }
+    [[nodiscard]] uint32_t size() const { return m_size; }
+    [[nodiscard]] bool empty() const { return m_msg_sizes.empty(); }
+    [[nodiscard]] uint32_t front_msg_size() const {
+      return m_msg_sizes.front();
+    }
+    // Caller makes sure it fits
+    void push(const uint8_t* data, uint32_t data_len);
+    void pop_into(std::vector<uint8_t>& out);
+    void pop();
+
+   private:
+    std::vector<uint8_t> m_buff;
+    uint32_t m_head = 0;
+    uint32_t m_size = 0;
+    std::deque<uint32_t> m_msg_sizes;
+  };
+  const Config m_config;
+  mutable std::mutex m_mutex;
+  Ring m_priority_ring;
+  Ring m_ring;
+  Stats m_stats{};
+};
+
+#endif  // OPENHD_OPENHD_OHD_TELEMETRY_SRC_ENDPOINTS_SERIALTXQUEUE_H_
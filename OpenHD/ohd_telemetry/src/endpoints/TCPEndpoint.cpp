@@ -13,26 +13,38 @@
 
 #include "openhd_util.h"
 
-TCPEndpoint::TCPEndpoint(openhd::TCPServer::Config config)
-    : MEndpoint("TCPServer"), openhd::TCPServer("MTCPServer", config) {}
-
-bool TCPEndpoint::sendMessagesImpl(
-    const std::vector<MavlinkMessage>& messages) {
-  auto message_buffers = aggregate_pack_messages(messages, 1024);
-  for (const auto& message_buffer : message_buffers) {
-    const auto& buff = message_buffer.aggregated_data;
-    send_message_to_all_clients(buff->data(), buff->size());
-  }
+TCPEndpoint::TCPEndpoint(openhd::TCPServer::Config config,
+                         std::shared_ptr<openhd::EventLoop> event_loop)
+    : MEndpoint("TCPServer"),
+      openhd::TCPServer("MTCPServer", config, false, std::move(event_loop)) {}
+
+TCPEndpoint::~TCPEndpoint() {
+  // Our overrides must not be called once we are (partially) destructed
+  stop();
+}
+
+bool TCPEndpoint::sendMessagesImpl(MavlinkMessageSpan messages) {
+  aggregate_pack_messages(messages, 1024,
+                          [this](const AggregatedMavlinkPacketView& view) {
+                            send_message_to_all_clients(view.data,
+                                                        view.data_len);
+                          });
   return true;
 }
 
-void TCPEndpoint::on_external_device(std::string ip, int port, bool connected) {
+void TCPEndpoint::on_external_device(int client_id, std::string ip, int port,
+                                     bool connected) {
+  if (connected) {
+    m_rx_parsers[client_id];
+  } else {
+    m_rx_parsers.erase(client_id);
+  }
   auto external_device = openhd::ExternalDevice{"MAV TCP CLIENT", ip, true};
   openhd::ExternalDeviceManager::instance().on_new_external_device(
       external_device, connected);
 }
 
-void TCPEndpoint::on_packet_any_tcp_client(const uint8_t* data, int data_len) {
-  std::lock_guard<std::mutex> guard(m_rx_parse_mutex);
-  MEndpoint::parseNewData(data, (int)data_len);
+void TCPEndpoint::on_packet_any_tcp_client(int client_id, const uint8_t* data,
+                                           int data_len) {
+  MEndpoint::parseNewData(m_rx_parsers[client_id], data, data_len);
 }
@@ -5,6 +5,9 @@
 #ifndef OPENHD_TCPENDPOINT_H
 #define OPENHD_TCPENDPOINT_H
 
+#include <map>
+#include <memory>
+
 #include "MEndpoint.h"
 #include "openhd_external_device.h"
 #include "openhd_tcp.h"
@@ -12,15 +15,21 @@
 // Simple TCP Mavlink server (UDP-like)
 class TCPEndpoint : public MEndpoint, openhd::TCPServer {
  public:
-  explicit TCPEndpoint(openhd::TCPServer::Config config);
-  ~TCPEndpoint() = default;
+  explicit TCPEndpoint(
+      openhd::TCPServer::Config config,
+      std::shared_ptr<openhd::EventLoop> event_loop = nullptr);
+  ~TCPEndpoint() override;
   static constexpr int DEFAULT_PORT = 5760;
 
  private:
-  bool sendMessagesImpl(const std::vector<MavlinkMessage>& messages) override;
-  std::mutex m_rx_parse_mutex;
-  void on_external_device(std::string ip, int port, bool connected) override;
-  void on_packet_any_tcp_client(const uint8_t* data, int data_len) override;
+  bool sendMessagesImpl(MavlinkMessageSpan messages) override;
+  void on_external_device(int client_id, std::string ip, int port,
+                          bool connected) override;
+  void on_packet_any_tcp_client(int client_id, const uint8_t* data,
+                                int data_len) override;
+  // One parser per client (TCP is a stream, a client might send a partial
+  // frame). Only accessed on the event loop thread.
+  std::map<int, MavlinkFrameParser> m_rx_parsers;
 };
 
 #endif  // OPENHD_TCPENDPOINT_H
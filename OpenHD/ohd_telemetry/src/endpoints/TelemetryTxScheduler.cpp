@@ -0,0 +1,281 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#include "TelemetryTxScheduler.h"
+
+#include <algorithm>
+#include <sstream>
+#include <utility>
+
+TelemetryTxScheduler::Priority TelemetryTxScheduler::classify(
+    const uint32_t msg_id) {
+  switch (msg_id) {
+    case MAVLINK_MSG_ID_RC_CHANNELS_OVERRIDE:
+    case MAVLINK_MSG_ID_MANUAL_CONTROL:
+      return Priority::RC_OVERRIDE;
+    case MAVLINK_MSG_ID_COMMAND_LONG:
+    case MAVLINK_MSG_ID_COMMAND_INT:
+    case MAVLINK_MSG_ID_COMMAND_ACK:
+    case MAVLINK_MSG_ID_COMMAND_CANCEL:
+    case MAVLINK_MSG_ID_SET_MODE:
+    case MAVLINK_MSG_ID_HEARTBEAT:
+    case MAVLINK_MSG_ID_TIMESYNC:
+      return Priority::COMMAND;
+    case MAVLINK_MSG_ID_PARAM_REQUEST_READ:
+    case MAVLINK_MSG_ID_PARAM_REQUEST_LIST:
+    case MAVLINK_MSG_ID_PARAM_VALUE:
+    case MAVLINK_MSG_ID_PARAM_SET:
+    case MAVLINK_MSG_ID_PARAM_EXT_REQUEST_READ:
+    case MAVLINK_MSG_ID_PARAM_EXT_REQUEST_LIST:
+    case MAVLINK_MSG_ID_PARAM_EXT_VALUE:
+    case MAVLINK_MSG_ID_PARAM_EXT_SET:
+    case MAVLINK_MSG_ID_PARAM_EXT_ACK:
+    case MAVLINK_MSG_ID_MISSION_REQUEST_LIST:
+    case MAVLINK_MSG_ID_MISSION_REQUEST_INT:
+    case MAVLINK_MSG_ID_MISSION_COUNT:
+    case MAVLINK_MSG_ID_MISSION_ITEM_INT:
+    case MAVLINK_MSG_ID_MISSION_ACK:
+    case MAVLINK_MSG_ID_MISSION_CLEAR_ALL:
+    case MAVLINK_MSG_ID_MISSION_SET_CURRENT:
+      return Priority::PARAM;
+    default:
+      return Priority::BULK;
+  }
+}
+
+bool TelemetryTxScheduler::is_latest_value_wins(const uint32_t msg_id) {
+  switch (msg_id) {
+    case MAVLINK_MSG_ID_HEARTBEAT:
+    case MAVLINK_MSG_ID_RC_CHANNELS_OVERRIDE:
+    case MAVLINK_MSG_ID_MANUAL_CONTROL:
+    case MAVLINK_MSG_ID_SYS_STATUS:
+    case MAVLINK_MSG_ID_ATTITUDE:
+    case MAVLINK_MSG_ID_ATTITUDE_QUATERNION:
+    case MAVLINK_MSG_ID_GLOBAL_POSITION_INT:
+    case MAVLINK_MSG_ID_LOCAL_POSITION_NED:
+    case MAVLINK_MSG_ID_GPS_RAW_INT:
+    case MAVLINK_MSG_ID_VFR_HUD:
+    case MAVLINK_MSG_ID_RC_CHANNELS:
+    case MAVLINK_MSG_ID_RC_CHANNELS_RAW:
+    case MAVLINK_MSG_ID_SERVO_OUTPUT_RAW:
+    case MAVLINK_MSG_ID_BATTERY_STATUS:
+    case MAVLINK_MSG_ID_RADIO_STATUS:
+    case MAVLINK_MSG_ID_SCALED_PRESSURE:
+    case MAVLINK_MSG_ID_ALTITUDE:
+    case MAVLINK_MSG_ID_EXTENDED_SYS_STATE:
+      return true;
+    default:
+      return false;
+  }
+}
+
+std::string TelemetryTxScheduler::priority_as_string(const Priority priority) {
+  switch (priority) {
+    case Priority::RC_OVERRIDE:
+      return "RC";
+    case Priority::COMMAND:
+      return "CMD";
+    case Priority::PARAM:
+      return "PARAM";
+    case Priority::BULK:
+      return "BULK";
+  }
+  return "?";
+}
+
+TelemetryTxScheduler::TelemetryTxScheduler()
+    : TelemetryTxScheduler(Config{}) {}
+
+TelemetryTxScheduler::TelemetryTxScheduler(Config config)
+    : m_config(std::move(config)),
+      m_aggregation_window(m_config.aggregation_window) {}
+
+void TelemetryTxScheduler::pop_front(Class& c) {
+  c.queued_bytes -= c.queue.front().msg.get_packed_size();
+  c.queue.pop_front();
+}
+
+void TelemetryTxScheduler::enqueue(MavlinkMessageSpan messages,
+                                   std::chrono::steady_clock::time_point now) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (const auto& msg : messages) {
+    enqueue_locked(msg, now);
+  }
+}
+
+void TelemetryTxScheduler::enqueue_locked(
+    const MavlinkMessage& msg, std::chrono::steady_clock::time_point now) {
+  const int class_idx = static_cast<int>(classify(msg.m.msgid));
+  auto& c = m_classes[class_idx];
+  if (is_latest_value_wins(msg.m.msgid)) {
+    for (auto& entry : c.queue) {
+      if (entry.msg.m.msgid == msg.m.msgid &&
+          entry.msg.m.sysid == msg.m.sysid &&
+          entry.msg.m.compid == msg.m.compid) {
+        c.queued_bytes += msg.get_packed_size() - entry.msg.get_packed_size();
+        entry.msg = msg;
+        entry.enqueue_time = now;
+        c.stats.n_replaced++;
+        return;
+      }
+    }
+  }
+  if ((int)c.queue.size() >= m_config.max_queue_size[class_idx]) {
+    pop_front(c);
+    c.stats.n_dropped_overflow++;
+  }
+  c.queue.push_back(Entry{msg, now});
+  c.queued_bytes += msg.get_packed_size();
+  c.stats.queue_depth = (int)c.queue.size();
+  c.stats.max_queue_depth =
+      std::max(c.stats.max_queue_depth, c.stats.queue_depth);
+}
+
+std::vector<AggregatedMavlinkPacket> TelemetryTxScheduler::dequeue(
+    const int max_n_packets, std::chrono::steady_clock::time_point now) {
+  std::vector<AggregatedMavlinkPacket> ret;
+  // Re-used, avoids an allocation per call
+  thread_local std::vector<MavlinkMessage> packet_messages;
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (int class_idx = 0; class_idx < N_PRIORITIES; class_idx++) {
+    auto& c = m_classes[class_idx];
+    const auto deadline = m_config.deadlines[class_idx];
+    while (!c.queue.empty() && now - c.queue.front().enqueue_time > deadline) {
+      pop_front(c);
+      c.stats.n_dropped_stale++;
+    }
+    while (!c.queue.empty() && (int)ret.size() < max_n_packets &&
+           !hold_back_for_aggregation(class_idx, now)) {
+      packet_messages.clear();
+      int packet_size = 0;
+      while (!c.queue.empty()) {
+        auto& entry = c.queue.front();
+        const int packed_size = entry.msg.get_packed_size();
+        // One message might exceed the mtu (it is sent alone then)
+        if (!packet_messages.empty() &&
+            packet_size + packed_size > (int)m_config.max_mtu) {
+          break;
+        }
+        // Deadlines are checked in order (front to back), but a replaced
+        // (latest-value-wins) entry might be newer than the ones behind it.
+        if (now - entry.enqueue_time <= deadline) {
+          const auto sojourn_time = now - entry.enqueue_time;
+          c.stats.sojourn_time_total += sojourn_time;
+          c.stats.sojourn_time_max =
+              std::max(c.stats.sojourn_time_max,
+                       std::chrono::nanoseconds(sojourn_time));
+          c.stats.n_sent++;
+          packet_size += packed_size;
+          packet_messages.push_back(entry.msg);
+        } else {
+          c.stats.n_dropped_stale++;
+        }
+        pop_front(c);
+      }
+      if (packet_messages.empty()) continue;
+      aggregate_pack_messages(
+          packet_messages, m_config.max_mtu,
+          [this, &ret](const AggregatedMavlinkPacketView& view) {
+            m_n_packet_bytes += view.data_len;
+            ret.push_back(AggregatedMavlinkPacket{
+                openhd::FragmentBufferPool::instance().acquire(view.data,
+                                                               view.data_len),
+                view.recommended_n_retransmissions,
+                view.n_aggregated_mavlink_packets});
+          });
+    }
+    c.stats.queue_depth = (int)c.queue.size();
+  }
+  m_n_packets += ret.size();
+  m_packets_per_second_count += ret.size();
+  const auto elapsed = now - m_packets_per_second_begin;
+  if (elapsed >= std::chrono::seconds(1)) {
+    m_curr_packets_per_second =
+        elapsed < std::chrono::seconds(2)
+            ? (int)(m_packets_per_second_count * std::chrono::seconds(1) /
+                    elapsed)
+            : 0;  // idle / first call
+    m_packets_per_second_count = 0;
+    m_packets_per_second_begin = now;
+  }
+  return ret;
+}
+
+bool TelemetryTxScheduler::hold_back_for_aggregation(
+    const int class_idx, std::chrono::steady_clock::time_point now) const {
+  const auto& c = m_classes[class_idx];
+  if (m_config.flush_immediately[class_idx] ||
+      m_aggregation_window.count() == 0) {
+    return false;
+  }
+  return c.queued_bytes < (int)m_config.max_mtu &&
+         now - c.queue.front().enqueue_time < m_aggregation_window;
+}
+
+void TelemetryTxScheduler::set_aggregation_window(
+    std::chrono::milliseconds window) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_aggregation_window = window;
+}
+
+std::optional<std::chrono::steady_clock::time_point>
+TelemetryTxScheduler::get_next_aggregation_flush() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  std::optional<std::chrono::steady_clock::time_point> ret;
+  for (int class_idx = 0; class_idx < N_PRIORITIES; class_idx++) {
+    const auto& c = m_classes[class_idx];
+    if (c.queue.empty()) continue;
+    const auto flush = m_config.flush_immediately[class_idx]
+                           ? c.queue.front().enqueue_time
+                           : c.queue.front().enqueue_time + m_aggregation_window;
+    if (!ret.has_value() || flush < ret.value()) {
+      ret = flush;
+    }
+  }
+  return ret;
+}
+
+bool TelemetryTxScheduler::is_empty() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (const auto& c : m_classes) {
+    if (!c.queue.empty()) return false;
+  }
+  return true;
+}
+
+TelemetryTxScheduler::Stats TelemetryTxScheduler::get_stats() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  Stats ret;
+  for (int i = 0; i < N_PRIORITIES; i++) {
+    ret.classes[i] = m_classes[i].stats;
+  }
+  ret.n_packets = m_n_packets;
+  ret.n_packet_bytes = m_n_packet_bytes;
+  ret.curr_packets_per_second = m_curr_packets_per_second;
+  ret.avg_fill_perc =
+      m_n_packets > 0
+          ? (int)(m_n_packet_bytes * 100 / (m_n_packets * m_config.max_mtu))
+          : 0;
+  return ret;
+}
+
+std::string TelemetryTxScheduler::stats_as_string(const Stats& stats) {
+  std::stringstream ss;
+  ss << "packets:" << stats.n_packets
+     << " pps:" << stats.curr_packets_per_second
+     << " avg_fill:" << stats.avg_fill_perc << "% ";
+  for (int i = 0; i < N_PRIORITIES; i++) {
+    const auto& s = stats.classes[i];
+    const auto to_us = [](std::chrono::nanoseconds t) {
+      return std::chrono::duration_cast<std::chrono::microseconds>(t).count();
+    };
+    ss << priority_as_string(static_cast<Priority>(i)) << "{q:" << s.queue_depth
+       << " q_max:" << s.max_queue_depth << " sent:" << s.n_sent
+       << " replaced:" << s.n_replaced << " stale:" << s.n_dropped_stale
+       << " overflow:" << s.n_dropped_overflow
+       << " sojourn_avg:" << to_us(s.sojourn_time_avg())
+       << "us sojourn_max:" << to_us(s.sojourn_time_max) << "us} ";
+  }
+  return ss.str();
+}
@@ -0,0 +1,141 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#ifndef OPENHD_OPENHD_OHD_TELEMETRY_SRC_ENDPOINTS_TELEMETRYTXSCHEDULER_H_
+#define OPENHD_OPENHD_OHD_TELEMETRY_SRC_ENDPOINTS_TELEMETRYTXSCHEDULER_H_
+
+#include <array>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "../mav_include.h"
+
+/**
+ * Sits between the telemetry producers and the (shallow) telemetry tx queue
+ * of the link. Instead of one FIFO that drops on overflow, messages are queued
+ * per priority class and handed to the link highest priority first, one
+ * aggregated packet at a time, only when the link has space. This way, a
+ * command doesn't wait behind a burst of bulk telemetry when the link is slow
+ * (e.g. the uplink contends with video for airtime).
+ * - Each class has a deadline, messages older than that are dropped instead of
+ * sent (a stale RC override / command does more harm than good).
+ * - Periodic messages are latest-value-wins: a new message with the same
+ * (msg id, sys id, comp id) replaces the queued one (keeping its position).
+ * - Nagle-style aggregation: Classes that are not flushed immediately are
+ * held back for a short time window (unless a full packet is queued), such
+ * that packets are filled towards max_mtu instead of carrying one or two
+ * messages each (messages from the FC UART come in small chunks).
+ * Thread-safe.
+ */
+class TelemetryTxScheduler {
+ public:
+  enum class Priority : int {
+    RC_OVERRIDE = 0,
+    COMMAND = 1,  // commands / acks / heartbeat
+    PARAM = 2,    // param and mission protocol
+    BULK = 3      // everything else
+  };
+  static constexpr int N_PRIORITIES = 4;
+  static Priority classify(uint32_t msg_id);
+  static bool is_latest_value_wins(uint32_t msg_id);
+  static std::string priority_as_string(Priority priority);
+
+  struct Config {
+    std::array<std::chrono::milliseconds, N_PRIORITIES> deadlines{
+        std::chrono::milliseconds(100), std::chrono::milliseconds(1000),
+        std::chrono::milliseconds(2000), std::chrono::milliseconds(1000)};
+    // On overflow, the oldest message of this class is dropped
+    std::array<int, N_PRIORITIES> max_queue_size{8, 32, 64, 128};
+    // max size of one aggregated packet
+    uint32_t max_mtu = 1024;
+    // See set_aggregation_window()
+    std::chrono::milliseconds aggregation_window{5};
+    std::array<bool, N_PRIORITIES> flush_immediately{true, true, false, false};
+  };
+  TelemetryTxScheduler();
+  explicit TelemetryTxScheduler(Config config);
+
+  void enqueue(MavlinkMessageSpan messages,
+               std::chrono::steady_clock::time_point now =
+                   std::chrono::steady_clock::now());
+  /**
+   * Drops stale messages, then packs up to max_n_packets packets, highest
+   * priority first. Messages of different classes are never aggregated into
+   * the same packet (they usually differ in n of injections).
+   */
+  std::vector<AggregatedMavlinkPacket> dequeue(
+      int max_n_packets, std::chrono::steady_clock::time_point now =
+                             std::chrono::steady_clock::now());
+  [[nodiscard]] bool is_empty() const;
+  /**
+   * Messages of classes that are not flushed immediately are sent once the
+   * oldest one has been queued for this long, or once they fill a packet.
+   * 0 disables aggregation over time (messages are sent as soon as the link has
+   * space).
+   */
+  void set_aggregation_window(std::chrono::milliseconds window);
+  // When dequeue() will return the messages currently held back for
+  // aggregation, std::nullopt if there are none.
+  [[nodiscard]] std::optional<std::chrono::steady_clock::time_point>
+  get_next_aggregation_flush() const;
+
+  struct ClassStats {
+    int queue_depth = 0;
+    int max_queue_depth = 0;
+    int64_t n_sent = 0;
+    int64_t n_replaced = 0;
+    int64_t n_dropped_stale = 0;
+    int64_t n_dropped_overflow = 0;
+    // time from enqueue to dequeue, of all sent messages
+    std::chrono::nanoseconds sojourn_time_total{0};
+    std::chrono::nanoseconds sojourn_time_max{0};
+    [[nodiscard]] std::chrono::nanoseconds sojourn_time_avg() const {
+      return n_sent > 0 ? sojourn_time_total / n_sent
+                        : std::chrono::nanoseconds(0);
+    }
+  };
+  struct Stats {
+    std::array<ClassStats, N_PRIORITIES> classes;
+    int64_t n_packets = 0;
+    int64_t n_packet_bytes = 0;
+    int curr_packets_per_second = 0;
+    // average packet size, in percent of max_mtu
+    int avg_fill_perc = 0;
+  };
+  [[nodiscard]] Stats get_stats() const;
+  static std::string stats_as_string(const Stats& stats);
+
+ private:
+  struct Entry {
+    MavlinkMessage msg;
+    std::chrono::steady_clock::time_point enqueue_time;
+  };
+  struct Class {
+    std::deque<Entry> queue;
+    // sum of the packed size of all queued messages
+    int queued_bytes = 0;
+    ClassStats stats;
+  };
+  void enqueue_locked(const MavlinkMessage& msg,
+                      std::chrono::steady_clock::time_point now);
+  static void pop_front(Class& c);
+  // true if the messages of this class should be held back for now
+  bool hold_back_for_aggregation(int class_idx,
+                                 std::chrono::steady_clock::time_point now) const;
+  const Config m_config;
+  mutable std::mutex m_mutex;
+  std::array<Class, N_PRIORITIES> m_classes;
+  std::chrono::milliseconds m_aggregation_window;
+  int64_t m_n_packets = 0;
+  int64_t m_n_packet_bytes = 0;
+  int m_curr_packets_per_second = 0;
+  int m_packets_per_second_count = 0;
+  std::chrono::steady_clock::time_point m_packets_per_second_begin{};
+};
+
+#endif  // OPENHD_OPENHD_OHD_TELEMETRY_SRC_ENDPOINTS_TELEMETRYTXSCHEDULER_H_
@@ -7,8 +7,9 @@
 #include <utility>
 
 UDPEndpoint::UDPEndpoint(const std::string& TAG, int senderPort,
-                         int receiverPort, std::string senderIp,
-                         std::string receiverIp)
+                         int receiverPort,
+                         std::shared_ptr<openhd::EventLoop> event_loop,
+                         std::string senderIp, std::string receiverIp)
     : MEndpoint(TAG),
       SEND_PORT(senderPort),
       RECV_PORT(receiverPort),
@@ -22,25 +23,23 @@ UDPEndpoint::UDPEndpoint(const std::string& TAG, int senderPort,
   };
   m_receiver_sender =
       std::make_unique<openhd::UDPReceiver>(RECV_IP, RECV_PORT, cb);
-  m_receiver_sender->runInBackground();
+  m_receiver_sender->runInEventLoop(std::move(event_loop));
 }
 
 UDPEndpoint::~UDPEndpoint() { m_receiver_sender->stopBackground(); }
 
-bool UDPEndpoint::sendMessagesImpl(
-    const std::vector<MavlinkMessage>& messages) {
-  auto message_buffers = aggregate_pack_messages(messages);
+bool UDPEndpoint::sendMessagesImpl(MavlinkMessageSpan messages) {
   const auto other_ips = get_all_curr_dest_ips();
-  for (const auto& message_buffer : message_buffers) {
-    m_receiver_sender->forwardPacketViaUDP(
-        SENDER_IP, SEND_PORT, message_buffer.aggregated_data->data(),
-        message_buffer.aggregated_data->size());
+  const auto send_fn = [this,
+                        &other_ips](const AggregatedMavlinkPacketView& view) {
+    m_receiver_sender->forwardPacketViaUDP(SENDER_IP, SEND_PORT, view.data,
+                                           view.data_len);
     for (const auto& ip : other_ips) {
-      m_receiver_sender->forwardPacketViaUDP(
-          ip, SEND_PORT, message_buffer.aggregated_data->data(),
-          message_buffer.aggregated_data->size());
+      m_receiver_sender->forwardPacketViaUDP(ip, SEND_PORT, view.data,
+                                             view.data_len);
     }
-  }
+  };
+  aggregate_pack_messages(messages, 1024, send_fn);
   return true;
 }
 
@@ -21,7 +21,9 @@
  */
 class UDPEndpoint : public MEndpoint {
  public:
+  // Receives on the given event loop
   UDPEndpoint(const std::string& TAG, int senderPort, int receiverPort,
+              std::shared_ptr<openhd::EventLoop> event_loop,
               std::string senderIp = openhd::ADDRESS_LOCALHOST,
               std::string receiverIp = openhd::ADDRESS_LOCALHOST);
   ~UDPEndpoint();
@@ -34,7 +36,7 @@ class UDPEndpoint : public MEndpoint {
 
  private:
   std::shared_ptr<spdlog::logger> m_console;
-  bool sendMessagesImpl(const std::vector<MavlinkMessage>& messages) override;
+  bool sendMessagesImpl(MavlinkMessageSpan messages) override;
   const std::string SENDER_IP;
   const int SEND_PORT;
   const std::string RECV_IP;
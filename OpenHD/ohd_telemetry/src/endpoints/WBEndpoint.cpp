@@ -6,8 +6,11 @@
 
 #include <utility>
 
-WBEndpoint::WBEndpoint(std::shared_ptr<OHDLink> link, std::string TAG)
-    : MEndpoint(std::move(TAG)), m_link_handle(std::move(link)) {
+WBEndpoint::WBEndpoint(std::shared_ptr<OHDLink> link, std::string TAG,
+                       std::shared_ptr<openhd::EventLoop> event_loop)
+    : MEndpoint(std::move(TAG)),
+      m_link_handle(std::move(link)),
+      m_event_loop(std::move(event_loop)) {
   // assert(m_tx_rx_handle);
   if (!m_link_handle) {
     openhd::log::get_default()->warn(
@@ -15,9 +18,14 @@ WBEndpoint::WBEndpoint(std::shared_ptr<OHDLink> link, std::string TAG)
         "air and ground)");
   } else {
     auto cb = [this](std::shared_ptr<std::vector<uint8_t>> data) {
-      MEndpoint::parseNewData(data->data(), data->size());
+      std::weak_ptr<int> alive = m_rx_alive_token;
+      m_event_loop->post([this, alive, data = std::move(data)] {
+        if (alive.expired()) return;
+        MEndpoint::parseNewData(data->data(), data->size());
+      });
     };
     m_link_handle->register_on_receive_telemetry_data_cb(cb);
+    m_tx_thread = std::make_unique<std::thread>([this] { loop_tx(); });
   }
 }
 
@@ -25,17 +33,74 @@ WBEndpoint::~WBEndpoint() {
   if (m_link_handle) {
     m_link_handle->register_on_receive_telemetry_data_cb(nullptr);
   }
+  // On the loop thread, such that no posted data is being parsed right now
+  m_event_loop->run_sync([this] { m_rx_alive_token = nullptr; });
+  if (m_tx_thread) {
+    {
+      std::lock_guard<std::mutex> lock(m_tx_wakeup_mutex);
+      m_tx_terminate = true;
+    }
+    m_tx_wakeup.notify_one();
+    m_tx_thread->join();
+    m_tx_thread = nullptr;
+  }
 }
 
-bool WBEndpoint::sendMessagesImpl(const std::vector<MavlinkMessage>& messages) {
-  auto message_buffers = aggregate_pack_messages(messages);
-  for (const auto& message_buffer : message_buffers) {
-    if (m_link_handle) {
-      std::lock_guard<std::mutex> guard(m_send_messages_mutex);
-      m_link_handle->transmit_telemetry_data(
-          {message_buffer.aggregated_data,
-           message_buffer.recommended_n_retransmissions});
-    }
+bool WBEndpoint::sendMessagesImpl(MavlinkMessageSpan messages) {
+  if (!m_link_handle) {
+    return true;
   }
+  m_tx_scheduler.enqueue(messages);
+  {
+    // Otherwise the wakeup might get lost between the tx thread checking the
+    // scheduler and waiting
+    std::lock_guard<std::mutex> lock(m_tx_wakeup_mutex);
+  }
+  m_tx_wakeup.notify_one();
   return true;
 }
+
+void WBEndpoint::loop_tx() {
+  while (!m_tx_terminate) {
+    const int n_free =
+        MAX_LINK_QUEUE_DEPTH - m_link_handle->get_telemetry_tx_queue_depth();
+    if (n_free > 0) {
+      const auto packets = m_tx_scheduler.dequeue(n_free);
+      for (const auto& packet : packets) {
+        m_link_handle->transmit_telemetry_data(
+            {packet.aggregated_data, packet.recommended_n_retransmissions});
+      }
+      if (!packets.empty()) continue;
+    }
+    std::unique_lock<std::mutex> lock(m_tx_wakeup_mutex);
+    if (m_tx_terminate) break;
+    const auto opt_next_flush = m_tx_scheduler.get_next_aggregation_flush();
+    if (!opt_next_flush.has_value()) {
+      // Nothing queued, wait for sendMessagesImpl()
+      m_tx_wakeup.wait(lock);
+    } else if (n_free <= 0) {
+      // The link does not notify us when it has sent a packet. A telemetry
+      // packet takes ~1ms of airtime (more under contention).
+      m_tx_wakeup.wait_for(lock, std::chrono::milliseconds(1));
+    } else {
+      // Messages are held back for aggregation - wait until the window
+      // expires, or until new messages (might fill a packet / high priority)
+      m_tx_wakeup.wait_until(lock, opt_next_flush.value());
+    }
+  }
+}
+
+void WBEndpoint::set_aggregation_window(std::chrono::milliseconds window) {
+  m_tx_scheduler.set_aggregation_window(window);
+  // Re-evaluate what is held back
+  {
+    std::lock_guard<std::mutex> lock(m_tx_wakeup_mutex);
+  }
+  m_tx_wakeup.notify_one();
+}
+
+std::string WBEndpoint::createInfo() const {
+  return MEndpoint::createInfo() + "tx scheduler: " +
+         TelemetryTxScheduler::stats_as_string(m_tx_scheduler.get_stats()) +
+         "\n";
+}
@@ -5,20 +5,48 @@
 #ifndef OPENHD_OPENHD_OHD_TELEMETRY_SRC_ENDPOINTS_WBENDPOINT_H_
 #define OPENHD_OPENHD_OHD_TELEMETRY_SRC_ENDPOINTS_WBENDPOINT_H_
 
+#include <atomic>
+#include <condition_variable>
+#include <thread>
+
 #include "MEndpoint.h"
+#include "TelemetryTxScheduler.h"
+#include "openhd_event_loop.h"
 #include "openhd_link.hpp"
 
 // Abstraction for sending / receiving data on/from the link between air and
-// ground unit
+// ground unit. Received data is handed over to the event loop (parsed and
+// forwarded there), the link's rx thread never calls into telemetry itself.
 class WBEndpoint : public MEndpoint {
  public:
-  explicit WBEndpoint(std::shared_ptr<OHDLink> link, std::string TAG);
+  explicit WBEndpoint(std::shared_ptr<OHDLink> link, std::string TAG,
+                      std::shared_ptr<openhd::EventLoop> event_loop);
   ~WBEndpoint();
+  // See TelemetryTxScheduler::set_aggregation_window()
+  void set_aggregation_window(std::chrono::milliseconds window);
+  [[nodiscard]] std::string createInfo() const override;
+  [[nodiscard]] TelemetryTxScheduler::Stats get_tx_scheduler_stats() const {
+    return m_tx_scheduler.get_stats();
+  }
 
  private:
   std::shared_ptr<OHDLink> m_link_handle;
-  bool sendMessagesImpl(const std::vector<MavlinkMessage>& messages) override;
-  std::mutex m_send_messages_mutex;
+  const std::shared_ptr<openhd::EventLoop> m_event_loop;
+  // Data posted to the loop is only parsed while this is alive (it might
+  // still be queued when we are destroyed)
+  std::shared_ptr<int> m_rx_alive_token = std::make_shared<int>(0);
+  bool sendMessagesImpl(MavlinkMessageSpan messages) override;
+  // Messages are not handed to the link directly, but go through the
+  // scheduler. The link queue is kept shallow (such that the scheduler decides
+  // what goes out next) by this thread.
+  TelemetryTxScheduler m_tx_scheduler;
+  void loop_tx();
+  std::unique_ptr<std::thread> m_tx_thread;
+  std::atomic<bool> m_tx_terminate = false;
+  std::mutex m_tx_wakeup_mutex;
+  std::condition_variable m_tx_wakeup;
+  // n of packets we allow to be queued inside the link at a time
+  static constexpr int MAX_LINK_QUEUE_DEPTH = 2;
 };
 
 #endif  // OPENHD_OPENHD_OHD_TELEMETRY_SRC_ENDPOINTS_WBENDPOINT_H_
@@ -0,0 +1,524 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#include "MavlinkFTPServer.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <sstream>
+
+#include "openhd_util.h"
+
+static constexpr int PAYLOAD_LEN = 251;
+static_assert(offsetof(MavlinkFTPServer::Payload, data) == 12 &&
+                  offsetof(MavlinkFTPServer::Payload, data) +
+                          MavlinkFTPServer::MAX_DATA_LEN ==
+                      PAYLOAD_LEN,
+              "Payload layout must match FILE_TRANSFER_PROTOCOL");
+
+// Never served, even inside a root (e.g. the link key in the settings dir)
+static bool is_hidden(const std::string& filename) {
+  static constexpr std::string_view SUFFIX = ".key";
+  return filename.size() >= SUFFIX.size() &&
+         filename.compare(filename.size() - SUFFIX.size(), SUFFIX.size(),
+                          SUFFIX) == 0;
+}
+
+static uint32_t clamp_file_size(off_t size) {
+  // Offsets are 32 bit - the rest of a larger file cannot be read
+  return static_cast<uint32_t>(std::min<off_t>(
+      size, std::numeric_limits<uint32_t>::max()));
+}
+
+MavlinkFTPServer::MavlinkFTPServer(uint8_t sys_id, uint8_t comp_id,
+                                   std::vector<Root> roots)
+    : MavlinkComponent(sys_id, comp_id), m_roots(std::move(roots)) {
+  m_console = openhd::log::create_or_get("ftp");
+}
+
+MavlinkFTPServer::~MavlinkFTPServer() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (int i = 0; i < MAX_N_SESSIONS; i++) close_session_locked(i);
+  if (m_crc_job.has_value()) close(m_crc_job->fd);
+}
+
+std::vector<MavlinkMessage> MavlinkFTPServer::process_mavlink_messages(
+    MavlinkMessageSpan messages) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  std::vector<MavlinkMessage> ret;
+  for (const auto& msg : messages) {
+    if (msg.m.msgid != MAVLINK_MSG_ID_FILE_TRANSFER_PROTOCOL) continue;
+    mavlink_file_transfer_protocol_t ftp;
+    mavlink_msg_file_transfer_protocol_decode(&msg.m, &ftp);
+    if (ftp.target_system != m_sys_id || ftp.target_component != m_comp_id) {
+      continue;
+    }
+    handle_request_locked(Requester{msg.m.sysid, msg.m.compid},
+                          decode_payload(msg.m), ret);
+  }
+  // Start bursts right away instead of on the next generate call
+  pump_locked(ret);
+  return ret;
+}
+
+std::vector<MavlinkMessage> MavlinkFTPServer::generate_mavlink_messages() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  const auto now = std::chrono::steady_clock::now();
+  for (int i = 0; i < MAX_N_SESSIONS; i++) {
+    const auto& session = m_sessions[i];
+    if (session.fd >= 0 && !session.burst.has_value() &&
+        now - session.last_activity > SESSION_TIMEOUT) {
+      m_console->debug("Session {} timed out", i);
+      m_stats.n_sessions_timed_out++;
+      close_session_locked(i);
+    }
+  }
+  std::vector<MavlinkMessage> ret;
+  pump_locked(ret);
+  return ret;
+}
+
+MavlinkComponent::MessageFilter MavlinkFTPServer::get_message_filter() const {
+  return {{MAVLINK_MSG_ID_FILE_TRANSFER_PROTOCOL}, true};
+}
+
+void MavlinkFTPServer::set_tx_budget_bytes_per_second(
+    std::optional<int> bytes_per_second) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_tx_budget.set_bytes_per_second(bytes_per_second);
+}
+
+MavlinkFTPServer::Payload MavlinkFTPServer::decode_payload(
+    const mavlink_message_t& msg) {
+  mavlink_file_transfer_protocol_t ftp;
+  mavlink_msg_file_transfer_protocol_decode(&msg, &ftp);
+  Payload ret{};
+  std::memcpy(&ret, ftp.payload, PAYLOAD_LEN);
+  return ret;
+}
+
+MavlinkMessage MavlinkFTPServer::create_message(uint8_t sys_id,
+                                                uint8_t comp_id,
+                                                uint8_t target_sys_id,
+                                                uint8_t target_comp_id,
+                                                const Payload& payload) {
+  uint8_t buf[PAYLOAD_LEN];
+  std::memcpy(buf, &payload, PAYLOAD_LEN);
+  MavlinkMessage msg;
+  mavlink_msg_file_transfer_protocol_pack(sys_id, comp_id, &msg.m, 0,
+                                          target_sys_id, target_comp_id, buf);
+  return msg;
+}
+
+std::string MavlinkFTPServer::Stats::to_string() const {
+  std::stringstream ss;
+  ss << "FTP{requests:" << n_requests << " duplicates:" << n_duplicate_requests
+     << " naks:" << n_naks << " bursts:" << n_bursts
+     << " burst_packets:" << n_burst_packets
+     << " sent:" << n_file_bytes / 1024 << "KiB"
+     << " sessions_timed_out:" << n_sessions_timed_out << "}";
+  return ss.str();
+}
+
+MavlinkFTPServer::Stats MavlinkFTPServer::get_stats() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_stats;
+}
+
+void MavlinkFTPServer::handle_request_locked(const Requester& requester,
+                                             const Payload& req,
+                                             std::vector<MavlinkMessage>& ret) {
+  m_stats.n_requests++;
+  const auto key = std::make_pair(requester.sys_id, requester.comp_id);
+  auto cached = m_last_responses.find(key);
+  if (cached != m_last_responses.end() &&
+      cached->second.req_seq_number == req.seq_number) {
+    // Our response got lost
+    m_stats.n_duplicate_requests++;
+    ret.push_back(cached->second.response);
+    return;
+  }
+  Payload response{};
+  response.seq_number = req.seq_number + 1;
+  response.session = req.session;
+  response.opcode = ACK;
+  response.req_opcode = req.opcode;
+  response.offset = req.offset;
+  bool respond_now = true;
+  switch (req.opcode) {
+    case NONE:
+      break;
+    case TERMINATE_SESSION:
+      if (get_session_locked(req.session) == nullptr) {
+        set_nak(response, ERR_INVALID_SESSION);
+      } else {
+        close_session_locked(req.session);
+      }
+      break;
+    case RESET_SESSIONS:
+      for (int i = 0; i < MAX_N_SESSIONS; i++) close_session_locked(i);
+      break;
+    case LIST_DIRECTORY:
+      respond_now = list_directory_locked(req, response);
+      break;
+    case OPEN_FILE_RO:
+      respond_now = open_file_locked(req, response);
+      break;
+    case READ_FILE:
+      respond_now = read_file_locked(req, response);
+      break;
+    case BURST_READ_FILE:
+      respond_now = burst_read_file_locked(requester, req, response);
+      break;
+    case CALC_FILE_CRC32:
+      respond_now = calc_file_crc32_locked(requester, req, response);
+      break;
+    case CREATE_FILE:
+    case WRITE_FILE:
+    case REMOVE_FILE:
+    case CREATE_DIRECTORY:
+    case REMOVE_DIRECTORY:
+    case OPEN_FILE_WO:
+    case TRUNCATE_FILE:
+    case RENAME:
+      set_nak(response, ERR_FILE_PROTECTED);
+      break;
+    default:
+      set_nak(response, ERR_UNKNOWN_COMMAND);
+      break;
+  }
+  if (!respond_now) return;
+  if (response.opcode == NAK) m_stats.n_naks++;
+  const auto msg = send_locked(requester, response);
+  ret.push_back(msg);
+  m_last_responses[key] = CachedResponse{req.seq_number, msg};
+}
+
+bool MavlinkFTPServer::list_directory_locked(const Payload& req,
+                                             Payload& response) {
+  const auto path = resolve_path(get_path(req));
+  if (!path.has_value()) {
+    set_nak(response, ERR_FILE_NOT_FOUND);
+    return true;
+  }
+  // Sorted, such that the entry index (offset) is stable between requests
+  std::vector<std::string> entries;
+  if (path->empty()) {
+    for (const auto& root : m_roots) entries.push_back("D" + root.name);
+  } else {
+    std::error_code error;
+    std::filesystem::directory_iterator it(path.value(), error);
+    if (error) {
+      set_nak(response, ERR_FILE_NOT_FOUND);
+      return true;
+    }
+    for (; it != std::filesystem::directory_iterator(); it.increment(error)) {
+      const auto name = it->path().filename().string();
+      if (is_hidden(name)) continue;
+      // Same as resolve_path(), a symlink to a hidden file is hidden
+      if (it->is_symlink(error) &&
+          is_hidden(std::filesystem::weakly_canonical(it->path(), error)
+                        .filename()
+                        .string())) {
+        continue;
+      }
+      if (it->is_directory(error)) {
+        entries.push_back("D" + name);
+      } else if (it->is_regular_file(error)) {
+        const auto size = it->file_size(error);
+        entries.push_back("F" + name + "\t" +
+                          std::to_string(error ? 0 : size));
+      }
+    }
+    std::sort(entries.begin(), entries.end(),
+              [](const std::string& a, const std::string& b) {
+                return a.substr(1) < b.substr(1);
+              });
+  }
+  if (req.offset >= entries.size()) {
+    set_nak(response, ERR_EOF);
+    return true;
+  }
+  size_t len = 0;
+  for (size_t i = req.offset; i < entries.size(); i++) {
+    auto entry = entries[i];
+    // Would never fit, keep the index of the following entries
+    if (entry.size() + 1 > MAX_DATA_LEN) entry = "S";
+    if (len + entry.size() + 1 > MAX_DATA_LEN) break;
+    std::memcpy(response.data.data() + len, entry.c_str(), entry.size() + 1);
+    len += entry.size() + 1;
+  }
+  response.size = len;
+  return true;
+}
+
+bool MavlinkFTPServer::open_file_locked(const Payload& req,
+                                        Payload& response) {
+  const auto path = resolve_path(get_path(req));
+  if (!path.has_value() || path->empty()) {
+    set_nak(response, ERR_FILE_NOT_FOUND);
+    return true;
+  }
+  int session = -1;
+  for (int i = 0; i < MAX_N_SESSIONS; i++) {
+    if (m_sessions[i].fd < 0) {
+      session = i;
+      break;
+    }
+  }
+  if (session < 0) {
+    set_nak(response, ERR_NO_SESSIONS_AVAILABLE);
+    return true;
+  }
+  const int fd = open(path->c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat st {};
+  if (fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    const int err = errno;
+    if (fd >= 0) close(fd);
+    if (fd < 0 && err == ENOENT) {
+      set_nak(response, ERR_FILE_NOT_FOUND);
+    } else {
+      set_nak(response, ERR_FAIL_ERRNO, err);
+    }
+    return true;
+  }
+  auto& s = m_sessions[session];
+  s.fd = fd;
+  s.file_size = clamp_file_size(st.st_size);
+  s.last_activity = std::chrono::steady_clock::now();
+  s.burst = std::nullopt;
+  m_console->debug("Session {}: {} ({} bytes)", session, path.value(),
+                   s.file_size);
+  response.session = session;
+  response.size = sizeof(uint32_t);
+  std::memcpy(response.data.data(), &s.file_size, sizeof(uint32_t));
+  return true;
+}
+
+bool MavlinkFTPServer::read_file_locked(const Payload& req,
+                                        Payload& response) {
+  auto* session = get_session_locked(req.session);
+  if (session == nullptr) {
+    set_nak(response, ERR_INVALID_SESSION);
+    return true;
+  }
+  session->last_activity = std::chrono::steady_clock::now();
+  if (req.offset >= session->file_size) {
+    set_nak(response, ERR_EOF);
+    return true;
+  }
+  const auto len = std::min<uint32_t>(
+      {MAX_DATA_LEN, session->file_size - req.offset,
+       req.size > 0 ? req.size : static_cast<uint32_t>(MAX_DATA_LEN)});
+  const auto n = pread(session->fd, response.data.data(), len, req.offset);
+  if (n <= 0) {
+    set_nak(response, n < 0 ? ERR_FAIL_ERRNO : ERR_EOF, errno);
+    return true;
+  }
+  response.size = n;
+  m_stats.n_file_bytes += n;
+  return true;
+}
+
+bool MavlinkFTPServer::burst_read_file_locked(const Requester& requester,
+                                              const Payload& req,
+                                              Payload& response) {
+  auto* session = get_session_locked(req.session);
+  if (session == nullptr) {
+    set_nak(response, ERR_INVALID_SESSION);
+    return true;
+  }
+  session->last_activity = std::chrono::steady_clock::now();
+  if (req.offset >= session->file_size) {
+    set_nak(response, ERR_EOF);
+    response.burst_complete = 1;
+    return true;
+  }
+  // Replaces a burst that might still be running on this session - the client
+  // knows best what it is missing
+  const uint32_t end = std::min<uint64_t>(
+      session->file_size, uint64_t{req.offset} + BURST_MAX_N_BYTES);
+  session->burst = Burst{req.offset, end,
+                         static_cast<uint16_t>(req.seq_number + 1), requester};
+  m_stats.n_bursts++;
+  return false;
+}
+
+bool MavlinkFTPServer::calc_file_crc32_locked(const Requester& requester,
+                                              const Payload& req,
+                                              Payload& response) {
+  if (m_crc_job.has_value() &&
+      m_crc_job->requester.sys_id == requester.sys_id &&
+      m_crc_job->requester.comp_id == requester.comp_id &&
+      m_crc_job->response.seq_number == response.seq_number) {
+    // Retry of the request that is still being processed
+    return false;
+  }
+  const auto path = resolve_path(get_path(req));
+  if (!path.has_value() || path->empty()) {
+    set_nak(response, ERR_FILE_NOT_FOUND);
+    return true;
+  }
+  const int fd = open(path->c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    set_nak(response, errno == ENOENT ? ERR_FILE_NOT_FOUND : ERR_FAIL_ERRNO,
+            errno);
+    return true;
+  }
+  // Only one at a time, a new request (e.g. the client gave up waiting)
+  // replaces the previous one
+  if (m_crc_job.has_value()) close(m_crc_job->fd);
+  m_crc_job = CrcJob{fd, 0, requester, response};
+  return false;
+}
+
+void MavlinkFTPServer::pump_locked(std::vector<MavlinkMessage>& ret) {
+  if (m_crc_job.has_value()) {
+    auto& job = m_crc_job.value();
+    std::vector<uint8_t> buf(64 * 1024);
+    int n_read = 0;
+    ssize_t n = 0;
+    while (n_read < CRC_N_BYTES_PER_CALL &&
+           (n = read(job.fd, buf.data(), buf.size())) > 0) {
+      job.crc = OHDUtil::crc32(buf.data(), n, job.crc);
+      n_read += n;
+    }
+    if (n <= 0) {
+      if (n < 0) {
+        set_nak(job.response, ERR_FAIL_ERRNO, errno);
+        m_stats.n_naks++;
+      } else {
+        job.response.size = sizeof(uint32_t);
+        std::memcpy(job.response.data.data(), &job.crc, sizeof(uint32_t));
+      }
+      const auto msg = send_locked(job.requester, job.response);
+      ret.push_back(msg);
+      m_last_responses[{job.requester.sys_id, job.requester.comp_id}] =
+          CachedResponse{static_cast<uint16_t>(job.response.seq_number - 1),
+                         msg};
+      close(job.fd);
+      m_crc_job = std::nullopt;
+    }
+  }
+  int budget = m_tx_budget.refill();
+  int n_idle = 0;
+  while (budget > 0 && n_idle < MAX_N_SESSIONS) {
+    const int idx = m_next_burst_session;
+    m_next_burst_session = (m_next_burst_session + 1) % MAX_N_SESSIONS;
+    auto& session = m_sessions[idx];
+    if (session.fd < 0 || !session.burst.has_value()) {
+      n_idle++;
+      continue;
+    }
+    n_idle = 0;
+    auto& burst = session.burst.value();
+    Payload packet{};
+    packet.seq_number = burst.seq_number++;
+    packet.session = idx;
+    packet.opcode = ACK;
+    packet.req_opcode = BURST_READ_FILE;
+    packet.offset = burst.offset;
+    const auto len = std::min<uint32_t>(MAX_DATA_LEN, burst.end - burst.offset);
+    const auto n = pread(session.fd, packet.data.data(), len, burst.offset);
+    if (n <= 0) {
+      // File shrunk / read error
+      set_nak(packet, n < 0 ? ERR_FAIL_ERRNO : ERR_EOF, errno);
+      packet.burst_complete = 1;
+      m_stats.n_naks++;
+      session.burst = std::nullopt;
+    } else {
+      packet.size = n;
+      burst.offset += n;
+      m_stats.n_file_bytes += n;
+      if (burst.offset >= burst.end) {
+        packet.burst_complete = 1;
+      }
+    }
+    const auto requester = burst.requester;
+    if (packet.burst_complete) session.burst = std::nullopt;
+    session.last_activity = std::chrono::steady_clock::now();
+    m_stats.n_burst_packets++;
+    const auto msg = send_locked(requester, packet);
+    ret.push_back(msg);
+    budget -= MAVLINK_NUM_NON_PAYLOAD_BYTES + msg.m.len;
+  }
+}
+
+void MavlinkFTPServer::close_session_locked(int session) {
+  auto& s = m_sessions[session];
+  if (s.fd >= 0) close(s.fd);
+  s = Session{};
+}
+
+MavlinkFTPServer::Session* MavlinkFTPServer::get_session_locked(
+    uint8_t session) {
+  if (session >= MAX_N_SESSIONS || m_sessions[session].fd < 0) return nullptr;
+  return &m_sessions[session];
+}
+
+std::optional<std::string> MavlinkFTPServer::resolve_path(
+    const std::string& path) const {
+  // Split into components, ignoring empty ones (leading / double /)
+  std::vector<std::string> components;
+  std::stringstream ss(path);
+  std::string component;
+  while (std::getline(ss, component, '/')) {
+    if (component.empty() || component == ".") continue;
+    if (component == ".." || is_hidden(component)) return std::nullopt;
+    components.push_back(component);
+  }
+  if (components.empty()) return std::string{};
+  const auto root = std::find_if(
+      m_roots.begin(), m_roots.end(),
+      [&components](const Root& r) { return r.name == components[0]; });
+  if (root == m_roots.end()) return std::nullopt;
+  std::filesystem::path ret(root->path);
+  for (size_t i = 1; i < components.size(); i++) ret /= components[i];
+  // A symlink inside a root must not lead outside of it
+  std::error_code error_root;
+  std::error_code error;
+  const auto canonical_root =
+      std::filesystem::weakly_canonical(root->path, error_root);
+  const auto canonical = std::filesystem::weakly_canonical(ret, error);
+  if (error_root || error) return std::nullopt;
+  const auto rel = canonical.lexically_relative(canonical_root);
+  if (rel.empty() || *rel.begin() == "..") return std::nullopt;
+  // Nor to a hidden file (e.g. a link to the link key)
+  if (is_hidden(canonical.filename().string())) return std::nullopt;
+  return canonical.string();
+}
+
+std::string MavlinkFTPServer::get_path(const Payload& req) {
+  const auto len = std::min<size_t>(req.size, MAX_DATA_LEN);
+  const auto* begin = reinterpret_cast<const char*>(req.data.data());
+  return std::string(begin, strnlen(begin, len));
+}
+
+void MavlinkFTPServer::set_nak(Payload& response, Error error,
+                               int errno_value) {
+  response.opcode = NAK;
+  response.data[0] = error;
+  response.size = 1;
+  if (error == ERR_FAIL_ERRNO) {
+    response.data[1] = static_cast<uint8_t>(errno_value);
+    response.size = 2;
+  }
+}
+
+MavlinkMessage MavlinkFTPServer::send_locked(const Requester& requester,
+                                             const Payload& payload) {
+  auto msg = create_message(m_sys_id, m_comp_id, requester.sys_id,
+                            requester.comp_id, payload);
+  // Responses are sent even without budget, paid back by the bursts
+  m_tx_budget.consume(MAVLINK_NUM_NON_PAYLOAD_BYTES + msg.m.len);
+  return msg;
+}
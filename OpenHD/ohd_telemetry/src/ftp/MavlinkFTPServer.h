@@ -0,0 +1,207 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#ifndef OPENHD_OPENHD_OHD_TELEMETRY_SRC_FTP_MAVLINKFTPSERVER_H_
+#define OPENHD_OPENHD_OHD_TELEMETRY_SRC_FTP_MAVLINKFTPSERVER_H_
+
+#include <array>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "../routing/MavlinkComponent.hpp"
+#include "openhd_spdlog.h"
+#include "openhd_tx_budget.h"
+
+/**
+ * Read-only MAVLink FTP server (FILE_TRANSFER_PROTOCOL, see
+ * https://mavlink.io/en/services/ftp.html), such that files on the air unit
+ * (e.g. recordings) can be pulled over the link.
+ * The given roots show up as directories under "/" - nothing outside of them
+ * can be listed or read, and nothing can be written.
+ * Made for the lossy link, where the uplink is the expensive direction:
+ * - BurstReadFile streams one window (up to BURST_MAX_N_BYTES) of the file per
+ * request, instead of one request per packet with ReadFile. Packets lost on
+ * the way down are re-requested (ReadFile / another burst) by the client.
+ * - Up to MAX_N_SESSIONS sessions (e.g. the same file opened multiple times)
+ * can burst at the same time, they are served round-robin. This way the
+ * downlink doesn't sit idle while the request for the next window of one
+ * session (or the re-request of a gap) is on its way.
+ * - A repeated request (same seq, the response got lost) is answered with the
+ * cached response instead of being executed again.
+ * - Everything is sent within a tx budget (token bucket, like
+ * XMavlinkParamProvider), such that a download never takes more than its
+ * share of the link. Bursts are sent from generate_mavlink_messages() and when
+ * a request comes in, as far as the budget allows.
+ * Thread-safe.
+ */
+class MavlinkFTPServer : public MavlinkComponent {
+ public:
+  struct Root {
+    // Shows up as /<name>
+    std::string name;
+    // Directory on the air unit
+    std::string path;
+  };
+  MavlinkFTPServer(uint8_t sys_id, uint8_t comp_id, std::vector<Root> roots);
+  ~MavlinkFTPServer();
+  MavlinkFTPServer(const MavlinkFTPServer&) = delete;
+  MavlinkFTPServer& operator=(const MavlinkFTPServer&) = delete;
+  // override from component
+  std::vector<MavlinkMessage> process_mavlink_messages(
+      MavlinkMessageSpan messages) override;
+  // override from component
+  std::vector<MavlinkMessage> generate_mavlink_messages() override;
+  // override from component - only FILE_TRANSFER_PROTOCOL for us
+  [[nodiscard]] MessageFilter get_message_filter() const override;
+  // Bytes per second of packed mavlink messages, std::nullopt == unlimited
+  void set_tx_budget_bytes_per_second(std::optional<int> bytes_per_second);
+
+  enum Opcode : uint8_t {
+    NONE = 0,
+    TERMINATE_SESSION = 1,
+    RESET_SESSIONS = 2,
+    LIST_DIRECTORY = 3,
+    OPEN_FILE_RO = 4,
+    READ_FILE = 5,
+    CREATE_FILE = 6,
+    WRITE_FILE = 7,
+    REMOVE_FILE = 8,
+    CREATE_DIRECTORY = 9,
+    REMOVE_DIRECTORY = 10,
+    OPEN_FILE_WO = 11,
+    TRUNCATE_FILE = 12,
+    RENAME = 13,
+    CALC_FILE_CRC32 = 14,
+    BURST_READ_FILE = 15,
+    ACK = 128,
+    NAK = 129
+  };
+  // First data byte of a NAK
+  enum Error : uint8_t {
+    ERR_NONE = 0,
+    ERR_FAIL = 1,
+    ERR_FAIL_ERRNO = 2,
+    ERR_INVALID_DATA_SIZE = 3,
+    ERR_INVALID_SESSION = 4,
+    ERR_NO_SESSIONS_AVAILABLE = 5,
+    ERR_EOF = 6,
+    ERR_UNKNOWN_COMMAND = 7,
+    ERR_FILE_EXISTS = 8,
+    ERR_FILE_PROTECTED = 9,
+    ERR_FILE_NOT_FOUND = 10
+  };
+  static constexpr int MAX_DATA_LEN = 239;
+  // The payload of FILE_TRANSFER_PROTOCOL (251 bytes, no padding)
+  struct Payload {
+    uint16_t seq_number;
+    uint8_t session;
+    uint8_t opcode;
+    uint8_t size;
+    uint8_t req_opcode;
+    uint8_t burst_complete;
+    uint8_t padding;
+    uint32_t offset;
+    std::array<uint8_t, MAX_DATA_LEN> data;
+  };
+  static Payload decode_payload(const mavlink_message_t& msg);
+  static MavlinkMessage create_message(uint8_t sys_id, uint8_t comp_id,
+                                       uint8_t target_sys_id,
+                                       uint8_t target_comp_id,
+                                       const Payload& payload);
+
+  static constexpr int MAX_N_SESSIONS = 4;
+  // A multiple of MAX_DATA_LEN, such that the packets of consecutive windows
+  // share the same offset grid
+  static constexpr uint32_t BURST_MAX_N_BYTES = MAX_DATA_LEN * 128;
+  // Sessions the client forgot to terminate are closed after this long
+  static constexpr auto SESSION_TIMEOUT = std::chrono::seconds(30);
+  // Read per call while calculating a CRC, such that a large file doesn't
+  // block the telemetry loop
+  static constexpr int CRC_N_BYTES_PER_CALL = 1024 * 1024;
+
+  struct Stats {
+    int64_t n_requests = 0;
+    int64_t n_duplicate_requests = 0;
+    int64_t n_naks = 0;
+    int64_t n_bursts = 0;
+    int64_t n_burst_packets = 0;
+    // file content sent (ReadFile / BurstReadFile)
+    int64_t n_file_bytes = 0;
+    int64_t n_sessions_timed_out = 0;
+    [[nodiscard]] std::string to_string() const;
+  };
+  Stats get_stats();
+
+ private:
+  struct Requester {
+    uint8_t sys_id;
+    uint8_t comp_id;
+  };
+  struct Burst {
+    uint32_t offset;
+    uint32_t end;
+    uint16_t seq_number;
+    Requester requester;
+  };
+  struct Session {
+    int fd = -1;
+    uint32_t file_size = 0;
+    std::chrono::steady_clock::time_point last_activity;
+    std::optional<Burst> burst;
+  };
+  struct CrcJob {
+    int fd;
+    uint32_t crc;
+    Requester requester;
+    Payload response;
+  };
+  struct CachedResponse {
+    uint16_t req_seq_number;
+    MavlinkMessage response;
+  };
+  void handle_request_locked(const Requester& requester, const Payload& req,
+                             std::vector<MavlinkMessage>& ret);
+  // The handlers fill in the response (ACK by default). Return false if the
+  // response is sent later (burst, CRC).
+  bool list_directory_locked(const Payload& req, Payload& response);
+  bool open_file_locked(const Payload& req, Payload& response);
+  bool read_file_locked(const Payload& req, Payload& response);
+  bool burst_read_file_locked(const Requester& requester, const Payload& req,
+                              Payload& response);
+  bool calc_file_crc32_locked(const Requester& requester, const Payload& req,
+                              Payload& response);
+  void pump_locked(std::vector<MavlinkMessage>& ret);
+  void close_session_locked(int session);
+  [[nodiscard]] Session* get_session_locked(uint8_t session);
+  /**
+   * Maps a path of the client (e.g. /recordings/1.mkv) to the file on the air
+   * unit. Returns an empty string for "/" (the list of roots), std::nullopt
+   * if the path is outside of the roots (or hidden).
+   */
+  [[nodiscard]] std::optional<std::string> resolve_path(
+      const std::string& path) const;
+  static std::string get_path(const Payload& req);
+  static void set_nak(Payload& response, Error error, int errno_value = 0);
+  MavlinkMessage send_locked(const Requester& requester,
+                             const Payload& payload);
+
+ private:
+  const std::vector<Root> m_roots;
+  std::shared_ptr<spdlog::logger> m_console;
+  std::mutex m_mutex;
+  std::array<Session, MAX_N_SESSIONS> m_sessions;
+  // Sessions are served round-robin while bursting
+  int m_next_burst_session = 0;
+  std::optional<CrcJob> m_crc_job;
+  std::map<std::pair<uint8_t, uint8_t>, CachedResponse> m_last_responses;
+  // See set_tx_budget_bytes_per_second()
+  openhd::TxBudget m_tx_budget;
+  Stats m_stats;
+};
+
+#endif  // OPENHD_OPENHD_OHD_TELEMETRY_SRC_FTP_MAVLINKFTPSERVER_H_
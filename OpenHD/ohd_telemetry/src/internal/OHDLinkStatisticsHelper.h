@@ -6,6 +6,7 @@
 #define OPENHD_OPENHD_OHD_TELEMETRY_SRC_INTERNAL_OHDLINKSTATISTICSHELPER_H_
 
 #include "../mav_include.h"
+#include "StatsChangeFilter.h"
 #include "openhd_action_handler.h"
 #include "openhd_link_statistics.hpp"
 
@@ -260,5 +261,198 @@ static MavlinkMessage generate_sys_status1(
   return msg;
 }
 
+// Per field thresholds for StatsChangeFilter, in the same order as the
+// pack_ functions above. Group names are used for the user overrides, e.g.
+// "card.rx_rssi".
+#define OHD_STATS_FIELD(T, field, threshold, relative)                 \
+  StatsChangeFilter::Field<T> {                                        \
+    #field, [](const T& s) -> int64_t { return s.field; }, threshold, \
+        relative                                                       \
+  }
+static constexpr bool ABSOLUTE = false;
+// Threshold in percent of the last sent value
+static constexpr bool RELATIVE = true;
+static constexpr int ANY = StatsChangeFilter::THRESHOLD_ANY_CHANGE;
+static constexpr int NEVER = StatsChangeFilter::THRESHOLD_NEVER;
+
+using CardStats =
+    openhd::link_statistics::Xmavlink_openhd_stats_monitor_mode_wifi_card_t;
+static const std::vector<StatsChangeFilter::Field<CardStats>>& card_fields() {
+  static const std::vector<StatsChangeFilter::Field<CardStats>> fields{
+      OHD_STATS_FIELD(CardStats, rx_rssi, 3, ABSOLUTE),
+      OHD_STATS_FIELD(CardStats, rx_rssi_1, 3, ABSOLUTE),
+      OHD_STATS_FIELD(CardStats, rx_rssi_2, 3, ABSOLUTE),
+      OHD_STATS_FIELD(CardStats, count_p_received, NEVER, ABSOLUTE),
+      OHD_STATS_FIELD(CardStats, count_p_injected, NEVER, ABSOLUTE),
+      OHD_STATS_FIELD(CardStats, curr_rx_packet_loss_perc, 2, ABSOLUTE),
+      OHD_STATS_FIELD(CardStats, card_type, ANY, ABSOLUTE),
+      OHD_STATS_FIELD(CardStats, tx_power_current, ANY, ABSOLUTE),
+      OHD_STATS_FIELD(CardStats, tx_power_armed, ANY, ABSOLUTE),
+      OHD_STATS_FIELD(CardStats, tx_power_disarmed, ANY, ABSOLUTE),
+      OHD_STATS_FIELD(CardStats, curr_status, ANY, ABSOLUTE),
+      OHD_STATS_FIELD(CardStats, rx_signal_quality_adapter, 5, ABSOLUTE),
+      OHD_STATS_FIELD(CardStats, rx_noise_adapter, 3, ABSOLUTE),
+      OHD_STATS_FIELD(CardStats, tx_active, ANY, ABSOLUTE)};
+  return fields;
+}
+
+using LinkStats =
+    openhd::link_statistics::Xmavlink_openhd_stats_monitor_mode_wifi_link_t;
+static const std::vector<StatsChangeFilter::Field<LinkStats>>& link_fields() {
+  static const std::vector<StatsChangeFilter::Field<LinkStats>> fields{
+      OHD_STATS_FIELD(LinkStats, curr_tx_pps, 10, RELATIVE),
+      OHD_STATS_FIELD(LinkStats, curr_rx_pps, 10, RELATIVE),
+      OHD_STATS_FIELD(LinkStats, curr_tx_bps, 10, RELATIVE),
+      OHD_STATS_FIELD(LinkStats, curr_rx_bps, 10, RELATIVE),
+      // Errors / drops are what the user needs to see asap
+      OHD_STATS_FIELD(LinkStats, count_tx_inj_error_hint, ANY, ABSOLUTE),
+      OHD_STATS_FIELD(LinkStats, count_tx_dropped_packets, ANY, ABSOLUTE),
+      OHD_STATS_FIELD(LinkStats, curr_rx_packet_loss_perc, 2, ABSOLUTE),
+      OHD_STATS_FIELD(LinkStats, curr_tx_mcs_index, ANY, ABSOLUTE),
+      OHD_STATS_FIELD(LinkStats, curr_tx_channel_mhz, ANY, ABSOLUTE),
+      OHD_STATS_FIELD(LinkStats, curr_tx_channel_w_mhz, ANY, ABSOLUTE),
+      OHD_STATS_FIELD(LinkStats, curr_rx_big_gaps_counter, ANY, ABSOLUTE),
+      OHD_STATS_FIELD(LinkStats, bitfield, ANY, ABSOLUTE),
+      OHD_STATS_FIELD(LinkStats, curr_rate_kbits, ANY, ABSOLUTE),
+      OHD_STATS_FIELD(LinkStats, curr_n_rate_adjustments, ANY, ABSOLUTE),
+      OHD_STATS_FIELD(LinkStats, pollution_perc, 5, ABSOLUTE)};
+  return fields;
+}
+
+using TeleStats = openhd::link_statistics::Xmavlink_openhd_stats_telemetry_t;
+static const std::vector<StatsChangeFilter::Field<TeleStats>>& tele_fields() {
+  static const std::vector<StatsChangeFilter::Field<TeleStats>> fields{
+      OHD_STATS_FIELD(TeleStats, curr_tx_pps, 10, RELATIVE),
+      OHD_STATS_FIELD(TeleStats, curr_rx_pps, 10, RELATIVE),
+      OHD_STATS_FIELD(TeleStats, curr_tx_bps, 10, RELATIVE),
+      OHD_STATS_FIELD(TeleStats, curr_rx_bps, 10, RELATIVE),
+      OHD_STATS_FIELD(TeleStats, curr_rx_packet_loss_perc, 2, ABSOLUTE)};
+  return fields;
+}
+
+using VidAirStats =
+    openhd::link_statistics::Xmavlink_openhd_stats_wb_video_air_t;
+static const std::vector<StatsChangeFilter::Field<VidAirStats>>&
+vid_air_fields() {
+  static const std::vector<StatsChangeFilter::Field<VidAirStats>> fields{
+      OHD_STATS_FIELD(VidAirStats, curr_recommended_bitrate, ANY, ABSOLUTE),
+      OHD_STATS_FIELD(VidAirStats, curr_measured_encoder_bitrate, 10,
+                      RELATIVE),
+      OHD_STATS_FIELD(VidAirStats, curr_injected_bitrate, 10, RELATIVE),
+      OHD_STATS_FIELD(VidAirStats, curr_injected_pps, 10, RELATIVE),
+      OHD_STATS_FIELD(VidAirStats, curr_dropped_frames, ANY, ABSOLUTE),
+      OHD_STATS_FIELD(VidAirStats, curr_fec_percentage, ANY, ABSOLUTE)};
+  return fields;
+}
+
+using AirFecStats = openhd::link_statistics::
+    Xmavlink_openhd_stats_wb_video_air_fec_performance_t;
+static const std::vector<StatsChangeFilter::Field<AirFecStats>>&
+air_fec_fields() {
+  static const std::vector<StatsChangeFilter::Field<AirFecStats>> fields{
+      OHD_STATS_FIELD(AirFecStats, curr_fec_encode_time_avg_us, 20, RELATIVE),
+      OHD_STATS_FIELD(AirFecStats, curr_fec_encode_time_min_us, 20, RELATIVE),
+      OHD_STATS_FIELD(AirFecStats, curr_fec_encode_time_max_us, 20, RELATIVE),
+      OHD_STATS_FIELD(AirFecStats, curr_fec_block_size_avg, 10, RELATIVE),
+      OHD_STATS_FIELD(AirFecStats, curr_fec_block_size_min, 10, RELATIVE),
+      OHD_STATS_FIELD(AirFecStats, curr_fec_block_size_max, 10, RELATIVE),
+      OHD_STATS_FIELD(AirFecStats, curr_tx_delay_min_us, 20, RELATIVE),
+      OHD_STATS_FIELD(AirFecStats, curr_tx_delay_max_us, 20, RELATIVE),
+      OHD_STATS_FIELD(AirFecStats, curr_tx_delay_avg_us, 20, RELATIVE)};
+  return fields;
+}
+
+using VidGndStats =
+    openhd::link_statistics::Xmavlink_openhd_stats_wb_video_ground_t;
+static const std::vector<StatsChangeFilter::Field<VidGndStats>>&
+vid_gnd_fields() {
+  static const std::vector<StatsChangeFilter::Field<VidGndStats>> fields{
+      OHD_STATS_FIELD(VidGndStats, curr_incoming_bitrate, 10, RELATIVE),
+      OHD_STATS_FIELD(VidGndStats, count_blocks_total, NEVER, ABSOLUTE),
+      OHD_STATS_FIELD(VidGndStats, count_blocks_lost, ANY, ABSOLUTE),
+      OHD_STATS_FIELD(VidGndStats, count_blocks_recovered, NEVER, ABSOLUTE),
+      OHD_STATS_FIELD(VidGndStats, count_fragments_recovered, NEVER,
+                      ABSOLUTE)};
+  return fields;
+}
+
+using GndFecStats = openhd::link_statistics::
+    Xmavlink_openhd_stats_wb_video_ground_fec_performance_t;
+static const std::vector<StatsChangeFilter::Field<GndFecStats>>&
+gnd_fec_fields() {
+  static const std::vector<StatsChangeFilter::Field<GndFecStats>> fields{
+      OHD_STATS_FIELD(GndFecStats, curr_fec_decode_time_avg_us, 20, RELATIVE),
+      OHD_STATS_FIELD(GndFecStats, curr_fec_decode_time_min_us, 20, RELATIVE),
+      OHD_STATS_FIELD(GndFecStats, curr_fec_decode_time_max_us, 20,
+                      RELATIVE)};
+  return fields;
+}
+
+using GndOperatingMode =
+    openhd::link_statistics::Xmavlink_openhd_wifbroadcast_gnd_operating_mode_t;
+static const std::vector<StatsChangeFilter::Field<GndOperatingMode>>&
+gnd_operating_mode_fields() {
+  static const std::vector<StatsChangeFilter::Field<GndOperatingMode>> fields{
+      OHD_STATS_FIELD(GndOperatingMode, operating_mode, ANY, ABSOLUTE),
+      OHD_STATS_FIELD(GndOperatingMode, tx_passive_mode_is_enabled, ANY,
+                      ABSOLUTE)};
+  return fields;
+}
+
+using CamInfo = openhd::LinkActionHandler::CamInfo;
+static const std::vector<StatsChangeFilter::Field<CamInfo>>& camera_fields() {
+  static const std::vector<StatsChangeFilter::Field<CamInfo>> fields{
+      OHD_STATS_FIELD(CamInfo, cam_type, ANY, ABSOLUTE),
+      OHD_STATS_FIELD(CamInfo, cam_status, ANY, ABSOLUTE),
+      OHD_STATS_FIELD(CamInfo, air_recording_active, ANY, ABSOLUTE),
+      OHD_STATS_FIELD(CamInfo, encoding_format, ANY, ABSOLUTE),
+      OHD_STATS_FIELD(CamInfo, encoding_bitrate_kbits, ANY, ABSOLUTE),
+      OHD_STATS_FIELD(CamInfo, encoding_keyframe_interval, ANY, ABSOLUTE),
+      OHD_STATS_FIELD(CamInfo, stream_w, ANY, ABSOLUTE),
+      OHD_STATS_FIELD(CamInfo, stream_h, ANY, ABSOLUTE),
+      OHD_STATS_FIELD(CamInfo, stream_fps, ANY, ABSOLUTE),
+      OHD_STATS_FIELD(CamInfo, supports_variable_bitrate, ANY, ABSOLUTE)};
+  return fields;
+}
+
+// See OnboardComputerStatusProvider for the (re-) use of the fields
+using OnboardStatus = mavlink_onboard_computer_status_t;
+static const std::vector<StatsChangeFilter::Field<OnboardStatus>>&
+onboard_computer_status_fields() {
+  static const std::vector<StatsChangeFilter::Field<OnboardStatus>> fields{
+      OHD_STATS_FIELD(OnboardStatus, cpu_cores[0], 5, ABSOLUTE),
+      OHD_STATS_FIELD(OnboardStatus, temperature_core[0], 2, ABSOLUTE),
+      // clocks
+      OHD_STATS_FIELD(OnboardStatus, storage_type[0], 10, RELATIVE),
+      OHD_STATS_FIELD(OnboardStatus, storage_type[1], 10, RELATIVE),
+      OHD_STATS_FIELD(OnboardStatus, storage_type[2], 10, RELATIVE),
+      OHD_STATS_FIELD(OnboardStatus, storage_type[3], 10, RELATIVE),
+      OHD_STATS_FIELD(OnboardStatus, storage_usage[0], 10, RELATIVE),
+      // space left, ina219 voltage / current
+      OHD_STATS_FIELD(OnboardStatus, storage_usage[1], 1, RELATIVE),
+      OHD_STATS_FIELD(OnboardStatus, storage_usage[2], 2, RELATIVE),
+      OHD_STATS_FIELD(OnboardStatus, storage_usage[3], 5, RELATIVE),
+      OHD_STATS_FIELD(OnboardStatus, link_type[0], ANY, ABSOLUTE),
+      OHD_STATS_FIELD(OnboardStatus, ram_usage, 5, ABSOLUTE),
+      OHD_STATS_FIELD(OnboardStatus, ram_total, ANY, ABSOLUTE),
+      OHD_STATS_FIELD(OnboardStatus, link_tx_rate[0], ANY, ABSOLUTE),
+      // fc sys id, operating mode
+      OHD_STATS_FIELD(OnboardStatus, fan_speed[0], ANY, ABSOLUTE),
+      OHD_STATS_FIELD(OnboardStatus, fan_speed[1], ANY, ABSOLUTE)};
+  return fields;
+}
+
+using SysStatus1 = mavlink_openhd_sys_status1_t;
+static const std::vector<StatsChangeFilter::Field<SysStatus1>>&
+sys_status1_fields() {
+  static const std::vector<StatsChangeFilter::Field<SysStatus1>> fields{
+      OHD_STATS_FIELD(SysStatus1, wifi_hotspot_state, ANY, ABSOLUTE),
+      OHD_STATS_FIELD(SysStatus1, wifi_hotspot_frequency, ANY, ABSOLUTE),
+      OHD_STATS_FIELD(SysStatus1, ethernet_hotspot_state, ANY, ABSOLUTE),
+      OHD_STATS_FIELD(SysStatus1, external_devices_count, ANY, ABSOLUTE)};
+  return fields;
+}
+#undef OHD_STATS_FIELD
+
 }  // namespace openhd::LinkStatisticsHelper
 #endif  // OPENHD_OPENHD_OHD_TELEMETRY_SRC_INTERNAL_OHDLINKSTATISTICSHELPER_H_
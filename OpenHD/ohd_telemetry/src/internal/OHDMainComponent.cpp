@@ -56,7 +56,7 @@ std::vector<MavlinkMessage> OHDMainComponent::generate_mavlink_messages() {
 }
 
 std::vector<MavlinkMessage> OHDMainComponent::process_mavlink_messages(
-    std::vector<MavlinkMessage> messages) {
+    MavlinkMessageSpan messages) {
   std::vector<MavlinkMessage> ret{};
   for (const auto& msg : messages) {
     switch (msg.m.msgid) {  // NOLINT(cppcoreguidelines-narrowing-conversions)
@@ -96,10 +96,29 @@ std::vector<MavlinkMessage> OHDMainComponent::process_mavlink_messages(
   return ret;
 }
 
+MavlinkComponent::MessageFilter OHDMainComponent::get_message_filter() const {
+  // Needs to match process_mavlink_messages(). The commands check their target
+  // themselves.
+  return {{MAVLINK_MSG_ID_TIMESYNC, MAVLINK_MSG_ID_COMMAND_LONG,
+           MAVLINK_MSG_ID_GLOBAL_POSITION_INT},
+          false};
+}
+
+void OHDMainComponent::set_stats_filter_config(
+    StatsChangeFilter::Config config) {
+  m_stats_filter.set_config(std::move(config));
+}
+
+StatsChangeFilter::Stats OHDMainComponent::get_stats_filter_stats() {
+  return m_stats_filter.get_stats();
+}
+
 std::vector<MavlinkMessage> OHDMainComponent::generate_mav_wb_stats() {
   // m_console->debug("OHDMainComponent::generate_mav_wb_stats");
-  const auto latest_stats =
-      openhd::LinkActionHandler::instance().get_link_stats();
+  // No copy, the snapshot stays valid while we pack it
+  const auto latest_stats_snapshot =
+      openhd::LinkActionHandler::instance().link_stats().read_ref();
+  const auto& latest_stats = *latest_stats_snapshot;
   if (!latest_stats.ready) {
     // Not yet updated
     return {};
@@ -119,28 +138,54 @@ std::vector<MavlinkMessage> OHDMainComponent::generate_mav_wb_stats() {
     }
     MavlinkMessage msg = openhd::LinkStatisticsHelper::pack_card(
         m_sys_id, m_comp_id, card_index, card_stats);
+    if (m_stats_filter.should_send("card", card_index, card_stats,
+                                   openhd::LinkStatisticsHelper::card_fields(),
+                                   msg)) {
+      ret.push_back(msg);
+    }
     card_index++;
-    ret.push_back(msg);
   }
-  ret.push_back(openhd::LinkStatisticsHelper::pack_link_general(
-      m_sys_id, m_comp_id, latest_stats.monitor_mode_link));
-  ret.push_back(openhd::LinkStatisticsHelper::pack_tele(
-      m_sys_id, m_comp_id, latest_stats.telemetry));
+  // Adds msg if it changed meaningfully / the keep-alive elapsed
+  auto add_if_needed = [this, &ret](const char* group, int index,
+                                    const auto& stats, const auto& fields,
+                                    const MavlinkMessage& msg) {
+    if (m_stats_filter.should_send(group, index, stats, fields, msg)) {
+      ret.push_back(msg);
+    }
+  };
+  add_if_needed("link", 0, latest_stats.monitor_mode_link,
+                openhd::LinkStatisticsHelper::link_fields(),
+                openhd::LinkStatisticsHelper::pack_link_general(
+                    m_sys_id, m_comp_id, latest_stats.monitor_mode_link));
+  add_if_needed("tele", 0, latest_stats.telemetry,
+                openhd::LinkStatisticsHelper::tele_fields(),
+                openhd::LinkStatisticsHelper::pack_tele(
+                    m_sys_id, m_comp_id, latest_stats.telemetry));
   if (RUNS_ON_AIR) {
     for (const auto& stats : latest_stats.stats_wb_video_air) {
-      ret.push_back(openhd::LinkStatisticsHelper::pack_vid_air(
-          m_sys_id, m_comp_id, stats));
+      add_if_needed("vid_air", stats.link_index, stats,
+                    openhd::LinkStatisticsHelper::vid_air_fields(),
+                    openhd::LinkStatisticsHelper::pack_vid_air(
+                        m_sys_id, m_comp_id, stats));
     }
-    ret.push_back(openhd::LinkStatisticsHelper::pack_vid_air_fec_performance(
-        m_sys_id, m_comp_id, latest_stats.air_fec_performance));
+    add_if_needed("air_fec", 0, latest_stats.air_fec_performance,
+                  openhd::LinkStatisticsHelper::air_fec_fields(),
+                  openhd::LinkStatisticsHelper::pack_vid_air_fec_performance(
+                      m_sys_id, m_comp_id, latest_stats.air_fec_performance));
   } else {
     for (const auto& ground_video : latest_stats.stats_wb_video_ground) {
-      ret.push_back(openhd::LinkStatisticsHelper::pack_vid_gnd(
-          m_sys_id, m_comp_id, ground_video));
+      add_if_needed("vid_gnd", ground_video.link_index, ground_video,
+                    openhd::LinkStatisticsHelper::vid_gnd_fields(),
+                    openhd::LinkStatisticsHelper::pack_vid_gnd(
+                        m_sys_id, m_comp_id, ground_video));
     }
-    ret.push_back(openhd::LinkStatisticsHelper::pack_vid_gnd_fec_performance(
-        m_sys_id, m_comp_id, latest_stats.gnd_fec_performance));
-    ret.push_back(
+    add_if_needed("gnd_fec", 0, latest_stats.gnd_fec_performance,
+                  openhd::LinkStatisticsHelper::gnd_fec_fields(),
+                  openhd::LinkStatisticsHelper::pack_vid_gnd_fec_performance(
+                      m_sys_id, m_comp_id, latest_stats.gnd_fec_performance));
+    add_if_needed(
+        "gnd_mode", 0, latest_stats.gnd_operating_mode,
+        openhd::LinkStatisticsHelper::gnd_operating_mode_fields(),
         openhd::LinkStatisticsHelper::
             pack_mavlink_openhd_wifbroadcast_gnd_operating_mode(
                 m_sys_id, m_comp_id, latest_stats.gnd_operating_mode));
@@ -148,9 +193,11 @@ std::vector<MavlinkMessage> OHDMainComponent::generate_mav_wb_stats() {
         nullptr) {
       auto channels =
           openhd::LinkActionHandler::instance().wb_get_supported_channels();
-      ret.push_back(openhd::LinkStatisticsHelper::
-                        generate_msg_openhd_wifibroadcast_supported_channels(
-                            m_sys_id, m_comp_id, channels));
+      const auto msg = openhd::LinkStatisticsHelper::
+          generate_msg_openhd_wifibroadcast_supported_channels(
+              m_sys_id, m_comp_id, channels);
+      // Only changes with the card(s)
+      if (m_stats_filter.should_send("channels", 0, msg)) ret.push_back(msg);
     }
     auto progress_x =
         openhd::LinkActionHandler::instance().get_analyze_results();
@@ -234,7 +281,7 @@ std::optional<MavlinkMessage> OHDMainComponent::handle_timesync_message(
 }
 
 void OHDMainComponent::check_fc_messages_for_actions(
-    const std::vector<MavlinkMessage>& messages) {
+    MavlinkMessageSpan messages) {
   for (const auto& msg : messages) {
     if (msg.m.msgid == MAVLINK_MSG_ID_HEARTBEAT) {
       // This is mainly for the user to debug
@@ -296,17 +343,37 @@ OHDMainComponent::create_broadcast_stats_if_needed() {
           m_air_fc_sys_id.load(), 0};
     }
     OnboardComputerStatusProvider::ExtraUartInfo extra{m_air_fc_sys_id};
-    ret.push_back(m_onboard_computer_status_provider
-                      ->get_current_status_as_mavlink_message(
-                          m_sys_id, m_comp_id, opt_uart_info));
-    ret.push_back(openhd::LinkStatisticsHelper::generate_sys_status1(
-        m_sys_id, m_comp_id, openhd::LinkActionHandler::instance()));
+    const auto status_msg =
+        m_onboard_computer_status_provider
+            ->get_current_status_as_mavlink_message(m_sys_id, m_comp_id,
+                                                    opt_uart_info);
+    mavlink_onboard_computer_status_t status;
+    mavlink_msg_onboard_computer_status_decode(&status_msg.m, &status);
+    if (m_stats_filter.should_send(
+            "onboard", 0, status,
+            openhd::LinkStatisticsHelper::onboard_computer_status_fields(),
+            status_msg)) {
+      ret.push_back(status_msg);
+    }
+    const auto sys_status1_msg =
+        openhd::LinkStatisticsHelper::generate_sys_status1(
+            m_sys_id, m_comp_id, openhd::LinkActionHandler::instance());
+    mavlink_openhd_sys_status1_t sys_status1;
+    mavlink_msg_openhd_sys_status1_decode(&sys_status1_msg.m, &sys_status1);
+    if (m_stats_filter.should_send(
+            "sys_status1", 0, sys_status1,
+            openhd::LinkStatisticsHelper::sys_status1_fields(),
+            sys_status1_msg)) {
+      ret.push_back(sys_status1_msg);
+    }
   }
   {
     const auto elapsed_version = now - m_last_version_message_tp;
     if (elapsed_version > m_version_message_interval) {
       m_last_version_message_tp = now;
-      ret.push_back(generate_ohd_version());
+      const auto msg = generate_ohd_version();
+      // Never changes at run time
+      if (m_stats_filter.should_send("version", 0, msg)) ret.push_back(msg);
     }
   }
   const auto elapsed_wb = now - m_last_wb_stats;
@@ -320,12 +387,22 @@ OHDMainComponent::create_broadcast_stats_if_needed() {
       // though we are not the camera itself, We send the broadcast message(s)
       // for it
       if (cam_stats1.active) {
-        ret.push_back(openhd::LinkStatisticsHelper::pack_camera_stats(
-            m_sys_id, MAV_COMP_ID_CAMERA, cam_stats1));
+        const auto msg = openhd::LinkStatisticsHelper::pack_camera_stats(
+            m_sys_id, MAV_COMP_ID_CAMERA, cam_stats1);
+        if (m_stats_filter.should_send(
+                "camera", 0, cam_stats1,
+                openhd::LinkStatisticsHelper::camera_fields(), msg)) {
+          ret.push_back(msg);
+        }
       }
       if (cam_stats2.active) {
-        ret.push_back(openhd::LinkStatisticsHelper::pack_camera_stats(
-            m_sys_id, MAV_COMP_ID_CAMERA2, cam_stats2));
+        const auto msg = openhd::LinkStatisticsHelper::pack_camera_stats(
+            m_sys_id, MAV_COMP_ID_CAMERA2, cam_stats2);
+        if (m_stats_filter.should_send(
+                "camera", 1, cam_stats2,
+                openhd::LinkStatisticsHelper::camera_fields(), msg)) {
+          ret.push_back(msg);
+        }
       }
     }
   }
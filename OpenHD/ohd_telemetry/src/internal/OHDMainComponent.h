@@ -13,6 +13,7 @@
 
 #include "../mav_helper.h"
 #include "OnboardComputerStatusProvider.h"
+#include "StatsChangeFilter.h"
 #include "last_known_position/LastKnowPosition.h"
 #include "openhd_action_handler.h"
 #include "openhd_link_statistics.hpp"
@@ -43,14 +44,19 @@ class OHDMainComponent : public MavlinkComponent {
   std::vector<MavlinkMessage> generate_mavlink_messages() override;
   // override from component
   std::vector<MavlinkMessage> process_mavlink_messages(
-      std::vector<MavlinkMessage> messages) override;
+      MavlinkMessageSpan messages) override;
+  // override from component
+  [[nodiscard]] MessageFilter get_message_filter() const override;
   void process_command_self(const mavlink_command_long_t& command,
                             int source_sys_id, int source_comp_id,
                             std::vector<MavlinkMessage>& message_buffer);
   // Some features rely on the arming state of the FC, like adjusting tx power &
   // Some features rely on (RC) channel switches, like changing the mcs index
-  void check_fc_messages_for_actions(
-      const std::vector<MavlinkMessage>& messages);
+  void check_fc_messages_for_actions(MavlinkMessageSpan messages);
+  // The stats messages are only sent on change / keep-alive, see
+  // StatsChangeFilter. Disabled (always sent) by default.
+  void set_stats_filter_config(StatsChangeFilter::Config config);
+  StatsChangeFilter::Stats get_stats_filter_stats();
 
  private:
   const bool RUNS_ON_AIR;
@@ -95,6 +101,7 @@ class OHDMainComponent : public MavlinkComponent {
   // Only set / used on air, where we have a uart connection to the FC and
   // therefore can be 100% sure about the FC sys id
   std::atomic_int16_t m_air_fc_sys_id = -1;
+  StatsChangeFilter m_stats_filter;
 };
 
 #endif  // XMAVLINKSERVICE_INTERNALTELEMETRY_H
@@ -0,0 +1,113 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#include "StatsChangeFilter.h"
+
+#include <cstdlib>
+#include <sstream>
+
+void StatsChangeFilter::set_config(StatsChangeFilter::Config config) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_config = std::move(config);
+  // Such that the new thresholds apply from a fresh baseline
+  m_states.clear();
+}
+
+bool StatsChangeFilter::should_send_values(
+    const char* group, int index, const std::vector<FieldValue>& values,
+    int n_bytes, std::chrono::steady_clock::time_point now) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  bool send = m_config.keep_alive_interval.count() == 0;
+  if (!send) {
+    auto it = m_states.find({group, index});
+    if (it == m_states.end() ||
+        it->second.last_sent_values.size() != values.size() ||
+        now - it->second.last_sent >= m_config.keep_alive_interval) {
+      send = true;
+    } else {
+      const auto& last_sent_values = it->second.last_sent_values;
+      for (size_t i = 0; i < values.size() && !send; i++) {
+        const auto& field = values[i];
+        int threshold = field.threshold;
+        if (!m_config.thresholds.empty()) {
+          const auto custom = m_config.thresholds.find(
+              std::string(group) + "." + field.name);
+          if (custom != m_config.thresholds.end()) {
+            threshold = custom->second;
+          }
+        }
+        send = is_significant(last_sent_values[i], field.value, threshold,
+                              field.relative);
+      }
+    }
+    if (send) {
+      auto& state = m_states[{group, index}];
+      state.last_sent = now;
+      state.last_sent_values.resize(values.size());
+      for (size_t i = 0; i < values.size(); i++) {
+        state.last_sent_values[i] = values[i].value;
+      }
+    }
+  }
+  if (send) {
+    m_stats.n_sent++;
+    m_stats.n_bytes_sent += n_bytes;
+  } else {
+    m_stats.n_suppressed++;
+    m_stats.n_bytes_saved += n_bytes;
+  }
+  return send;
+}
+
+bool StatsChangeFilter::is_significant(int64_t last, int64_t value,
+                                       int threshold, bool relative) {
+  if (threshold < 0 || value == last) return false;
+  const int64_t diff = std::abs(value - last);
+  if (relative) {
+    return diff * 100 >= (int64_t)threshold * std::abs(last);
+  }
+  return diff >= threshold;
+}
+
+StatsChangeFilter::Stats StatsChangeFilter::get_stats() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_stats;
+}
+
+std::string StatsChangeFilter::Stats::to_string() const {
+  std::stringstream ss;
+  ss << "StatsChangeFilter{sent:" << n_sent << " suppressed:" << n_suppressed
+     << " bytes_sent:" << n_bytes_sent << " bytes_saved:" << n_bytes_saved
+     << "}";
+  return ss.str();
+}
+
+std::optional<std::map<std::string, int>> StatsChangeFilter::parse_thresholds(
+    const std::string& value) {
+  std::map<std::string, int> ret;
+  std::stringstream ss(value);
+  std::string entry;
+  while (std::getline(ss, entry, ',')) {
+    if (entry.empty()) continue;
+    const auto sep = entry.find(':');
+    if (sep == std::string::npos) return std::nullopt;
+    const auto name = entry.substr(0, sep);
+    const auto dot = name.find('.');
+    if (dot == std::string::npos || dot == 0 || dot + 1 == name.size()) {
+      return std::nullopt;
+    }
+    try {
+      size_t n_parsed = 0;
+      const auto threshold_str = entry.substr(sep + 1);
+      const auto threshold = std::stoi(threshold_str, &n_parsed);
+      if (n_parsed != threshold_str.size() || threshold < THRESHOLD_NEVER) {
+        return std::nullopt;
+      }
+      ret[name] = threshold;
+    } catch (const std::exception&) {
+      return std::nullopt;
+    }
+  }
+  return ret;
+}
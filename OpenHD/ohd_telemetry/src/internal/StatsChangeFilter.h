@@ -0,0 +1,115 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#ifndef OPENHD_OPENHD_OHD_TELEMETRY_SRC_INTERNAL_STATSCHANGEFILTER_H_
+#define OPENHD_OPENHD_OHD_TELEMETRY_SRC_INTERNAL_STATSCHANGEFILTER_H_
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "../mav_include.h"
+
+/**
+ * Change detection for the OpenHD stats messages (link, cards, camera, ...),
+ * which are regenerated in regular intervals whether anything changed or not.
+ * Per message instance (e.g. the stats of card 1), compares each field to the
+ * value it had when the message was last sent:
+ * - Sent immediately if any field changed by at least its threshold.
+ * - Otherwise only once per keep-alive interval, such that the ground never
+ * shows stale values for long (and knows the air unit is still there).
+ * Thresholds are per field, with a default per field that can be overridden
+ * (see parse_thresholds).
+ * Thread-safe.
+ */
+class StatsChangeFilter {
+ public:
+  // Change needed to send the message before its keep-alive
+  static constexpr int THRESHOLD_ANY_CHANGE = 0;
+  // The field never triggers a send (e.g. ever-increasing counters), it goes
+  // out with the keep-alive
+  static constexpr int THRESHOLD_NEVER = -1;
+  template <typename T>
+  struct Field {
+    const char* name;
+    int64_t (*get)(const T&);
+    // In units of the field, or in percent of the last sent value if relative
+    int threshold;
+    bool relative;
+  };
+  struct Config {
+    // Disabled (every message is sent every time) if 0
+    std::chrono::milliseconds keep_alive_interval{0};
+    // "<group>.<field>" -> threshold, overrides the default of the field
+    std::map<std::string, int> thresholds;
+  };
+  void set_config(Config config);
+  /**
+   * @param group name of the message, e.g. "card"
+   * @param index instance of the message, e.g. the card index
+   * @param msg the packed message, for the stats
+   * @return true if @param msg should be sent now
+   */
+  template <typename T>
+  bool should_send(const char* group, int index, const T& value,
+                   const std::vector<Field<T>>& fields,
+                   const MavlinkMessage& msg,
+                   std::chrono::steady_clock::time_point now =
+                       std::chrono::steady_clock::now()) {
+    std::vector<FieldValue> values;
+    values.reserve(fields.size());
+    for (const auto& field : fields) {
+      values.push_back(FieldValue{field.name, field.get(value),
+                                  field.threshold, field.relative});
+    }
+    return should_send_values(group, index, values, msg.get_packed_size(),
+                              now);
+  }
+  // For messages without fields that change (e.g. the version), only the
+  // keep-alive
+  bool should_send(const char* group, int index, const MavlinkMessage& msg,
+                   std::chrono::steady_clock::time_point now =
+                       std::chrono::steady_clock::now()) {
+    return should_send_values(group, index, {}, msg.get_packed_size(), now);
+  }
+  struct Stats {
+    int64_t n_sent = 0;
+    int64_t n_suppressed = 0;
+    int64_t n_bytes_sent = 0;
+    int64_t n_bytes_saved = 0;
+    [[nodiscard]] std::string to_string() const;
+  };
+  Stats get_stats();
+  // Format: "group.field:threshold,group.field:threshold", e.g.
+  // "card.rx_rssi:5,link.curr_rx_bps:20". Empty string is valid (no
+  // overrides), std::nullopt if malformed.
+  static std::optional<std::map<std::string, int>> parse_thresholds(
+      const std::string& value);
+
+ private:
+  struct FieldValue {
+    const char* name;
+    int64_t value;
+    int threshold;
+    bool relative;
+  };
+  struct State {
+    std::chrono::steady_clock::time_point last_sent;
+    std::vector<int64_t> last_sent_values;
+  };
+  bool should_send_values(const char* group, int index,
+                          const std::vector<FieldValue>& values, int n_bytes,
+                          std::chrono::steady_clock::time_point now);
+  static bool is_significant(int64_t last, int64_t value, int threshold,
+                             bool relative);
+  std::mutex m_mutex;
+  Config m_config;
+  std::map<std::pair<std::string, int>, State> m_states;
+  Stats m_stats;
+};
+
+#endif  // OPENHD_OPENHD_OHD_TELEMETRY_SRC_INTERNAL_STATSCHANGEFILTER_H_
@@ -128,7 +128,7 @@ static void debugMavlinkMessage(const mavlink_message_t& msg, const char* TAG) {
   printf("%s message with ID %d, sequence: %d from component %d of system %d\n",
          TAG, (int)msg.msgid, msg.seq, msg.compid, msg.sysid);
 }
-static void debugMavlinkMessages(const std::vector<MavlinkMessage>& messages,
+static void debugMavlinkMessages(MavlinkMessageSpan messages,
                                  const char* TAG) {
   for (const auto& msg : messages) {
     debugMavlinkMessage(msg.m, TAG);
@@ -219,7 +219,24 @@ struct MTarget {
 };
 static MTarget get_target_from_message_if_available(
     const mavlink_message_t& msg) {
-  // if(msg.incompat_flags)
+  // Generic, works for all messages that have a target (the same info the
+  // mavlink routing rules are based on). A mavlink2 payload might be truncated
+  // (trailing zeroes) - a target that has been cut off is 0 (broadcast).
+  const mavlink_msg_entry_t* entry = mavlink_get_msg_entry(msg.msgid);
+  if (entry != nullptr) {
+    const auto* payload = reinterpret_cast<const uint8_t*>(_MAV_PAYLOAD(&msg));
+    MTarget ret{0, 0};
+    if ((entry->flags & MAV_MSG_ENTRY_FLAG_HAVE_TARGET_SYSTEM) &&
+        entry->target_system_ofs < msg.len) {
+      ret.sys_id = payload[entry->target_system_ofs];
+    }
+    if ((entry->flags & MAV_MSG_ENTRY_FLAG_HAVE_TARGET_COMPONENT) &&
+        entry->target_component_ofs < msg.len) {
+      ret.comp_id = payload[entry->target_component_ofs];
+    }
+    return ret;
+  }
+  // Unknown msg id, fall back to the messages we know
   if (msg.msgid == MAVLINK_MSG_ID_COMMAND_LONG) {
     mavlink_command_long_t command;
     mavlink_msg_command_long_decode(&msg, &command);
@@ -251,7 +268,7 @@ static MTarget get_target_from_message_if_available(
 // speaking, we fill 2 buckets (generic and local_only) with the given
 // message(s)
 static std::tuple<std::vector<MavlinkMessage>, std::vector<MavlinkMessage>>
-split_into_generic_and_local_only(const std::vector<MavlinkMessage>& messages,
+split_into_generic_and_local_only(MavlinkMessageSpan messages,
                                   uint16_t local_target_sys_id) {
   std::vector<MavlinkMessage> generic{};
   generic.reserve(messages.size());
@@ -270,7 +287,7 @@ split_into_generic_and_local_only(const std::vector<MavlinkMessage>& messages,
 
 // Return all messages where the source sys id matches the given sys id
 static std::vector<MavlinkMessage> filter_by_source_sys_id(
-    const std::vector<MavlinkMessage>& messages, uint16_t source_sys_id) {
+    MavlinkMessageSpan messages, uint16_t source_sys_id) {
   std::vector<MavlinkMessage> ret;
   for (const auto& msg : messages) {
     if (msg.m.sysid == source_sys_id) {
@@ -16,6 +16,9 @@ extern "C" {
 #include <memory>
 #include <vector>
 
+#include "openhd_buffer_pool.h"
+#include "openhd_span.h"
+
 // OpenHD mavlink sys IDs
 // Any mavlink message generated by openhd on the ground unit uses this sys id
 static constexpr auto OHD_SYS_ID_GROUND = 100;
@@ -44,70 +47,110 @@ struct MavlinkMessage {
     buf.resize(size);
     return buf;
   }
+  // Pack directly into the given buffer, which needs to have space for at
+  // least get_packed_size() bytes. Returns the n of written bytes.
+  int pack_into(uint8_t* buf) const {
+    return mavlink_msg_to_send_buffer(buf, &m);
+  }
+  // The n of bytes pack() / pack_into() produce, without packing the message.
+  // (Upper bound for mavlink2 messages with a non-trimmed payload, which are
+  // trimmed on packing)
+  [[nodiscard]] int get_packed_size() const {
+    if (m.magic == MAVLINK_STX_MAVLINK1) {
+      return MAVLINK_CORE_HEADER_MAVLINK1_LEN + 1 + m.len +
+             MAVLINK_NUM_CHECKSUM_BYTES;
+    }
+    const int signature_len = (m.incompat_flags & MAVLINK_IFLAG_SIGNED)
+                                  ? MAVLINK_SIGNATURE_BLOCK_LEN
+                                  : 0;
+    return MAVLINK_CORE_HEADER_LEN + 1 + m.len + MAVLINK_NUM_CHECKSUM_BYTES +
+           signature_len;
+  }
 };
 
+// Non-owning view on one or more mavlink messages - received messages are
+// passed to all consumers this way, without copying them.
+using MavlinkMessageSpan = openhd::Span<const MavlinkMessage>;
+
 struct AggregatedMavlinkPacket {
   std::shared_ptr<std::vector<uint8_t>> aggregated_data;
   int recommended_n_retransmissions = 1;
   // how many mavlink packet(s) have been aggregated together
   int n_aggregated_mavlink_packets = 0;
 };
+// View on an aggregated packet - the data is only valid for the duration of
+// the callback it is passed to.
+struct AggregatedMavlinkPacketView {
+  const uint8_t* data;
+  int data_len;
+  int recommended_n_retransmissions = 1;
+  int n_aggregated_mavlink_packets = 0;
+};
 /**
  * It is more efficient to aggregate / keep mavlink messages in chunks instead
  * of using a wb packet for each of them - Aggregates the given mavlink
  * message(s) int packets >=@param max_mtu The n of recommended retransmissions
  * is the highest recommended number of all aggregated mavlink messages.
+ * The messages are packed directly into a re-used (per thread) buffer, no
+ * allocations - @param cb is called for each aggregated packet.
  */
-static std::vector<AggregatedMavlinkPacket> aggregate_pack_messages(
-    const std::vector<MavlinkMessage>& messages, uint32_t max_mtu = 1024) {
-  std::vector<AggregatedMavlinkPacket> ret;
-  auto buff = std::make_shared<std::vector<uint8_t>>();
-  buff->reserve(max_mtu);
-  int recommended_n_retransmissions = 1;
-  int n_aggregated_mavlink_packets = 0;
+template <class F>
+static void aggregate_pack_messages(MavlinkMessageSpan messages,
+                                    uint32_t max_mtu, F cb) {
+  // One message might exceed the mtu (it is sent alone then)
+  thread_local std::vector<uint8_t> buff;
+  if (buff.size() < max_mtu + MAVLINK_MAX_PACKET_LEN) {
+    buff.resize(max_mtu + MAVLINK_MAX_PACKET_LEN);
+  }
+  AggregatedMavlinkPacketView view{buff.data(), 0, 1, 0};
   for (const auto& msg : messages) {
-    auto data = msg.pack();
-    if (buff->size() + data.size() <= max_mtu) {
-      // we haven't reached MTU yet
-      buff->insert(buff->end(), data.begin(), data.end());
-      n_aggregated_mavlink_packets++;
-      if (msg.recommended_n_injections > recommended_n_retransmissions) {
-        recommended_n_retransmissions = msg.recommended_n_injections;
-      }
-    } else {
-      // MTU is reached or we need to allocate a new buffer
-      if (!buff->empty()) {
-        ret.push_back({buff, recommended_n_retransmissions});
-        buff = std::make_shared<std::vector<uint8_t>>();
-        buff->reserve(max_mtu);
-        recommended_n_retransmissions = 1;
-        n_aggregated_mavlink_packets = 0;
-      }
-      buff->insert(buff->end(), data.begin(), data.end());
-      n_aggregated_mavlink_packets++;
-      if (msg.recommended_n_injections > recommended_n_retransmissions) {
-        recommended_n_retransmissions = msg.recommended_n_injections;
-      }
+    const int packed_size = msg.get_packed_size();
+    if (view.data_len > 0 && view.data_len + packed_size > (int)max_mtu) {
+      // MTU is reached, continue with an empty buffer
+      cb(view);
+      view = AggregatedMavlinkPacketView{buff.data(), 0, 1, 0};
+    }
+    view.data_len += msg.pack_into(buff.data() + view.data_len);
+    view.n_aggregated_mavlink_packets++;
+    if (msg.recommended_n_injections > view.recommended_n_retransmissions) {
+      view.recommended_n_retransmissions = msg.recommended_n_injections;
     }
   }
-  if (!buff->empty()) {
-    ret.push_back({buff, recommended_n_retransmissions});
+  if (view.data_len > 0) {
+    cb(view);
   }
+}
+
+/**
+ * Same as above, but for consumers that need to keep the data (e.g. queue it)
+ * - the aggregated packets use buffers from the FragmentBufferPool.
+ */
+static std::vector<AggregatedMavlinkPacket> aggregate_pack_messages(
+    MavlinkMessageSpan messages, uint32_t max_mtu = 1024) {
+  std::vector<AggregatedMavlinkPacket> ret;
+  aggregate_pack_messages(
+      messages, max_mtu, [&ret](const AggregatedMavlinkPacketView& view) {
+        ret.push_back(AggregatedMavlinkPacket{
+            openhd::FragmentBufferPool::instance().acquire(view.data,
+                                                           view.data_len),
+            view.recommended_n_retransmissions,
+            view.n_aggregated_mavlink_packets});
+      });
   return ret;
 }
 
-static int get_size(const std::vector<MavlinkMessage>& messages) {
+static int get_size(MavlinkMessageSpan messages) {
   int ret = 0;
   for (const auto& message : messages) {
-    ret += message.pack().size();
+    ret += message.get_packed_size();
   }
   return ret;
 }
 
 // For registering a callback that is called every time component X receives one
-// or more mavlink messages
-typedef std::function<void(const std::vector<MavlinkMessage> messages)>
-    MAV_MSG_CALLBACK;
+// or more mavlink messages. The messages are only valid for the duration of the
+// callback.
+typedef std::function<void(MavlinkMessageSpan messages)> MAV_MSG_CALLBACK;
 
 static int64_t get_time_microseconds() {
   const auto time = std::chrono::steady_clock::now().time_since_epoch();
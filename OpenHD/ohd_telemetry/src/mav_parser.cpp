@@ -0,0 +1,145 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#include "mav_parser.h"
+
+#include <cstring>
+#include <sstream>
+
+// mavlink2: STX, len, incompat flags, compat flags, seq, sysid, compid,
+// msgid (3 bytes)
+static constexpr int HEADER_LEN_V2 = MAVLINK_CORE_HEADER_LEN + 1;
+// mavlink1: STX, len, seq, sysid, compid, msgid (1 byte)
+static constexpr int HEADER_LEN_V1 = MAVLINK_CORE_HEADER_MAVLINK1_LEN + 1;
+
+std::string MavlinkFrameParser::Stats::to_string() const {
+  std::stringstream ss;
+  ss << "messages:" << n_messages << " bad_frames:" << n_bad_frames
+     << " bytes_skipped:" << n_bytes_skipped;
+  return ss.str();
+}
+
+MavlinkMessageSpan MavlinkFrameParser::parse(const uint8_t* data,
+                                             int data_len) {
+  m_n_messages = 0;
+  int offset = 0;
+  if (!m_tail.empty()) {
+    // Complete the frame from the previous call. A frame is never longer than
+    // MAVLINK_MAX_PACKET_LEN, so that many bytes are enough to either complete
+    // it or find out that it wasn't a frame.
+    const int tail_len = (int)m_tail.size();
+    const int n_append = std::min(data_len, MAVLINK_MAX_PACKET_LEN);
+    m_tail.insert(m_tail.end(), data, data + n_append);
+    const int consumed = parse_frames(m_tail.data(), (int)m_tail.size());
+    if (consumed < tail_len) {
+      // Still incomplete - only possible if we ran out of data
+      m_tail.erase(m_tail.begin(), m_tail.begin() + consumed);
+      return {m_messages.data(), m_n_messages};
+    }
+    offset = consumed - tail_len;
+    m_tail.clear();
+  }
+  offset += parse_frames(data + offset, data_len - offset);
+  if (offset < data_len) {
+    m_tail.assign(data + offset, data + data_len);
+  }
+  return {m_messages.data(), m_n_messages};
+}
+
+MavlinkMessage& MavlinkFrameParser::next_message() {
+  if (m_n_messages == m_messages.size()) {
+    m_messages.emplace_back();
+  }
+  return m_messages[m_n_messages++];
+}
+
+int MavlinkFrameParser::parse_frames(const uint8_t* data, int data_len) {
+  int i = 0;
+  while (i < data_len) {
+    const uint8_t stx = data[i];
+    if (stx != MAVLINK_STX && stx != MAVLINK_STX_MAVLINK1) {
+      m_stats.n_bytes_skipped++;
+      i++;
+      continue;
+    }
+    const bool is_v2 = stx == MAVLINK_STX;
+    const int header_len = is_v2 ? HEADER_LEN_V2 : HEADER_LEN_V1;
+    if (data_len - i < header_len) {
+      break;
+    }
+    const uint8_t* frame = data + i;
+    const int payload_len = frame[1];
+    const uint8_t incompat_flags = is_v2 ? frame[2] : 0;
+    if ((incompat_flags & ~MAVLINK_IFLAG_SIGNED) != 0) {
+      // We do not understand this frame
+      m_stats.n_bad_frames++;
+      i++;
+      continue;
+    }
+    const int signature_len =
+        (incompat_flags & MAVLINK_IFLAG_SIGNED) ? MAVLINK_SIGNATURE_BLOCK_LEN
+                                                : 0;
+    const int frame_len = header_len + payload_len +
+                          MAVLINK_NUM_CHECKSUM_BYTES + signature_len;
+    if (data_len - i < frame_len) {
+      break;
+    }
+    const uint32_t msgid =
+        is_v2 ? (uint32_t)frame[7] | ((uint32_t)frame[8] << 8) |
+                    ((uint32_t)frame[9] << 16)
+              : (uint32_t)frame[5];
+    const mavlink_msg_entry_t* entry = mavlink_get_msg_entry(msgid);
+    if (entry == nullptr) {
+      // Same as mavlink_parse_char - cannot validate the CRC without crc extra
+      m_stats.n_bad_frames++;
+      i++;
+      continue;
+    }
+    // CRC covers everything but STX, plus the message specific crc extra
+    uint16_t crc = crc_calculate(frame + 1, header_len - 1 + payload_len);
+    crc_accumulate(entry->crc_extra, &crc);
+    const uint8_t* ck = frame + header_len + payload_len;
+    if (ck[0] != (crc & 0xFF) || ck[1] != (crc >> 8)) {
+      // Resync on the next byte
+      m_stats.n_bad_frames++;
+      i++;
+      continue;
+    }
+    auto& msg = next_message();
+    msg.recommended_n_injections = 1;
+    mavlink_message_t& m = msg.m;
+    m.magic = stx;
+    m.len = payload_len;
+    m.msgid = msgid;
+    if (is_v2) {
+      m.incompat_flags = incompat_flags;
+      m.compat_flags = frame[3];
+      m.seq = frame[4];
+      m.sysid = frame[5];
+      m.compid = frame[6];
+    } else {
+      m.incompat_flags = 0;
+      m.compat_flags = 0;
+      m.seq = frame[2];
+      m.sysid = frame[3];
+      m.compid = frame[4];
+    }
+    auto* payload = reinterpret_cast<uint8_t*>(m.payload64);
+    std::memcpy(payload, frame + header_len, payload_len);
+    // zero-fill (mavlink2 payload truncation), same as mavlink_parse_char
+    if (payload_len < entry->max_msg_len) {
+      std::memset(payload + payload_len, 0, entry->max_msg_len - payload_len);
+    }
+    m.checksum = crc;
+    m.ck[0] = ck[0];
+    m.ck[1] = ck[1];
+    if (signature_len > 0) {
+      std::memcpy(m.signature, ck + MAVLINK_NUM_CHECKSUM_BYTES,
+                  MAVLINK_SIGNATURE_BLOCK_LEN);
+    }
+    m_stats.n_messages++;
+    i += frame_len;
+  }
+  return i;
+}
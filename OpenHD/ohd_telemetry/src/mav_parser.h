@@ -0,0 +1,55 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#ifndef OPENHD_OPENHD_OHD_TELEMETRY_SRC_MAV_PARSER_H_
+#define OPENHD_OPENHD_OHD_TELEMETRY_SRC_MAV_PARSER_H_
+
+#include <string>
+#include <vector>
+
+#include "mav_include.h"
+
+/**
+ * Frame-level mavlink (v1 and v2) parser - alternative to calling
+ * mavlink_parse_char() for each byte.
+ * Scans the received data for STX, reads the frame length from the header and,
+ * once the full frame is available, validates the CRC over the whole frame in
+ * one go. Valid frames are deserialized into re-used message storage - after
+ * warm-up, parsing doesn't allocate.
+ * Frames split across multiple reads (e.g. UART) are handled by keeping the
+ * incomplete tail (at most one frame) until the next call.
+ * Not thread-safe, use one instance per endpoint / channel.
+ */
+class MavlinkFrameParser {
+ public:
+  /**
+   * Parse the given data.
+   * @return all messages that were completed by this data. Only valid until the
+   * next call to parse().
+   */
+  MavlinkMessageSpan parse(const uint8_t* data, int data_len);
+  struct Stats {
+    uint64_t n_messages = 0;
+    // Frames (or what looked like a frame) with a wrong CRC / unknown msg id
+    uint64_t n_bad_frames = 0;
+    // Garbage between frames
+    uint64_t n_bytes_skipped = 0;
+    [[nodiscard]] std::string to_string() const;
+  };
+  [[nodiscard]] const Stats& get_stats() const { return m_stats; }
+
+ private:
+  // Parses all complete frames in [data, data+data_len), returns the n of
+  // consumed bytes (Everything up to the first incomplete frame)
+  int parse_frames(const uint8_t* data, int data_len);
+  MavlinkMessage& next_message();
+  // Incomplete frame from the previous call
+  std::vector<uint8_t> m_tail;
+  // Re-used storage, m_n_messages are valid
+  std::vector<MavlinkMessage> m_messages;
+  size_t m_n_messages = 0;
+  Stats m_stats{};
+};
+
+#endif  // OPENHD_OPENHD_OHD_TELEMETRY_SRC_MAV_PARSER_H_
@@ -6,16 +6,33 @@
 
 #include <openhd_spdlog.h>
 
+#include <algorithm>
+
+#include "openhd_action_handler.h"
+
 XMavlinkParamProvider::XMavlinkParamProvider(
     uint8_t sys_id, uint8_t comp_id,
     std::optional<std::chrono::milliseconds> opt_heartbeat_interval)
     : MavlinkComponent(sys_id, comp_id),
-      m_opt_heartbeat_interval(opt_heartbeat_interval) {
+      m_opt_heartbeat_interval(opt_heartbeat_interval),
+      m_param_changed_listener_tag(
+          fmt::format("XMavlinkParamProvider{}:{}", sys_id, comp_id)) {
   _sender = std::make_shared<mavsdk::SenderWrapper>(*this);
   _mavlink_message_handler = std::make_shared<mavsdk::MavlinkMessageHandler>();
   _mavlink_parameter_receiver =
       std::make_shared<mavsdk::MavlinkParameterReceiver>(
           *_sender, *_mavlink_message_handler);
+  openhd::ParamChangedHelper::instance().register_listener(
+      m_param_changed_listener_tag,
+      [this](const std::string& param_id, int value) {
+        std::lock_guard<std::mutex> lock(m_pending_int_param_updates_mutex);
+        m_pending_int_param_updates.emplace_back(param_id, value);
+      });
+}
+
+XMavlinkParamProvider::~XMavlinkParamProvider() {
+  openhd::ParamChangedHelper::instance().unregister_listener(
+      m_param_changed_listener_tag);
 }
 
 void XMavlinkParamProvider::add_param(const openhd::Setting& setting) {
@@ -24,9 +41,6 @@ void XMavlinkParamProvider::add_param(const openhd::Setting& setting) {
     const auto result = _mavlink_parameter_receiver->provide_server_param<int>(
         setting.id, intSetting.value, intSetting.change_callback);
     assert(result == mavsdk::MavlinkParameterReceiver::Result::Success);
-    if (intSetting.get_callback != nullptr) {
-      m_int_settings_with_update_functionality.push_back(setting);
-    }
   } else if (std::holds_alternative<openhd::StringSetting>(setting.setting)) {
     const auto stringSetting = std::get<openhd::StringSetting>(setting.setting);
     const auto result =
@@ -50,38 +64,61 @@ void XMavlinkParamProvider::set_ready() {
 }
 
 std::vector<MavlinkMessage> XMavlinkParamProvider::process_mavlink_messages(
-    std::vector<MavlinkMessage> messages) {
+    MavlinkMessageSpan messages) {
   std::lock_guard<std::mutex> lock(_mutex);
-  for (const auto& setting : m_int_settings_with_update_functionality) {
-    const auto intSetting = std::get<openhd::IntSetting>(setting.setting);
-    const auto currValue =
-        _mavlink_parameter_receiver->retrieve_server_param_int(setting.id);
-    if (currValue.first == mavsdk::MavlinkParameterReceiver::Result::Success) {
-      const int currValueInt = currValue.second;
-      const int newIntvalue = intSetting.get_callback();
-      if (currValueInt != newIntvalue) {
-        // Param set on ground is now different to the one inside the gcs
-        openhd::log::get_default()->warn("Updating {} from {} to {}",
-                                         setting.id, currValueInt, newIntvalue);
-        _mavlink_parameter_receiver->update_existing_server_param_int(
-            setting.id, newIntvalue);
-      }
-    }
-  }
   for (const auto& msg : messages) {
     _mavlink_message_handler->process_message(msg.m);
   }
-  for (int i = 0; i < 100; i++) {
-    _mavlink_parameter_receiver->do_work();
+  return update_and_collect_messages();
+}
+
+std::vector<MavlinkMessage> XMavlinkParamProvider::update_and_collect_messages() {
+  std::vector<std::pair<std::string, int>> updates;
+  {
+    std::lock_guard<std::mutex> lock(m_pending_int_param_updates_mutex);
+    std::swap(updates, m_pending_int_param_updates);
+  }
+  for (const auto& [param_id, value] : updates) {
+    const auto curr_value =
+        _mavlink_parameter_receiver->retrieve_server_param_int(param_id);
+    // Not one of our params / already up to date
+    if (curr_value.first != mavsdk::MavlinkParameterReceiver::Result::Success ||
+        curr_value.second == value) {
+      continue;
+    }
+    // Param changed by openhd is now different to the one inside the gcs
+    openhd::log::get_default()->warn("Updating {} from {} to {}", param_id,
+                                     curr_value.second, value);
+    _mavlink_parameter_receiver->update_existing_server_param_int(param_id,
+                                                                  value);
   }
-  auto msges = _sender->messages;
+  // do_work() might exceed the budget by one message, which is then paid back
+  // on the next call(s)
+  const int n_bytes_sent =
+      _mavlink_parameter_receiver->do_work(m_tx_budget.refill());
+  m_tx_budget.consume(n_bytes_sent);
+  auto msges = std::move(_sender->messages);
   // std::cout<<"XMavlinkParamProvider::process_mavlink_message:"<<msges.size()<<"\n";
   _sender->messages.clear();
   return msges;
 }
 
+MavlinkComponent::MessageFilter XMavlinkParamProvider::get_message_filter()
+    const {
+  return {_mavlink_message_handler->get_registered_msg_ids(), true};
+}
+
+void XMavlinkParamProvider::set_tx_budget_bytes_per_second(
+    std::optional<int> bytes_per_second) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  m_tx_budget.set_bytes_per_second(bytes_per_second);
+}
+
 std::vector<MavlinkMessage> XMavlinkParamProvider::generate_mavlink_messages() {
-  std::vector<MavlinkMessage> ret;
+  std::lock_guard<std::mutex> lock(_mutex);
+  // Param changes made by openhd / the rest of a long param list are sent
+  // from here, since we are only called with messages for us.
+  std::vector<MavlinkMessage> ret = update_and_collect_messages();
   if (m_opt_heartbeat_interval.has_value()) {
     const auto now = std::chrono::steady_clock::now();
     const auto elapsed = now - m_last_heartbeat;
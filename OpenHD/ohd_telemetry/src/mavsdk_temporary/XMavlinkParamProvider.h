@@ -10,6 +10,7 @@
 #include <utility>
 
 #include "openhd_settings_imp.h"
+#include "openhd_tx_budget.h"
 #include "routing/MavlinkComponent.hpp"
 
 // mavsdk
@@ -25,17 +26,28 @@ class XMavlinkParamProvider : public MavlinkComponent {
   explicit XMavlinkParamProvider(uint8_t sys_id, uint8_t comp_id,
                                  std::optional<std::chrono::milliseconds>
                                      opt_heartbeat_interval = std::nullopt);
+  ~XMavlinkParamProvider();
   void add_param(const openhd::Setting& setting);
   // only usable when manually_set_ready is true
   void add_params(const std::vector<openhd::Setting>& settings);
   void set_ready();
   // override from component
   std::vector<MavlinkMessage> process_mavlink_messages(
-      std::vector<MavlinkMessage> messages) override;
+      MavlinkMessageSpan messages) override;
   // override from component
   std::vector<MavlinkMessage> generate_mavlink_messages() override;
+  // override from component - only the param protocol messages for us
+  [[nodiscard]] MessageFilter get_message_filter() const override;
+  // Limits the rate param messages are sent out with (e.g. during a param list
+  // transmission) to not congest a low bandwidth link. Bytes per second of
+  // packed mavlink messages, std::nullopt (default) == unlimited.
+  void set_tx_budget_bytes_per_second(std::optional<int> bytes_per_second);
 
  private:
+  // Applies the int param changes openhd made itself (see
+  // openhd::ParamChangedHelper) and sends out the queued param messages.
+  // Needs _mutex.
+  std::vector<MavlinkMessage> update_and_collect_messages();
   // mavsdk
   std::shared_ptr<mavsdk::SenderWrapper> _sender;
   std::shared_ptr<mavsdk::MavlinkMessageHandler> _mavlink_message_handler;
@@ -46,8 +58,13 @@ class XMavlinkParamProvider : public MavlinkComponent {
   const std::optional<std::chrono::milliseconds> m_opt_heartbeat_interval;
   std::chrono::steady_clock::time_point m_last_heartbeat =
       std::chrono::steady_clock::now();
-  // Dirty, when openhd updates a setting
-  std::vector<openhd::Setting> m_int_settings_with_update_functionality;
+  const std::string m_param_changed_listener_tag;
+  // Filled by the openhd::ParamChangedHelper listener, which must not lock
+  // _mutex (the param might be changed from inside a change callback)
+  std::mutex m_pending_int_param_updates_mutex;
+  std::vector<std::pair<std::string, int>> m_pending_int_param_updates;
+  // See set_tx_budget_bytes_per_second(). Needs _mutex.
+  openhd::TxBudget m_tx_budget;
 };
 
 #endif  // OPENHD_OPENHD_OHD_TELEMETRY_SRC_MAV_PARAM_XMAVLINKPARAMPROVIDER_H_
@@ -1,5 +1,6 @@
 #include "mavlink_message_handler.h"
 
+#include <algorithm>
 #include <mutex>
 
 namespace mavsdk {
@@ -87,4 +88,15 @@ void MavlinkMessageHandler::update_component_id(uint16_t msg_id,
   }
 }
 
+std::vector<uint32_t> MavlinkMessageHandler::get_registered_msg_ids() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  std::vector<uint32_t> ret;
+  for (const auto& entry : _table) {
+    ret.push_back(entry.msg_id);
+  }
+  std::sort(ret.begin(), ret.end());
+  ret.erase(std::unique(ret.begin(), ret.end()), ret.end());
+  return ret;
+}
+
 }  // namespace mavsdk
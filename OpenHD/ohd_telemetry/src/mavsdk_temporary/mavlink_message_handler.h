@@ -29,6 +29,8 @@ class MavlinkMessageHandler {
   void unregister_all(const void* cookie);
   void process_message(const mavlink_message_t& message);
   void update_component_id(uint16_t msg_id, uint8_t cmp_id, const void* cookie);
+  // All message ids there is at least one callback for (sorted, unique)
+  std::vector<uint32_t> get_registered_msg_ids();
 
  private:
   std::mutex _mutex{};
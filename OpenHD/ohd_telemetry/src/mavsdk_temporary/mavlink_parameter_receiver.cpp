@@ -1,6 +1,10 @@
 #include "mavlink_parameter_receiver.h"
 
+#include <algorithm>
 #include <cassert>
+#include <limits>
+
+#include "openhd_util.h"
 
 namespace mavsdk {
 
@@ -98,6 +102,7 @@ MavlinkParameterReceiver::Result MavlinkParameterReceiver::provide_server_param(
   // Param set makes sure we cannot add the same parameter more than once and
   // keeps the type safe
   if (_param_set.add_new_parameter(name, param_value, tmp)) {
+    m_param_set_version++;
     return Result::Success;
   }
   return Result::WrongType;
@@ -237,6 +242,7 @@ void MavlinkParameterReceiver::process_param_set_internally(
           _param_set.lookup_parameter(param_id, extended).value();
       if (result == MavlinkParameterSet::UpdateExistingParamResult::SUCCESS) {
         LogDebug() << "Got param_set SUCCESS:" << updated_parameter;
+        m_param_set_version++;
       } else {
         assert(result ==
                MavlinkParameterSet::UpdateExistingParamResult::NO_CHANGE);
@@ -352,6 +358,11 @@ void MavlinkParameterReceiver::internal_process_param_request_read(
     const std::variant<std::string, uint16_t>& identifier,
     const bool extended) {
   std::lock_guard<std::mutex> lock(_all_params_mutex);
+  if (std::holds_alternative<std::string>(identifier) &&
+      std::get<std::string>(identifier) == HASH_CHECK_PARAM_ID) {
+    queue_hash_check(extended);
+    return;
+  }
   // look up the parameter in the parameter set by its identifier.
   const auto param_opt = _param_set.lookup_parameter(identifier, extended);
   if (!param_opt.has_value()) {
@@ -403,71 +414,161 @@ void MavlinkParameterReceiver::broadcast_all_parameters(const bool extended) {
     return;
   }
   m_last_broadcast_all_request = std::chrono::steady_clock::now();
-  const auto all_params = _param_set.list_all_parameters(extended);
   LogDebug() << "broadcast_all_parameters " << (extended ? "Ext" : "") << ": "
-             << all_params.size();
-  for (const auto& parameter : all_params) {
-    LogDebug() << "sending param:" << parameter;
-    auto new_work = std::make_shared<WorkItem>(
-        parameter.param_id, parameter.value,
-        WorkItemValue{parameter.param_index,
-                      static_cast<uint16_t>(all_params.size()), extended});
-    _work_queue.push_back(new_work);
+             << get_encoded_table(extended).messages.size();
+  // Hash first - a client with a matching cache can stop listening here.
+  // A list transmission that is still ongoing is restarted.
+  queue_hash_check(extended);
+  m_list_transmission =
+      ListTransmission{extended, 0, std::chrono::steady_clock::now()};
+}
+
+void MavlinkParameterReceiver::queue_hash_check(const bool extended) {
+  const auto& table = get_encoded_table(extended);
+  ParamValue value;
+  value.set(table.hash);
+  // Not part of the param set, index -1 (same as PX4)
+  auto new_work = std::make_shared<WorkItem>(
+      HASH_CHECK_PARAM_ID, value,
+      WorkItemValue{std::numeric_limits<uint16_t>::max(),
+                    _param_set.get_current_parameters_count(extended),
+                    extended});
+  _work_queue.push_back(new_work);
+}
+
+// Same as PX4 (param_hash_check) and QGroundControl (hash of its param
+// cache): CRC32 over the id and the value (at the size of its type) of each
+// param, in the order of the param ids.
+static uint32_t calculate_hash(
+    const std::vector<MavlinkParameterSet::Parameter>& params) {
+  std::vector<const MavlinkParameterSet::Parameter*> sorted;
+  sorted.reserve(params.size());
+  for (const auto& parameter : params) sorted.push_back(&parameter);
+  std::sort(sorted.begin(), sorted.end(), [](const auto* lhs, const auto* rhs) {
+    return lhs->param_id < rhs->param_id;
+  });
+  uint32_t hash = 0;
+  for (const auto* parameter : sorted) {
+    const auto value = parameter->value.get_128_bytes();
+    hash = OHDUtil::crc32(
+        reinterpret_cast<const uint8_t*>(parameter->param_id.data()),
+        parameter->param_id.size(), hash);
+    hash = OHDUtil::crc32(reinterpret_cast<const uint8_t*>(value.data()),
+                          parameter->value.get_n_value_bytes(), hash);
   }
+  return hash;
 }
 
-void MavlinkParameterReceiver::do_work() {
-  LockedQueue<WorkItem>::Guard work_queue_guard(_work_queue);
-  auto work = work_queue_guard.get_front();
-  if (!work) {
-    return;
+const MavlinkParameterReceiver::EncodedParamTable&
+MavlinkParameterReceiver::get_encoded_table(const bool extended) {
+  auto& table = m_encoded_tables[extended ? 1 : 0];
+  if (table.version == m_param_set_version) {
+    return table;
   }
+  const auto all_params = _param_set.list_all_parameters(extended);
+  const auto param_count = static_cast<uint16_t>(all_params.size());
+  table.messages.clear();
+  table.messages.reserve(all_params.size());
+  for (const auto& parameter : all_params) {
+    table.messages.push_back(encode_param_value(parameter.param_id,
+                                                parameter.value,
+                                                parameter.param_index,
+                                                param_count, extended));
+  }
+  table.hash = calculate_hash(all_params);
+  table.version = m_param_set_version;
+  return table;
+}
+
+mavlink_message_t MavlinkParameterReceiver::encode_param_value(
+    const std::string& param_id, const ParamValue& param_value,
+    const uint16_t param_index, const uint16_t param_count,
+    const bool extended) {
   const auto param_id_message_buffer =
-      MavlinkParameterSet::param_id_to_message_buffer(work->param_id);
+      MavlinkParameterSet::param_id_to_message_buffer(param_id);
   mavlink_message_t mavlink_message;
-  if (std::holds_alternative<WorkItemValue>(work->work_item_variant)) {
-    const auto& specific = std::get<WorkItemValue>(work->work_item_variant);
-    if (specific.extended) {
-      const auto buf = work->param_value.get_128_bytes();
-      // mavlink_msg_param_ext_value_encode()
-      mavlink_msg_param_ext_value_pack(
-          _sender.get_own_system_id(), _sender.get_own_component_id(),
-          &mavlink_message, param_id_message_buffer.data(), buf.data(),
-          work->param_value.get_mav_param_ext_type(), specific.param_count,
-          specific.param_index);
+  if (extended) {
+    const auto buf = param_value.get_128_bytes();
+    mavlink_msg_param_ext_value_pack(
+        _sender.get_own_system_id(), _sender.get_own_component_id(),
+        &mavlink_message, param_id_message_buffer.data(), buf.data(),
+        param_value.get_mav_param_ext_type(), param_count, param_index);
+  } else {
+    float value;
+    if (_sender.autopilot() == Sender::Autopilot::ArduPilot) {
+      value = param_value.get_4_float_bytes_cast();
     } else {
-      float param_value;
-      if (_sender.autopilot() == Sender::Autopilot::ArduPilot) {
-        param_value = work->param_value.get_4_float_bytes_cast();
-      } else {
-        param_value = work->param_value.get_4_float_bytes_bytewise();
-      }
-      mavlink_msg_param_value_pack(
-          _sender.get_own_system_id(), _sender.get_own_component_id(),
-          &mavlink_message, param_id_message_buffer.data(), param_value,
-          work->param_value.get_mav_param_type(), specific.param_count,
-          specific.param_index);
+      value = param_value.get_4_float_bytes_bytewise();
     }
+    mavlink_msg_param_value_pack(
+        _sender.get_own_system_id(), _sender.get_own_component_id(),
+        &mavlink_message, param_id_message_buffer.data(), value,
+        param_value.get_mav_param_type(), param_count, param_index);
+  }
+  return mavlink_message;
+}
+
+mavlink_message_t MavlinkParameterReceiver::encode_work_item(
+    const WorkItem& work) {
+  if (std::holds_alternative<WorkItemValue>(work.work_item_variant)) {
+    const auto& specific = std::get<WorkItemValue>(work.work_item_variant);
+    return encode_param_value(work.param_id, work.param_value,
+                              specific.param_index, specific.param_count,
+                              specific.extended);
+  }
+  const auto& specific = std::get<WorkItemAck>(work.work_item_variant);
+  const auto param_id_message_buffer =
+      MavlinkParameterSet::param_id_to_message_buffer(work.param_id);
+  auto buf = work.param_value.get_128_bytes();
+  mavlink_message_t mavlink_message;
+  mavlink_msg_param_ext_ack_pack(
+      _sender.get_own_system_id(), _sender.get_own_component_id(),
+      &mavlink_message, param_id_message_buffer.data(), buf.data(),
+      work.param_value.get_mav_param_ext_type(), specific.param_ack);
+  return mavlink_message;
+}
+
+int MavlinkParameterReceiver::do_work(const int max_n_bytes) {
+  int n_bytes = 0;
+  // Responses to single requests / changes first
+  while (n_bytes < max_n_bytes) {
+    LockedQueue<WorkItem>::Guard work_queue_guard(_work_queue);
+    auto work = work_queue_guard.get_front();
+    if (!work) {
+      break;
+    }
+    auto mavlink_message = encode_work_item(*work);
+    work_queue_guard.pop_front();
+    n_bytes += MAVLINK_NUM_NON_PAYLOAD_BYTES + mavlink_message.len;
     if (!_sender.send_message(mavlink_message)) {
       LogErr() << "Error: Send message failed";
-      work_queue_guard.pop_front();
-      return;
     }
-    work_queue_guard.pop_front();
-  } else {
-    const auto& specific = std::get<WorkItemAck>(work->work_item_variant);
-    auto buf = work->param_value.get_128_bytes();
-    mavlink_msg_param_ext_ack_pack(
-        _sender.get_own_system_id(), _sender.get_own_component_id(),
-        &mavlink_message, param_id_message_buffer.data(), buf.data(),
-        work->param_value.get_mav_param_ext_type(), specific.param_ack);
+  }
+  std::lock_guard<std::mutex> lock(_all_params_mutex);
+  while (m_list_transmission.has_value() && n_bytes < max_n_bytes) {
+    auto& transmission = m_list_transmission.value();
+    // Re-built if a param changed during the transmission
+    const auto& table = get_encoded_table(transmission.extended);
+    if (transmission.next_idx >= table.messages.size()) {
+      const auto elapsed =
+          std::chrono::steady_clock::now() - transmission.begin;
+      LogDebug() << "Param list " << (transmission.extended ? "Ext" : "")
+                 << " (" << table.messages.size() << ") sent in "
+                 << std::chrono::duration_cast<std::chrono::milliseconds>(
+                        elapsed)
+                        .count()
+                 << "ms";
+      m_list_transmission = std::nullopt;
+      break;
+    }
+    auto mavlink_message = table.messages[transmission.next_idx];
+    transmission.next_idx++;
+    n_bytes += MAVLINK_NUM_NON_PAYLOAD_BYTES + mavlink_message.len;
     if (!_sender.send_message(mavlink_message)) {
       LogErr() << "Error: Send message failed";
-      work_queue_guard.pop_front();
-      return;
     }
-    work_queue_guard.pop_front();
   }
+  return n_bytes;
 }
 
 std::ostream& operator<<(std::ostream& str,
@@ -546,8 +647,21 @@ MavlinkParameterReceiver::update_existing_server_param(const std::string& name,
   ParamValue param_value;
   param_value.set(value);
   auto res = _param_set.update_existing_parameter(name, param_value);
-  if (res == MavlinkParameterSet::UpdateExistingParamResult::SUCCESS)
+  if (res == MavlinkParameterSet::UpdateExistingParamResult::SUCCESS) {
+    m_param_set_version++;
+    // Changed by the server itself - broadcast the new value, so the ground
+    // station(s) don't need to re-fetch it
+    const auto updated_parameter = _param_set.lookup_parameter(name, false);
+    if (updated_parameter.has_value()) {
+      auto new_work = std::make_shared<WorkItem>(
+          updated_parameter->param_id, updated_parameter->value,
+          WorkItemValue{updated_parameter->param_index,
+                        _param_set.get_current_parameters_count(false),
+                        false});
+      _work_queue.push_back(new_work);
+    }
     return MavlinkParameterReceiver::Result::Success;
+  }
   return MavlinkParameterReceiver::Result::NotFound;
 }
 
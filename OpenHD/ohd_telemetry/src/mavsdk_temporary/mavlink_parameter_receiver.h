@@ -1,7 +1,9 @@
 #pragma once
 
+#include <chrono>
 #include <list>
 #include <map>
+#include <optional>
 #include <string>
 #include <utility>
 
@@ -117,7 +119,20 @@ class MavlinkParameterReceiver {
   std::pair<Result, std::string> retrieve_server_param_custom(
       const std::string& name);
 
-  void do_work();
+  /**
+   * Sends out pending responses first, then the next part of an ongoing "list
+   * all params" transmission (from the pre-encoded param table), until
+   * max_n_bytes (packed mavlink size) are reached. Call this in regular
+   * intervals with the telemetry budget for this interval.
+   * @return the n of bytes sent.
+   */
+  int do_work(int max_n_bytes);
+  // Cache hash parameter, sent first on each list request and as a response to
+  // a request read with this id. Its value (CRC32 over all param ids and
+  // values, computed like PX4 / QGroundControl) only changes when the param set
+  // changes, which lets a client skip the (slow) param list download if it has
+  // the param set cached.
+  static constexpr auto HASH_CHECK_PARAM_ID = "_HASH_CHECK";
 
   friend std::ostream& operator<<(std::ostream&, const Result&);
 
@@ -170,6 +185,36 @@ class MavlinkParameterReceiver {
   // broadcast all current parameters. If extended=false, string parameters are
   // ignored.
   void broadcast_all_parameters(bool extended);
+  // Queue the cache hash (see HASH_CHECK_PARAM_ID). Needs _all_params_mutex.
+  void queue_hash_check(bool extended);
+
+  // Incremented on each change of the param set (added param / new value).
+  // Needs _all_params_mutex.
+  uint32_t m_param_set_version = 0;
+  // All params of one protocol (non-extended / extended), encoded once and
+  // re-used for each list request until the param set changes.
+  struct EncodedParamTable {
+    // m_param_set_version this table was built from
+    std::optional<uint32_t> version;
+    uint32_t hash = 0;
+    std::vector<mavlink_message_t> messages;
+  };
+  // [0]: non-extended, [1]: extended
+  EncodedParamTable m_encoded_tables[2];
+  // Re-builds the table if outdated. Needs _all_params_mutex.
+  const EncodedParamTable& get_encoded_table(bool extended);
+  // Ongoing "list all params" transmission. Needs _all_params_mutex.
+  struct ListTransmission {
+    bool extended;
+    // next index into the encoded table
+    size_t next_idx;
+    std::chrono::steady_clock::time_point begin;
+  };
+  std::optional<ListTransmission> m_list_transmission;
+  mavlink_message_t encode_param_value(const std::string& param_id,
+                                       const ParamValue& param_value,
+                                       uint16_t param_index,
+                                       uint16_t param_count, bool extended);
 
   // These are specific depending on the work item type.
   // note that ack needs fewer arguments.
@@ -201,6 +246,7 @@ class MavlinkParameterReceiver {
           work_item_variant(std::move(work_item_variant1)){};
   };
   LockedQueue<WorkItem> _work_queue{};
+  mavlink_message_t encode_work_item(const WorkItem& work);
   /**
    * See:
    * https://mavlink.io/en/services/parameter.html#multi-system-and-multi-component-support
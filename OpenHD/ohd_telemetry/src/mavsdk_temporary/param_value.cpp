@@ -1,6 +1,8 @@
 #include "param_value.h"
 
+#include <algorithm>
 #include <cassert>
+#include <type_traits>
 
 namespace mavsdk {
 
@@ -541,6 +543,19 @@ std::array<char, 128> ParamValue::get_128_bytes() const {
   return bytes;
 }
 
+size_t ParamValue::get_n_value_bytes() const {
+  return std::visit(
+      [](const auto& value) -> size_t {
+        using T = std::decay_t<decltype(value)>;
+        if constexpr (std::is_same_v<T, std::string>) {
+          return std::min(value.size(), size_t{128});
+        } else {
+          return sizeof(T);
+        }
+      },
+      _value);
+}
+
 [[nodiscard]] std::string ParamValue::get_string() const {
   return std::visit([](auto value) { return to_string(value); }, _value);
 }
@@ -51,6 +51,9 @@ class ParamValue {
   void set_custom(const std::string& new_value);
 
   [[nodiscard]] std::array<char, 128> get_128_bytes() const;
+  // N of bytes of get_128_bytes() that hold the value (size of the type, or
+  // the length of a string)
+  [[nodiscard]] size_t get_n_value_bytes() const;
 
   [[nodiscard]] std::string get_string() const;
 
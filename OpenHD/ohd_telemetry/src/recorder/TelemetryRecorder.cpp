@@ -0,0 +1,249 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#include "TelemetryRecorder.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <sstream>
+#include <utility>
+
+#include "openhd_util_filesystem.h"
+
+using namespace openhd::telemetry::recording;
+
+static uint64_t to_us(const std::chrono::steady_clock::time_point time) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             time.time_since_epoch())
+      .count();
+}
+
+std::unique_ptr<TelemetryRecorder> TelemetryRecorder::create(Config config) {
+  if (config.n_segments < 2 ||
+      config.segment_size < SEGMENT_HEADER_SIZE + 4 * 1024) {
+    openhd::log::get_default()->warn("Invalid telemetry recorder config");
+    return nullptr;
+  }
+  // private constructor
+  auto ret = std::unique_ptr<TelemetryRecorder>(
+      new TelemetryRecorder(std::move(config)));
+  if (!ret->open_segments()) return nullptr;
+  // The first segment is mapped right away, the prepare thread keeps the next
+  // one ready from now on.
+  ret->m_current = ret->map_segment(ret->m_next_index, ret->m_next_sequence);
+  if (ret->m_current.data == nullptr) return nullptr;
+  ret->m_next_index = (ret->m_next_index + 1) % ret->m_config.n_segments;
+  ret->m_next_sequence++;
+  ret->m_stats.n_segments++;
+  ret->m_prepare_thread = std::make_unique<std::thread>(
+      [recorder = ret.get()]() { recorder->prepare_loop(); });
+  return ret;
+}
+
+TelemetryRecorder::TelemetryRecorder(Config config)
+    : m_config(std::move(config)) {
+  m_console = openhd::log::create_or_get("tele_recorder");
+  m_session_unix_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                          std::chrono::system_clock::now().time_since_epoch())
+                          .count();
+  m_session_steady_us = to_us(std::chrono::steady_clock::now());
+}
+
+TelemetryRecorder::~TelemetryRecorder() {
+  if (m_prepare_thread) {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_prepare_run = false;
+    }
+    m_prepare_cv.notify_one();
+    m_prepare_thread->join();
+    m_prepare_thread = nullptr;
+  }
+  unmap_segment(m_current);
+  unmap_segment(m_next);
+  unmap_segment(m_full);
+  for (const int fd : m_fds) {
+    close(fd);
+  }
+  m_console->debug("Recorder stopped: {}", m_stats.to_string());
+}
+
+std::string TelemetryRecorder::segment_filename(const int index) const {
+  std::stringstream ss;
+  ss << m_config.directory;
+  if (!m_config.directory.empty() && m_config.directory.back() != '/') {
+    ss << "/";
+  }
+  ss << m_config.name << "_" << index << ".rec";
+  return ss.str();
+}
+
+bool TelemetryRecorder::open_segments() {
+  OHDFilesystemUtil::create_directories(m_config.directory);
+  int newest_index = -1;
+  uint64_t newest_sequence = 0;
+  for (int i = 0; i < m_config.n_segments; i++) {
+    const auto filename = segment_filename(i);
+    const int fd = open(filename.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+      m_console->warn("Cannot open {} {}", filename, strerror(errno));
+      return false;
+    }
+    m_fds.push_back(fd);
+    SegmentHeader header{};
+    if (pread(fd, &header, sizeof(header), 0) == sizeof(header) &&
+        header.magic == SEGMENT_MAGIC && header.version == FORMAT_VERSION &&
+        header.segment_size == m_config.segment_size) {
+      if (newest_index == -1 || header.sequence > newest_sequence) {
+        newest_index = i;
+        newest_sequence = header.sequence;
+      }
+    }
+    // Preallocate, such that we never get a SIGBUS (disk full) while writing
+    // to the mapping
+    if (OHDFilesystemUtil::get_file_size_bytes(filename) !=
+            static_cast<long>(m_config.segment_size) &&
+        ftruncate(fd, m_config.segment_size) != 0) {
+      m_console->warn("Cannot resize {} {}", filename, strerror(errno));
+      return false;
+    }
+    const int result = posix_fallocate(fd, 0, m_config.segment_size);
+    if (result != 0 && result != EOPNOTSUPP) {
+      m_console->warn("Cannot allocate {} {}", filename, strerror(result));
+      return false;
+    }
+  }
+  if (newest_index >= 0) {
+    m_next_index = (newest_index + 1) % m_config.n_segments;
+    m_next_sequence = newest_sequence + 1;
+  }
+  m_console->debug("Recording to {}, continuing at segment {}",
+                   segment_filename(m_next_index), m_next_sequence);
+  return true;
+}
+
+TelemetryRecorder::Segment TelemetryRecorder::map_segment(
+    const int index, const uint64_t sequence) {
+  // Pre-fault all pages, writing to the segment later never blocks on
+  // reading the (old) page content from disk
+  void* data = mmap(nullptr, m_config.segment_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, m_fds[index], 0);
+  if (data == MAP_FAILED) {
+    m_console->warn("Cannot map segment {} {}", index, strerror(errno));
+    return {};
+  }
+  Segment ret{index, static_cast<uint8_t*>(data)};
+  std::memset(ret.data, 0, SEGMENT_HEADER_SIZE);
+  auto* header = ret.header();
+  header->magic = SEGMENT_MAGIC;
+  header->version = FORMAT_VERSION;
+  header->segment_size = m_config.segment_size;
+  header->sequence = sequence;
+  header->session_unix_us = m_session_unix_us;
+  header->session_steady_us = m_session_steady_us;
+  header->used_bytes = 0;
+  header->n_records = 0;
+  for (int i = 0; i < MAX_N_LINKS; i++) {
+    std::strncpy(header->link_names[i], m_config.link_names[i].c_str(),
+                 MAX_LINK_NAME_LEN - 1);
+  }
+  return ret;
+}
+
+void TelemetryRecorder::unmap_segment(Segment& segment) {
+  if (segment.data == nullptr) return;
+  msync(segment.data, m_config.segment_size, MS_ASYNC);
+  munmap(segment.data, m_config.segment_size);
+  segment = {};
+}
+
+bool TelemetryRecorder::switch_segment_locked() {
+  if (m_next.data == nullptr) return false;
+  // The prepare thread has already picked up the previous full segment
+  // before it provided the next one
+  m_full = m_current;
+  m_current = m_next;
+  m_next = {};
+  m_stats.n_segments++;
+  m_prepare_cv.notify_one();
+  return true;
+}
+
+void TelemetryRecorder::prepare_loop() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (true) {
+    m_prepare_cv.wait(lock, [this] {
+      return !m_prepare_run || m_next.data == nullptr ||
+             m_full.data != nullptr;
+    });
+    if (!m_prepare_run) break;
+    Segment full = m_full;
+    m_full = {};
+    const bool need_next = m_next.data == nullptr;
+    const int index = m_next_index;
+    const uint64_t sequence = m_next_sequence;
+    lock.unlock();
+    unmap_segment(full);
+    Segment next{};
+    if (need_next) next = map_segment(index, sequence);
+    lock.lock();
+    if (!need_next) continue;
+    if (next.data != nullptr) {
+      m_next = next;
+      m_next_index = (index + 1) % m_config.n_segments;
+      m_next_sequence = sequence + 1;
+    } else {
+      // Retry later, drop messages in the meantime
+      m_prepare_cv.wait_for(lock, std::chrono::seconds(1),
+                            [this] { return !m_prepare_run; });
+    }
+  }
+}
+
+void TelemetryRecorder::record(
+    const int link, const Direction direction, MavlinkMessageSpan messages,
+    const std::chrono::steady_clock::time_point now) {
+  if (link < 0 || link >= MAX_N_LINKS) return;
+  const uint64_t timestamp_us = to_us(now);
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (const auto& msg : messages) {
+    if (msg.m.msgid == MAVLINK_MSG_ID_FILE_TRANSFER_PROTOCOL) continue;
+    const uint32_t max_size = sizeof(RecordHeader) + msg.get_packed_size();
+    if (m_current.data == nullptr ||
+        SEGMENT_HEADER_SIZE + m_current.header()->used_bytes + max_size >
+            m_config.segment_size) {
+      if (!switch_segment_locked()) {
+        m_stats.n_dropped++;
+        continue;
+      }
+    }
+    auto* header = m_current.header();
+    uint8_t* dst = m_current.data + SEGMENT_HEADER_SIZE + header->used_bytes;
+    const int len = msg.pack_into(dst + sizeof(RecordHeader));
+    const RecordHeader record{timestamp_us, static_cast<uint16_t>(len),
+                              static_cast<uint8_t>(link),
+                              static_cast<uint8_t>(direction)};
+    std::memcpy(dst, &record, sizeof(record));
+    // Only now the record becomes visible to a reader
+    header->used_bytes += sizeof(record) + len;
+    header->n_records++;
+    m_stats.n_records++;
+    m_stats.n_bytes += sizeof(record) + len;
+  }
+}
+
+TelemetryRecorder::Stats TelemetryRecorder::get_stats() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_stats;
+}
+
+std::string TelemetryRecorder::Stats::to_string() const {
+  std::stringstream ss;
+  ss << "Recorder:{records:" << n_records << ", bytes:" << n_bytes
+     << ", segments:" << n_segments << ", dropped:" << n_dropped << "}";
+  return ss.str();
+}
@@ -0,0 +1,115 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#ifndef OPENHD_OPENHD_OHD_TELEMETRY_SRC_RECORDER_TELEMETRYRECORDER_H_
+#define OPENHD_OPENHD_OHD_TELEMETRY_SRC_RECORDER_TELEMETRYRECORDER_H_
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "../mav_include.h"
+#include "TelemetryRecordingFormat.h"
+#include "openhd_spdlog.h"
+
+/**
+ * Telemetry flight recorder - appends every mavlink message that crosses one
+ * of the links of the air / ground unit (tagged with the link and direction)
+ * to a ring of preallocated, memory mapped segment files (see
+ * TelemetryRecordingFormat.h).
+ * Recording a message is a memcpy into the mapped segment, no syscall - the
+ * kernel writes the pages back. Mapping (and pre-faulting) the next segment
+ * and un-mapping a full one happens on a separate low priority thread, such
+ * that the caller (the telemetry event loop) never blocks on the disk. If the
+ * next segment is not ready in time, messages are dropped (and counted)
+ * instead.
+ * A new instance continues in the segment after the newest one of the
+ * previous session, such that the last flight(s) stay available until the
+ * ring wraps around.
+ * Use TelemetryRecording / TelemetryReplay to read / replay a recording.
+ */
+class TelemetryRecorder {
+ public:
+  using Direction = openhd::telemetry::recording::Direction;
+  static constexpr auto DEFAULT_DIRECTORY = "/home/openhd/TelemetryRecordings/";
+  struct Config {
+    std::string directory = DEFAULT_DIRECTORY;
+    // Segment files are <name>_<index>.rec, e.g. "air" or "ground"
+    std::string name;
+    int n_segments = 8;
+    uint32_t segment_size = 4 * 1024 * 1024;
+    // Names of the link ids passed to record(), stored in each segment
+    std::array<std::string, openhd::telemetry::recording::MAX_N_LINKS>
+        link_names;
+  };
+  // nullptr if the segment files cannot be created / mapped
+  static std::unique_ptr<TelemetryRecorder> create(Config config);
+  ~TelemetryRecorder();
+  TelemetryRecorder(const TelemetryRecorder&) = delete;
+  TelemetryRecorder(const TelemetryRecorder&&) = delete;
+  /**
+   * Record the given messages, received on / sent to the given link.
+   * File transfers (FTP) are skipped - downloading the recordings would
+   * otherwise overwrite them.
+   * Thread-safe, never blocks on I/O.
+   */
+  void record(int link, Direction direction, MavlinkMessageSpan messages,
+              std::chrono::steady_clock::time_point now =
+                  std::chrono::steady_clock::now());
+  struct Stats {
+    uint64_t n_records = 0;
+    uint64_t n_bytes = 0;
+    // Segments started by this instance
+    uint64_t n_segments = 0;
+    // Next segment was not mapped yet
+    uint64_t n_dropped = 0;
+    [[nodiscard]] std::string to_string() const;
+  };
+  [[nodiscard]] Stats get_stats() const;
+
+ private:
+  explicit TelemetryRecorder(Config config);
+  struct Segment {
+    int index = -1;
+    uint8_t* data = nullptr;
+    [[nodiscard]] openhd::telemetry::recording::SegmentHeader* header() const {
+      return reinterpret_cast<openhd::telemetry::recording::SegmentHeader*>(
+          data);
+    }
+  };
+  [[nodiscard]] std::string segment_filename(int index) const;
+  // Opens (and preallocates) all segment files, finds where to continue.
+  // Returns false on error.
+  bool open_segments();
+  // Maps the given segment and writes an empty header for the given sequence
+  // number. Blocking (disk I/O).
+  Segment map_segment(int index, uint64_t sequence);
+  void unmap_segment(Segment& segment);
+  // Makes the prepared segment the current one, needs m_mutex
+  bool switch_segment_locked();
+  void prepare_loop();
+  const Config m_config;
+  std::shared_ptr<spdlog::logger> m_console;
+  uint64_t m_session_unix_us = 0;
+  uint64_t m_session_steady_us = 0;
+  std::vector<int> m_fds;
+  mutable std::mutex m_mutex;
+  std::condition_variable m_prepare_cv;
+  Segment m_current;
+  // Mapped by the prepare thread, empty if not ready (yet)
+  Segment m_next;
+  // Full segment, to be unmapped by the prepare thread
+  Segment m_full;
+  int m_next_index = 0;
+  uint64_t m_next_sequence = 0;
+  bool m_prepare_run = true;
+  std::unique_ptr<std::thread> m_prepare_thread;
+  Stats m_stats{};
+};
+
+#endif  // OPENHD_OPENHD_OHD_TELEMETRY_SRC_RECORDER_TELEMETRYRECORDER_H_
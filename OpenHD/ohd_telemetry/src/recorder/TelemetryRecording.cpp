@@ -0,0 +1,147 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#include "TelemetryRecording.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <optional>
+#include <sstream>
+
+#include "../mav_parser.h"
+#include "openhd_util_filesystem.h"
+
+using namespace openhd::telemetry::recording;
+
+namespace {
+
+struct SegmentData {
+  SegmentHeader header;
+  std::vector<uint8_t> data;
+};
+
+bool ends_with(const std::string& str, const std::string& suffix) {
+  return str.size() >= suffix.size() &&
+         str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+std::optional<SegmentData> read_segment(const std::string& filename) {
+  std::ifstream file(filename, std::ios::binary);
+  if (!file) return std::nullopt;
+  std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)),
+                            std::istreambuf_iterator<char>());
+  if (data.size() < SEGMENT_HEADER_SIZE) return std::nullopt;
+  SegmentHeader header{};
+  std::memcpy(&header, data.data(), sizeof(header));
+  if (header.magic != SEGMENT_MAGIC || header.version != FORMAT_VERSION ||
+      header.segment_size != data.size() ||
+      SEGMENT_HEADER_SIZE + (uint64_t)header.used_bytes > data.size()) {
+    return std::nullopt;
+  }
+  return SegmentData{header, std::move(data)};
+}
+
+// Appends all valid records of the given segment
+void parse_records(const SegmentData& segment,
+                   TelemetryRecording& recording) {
+  MavlinkFrameParser parser;
+  const uint8_t* records = segment.data.data() + SEGMENT_HEADER_SIZE;
+  const uint32_t used_bytes = segment.header.used_bytes;
+  uint32_t offset = 0;
+  while (offset < used_bytes) {
+    RecordHeader record{};
+    if (offset + sizeof(record) > used_bytes) {
+      recording.n_bad_records++;
+      return;
+    }
+    std::memcpy(&record, records + offset, sizeof(record));
+    offset += sizeof(record);
+    if (record.len > MAVLINK_MAX_PACKET_LEN ||
+        offset + record.len > used_bytes || record.link >= MAX_N_LINKS ||
+        record.direction > static_cast<uint8_t>(Direction::TX)) {
+      recording.n_bad_records++;
+      return;
+    }
+    const auto parsed = parser.parse(records + offset, record.len);
+    offset += record.len;
+    if (parsed.size() != 1) {
+      recording.n_bad_records++;
+      // Don't let a broken frame affect the next one
+      parser = MavlinkFrameParser{};
+      continue;
+    }
+    recording.messages.push_back(RecordedMessage{
+        record.timestamp_us, record.link,
+        static_cast<Direction>(record.direction), parsed[0]});
+  }
+}
+
+}  // namespace
+
+std::vector<TelemetryRecording> TelemetryRecording::read_all(
+    const std::string& directory, const std::string& name) {
+  // session -> (sequence -> segment)
+  std::map<uint64_t, std::map<uint64_t, SegmentData>> sessions;
+  for (const auto& filename :
+       OHDFilesystemUtil::getAllEntriesFullPathInDirectory(directory)) {
+    const auto basename = filename.substr(filename.find_last_of('/') + 1);
+    if (basename.rfind(name + "_", 0) != 0 || !ends_with(basename, ".rec")) {
+      continue;
+    }
+    auto segment = read_segment(filename);
+    if (!segment.has_value()) continue;
+    const auto& header = segment->header;
+    sessions[header.session_unix_us][header.sequence] =
+        std::move(segment.value());
+  }
+  std::vector<TelemetryRecording> ret;
+  for (const auto& [session_unix_us, segments] : sessions) {
+    TelemetryRecording recording;
+    recording.session_unix_us = session_unix_us;
+    for (const auto& [sequence, segment] : segments) {
+      for (int i = 0; i < MAX_N_LINKS; i++) {
+        recording.link_names[i] =
+            std::string(segment.header.link_names[i],
+                        strnlen(segment.header.link_names[i],
+                                MAX_LINK_NAME_LEN));
+      }
+      parse_records(segment, recording);
+      recording.n_segments++;
+    }
+    ret.push_back(std::move(recording));
+  }
+  return ret;
+}
+
+int TelemetryRecording::get_link(const std::string& link_name) const {
+  for (int i = 0; i < MAX_N_LINKS; i++) {
+    if (!link_name.empty() && link_names[i] == link_name) return i;
+  }
+  return -1;
+}
+
+std::string TelemetryRecording::to_string() const {
+  std::stringstream ss;
+  const double duration_s =
+      messages.empty() ? 0
+                       : (double)(messages.back().timestamp_us -
+                                  messages.front().timestamp_us) /
+                             1000.0 / 1000.0;
+  ss << "Session " << session_unix_us << ": " << n_segments << " segments, "
+     << messages.size() << " messages, " << duration_s << "s";
+  if (n_bad_records > 0) ss << ", " << n_bad_records << " bad";
+  std::array<std::array<uint64_t, 2>, MAX_N_LINKS> counts{};
+  for (const auto& message : messages) {
+    counts[message.link][static_cast<int>(message.direction)]++;
+  }
+  for (int i = 0; i < MAX_N_LINKS; i++) {
+    if (counts[i][0] == 0 && counts[i][1] == 0) continue;
+    ss << "\n  " << link_names[i] << " rx:" << counts[i][0]
+       << " tx:" << counts[i][1];
+  }
+  return ss.str();
+}
@@ -0,0 +1,51 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#ifndef OPENHD_OPENHD_OHD_TELEMETRY_SRC_RECORDER_TELEMETRYRECORDING_H_
+#define OPENHD_OPENHD_OHD_TELEMETRY_SRC_RECORDER_TELEMETRYRECORDING_H_
+
+#include <array>
+#include <string>
+#include <vector>
+
+#include "../mav_include.h"
+#include "TelemetryRecordingFormat.h"
+
+struct RecordedMessage {
+  // Steady clock of the recording unit
+  uint64_t timestamp_us;
+  int link;
+  openhd::telemetry::recording::Direction direction;
+  MavlinkMessage msg;
+};
+
+/**
+ * One session (e.g. one flight) written by TelemetryRecorder, read back from
+ * the segment files. For post-flight analysis and TelemetryReplay.
+ */
+class TelemetryRecording {
+ public:
+  /**
+   * Reads all sessions of the recorder with the given name in the given
+   * directory, oldest first. Sessions might be incomplete at the start (the
+   * ring wrapped around) - corrupted records (e.g. the unit lost power while
+   * writing) end a segment and are counted.
+   */
+  static std::vector<TelemetryRecording> read_all(const std::string& directory,
+                                                  const std::string& name);
+  // Unix time (us) the recording was started
+  uint64_t session_unix_us = 0;
+  std::array<std::string, openhd::telemetry::recording::MAX_N_LINKS>
+      link_names;
+  // In the order they were recorded
+  std::vector<RecordedMessage> messages;
+  int n_segments = 0;
+  uint64_t n_bad_records = 0;
+  // Link id for the given name, -1 if there is no such link
+  [[nodiscard]] int get_link(const std::string& link_name) const;
+  // Duration, n of messages per link and direction
+  [[nodiscard]] std::string to_string() const;
+};
+
+#endif  // OPENHD_OPENHD_OHD_TELEMETRY_SRC_RECORDER_TELEMETRYRECORDING_H_
@@ -0,0 +1,65 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#ifndef OPENHD_OPENHD_OHD_TELEMETRY_SRC_RECORDER_TELEMETRYRECORDINGFORMAT_H_
+#define OPENHD_OPENHD_OHD_TELEMETRY_SRC_RECORDER_TELEMETRYRECORDINGFORMAT_H_
+
+#include <cstdint>
+
+// On-disk format of the telemetry flight recorder.
+// A recording is a ring of N preallocated segment files of a fixed size
+// (<name>_<index>.rec). Each segment starts with a SegmentHeader (padded to
+// SEGMENT_HEADER_SIZE), followed by records. A record is a RecordHeader
+// followed by one mavlink frame (as it is sent on the wire).
+// Segments are written in order of their sequence number, the oldest segment
+// is overwritten once the ring is full.
+// All values are little endian (host byte order, we only run on little endian
+// platforms).
+namespace openhd::telemetry::recording {
+
+static constexpr uint64_t SEGMENT_MAGIC = 0x3143455244484F00;  // "\0OHDREC1"
+static constexpr uint32_t FORMAT_VERSION = 1;
+static constexpr int MAX_N_LINKS = 8;
+static constexpr int MAX_LINK_NAME_LEN = 16;
+static constexpr int SEGMENT_HEADER_SIZE = 256;
+
+enum class Direction : uint8_t {
+  // Received on the link
+  RX = 0,
+  // Sent out on the link
+  TX = 1
+};
+
+struct SegmentHeader {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t segment_size;
+  // Increases by one for each segment written by a recorder instance.
+  uint64_t sequence;
+  // Unix time (us) the recorder instance was created - identifies a session
+  // (e.g. one flight / boot)
+  uint64_t session_unix_us;
+  // Steady clock (us) at the same time, to map record timestamps to unix time
+  uint64_t session_steady_us;
+  // Bytes of records after the header. Updated after each record.
+  uint32_t used_bytes;
+  uint32_t n_records;
+  // Names of the link ids used in the records, null-terminated
+  char link_names[MAX_N_LINKS][MAX_LINK_NAME_LEN];
+};
+static_assert(sizeof(SegmentHeader) <= SEGMENT_HEADER_SIZE);
+
+struct __attribute__((packed)) RecordHeader {
+  // Steady clock
+  uint64_t timestamp_us;
+  // Length of the mavlink frame following this header
+  uint16_t len;
+  uint8_t link;
+  uint8_t direction;
+};
+static_assert(sizeof(RecordHeader) == 12);
+
+}  // namespace openhd::telemetry::recording
+
+#endif  // OPENHD_OPENHD_OHD_TELEMETRY_SRC_RECORDER_TELEMETRYRECORDINGFORMAT_H_
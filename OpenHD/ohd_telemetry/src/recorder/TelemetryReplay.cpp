@@ -0,0 +1,75 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#include "TelemetryReplay.h"
+
+#include <algorithm>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+TelemetryReplay::Stats TelemetryReplay::replay(
+    const TelemetryRecording& recording, const Options& options,
+    const CALLBACK& cb) {
+  Stats stats{};
+  const auto& messages = recording.messages;
+  const auto start = std::chrono::steady_clock::now();
+  const uint64_t first_timestamp_us =
+      messages.empty() ? 0 : messages.front().timestamp_us;
+  std::vector<MavlinkMessage> batch;
+  size_t i = 0;
+  while (i < messages.size()) {
+    const auto& first = messages[i];
+    // Consecutive messages of the same link, direction and time
+    size_t end = i + 1;
+    while (end < messages.size() &&
+           messages[end].timestamp_us == first.timestamp_us &&
+           messages[end].link == first.link &&
+           messages[end].direction == first.direction) {
+      end++;
+    }
+    const bool selected =
+        (options.link < 0 || options.link == first.link) &&
+        (!options.direction.has_value() ||
+         options.direction.value() == first.direction);
+    if (selected) {
+      if (options.speed > 0) {
+        const auto offset = std::chrono::nanoseconds(static_cast<int64_t>(
+            (double)(first.timestamp_us - first_timestamp_us) * 1000.0 /
+            options.speed));
+        const auto scheduled = start + offset;
+        std::this_thread::sleep_until(scheduled);
+        stats.max_lateness = std::max(
+            stats.max_lateness,
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - scheduled));
+      }
+      batch.clear();
+      for (size_t j = i; j < end; j++) {
+        batch.push_back(messages[j].msg);
+      }
+      cb(first.link, first.direction, batch);
+      stats.n_messages += batch.size();
+      stats.n_batches++;
+    }
+    i = end;
+  }
+  stats.duration = std::chrono::steady_clock::now() - start;
+  return stats;
+}
+
+std::string TelemetryReplay::Stats::to_string() const {
+  std::stringstream ss;
+  const double duration_s = (double)duration.count() / 1000.0 / 1000.0 / 1000.0;
+  ss << "Replayed " << n_messages << " messages in " << n_batches
+     << " batches, " << duration_s << "s";
+  if (duration_s > 0) {
+    ss << " (" << (uint64_t)((double)n_messages / duration_s) << " msg/s)";
+  }
+  ss << ", max lateness:"
+     << std::chrono::duration_cast<std::chrono::microseconds>(max_lateness)
+            .count()
+     << "us";
+  return ss.str();
+}
@@ -0,0 +1,48 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#ifndef OPENHD_OPENHD_OHD_TELEMETRY_SRC_RECORDER_TELEMETRYREPLAY_H_
+#define OPENHD_OPENHD_OHD_TELEMETRY_SRC_RECORDER_TELEMETRYREPLAY_H_
+
+#include <chrono>
+#include <functional>
+#include <optional>
+#include <string>
+
+#include "TelemetryRecording.h"
+
+/**
+ * Replays a TelemetryRecording, e.g. into a MEndpoint (QGroundControl via
+ * UDP, a FC via UART) or into the routing / aggregation code as a
+ * reproducible benchmark. Messages that were recorded together (same link,
+ * direction and time) are delivered together, like they were received.
+ */
+class TelemetryReplay {
+ public:
+  using Direction = openhd::telemetry::recording::Direction;
+  struct Options {
+    // 1.0: Original timing, 10.0: 10x faster, 0: as fast as possible
+    double speed = 1.0;
+    // Only messages of this link, -1 for all links
+    int link = -1;
+    // Only messages in this direction, std::nullopt for both directions
+    std::optional<Direction> direction = std::nullopt;
+  };
+  typedef std::function<void(int link, Direction direction,
+                             MavlinkMessageSpan messages)>
+      CALLBACK;
+  struct Stats {
+    uint64_t n_messages = 0;
+    uint64_t n_batches = 0;
+    std::chrono::nanoseconds duration{};
+    // How much later than scheduled a batch was delivered (at most)
+    std::chrono::nanoseconds max_lateness{};
+    [[nodiscard]] std::string to_string() const;
+  };
+  // Blocks until the whole recording has been replayed
+  static Stats replay(const TelemetryRecording& recording,
+                      const Options& options, const CALLBACK& cb);
+};
+
+#endif  // OPENHD_OPENHD_OHD_TELEMETRY_SRC_RECORDER_TELEMETRYREPLAY_H_
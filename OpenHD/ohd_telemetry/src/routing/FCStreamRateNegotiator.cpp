@@ -0,0 +1,348 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#include "FCStreamRateNegotiator.h"
+
+#include <algorithm>
+#include <sstream>
+
+namespace {
+
+// The legacy (REQUEST_DATA_STREAM) group a message is streamed in, like
+// ArduPilot groups them
+std::optional<uint8_t> get_data_stream(uint32_t msg_id) {
+  switch (msg_id) {
+    case MAVLINK_MSG_ID_ATTITUDE:
+    case MAVLINK_MSG_ID_ATTITUDE_QUATERNION:
+      return MAV_DATA_STREAM_EXTRA1;
+    case MAVLINK_MSG_ID_VFR_HUD:
+      return MAV_DATA_STREAM_EXTRA2;
+    case MAVLINK_MSG_ID_GLOBAL_POSITION_INT:
+    case MAVLINK_MSG_ID_LOCAL_POSITION_NED:
+      return MAV_DATA_STREAM_POSITION;
+    case MAVLINK_MSG_ID_RC_CHANNELS:
+    case MAVLINK_MSG_ID_SERVO_OUTPUT_RAW:
+      return MAV_DATA_STREAM_RC_CHANNELS;
+    case MAVLINK_MSG_ID_SYS_STATUS:
+    case MAVLINK_MSG_ID_GPS_RAW_INT:
+      return MAV_DATA_STREAM_EXTENDED_STATUS;
+    case MAVLINK_MSG_ID_RAW_IMU:
+    case MAVLINK_MSG_ID_SCALED_PRESSURE:
+      return MAV_DATA_STREAM_RAW_SENSORS;
+    default:
+      return std::nullopt;
+  }
+}
+
+std::string rates_as_string(const std::map<uint32_t, int>& rates) {
+  std::stringstream ss;
+  for (const auto& [msg_id, rate_hz] : rates) {
+    ss << msg_id << ":";
+    if (rate_hz < 0) {
+      ss << "refused ";
+    } else {
+      ss << rate_hz << "Hz ";
+    }
+  }
+  return ss.str();
+}
+
+}  // namespace
+
+FCStreamRateNegotiator::FCStreamRateNegotiator(uint8_t sys_id, uint8_t comp_id)
+    : m_sys_id(sys_id), m_comp_id(comp_id) {
+  m_console = openhd::log::create_or_get("fc_rates");
+}
+
+void FCStreamRateNegotiator::set_enabled(bool enabled) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (enabled == m_enabled) return;
+  m_enabled = enabled;
+  if (m_enabled) renegotiate_all_locked();
+}
+
+void FCStreamRateNegotiator::set_profile(std::map<uint32_t, int> rates_hz) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_profile = std::move(rates_hz);
+  renegotiate_all_locked();
+}
+
+void FCStreamRateNegotiator::on_fc_messages(
+    MavlinkMessageSpan messages, std::chrono::steady_clock::time_point now) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (const auto& msg : messages) {
+    if (msg.m.msgid == MAVLINK_MSG_ID_HEARTBEAT) {
+      // Only the autopilot itself, not e.g. a gimbal on the same link
+      if (mavlink_msg_heartbeat_get_autopilot(&msg.m) ==
+          MAV_AUTOPILOT_INVALID) {
+        continue;
+      }
+      const auto fc = std::make_pair(msg.m.sysid, msg.m.compid);
+      if (!m_fc.has_value() || m_fc.value() != fc) {
+        m_console->info("FC {}:{} connected", fc.first, fc.second);
+        m_fc = fc;
+        m_mode = Mode::UNKNOWN;
+        m_in_flight = std::nullopt;
+        m_negotiated.clear();
+        m_pending.clear();
+        renegotiate_all_locked();
+      }
+      m_last_fc_heartbeat = now;
+    } else if (msg.m.msgid == MAVLINK_MSG_ID_COMMAND_ACK) {
+      on_command_ack_locked(msg.m);
+    }
+  }
+}
+
+std::vector<MavlinkMessage> FCStreamRateNegotiator::update(
+    const LinkCondition& condition, std::chrono::steady_clock::time_point now) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  std::vector<MavlinkMessage> ret;
+  if (m_fc.has_value() && now - m_last_fc_heartbeat > FC_TIMEOUT) {
+    // Most likely rebooted, which resets the rates
+    m_console->info("FC {}:{} lost", m_fc->first, m_fc->second);
+    m_fc = std::nullopt;
+    m_in_flight = std::nullopt;
+    m_pending.clear();
+    m_negotiated.clear();
+  }
+  update_scale_locked(condition, now);
+  if (!m_enabled || !m_fc.has_value()) return ret;
+  if (m_mode == Mode::DATA_STREAM) {
+    if (m_data_streams_pending) {
+      m_data_streams_pending = false;
+      ret = create_data_stream_requests_locked();
+      log_negotiated_locked();
+    }
+    return ret;
+  }
+  if (m_in_flight.has_value()) {
+    auto& in_flight = m_in_flight.value();
+    if (now - in_flight.sent < COMMAND_TIMEOUT) return ret;
+    if (in_flight.n_attempts < MAX_N_ATTEMPTS) {
+      in_flight.n_attempts++;
+      in_flight.sent = now;
+      ret.push_back(
+          create_set_message_interval(in_flight.msg_id, in_flight.rate_hz));
+      return ret;
+    }
+    m_stats.n_timeouts++;
+    m_console->warn("No ack for the interval of msg {}", in_flight.msg_id);
+    m_in_flight = std::nullopt;
+    if (m_mode == Mode::UNKNOWN) {
+      // The FC never answered - try the legacy way
+      m_console->info("FC ignores SET_MESSAGE_INTERVAL, using data streams");
+      m_mode = Mode::DATA_STREAM;
+      m_pending.clear();
+      ret = create_data_stream_requests_locked();
+      log_negotiated_locked();
+      return ret;
+    }
+  }
+  if (!m_pending.empty()) {
+    const auto msg_id = m_pending.front();
+    m_pending.pop_front();
+    const int rate_hz = get_target_rate_locked(msg_id);
+    m_in_flight = InFlight{msg_id, rate_hz, now, 1};
+    ret.push_back(create_set_message_interval(msg_id, rate_hz));
+  }
+  return ret;
+}
+
+std::map<uint32_t, int> FCStreamRateNegotiator::get_target_rates() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  std::map<uint32_t, int> ret;
+  for (const auto& [msg_id, rate_hz] : m_profile) {
+    ret[msg_id] = get_target_rate_locked(msg_id);
+  }
+  return ret;
+}
+
+int FCStreamRateNegotiator::get_scale_percent() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return SCALE_LEVELS_PERCENT[m_scale_level];
+}
+
+std::string FCStreamRateNegotiator::to_string() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  std::stringstream ss;
+  ss << "FCStreamRates{" << (m_enabled ? "enabled" : "disabled")
+     << " mode:" << mode_as_string(m_mode)
+     << " scale:" << SCALE_LEVELS_PERCENT[m_scale_level] << "%"
+     << " negotiated:" << rates_as_string(m_negotiated)
+     << "commands:" << m_stats.n_commands
+     << " accepted:" << m_stats.n_accepted
+     << " refused:" << m_stats.n_refused
+     << " timeouts:" << m_stats.n_timeouts
+     << " data_stream_requests:" << m_stats.n_data_stream_requests << "}";
+  return ss.str();
+}
+
+std::string FCStreamRateNegotiator::mode_as_string(Mode mode) {
+  switch (mode) {
+    case Mode::UNKNOWN:
+      return "unknown";
+    case Mode::MESSAGE_INTERVAL:
+      return "message_interval";
+    case Mode::DATA_STREAM:
+      return "data_stream";
+  }
+  return "unknown";
+}
+
+int FCStreamRateNegotiator::get_target_rate_locked(uint32_t msg_id) const {
+  const auto it = m_profile.find(msg_id);
+  if (it == m_profile.end() || it->second <= 0) return 0;
+  return std::max(1, it->second * SCALE_LEVELS_PERCENT[m_scale_level] / 100);
+}
+
+void FCStreamRateNegotiator::update_scale_locked(
+    const LinkCondition& condition, std::chrono::steady_clock::time_point now) {
+  const int max_level = (int)SCALE_LEVELS_PERCENT.size() - 1;
+  // What the link can carry right now, relative to the best rate we have seen
+  m_max_link_rate_kbits =
+      std::max(m_max_link_rate_kbits, condition.link_rate_kbits);
+  int capacity_level = 0;
+  if (condition.link_rate_kbits > 0 && m_max_link_rate_kbits > 0) {
+    const int perc = condition.link_rate_kbits * 100 / m_max_link_rate_kbits;
+    if (perc < 30) {
+      capacity_level = 3;
+    } else if (perc < 50) {
+      capacity_level = 2;
+    } else if (perc < 75) {
+      capacity_level = 1;
+    }
+  }
+  if (condition.n_rate_adjustments > 0) {
+    capacity_level = std::max(capacity_level, 1);
+  }
+  const bool dropped = m_last_n_tx_dropped >= 0 &&
+                       condition.n_tx_dropped > m_last_n_tx_dropped;
+  m_last_n_tx_dropped = condition.n_tx_dropped;
+  if (dropped) {
+    m_last_congestion = now;
+    if (m_scale_level < max_level &&
+        now - m_last_scale_change >= SCALE_DOWN_COOLDOWN) {
+      set_scale_level_locked(m_scale_level + 1, "telemetry tx drops", now);
+    }
+  }
+  if (m_scale_level < capacity_level) {
+    set_scale_level_locked(capacity_level, "reduced link rate", now);
+  } else if (m_scale_level > capacity_level &&
+             now - m_last_congestion >= RESTORE_HOLD &&
+             now - m_last_scale_change >= RESTORE_HOLD) {
+    set_scale_level_locked(m_scale_level - 1, "link recovered", now);
+  }
+}
+
+void FCStreamRateNegotiator::set_scale_level_locked(
+    int level, const char* reason, std::chrono::steady_clock::time_point now) {
+  m_console->info("FC rates {}% -> {}% ({})",
+                  SCALE_LEVELS_PERCENT[m_scale_level],
+                  SCALE_LEVELS_PERCENT[level], reason);
+  m_scale_level = level;
+  m_last_scale_change = now;
+  renegotiate_all_locked();
+}
+
+void FCStreamRateNegotiator::renegotiate_all_locked() {
+  if (m_mode == Mode::DATA_STREAM) {
+    m_data_streams_pending = true;
+    return;
+  }
+  // Only what differs from what the FC already confirmed
+  for (const auto& [msg_id, rate_hz] : m_profile) {
+    const int target = get_target_rate_locked(msg_id);
+    if (target <= 0) continue;
+    const auto negotiated = m_negotiated.find(msg_id);
+    if (negotiated != m_negotiated.end() && negotiated->second == target) {
+      continue;
+    }
+    if (std::find(m_pending.begin(), m_pending.end(), msg_id) ==
+        m_pending.end()) {
+      m_pending.push_back(msg_id);
+    }
+  }
+}
+
+void FCStreamRateNegotiator::on_command_ack_locked(
+    const mavlink_message_t& msg) {
+  mavlink_command_ack_t ack;
+  mavlink_msg_command_ack_decode(&msg, &ack);
+  if (ack.command != MAV_CMD_SET_MESSAGE_INTERVAL ||
+      !m_in_flight.has_value() || !m_fc.has_value() ||
+      msg.sysid != m_fc->first) {
+    return;
+  }
+  // The ack of a SET_MESSAGE_INTERVAL someone else (e.g. the GCS) sent. 0 ==
+  // not set (older firmware / truncated payload)
+  if ((ack.target_system != 0 && ack.target_system != m_sys_id) ||
+      (ack.target_component != 0 && ack.target_component != m_comp_id)) {
+    return;
+  }
+  if (ack.result == MAV_RESULT_IN_PROGRESS) return;
+  const auto in_flight = m_in_flight.value();
+  m_in_flight = std::nullopt;
+  if (ack.result == MAV_RESULT_ACCEPTED) {
+    m_mode = Mode::MESSAGE_INTERVAL;
+    m_negotiated[in_flight.msg_id] = in_flight.rate_hz;
+    m_stats.n_accepted++;
+  } else {
+    m_stats.n_refused++;
+    if (m_mode == Mode::UNKNOWN && ack.result == MAV_RESULT_UNSUPPORTED) {
+      m_console->info("FC does not support SET_MESSAGE_INTERVAL, using data "
+                      "streams");
+      m_mode = Mode::DATA_STREAM;
+      m_pending.clear();
+      m_data_streams_pending = true;
+      return;
+    }
+    m_console->warn("FC refused {}Hz for msg {} ({})", in_flight.rate_hz,
+                    in_flight.msg_id, (int)ack.result);
+    m_negotiated[in_flight.msg_id] = -1;
+  }
+  if (m_pending.empty()) log_negotiated_locked();
+}
+
+MavlinkMessage FCStreamRateNegotiator::create_set_message_interval(
+    uint32_t msg_id, int rate_hz) {
+  MavlinkMessage ret{};
+  const float interval_us = 1000.0f * 1000.0f / (float)rate_hz;
+  mavlink_msg_command_long_pack(m_sys_id, m_comp_id, &ret.m, m_fc->first,
+                                m_fc->second, MAV_CMD_SET_MESSAGE_INTERVAL, 0,
+                                (float)msg_id, interval_us, 0, 0, 0, 0, 0);
+  m_stats.n_commands++;
+  return ret;
+}
+
+std::vector<MavlinkMessage>
+FCStreamRateNegotiator::create_data_stream_requests_locked() {
+  // A stream goes with the highest rate of the messages in it
+  std::map<uint8_t, int> stream_rates;
+  m_negotiated.clear();
+  for (const auto& [msg_id, rate_hz] : m_profile) {
+    const int target = get_target_rate_locked(msg_id);
+    const auto stream = get_data_stream(msg_id);
+    if (target <= 0 || !stream.has_value()) continue;
+    stream_rates[stream.value()] =
+        std::max(stream_rates[stream.value()], target);
+    m_negotiated[msg_id] = target;
+  }
+  std::vector<MavlinkMessage> ret;
+  for (const auto& [stream, rate_hz] : stream_rates) {
+    MavlinkMessage msg{};
+    mavlink_msg_request_data_stream_pack(m_sys_id, m_comp_id, &msg.m,
+                                         m_fc->first, m_fc->second, stream,
+                                         rate_hz, 1);
+    ret.push_back(msg);
+    m_stats.n_data_stream_requests++;
+  }
+  return ret;
+}
+
+void FCStreamRateNegotiator::log_negotiated_locked() {
+  m_console->info("Negotiated FC rates ({}%, {}): {}",
+                  SCALE_LEVELS_PERCENT[m_scale_level], mode_as_string(m_mode),
+                  rates_as_string(m_negotiated));
+}
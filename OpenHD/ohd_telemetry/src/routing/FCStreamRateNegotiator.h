@@ -0,0 +1,129 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#ifndef OPENHD_OPENHD_OHD_TELEMETRY_SRC_ROUTING_FCSTREAMRATENEGOTIATOR_H_
+#define OPENHD_OPENHD_OHD_TELEMETRY_SRC_ROUTING_FCSTREAMRATENEGOTIATOR_H_
+
+#include <array>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "../mav_include.h"
+#include "openhd_spdlog.h"
+
+/**
+ * Owns the message intervals of the FC connected to the air unit: Instead of
+ * forwarding whatever rates the FC (SRx params) or a GCS configured, the FC is
+ * told how fast to stream each message of a profile (msg id -> rate). The
+ * rates are scaled down when the link cannot carry them (telemetry tx drops,
+ * reduced link rate) and restored once it can again.
+ * Uses MAV_CMD_SET_MESSAGE_INTERVAL (one command in flight at a time, since
+ * the ack does not say which message it is for, with retries). FCs that don't
+ * support it get REQUEST_DATA_STREAM instead.
+ * Everything is re-negotiated when the FC reboots (heartbeat timeout).
+ * Thread-safe.
+ */
+class FCStreamRateNegotiator {
+ public:
+  // sys / comp id we send the commands with
+  FCStreamRateNegotiator(uint8_t sys_id, uint8_t comp_id);
+  // Disabled: No message(s) are ever sent to the FC
+  void set_enabled(bool enabled);
+  // msg id -> rate in Hz at full link capacity, 0 means not managed
+  void set_profile(std::map<uint32_t, int> rates_hz);
+  // Messages from the FC (heartbeat, command ack)
+  void on_fc_messages(MavlinkMessageSpan messages,
+                      std::chrono::steady_clock::time_point now =
+                          std::chrono::steady_clock::now());
+  struct LinkCondition {
+    // Total n of telemetry messages dropped on the way to the ground so far
+    // (tx queue overflow / stale)
+    int64_t n_tx_dropped = 0;
+    // Current rate of the link (depends on the MCS), 0 if unknown
+    int link_rate_kbits = 0;
+    // > 0 if the link had to reduce its rate since tx could not keep up
+    int n_rate_adjustments = 0;
+  };
+  /**
+   * Call in regular intervals (e.g. 10Hz).
+   * @return messages that need to be sent to the FC
+   */
+  std::vector<MavlinkMessage> update(const LinkCondition& condition,
+                                     std::chrono::steady_clock::time_point now =
+                                         std::chrono::steady_clock::now());
+  // The profile, scaled to the current link capacity. Also valid if the FC
+  // does not (yet) stream with these rates.
+  std::map<uint32_t, int> get_target_rates();
+  // 100 = full profile rates
+  int get_scale_percent();
+  std::string to_string();
+
+  static constexpr std::array<int, 4> SCALE_LEVELS_PERCENT{100, 75, 50, 25};
+  static constexpr auto COMMAND_TIMEOUT = std::chrono::milliseconds(500);
+  static constexpr int MAX_N_ATTEMPTS = 3;
+  // FC is considered gone (rebooted) without a heartbeat for this long
+  static constexpr auto FC_TIMEOUT = std::chrono::seconds(5);
+  // Min time between two reductions, such that the effect of the previous one
+  // can be seen
+  static constexpr auto SCALE_DOWN_COOLDOWN = std::chrono::seconds(2);
+  // Rates are restored one step at a time, after no drops for this long
+  static constexpr auto RESTORE_HOLD = std::chrono::seconds(10);
+
+ private:
+  enum class Mode { UNKNOWN, MESSAGE_INTERVAL, DATA_STREAM };
+  static std::string mode_as_string(Mode mode);
+  struct InFlight {
+    uint32_t msg_id;
+    int rate_hz;
+    std::chrono::steady_clock::time_point sent;
+    int n_attempts;
+  };
+  [[nodiscard]] int get_target_rate_locked(uint32_t msg_id) const;
+  void update_scale_locked(const LinkCondition& condition,
+                           std::chrono::steady_clock::time_point now);
+  void set_scale_level_locked(int level, const char* reason,
+                              std::chrono::steady_clock::time_point now);
+  void renegotiate_all_locked();
+  void on_command_ack_locked(const mavlink_message_t& msg);
+  MavlinkMessage create_set_message_interval(uint32_t msg_id, int rate_hz);
+  std::vector<MavlinkMessage> create_data_stream_requests_locked();
+  void log_negotiated_locked();
+  const uint8_t m_sys_id;
+  const uint8_t m_comp_id;
+  std::shared_ptr<spdlog::logger> m_console;
+  std::mutex m_mutex;
+  bool m_enabled = false;
+  std::map<uint32_t, int> m_profile;
+  // FC we talk to, from its heartbeat
+  std::optional<std::pair<uint8_t, uint8_t>> m_fc;
+  std::chrono::steady_clock::time_point m_last_fc_heartbeat;
+  Mode m_mode = Mode::UNKNOWN;
+  // msg ids that (still) need to be sent to the FC
+  std::deque<uint32_t> m_pending;
+  std::optional<InFlight> m_in_flight;
+  bool m_data_streams_pending = false;
+  // msg id -> rate the FC confirmed (-1: FC refused it)
+  std::map<uint32_t, int> m_negotiated;
+  // Index into SCALE_LEVELS_PERCENT
+  int m_scale_level = 0;
+  std::chrono::steady_clock::time_point m_last_scale_change;
+  std::chrono::steady_clock::time_point m_last_congestion;
+  int64_t m_last_n_tx_dropped = -1;
+  int m_max_link_rate_kbits = 0;
+  struct Stats {
+    int64_t n_commands = 0;
+    int64_t n_accepted = 0;
+    int64_t n_refused = 0;
+    int64_t n_timeouts = 0;
+    int64_t n_data_stream_requests = 0;
+  };
+  Stats m_stats;
+};
+
+#endif  // OPENHD_OPENHD_OHD_TELEMETRY_SRC_ROUTING_FCSTREAMRATENEGOTIATOR_H_
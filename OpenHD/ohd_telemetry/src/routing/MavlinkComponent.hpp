@@ -8,6 +8,7 @@
 #include <cassert>
 #include <optional>
 #include <utility>
+#include <vector>
 
 #include "MavlinkSystem.hpp"
 #include "mav_include.h"
@@ -28,17 +29,30 @@ class MavlinkComponent {
   /**
    * Call this with any mavlink message received, the component can then decide
    * if he can use this message or not.
+   * The messages are only valid for the duration of this call.
    * @return a list of mavlink messages that were created as a response.Empty
    * unless the given message needs a response.
    */
   virtual std::vector<MavlinkMessage> process_mavlink_messages(
-      std::vector<MavlinkMessage> messages) = 0;
+      MavlinkMessageSpan messages) = 0;
   /**
    * The parent should call this method in regular intervals and send out the
    * generated mavlink messages. This is for fire and forget messages. For
    * example, a component might return the heartbeat(s) here.
    */
   virtual std::vector<MavlinkMessage> generate_mavlink_messages() = 0;
+  // Declares which messages the component wants to see, used by the
+  // MavlinkComponentDispatcher to only pass matching messages to
+  // process_mavlink_messages()
+  struct MessageFilter {
+    // Empty: all messages
+    std::vector<uint32_t> msg_ids;
+    // Drop messages that have a target sys / comp id which is not this
+    // component (0 == broadcast, always passed)
+    bool only_targeted_to_self = false;
+  };
+  // Queried once when the component is added to the dispatcher.
+  [[nodiscard]] virtual MessageFilter get_message_filter() const { return {}; }
 
  protected:
   // These are protected, and MUST be called in the implementation(s) process
@@ -0,0 +1,55 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#include "MavlinkComponentDispatcher.h"
+
+#include "../mav_helper.h"
+
+void MavlinkComponentDispatcher::add_component(
+    std::shared_ptr<MavlinkComponent> component) {
+  const size_t idx = m_components.size();
+  auto filter = component->get_message_filter();
+  if (filter.msg_ids.empty()) {
+    m_components_all_msg_ids.push_back(idx);
+  } else {
+    for (const auto msg_id : filter.msg_ids) {
+      m_components_by_msg_id[msg_id].push_back(idx);
+    }
+  }
+  m_entries.push_back(Entry{std::move(filter), {}});
+  m_components.push_back(std::move(component));
+}
+
+void MavlinkComponentDispatcher::add_to_batch(size_t component_idx,
+                                              const MavlinkMessage& msg) {
+  auto& entry = m_entries[component_idx];
+  if (entry.filter.only_targeted_to_self) {
+    const auto& component = *m_components[component_idx];
+    // 0 == broadcast / no target
+    const auto target = get_target_from_message_if_available(msg.m);
+    if (target.sys_id != 0 && target.sys_id != component.m_sys_id) return;
+    if (target.comp_id != 0 && target.comp_id != component.m_comp_id) return;
+  }
+  entry.batch.push_back(msg);
+}
+
+std::vector<MavlinkMessage> MavlinkComponentDispatcher::dispatch(
+    MavlinkMessageSpan messages) {
+  for (const auto& msg : messages) {
+    auto it = m_components_by_msg_id.find(msg.m.msgid);
+    if (it != m_components_by_msg_id.end()) {
+      for (const auto idx : it->second) add_to_batch(idx, msg);
+    }
+    for (const auto idx : m_components_all_msg_ids) add_to_batch(idx, msg);
+  }
+  std::vector<MavlinkMessage> ret;
+  for (size_t i = 0; i < m_entries.size(); i++) {
+    auto& batch = m_entries[i].batch;
+    if (batch.empty()) continue;
+    auto responses = m_components[i]->process_mavlink_messages(batch);
+    batch.clear();
+    ret.insert(ret.end(), responses.begin(), responses.end());
+  }
+  return ret;
+}
@@ -0,0 +1,53 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#ifndef OPENHD_OPENHD_OHD_TELEMETRY_SRC_ROUTING_MAVLINKCOMPONENTDISPATCHER_H_
+#define OPENHD_OPENHD_OHD_TELEMETRY_SRC_ROUTING_MAVLINKCOMPONENTDISPATCHER_H_
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "MavlinkComponent.hpp"
+
+/**
+ * Holds the OpenHD mavlink components of one unit (air / ground) and passes
+ * received messages only to the component(s) that declared (via
+ * get_message_filter()) that they consume them. The msg id -> component(s)
+ * table is built once when a component is added, so the cost per message is
+ * one lookup instead of calling each component with each message - most
+ * messages (e.g. the FC telemetry stream) are not consumed by any component.
+ * Not thread-safe, the owner needs to synchronize add_component / dispatch.
+ */
+class MavlinkComponentDispatcher {
+ public:
+  void add_component(std::shared_ptr<MavlinkComponent> component);
+  /**
+   * Calls process_mavlink_messages() on all components that consume one or
+   * more of the given messages (with only those messages).
+   * @return the responses of all called components.
+   */
+  std::vector<MavlinkMessage> dispatch(MavlinkMessageSpan messages);
+  [[nodiscard]] const std::vector<std::shared_ptr<MavlinkComponent>>&
+  get_components() const {
+    return m_components;
+  }
+
+ private:
+  struct Entry {
+    MavlinkComponent::MessageFilter filter;
+    // Re-used storage for the messages of one dispatch() call
+    std::vector<MavlinkMessage> batch;
+  };
+  void add_to_batch(size_t component_idx, const MavlinkMessage& msg);
+  std::vector<std::shared_ptr<MavlinkComponent>> m_components;
+  // Same index as m_components
+  std::vector<Entry> m_entries;
+  // msg id -> index of all components that consume this msg id
+  std::unordered_map<uint32_t, std::vector<size_t>> m_components_by_msg_id;
+  // components without a msg id filter
+  std::vector<size_t> m_components_all_msg_ids;
+};
+
+#endif  // OPENHD_OPENHD_OHD_TELEMETRY_SRC_ROUTING_MAVLINKCOMPONENTDISPATCHER_H_
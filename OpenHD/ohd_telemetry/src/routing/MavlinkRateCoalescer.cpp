@@ -0,0 +1,123 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#include "MavlinkRateCoalescer.h"
+
+#include <sstream>
+
+void MavlinkRateCoalescer::set_max_rates(
+    std::map<uint32_t, int> max_rates_hz) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_intervals.clear();
+  for (const auto& [msg_id, rate_hz] : max_rates_hz) {
+    if (rate_hz <= 0) continue;  // no limit
+    m_intervals[msg_id] = std::chrono::nanoseconds(1000 * 1000 * 1000) / rate_hz;
+  }
+  // Held back messages of a msg id that is not limited anymore are lost, which
+  // is fine (the FC sends a new one soon)
+  m_states.clear();
+}
+
+bool MavlinkRateCoalescer::on_rate_limited_message(
+    const MavlinkMessage& msg, const std::chrono::nanoseconds interval,
+    const std::chrono::steady_clock::time_point now) {
+  auto& state = m_states[get_key(msg.m)];
+  if (state.held_back.has_value()) {
+    // replaced by this one (either forwarded or held back)
+    m_stats.n_coalesced++;
+    m_stats.n_bytes_saved += state.held_back->get_packed_size();
+    state.held_back = std::nullopt;
+  }
+  if (now >= state.next_allowed) {
+    // Advance by exactly one interval, such that a stream that is not a
+    // multiple of the max rate doesn't lose rate - unless there was a gap.
+    state.next_allowed = (now - state.next_allowed > interval)
+                             ? now + interval
+                             : state.next_allowed + interval;
+    return true;
+  }
+  state.held_back = msg;
+  return false;
+}
+
+MavlinkMessageSpan MavlinkRateCoalescer::process(
+    MavlinkMessageSpan messages, std::chrono::steady_clock::time_point now) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_intervals.empty()) {
+    m_stats.n_forwarded += messages.size();
+    return messages;
+  }
+  m_out.clear();
+  bool any_held_back = false;
+  for (size_t i = 0; i < messages.size(); i++) {
+    const auto& msg = messages[i];
+    auto it = m_intervals.find(msg.m.msgid);
+    const bool forward =
+        it == m_intervals.end() || on_rate_limited_message(msg, it->second, now);
+    if (forward && any_held_back) {
+      m_out.push_back(msg);
+    } else if (!forward && !any_held_back) {
+      // First message we hold back - from now on, we need a copy
+      any_held_back = true;
+      m_out.assign(messages.begin(), messages.begin() + i);
+    }
+  }
+  if (!any_held_back) {
+    m_stats.n_forwarded += messages.size();
+    return messages;
+  }
+  m_stats.n_forwarded += m_out.size();
+  return m_out;
+}
+
+std::vector<MavlinkMessage> MavlinkRateCoalescer::flush(
+    std::chrono::steady_clock::time_point now) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  std::vector<MavlinkMessage> ret;
+  for (auto& [key, state] : m_states) {
+    if (!state.held_back.has_value() || now < state.next_allowed) continue;
+    const auto interval = m_intervals[state.held_back->m.msgid];
+    state.next_allowed = now + interval;
+    ret.push_back(state.held_back.value());
+    state.held_back = std::nullopt;
+  }
+  m_stats.n_forwarded += ret.size();
+  return ret;
+}
+
+MavlinkRateCoalescer::Stats MavlinkRateCoalescer::get_stats() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_stats;
+}
+
+std::string MavlinkRateCoalescer::stats_as_string(const Stats& stats) {
+  std::stringstream ss;
+  ss << "forwarded:" << stats.n_forwarded << " coalesced:" << stats.n_coalesced
+     << " bytes_saved:" << stats.n_bytes_saved;
+  return ss.str();
+}
+
+std::optional<std::map<uint32_t, int>> MavlinkRateCoalescer::parse_max_rates(
+    const std::string& value) {
+  std::map<uint32_t, int> ret;
+  std::stringstream ss(value);
+  std::string entry;
+  while (std::getline(ss, entry, ',')) {
+    if (entry.empty()) continue;
+    const auto sep = entry.find(':');
+    if (sep == std::string::npos) return std::nullopt;
+    try {
+      size_t n_parsed = 0;
+      const auto msg_id = std::stoul(entry.substr(0, sep), &n_parsed);
+      if (n_parsed != sep) return std::nullopt;
+      const auto rate_str = entry.substr(sep + 1);
+      const auto rate_hz = std::stoi(rate_str, &n_parsed);
+      if (n_parsed != rate_str.size() || rate_hz < 0) return std::nullopt;
+      ret[static_cast<uint32_t>(msg_id)] = rate_hz;
+    } catch (const std::exception&) {
+      return std::nullopt;
+    }
+  }
+  return ret;
+}
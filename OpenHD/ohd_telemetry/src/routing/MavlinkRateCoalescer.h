@@ -0,0 +1,79 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#ifndef OPENHD_OPENHD_OHD_TELEMETRY_SRC_ROUTING_MAVLINKRATECOALESCER_H_
+#define OPENHD_OPENHD_OHD_TELEMETRY_SRC_ROUTING_MAVLINKRATECOALESCER_H_
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../mav_include.h"
+
+/**
+ * Downsamples high-rate messages (e.g. ATTITUDE at 50Hz from the FC) to a
+ * max rate per message id, separately for each sender (sys id, comp id).
+ * Latest value wins - a message that arrives too early is held back and
+ * replaced by the next one, such that the value that goes out is always the
+ * most recent one. Messages without a max rate are passed through as they
+ * are, in order.
+ */
+class MavlinkRateCoalescer {
+ public:
+  // msg id -> max rate in Hz. Thread-safe.
+  void set_max_rates(std::map<uint32_t, int> max_rates_hz);
+  /**
+   * @return the messages to forward now. Either @param messages itself (if no
+   * message needs to be held back) or a span into internal storage that is
+   * valid until the next call. Only one thread may call this at a time.
+   */
+  MavlinkMessageSpan process(MavlinkMessageSpan messages,
+                             std::chrono::steady_clock::time_point now =
+                                 std::chrono::steady_clock::now());
+  /**
+   * Held back messages whose interval has elapsed and that have not been
+   * replaced by a newer one yet (e.g. the FC stopped sending them). Call in
+   * regular intervals.
+   */
+  std::vector<MavlinkMessage> flush(std::chrono::steady_clock::time_point now =
+                                        std::chrono::steady_clock::now());
+  struct Stats {
+    int64_t n_forwarded = 0;
+    // Messages that were replaced by a newer one before being sent
+    int64_t n_coalesced = 0;
+    int64_t n_bytes_saved = 0;
+  };
+  Stats get_stats();
+  static std::string stats_as_string(const Stats& stats);
+  // Format: "msg_id:max_rate_hz,msg_id:max_rate_hz", e.g. "30:10,33:5".
+  // Empty string is valid (no entries), std::nullopt if malformed.
+  static std::optional<std::map<uint32_t, int>> parse_max_rates(
+      const std::string& value);
+
+ private:
+  struct State {
+    std::chrono::steady_clock::time_point next_allowed;
+    std::optional<MavlinkMessage> held_back;
+  };
+  // returns true if msg should be forwarded now, needs m_mutex
+  bool on_rate_limited_message(const MavlinkMessage& msg,
+                               std::chrono::nanoseconds interval,
+                               std::chrono::steady_clock::time_point now);
+  static uint64_t get_key(const mavlink_message_t& msg) {
+    return ((uint64_t)msg.msgid << 16) | ((uint64_t)msg.sysid << 8) |
+           msg.compid;
+  }
+  std::mutex m_mutex;
+  // msg id -> min interval between 2 messages
+  std::unordered_map<uint32_t, std::chrono::nanoseconds> m_intervals;
+  std::unordered_map<uint64_t, State> m_states;
+  std::vector<MavlinkMessage> m_out;
+  Stats m_stats;
+};
+
+#endif  // OPENHD_OPENHD_OHD_TELEMETRY_SRC_ROUTING_MAVLINKRATECOALESCER_H_
@@ -0,0 +1,132 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#include "MavlinkRoutingTable.h"
+
+#include <sstream>
+#include <utility>
+
+#include "../mav_helper.h"
+
+MavlinkRoutingTable::MavlinkRoutingTable(
+    std::array<std::string, MAX_N_LINKS> link_names)
+    : m_link_names(std::move(link_names)) {}
+
+void MavlinkRoutingTable::learn(const LinkId link, MavlinkMessageSpan messages,
+                                const std::chrono::steady_clock::time_point now) {
+  if (link < 0 || link >= MAX_N_LINKS) return;
+  std::lock_guard<std::mutex> guard(m_mutex);
+  for (const auto& msg : messages) {
+    const auto sys_id = msg.m.sysid;
+    const auto comp_id = msg.m.compid;
+    m_components[make_key(sys_id, comp_id)].last_seen[link] = now;
+    m_systems[sys_id].last_seen[link] = now;
+  }
+}
+
+MavlinkRoutingTable::LinkMask MavlinkRoutingTable::get_links(
+    const std::unordered_map<uint16_t, Route>& routes, const uint16_t key,
+    const std::chrono::steady_clock::time_point now) const {
+  const auto it = routes.find(key);
+  if (it == routes.end()) return 0;
+  LinkMask ret = 0;
+  for (int i = 0; i < MAX_N_LINKS; i++) {
+    const auto& last_seen = it->second.last_seen[i];
+    if (last_seen != std::chrono::steady_clock::time_point{} &&
+        now - last_seen < ROUTE_TIMEOUT) {
+      ret |= (1u << i);
+    }
+  }
+  return ret;
+}
+
+bool MavlinkRoutingTable::should_forward_locked(
+    const MavlinkMessage& msg, const LinkId src, const LinkId dst,
+    const std::chrono::steady_clock::time_point now) {
+  // Never back to where it came from
+  if (src == dst) return false;
+  const auto target = get_target_from_message_if_available(msg.m);
+  if (!target.has_target()) return true;
+  LinkMask links = 0;
+  if (target.comp_id != 0) {
+    links = get_links(m_components,
+                      make_key(target.sys_id, target.comp_id), now);
+  }
+  if (links == 0) {
+    links = get_links(m_systems, target.sys_id, now);
+  }
+  // Unknown target, broadcast (see class comment)
+  if (links == 0) return true;
+  return (links & (1u << dst)) != 0;
+}
+
+bool MavlinkRoutingTable::should_forward(
+    const MavlinkMessage& msg, const LinkId src, const LinkId dst,
+    const std::chrono::steady_clock::time_point now) {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  return should_forward_locked(msg, src, dst, now);
+}
+
+MavlinkMessageSpan MavlinkRoutingTable::filter(
+    MavlinkMessageSpan messages, const LinkId src, const LinkId dst,
+    std::vector<MavlinkMessage>& storage,
+    const std::chrono::steady_clock::time_point now) {
+  if (dst < 0 || dst >= MAX_N_LINKS) return {};
+  std::lock_guard<std::mutex> guard(m_mutex);
+  auto& stats = m_stats.links[dst];
+  // Common case: everything is forwarded, no copy
+  size_t n_forward = 0;
+  while (n_forward < messages.size() &&
+         should_forward_locked(messages[n_forward], src, dst, now)) {
+    n_forward++;
+  }
+  if (n_forward == messages.size()) {
+    stats.n_forwarded += n_forward;
+    return messages;
+  }
+  storage.clear();
+  storage.insert(storage.end(), messages.begin(), messages.begin() + n_forward);
+  stats.n_filtered++;
+  for (size_t i = n_forward + 1; i < messages.size(); i++) {
+    if (should_forward_locked(messages[i], src, dst, now)) {
+      storage.push_back(messages[i]);
+    } else {
+      stats.n_filtered++;
+    }
+  }
+  stats.n_forwarded += storage.size();
+  return storage;
+}
+
+MavlinkRoutingTable::Stats MavlinkRoutingTable::get_stats() const {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  auto ret = m_stats;
+  ret.n_routes = (int)m_components.size();
+  return ret;
+}
+
+std::string MavlinkRoutingTable::to_string() const {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  const auto now = std::chrono::steady_clock::now();
+  std::stringstream ss;
+  ss << "Routes:{";
+  for (const auto& [key, route] : m_components) {
+    const auto links = get_links(m_components, key, now);
+    if (links == 0) continue;
+    ss << (key >> 8) << ":" << (key & 0xFF) << "->";
+    for (int i = 0; i < MAX_N_LINKS; i++) {
+      if (links & (1u << i)) ss << m_link_names[i] << ",";
+    }
+    ss << " ";
+  }
+  ss << "} Forwarded/filtered:{";
+  for (int i = 0; i < MAX_N_LINKS; i++) {
+    const auto& link = m_stats.links[i];
+    if (link.n_forwarded == 0 && link.n_filtered == 0) continue;
+    ss << m_link_names[i] << ":" << link.n_forwarded << "/" << link.n_filtered
+       << " ";
+  }
+  ss << "}";
+  return ss.str();
+}
@@ -0,0 +1,94 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#ifndef OPENHD_OPENHD_OHD_TELEMETRY_SRC_ROUTING_MAVLINKROUTINGTABLE_H_
+#define OPENHD_OPENHD_OHD_TELEMETRY_SRC_ROUTING_MAVLINKROUTINGTABLE_H_
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../mav_include.h"
+
+/**
+ * Learns which (sys id, comp id) live behind which link (endpoint), from the
+ * source of the messages received on each link, and decides which links a
+ * message needs to be forwarded to - following the mavlink routing rules:
+ * - Messages without a target (or target sys id 0) are broadcast (every link
+ * but the one they came from).
+ * - Messages with a target are only forwarded to the link(s) the target has
+ * been seen on. If the target component is unknown, to all links the target
+ * system has been seen on.
+ * Deviating from the rules, a message to a target that has never been seen
+ * (e.g. before the first heartbeat of a system) is broadcast instead of
+ * dropped - OpenHD is a transparent link, we do not want to loose the first
+ * messages after a (re-)connect.
+ * Routes expire after ROUTE_TIMEOUT (e.g. a GCS that disconnected).
+ * Links are identified by ids given by the owner (e.g. the air / ground unit).
+ * Thread-safe.
+ */
+class MavlinkRoutingTable {
+ public:
+  using LinkId = int;
+  static constexpr int MAX_N_LINKS = 8;
+  static constexpr auto ROUTE_TIMEOUT = std::chrono::seconds(30);
+  explicit MavlinkRoutingTable(std::array<std::string, MAX_N_LINKS> link_names);
+  // Learn the source(s) of messages received on the given link
+  void learn(LinkId link, MavlinkMessageSpan messages,
+             std::chrono::steady_clock::time_point now =
+                 std::chrono::steady_clock::now());
+  // If a message received on link src needs to be forwarded to link dst
+  bool should_forward(const MavlinkMessage& msg, LinkId src, LinkId dst,
+                      std::chrono::steady_clock::time_point now =
+                          std::chrono::steady_clock::now());
+  /**
+   * @return the messages (received on link src) that need to be forwarded to
+   * link dst. Either @param messages itself (if all need to be forwarded) or a
+   * span into @param storage.
+   */
+  MavlinkMessageSpan filter(MavlinkMessageSpan messages, LinkId src,
+                            LinkId dst, std::vector<MavlinkMessage>& storage,
+                            std::chrono::steady_clock::time_point now =
+                                std::chrono::steady_clock::now());
+  struct LinkStats {
+    uint64_t n_forwarded = 0;
+    // targeted to a sys / comp not behind this link
+    uint64_t n_filtered = 0;
+  };
+  struct Stats {
+    std::array<LinkStats, MAX_N_LINKS> links;
+    int n_routes = 0;
+  };
+  [[nodiscard]] Stats get_stats() const;
+  // Stats and all currently known routes
+  [[nodiscard]] std::string to_string() const;
+
+ private:
+  static uint16_t make_key(uint8_t sys_id, uint8_t comp_id) {
+    return (uint16_t)((sys_id << 8) | comp_id);
+  }
+  // bit i set == seen on link i
+  using LinkMask = uint32_t;
+  struct Route {
+    std::array<std::chrono::steady_clock::time_point, MAX_N_LINKS> last_seen{};
+  };
+  LinkMask get_links(const std::unordered_map<uint16_t, Route>& routes,
+                     uint16_t key,
+                     std::chrono::steady_clock::time_point now) const;
+  bool should_forward_locked(const MavlinkMessage& msg, LinkId src, LinkId dst,
+                             std::chrono::steady_clock::time_point now);
+  const std::array<std::string, MAX_N_LINKS> m_link_names;
+  mutable std::mutex m_mutex;
+  // (sys id, comp id) -> route
+  std::unordered_map<uint16_t, Route> m_components;
+  // (sys id, 0) -> route of any component of this system
+  std::unordered_map<uint16_t, Route> m_systems;
+  Stats m_stats{};
+};
+
+#endif  // OPENHD_OPENHD_OHD_TELEMETRY_SRC_ROUTING_MAVLINKROUTINGTABLE_H_
@@ -0,0 +1,51 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#include <iostream>
+
+#include "AirTelemetrySettings.h"
+#include "openhd_test_util.h"
+
+using openhd::test::check;
+
+// Written by a release before the fc_rate_*, tele_aggregation_window_ms,
+// ftp_max_kbytes_per_second and stats_* settings were added
+static constexpr auto OLD_FORMAT = R"({
+    "fc_battery_n_cells": 4,
+    "fc_uart_baudrate": 921600,
+    "fc_uart_connection_type": "/dev/ttyACM0",
+    "fc_uart_flow_control": true
+})";
+
+int main(int argc, char *argv[]) {
+  namespace air = openhd::telemetry::air;
+  const auto settings = air::settings_from_json(OLD_FORMAT);
+  check(settings.has_value(), "old settings file rejected");
+  // What the user configured is kept ...
+  check(settings->fc_uart_connection_type == "/dev/ttyACM0",
+        "fc_uart_connection_type");
+  check(settings->fc_uart_baudrate == 921600, "fc_uart_baudrate");
+  check(settings->fc_uart_flow_control, "fc_uart_flow_control");
+  check(settings->fc_battery_n_cells == 4, "fc_battery_n_cells");
+  // ... and what the file doesn't know about yet uses the default
+  const air::Settings defaults{};
+  check(settings->fc_rate_attitude == defaults.fc_rate_attitude,
+        "fc_rate_attitude");
+  check(settings->fc_rate_custom.empty(), "fc_rate_custom");
+  check(settings->fc_rate_negotiate == defaults.fc_rate_negotiate,
+        "fc_rate_negotiate");
+  check(settings->tele_aggregation_window_ms ==
+            defaults.tele_aggregation_window_ms,
+        "tele_aggregation_window_ms");
+  check(settings->ftp_max_kbytes_per_second ==
+            defaults.ftp_max_kbytes_per_second,
+        "ftp_max_kbytes_per_second");
+  check(settings->stats_keep_alive_ms == defaults.stats_keep_alive_ms,
+        "stats_keep_alive_ms");
+  check(settings->stats_thresholds.empty(), "stats_thresholds");
+  // Garbage is still rejected (-> create_default())
+  check(!air::settings_from_json("[1,2").has_value(), "invalid json accepted");
+  std::cout << "test_air_telemetry_settings passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,188 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#include <chrono>
+#include <iostream>
+
+#include "../src/mav_helper.h"
+#include "../src/mavsdk_temporary/XMavlinkParamProvider.h"
+#include "../src/routing/MavlinkComponentDispatcher.h"
+#include "openhd_action_handler.h"
+#include "openhd_spdlog.h"
+
+// Validates MavlinkComponentDispatcher (only matching messages reach a
+// component, param protocol still works, param changes made by openhd are
+// sent out) and compares it against passing each message to each component
+// at a realistic FC telemetry rate.
+
+static constexpr uint8_t SYS_ID = 100;
+
+class CountingComponent : public MavlinkComponent {
+ public:
+  CountingComponent(uint8_t comp_id, MessageFilter filter)
+      : MavlinkComponent(SYS_ID, comp_id), m_filter(std::move(filter)) {}
+  std::vector<MavlinkMessage> process_mavlink_messages(
+      MavlinkMessageSpan messages) override {
+    for (const auto& msg : messages) {
+      if (!m_filter.msg_ids.empty() &&
+          std::find(m_filter.msg_ids.begin(), m_filter.msg_ids.end(),
+                    msg.m.msgid) == m_filter.msg_ids.end()) {
+        throw std::runtime_error("Got a message we didn't ask for");
+      }
+      n_messages++;
+    }
+    return {};
+  }
+  std::vector<MavlinkMessage> generate_mavlink_messages() override {
+    return {};
+  }
+  MessageFilter get_message_filter() const override { return m_filter; }
+  int n_messages = 0;
+
+ private:
+  const MessageFilter m_filter;
+};
+
+static std::shared_ptr<XMavlinkParamProvider> create_param_provider(
+    uint8_t comp_id, int n_params) {
+  auto ret = std::make_shared<XMavlinkParamProvider>(SYS_ID, comp_id);
+  std::vector<openhd::Setting> settings;
+  for (int i = 0; i < n_params; i++) {
+    openhd::append_int_param(settings, fmt::format("P_{}_{}", comp_id, i), i,
+                             [](int) { return true; });
+  }
+  ret->add_params(settings);
+  ret->set_ready();
+  return ret;
+}
+
+static MavlinkMessage param_request_list(uint8_t target_comp_id) {
+  MavlinkMessage msg;
+  mavlink_msg_param_request_list_pack(255, 190, &msg.m, SYS_ID,
+                                      target_comp_id);
+  return msg;
+}
+
+static int count_param_values(const std::vector<MavlinkMessage>& messages,
+                              uint8_t comp_id) {
+  int ret = 0;
+  for (const auto& msg : messages) {
+    if (msg.m.msgid == MAVLINK_MSG_ID_PARAM_VALUE && msg.m.compid == comp_id) {
+      ret++;
+    }
+  }
+  return ret;
+}
+
+// What an ArduPilot FC sends with the default stream rates (per second),
+// roughly
+static std::vector<MavlinkMessage> create_fc_second() {
+  std::vector<MavlinkMessage> ret;
+  for (int i = 0; i < 50; i++) ret.push_back(MExampleMessage::attitude(1, 1));
+  for (int i = 0; i < 20; i++) ret.push_back(MExampleMessage::position(1, 1));
+  for (int i = 0; i < 10; i++) {
+    MavlinkMessage msg;
+    mavlink_msg_global_position_int_pack(1, 1, &msg.m, 0, 0, 0, 0, 0, 0, 0, 0,
+                                         0);
+    ret.push_back(msg);
+    mavlink_msg_rc_channels_raw_pack(1, 1, &msg.m, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                                     0, 0);
+    ret.push_back(msg);
+  }
+  ret.push_back(MExampleMessage::heartbeat(1, 1));
+  return ret;
+}
+
+static void test_correctness() {
+  MavlinkComponentDispatcher dispatcher;
+  auto heartbeats_only = std::make_shared<CountingComponent>(
+      1, MavlinkComponent::MessageFilter{{MAVLINK_MSG_ID_HEARTBEAT}, false});
+  auto all = std::make_shared<CountingComponent>(
+      2, MavlinkComponent::MessageFilter{});
+  auto generic_params = create_param_provider(MAV_COMP_ID_ONBOARD_COMPUTER, 10);
+  auto camera_params = create_param_provider(MAV_COMP_ID_CAMERA, 5);
+  dispatcher.add_component(heartbeats_only);
+  dispatcher.add_component(all);
+  dispatcher.add_component(generic_params);
+  dispatcher.add_component(camera_params);
+  const auto fc_messages = create_fc_second();
+  if (!dispatcher.dispatch(fc_messages).empty()) {
+    throw std::runtime_error("Unexpected response to FC telemetry");
+  }
+  if (heartbeats_only->n_messages != 1 ||
+      all->n_messages != (int)fc_messages.size()) {
+    throw std::runtime_error("Wrong n of dispatched messages");
+  }
+  // Targeted at the camera only
+  const auto camera_request = param_request_list(MAV_COMP_ID_CAMERA);
+  auto responses = dispatcher.dispatch({&camera_request, 1});
+  if (count_param_values(responses, MAV_COMP_ID_CAMERA) != 5 ||
+      count_param_values(responses, MAV_COMP_ID_ONBOARD_COMPUTER) != 0) {
+    throw std::runtime_error("Param request list (camera) failed");
+  }
+  // Broadcast (all components of this system)
+  const auto broadcast_request = param_request_list(0);
+  responses = dispatcher.dispatch({&broadcast_request, 1});
+  if (count_param_values(responses, MAV_COMP_ID_CAMERA) != 5 ||
+      count_param_values(responses, MAV_COMP_ID_ONBOARD_COMPUTER) != 10) {
+    throw std::runtime_error("Param request list (broadcast) failed");
+  }
+  // Param changed by openhd itself - sent out without any request
+  openhd::ParamChangedHelper::instance().notify_int_param_changed(
+      fmt::format("P_{}_3", MAV_COMP_ID_CAMERA), 42);
+  responses = camera_params->generate_mavlink_messages();
+  if (count_param_values(responses, MAV_COMP_ID_CAMERA) != 1 ||
+      !generic_params->generate_mavlink_messages().empty()) {
+    throw std::runtime_error("Param change notification failed");
+  }
+}
+
+static void benchmark() {
+  const int n_seconds = 600;
+  const int batch_size = 10;  // ~ what one UART read returns
+  const auto fc_second = create_fc_second();
+  std::vector<std::shared_ptr<MavlinkComponent>> components;
+  components.push_back(create_param_provider(MAV_COMP_ID_ONBOARD_COMPUTER, 80));
+  for (int i = 0; i < 4; i++) {
+    components.push_back(create_param_provider(MAV_COMP_ID_CAMERA + i, 40));
+  }
+  components.push_back(std::make_shared<CountingComponent>(
+      1, MavlinkComponent::MessageFilter{
+             {MAVLINK_MSG_ID_TIMESYNC, MAVLINK_MSG_ID_COMMAND_LONG,
+              MAVLINK_MSG_ID_GLOBAL_POSITION_INT},
+             false}));
+  MavlinkComponentDispatcher dispatcher;
+  for (auto& component : components) dispatcher.add_component(component);
+  auto run = [&](auto process_batch) {
+    const auto begin = std::chrono::steady_clock::now();
+    for (int s = 0; s < n_seconds; s++) {
+      for (size_t i = 0; i < fc_second.size(); i += batch_size) {
+        const size_t len = std::min((size_t)batch_size, fc_second.size() - i);
+        process_batch(MavlinkMessageSpan(fc_second.data() + i, len));
+      }
+    }
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - begin);
+  };
+  const auto elapsed_all = run([&](MavlinkMessageSpan batch) {
+    for (auto& component : components) {
+      component->process_mavlink_messages(batch);
+    }
+  });
+  const auto elapsed_dispatch =
+      run([&](MavlinkMessageSpan batch) { dispatcher.dispatch(batch); });
+  const double n_messages = (double)n_seconds * fc_second.size();
+  std::cout << fmt::format(
+      "{} components, {} msg/s FC telemetry: each component {:.0f}ns/msg, "
+      "dispatcher {:.0f}ns/msg\n",
+      components.size(), fc_second.size(), elapsed_all.count() / n_messages,
+      elapsed_dispatch.count() / n_messages);
+}
+
+int main(int argc, char* argv[]) {
+  test_correctness();
+  benchmark();
+  std::cout << "test_component_dispatch passed\n";
+  return 0;
+}
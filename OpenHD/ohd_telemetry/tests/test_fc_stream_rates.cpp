@@ -0,0 +1,256 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#include <iostream>
+#include <map>
+#include <stdexcept>
+
+#include "../src/routing/FCStreamRateNegotiator.h"
+#include "openhd_test_util.h"
+
+// Validates FCStreamRateNegotiator against a simulated FC: negotiation
+// (including lost commands), scaling down on tx drops / reduced link rate and
+// restoring, the REQUEST_DATA_STREAM fallback and re-negotiation after an FC
+// reboot. Runs on simulated time.
+
+using openhd::test::check;
+using Clock = std::chrono::steady_clock;
+using Negotiator = FCStreamRateNegotiator;
+
+static const std::map<uint32_t, int> PROFILE{
+    {MAVLINK_MSG_ID_ATTITUDE, 20},
+    {MAVLINK_MSG_ID_GLOBAL_POSITION_INT, 10},
+    {MAVLINK_MSG_ID_VFR_HUD, 8},
+    {MAVLINK_MSG_ID_RC_CHANNELS, 0}};
+
+// Like the FC connected to the air unit UART: Acks (or refuses)
+// SET_MESSAGE_INTERVAL, applies REQUEST_DATA_STREAM, forgets everything on a
+// reboot.
+class SimulatedFC {
+ public:
+  explicit SimulatedFC(bool supports_message_interval)
+      : m_supports_message_interval(supports_message_interval) {}
+  MavlinkMessage heartbeat() const {
+    MavlinkMessage msg{};
+    mavlink_msg_heartbeat_pack(OHD_SYS_ID_FC, 1, &msg.m, MAV_TYPE_QUADROTOR,
+                               MAV_AUTOPILOT_ARDUPILOTMEGA, 0, 0, 0);
+    return msg;
+  }
+  // A gimbal on the same UART, must not be mistaken for the FC
+  static MavlinkMessage gimbal_heartbeat() {
+    MavlinkMessage msg{};
+    mavlink_msg_heartbeat_pack(OHD_SYS_ID_FC, 154, &msg.m, MAV_TYPE_GIMBAL,
+                               MAV_AUTOPILOT_INVALID, 0, 0, 0);
+    return msg;
+  }
+  std::vector<MavlinkMessage> process(MavlinkMessageSpan messages) {
+    std::vector<MavlinkMessage> ret;
+    for (const auto& msg : messages) {
+      n_messages++;
+      if (msg.m.msgid == MAVLINK_MSG_ID_COMMAND_LONG) {
+        mavlink_command_long_t command;
+        mavlink_msg_command_long_decode(&msg.m, &command);
+        check(command.target_system == OHD_SYS_ID_FC &&
+                  command.target_component == 1 &&
+                  command.command == MAV_CMD_SET_MESSAGE_INTERVAL,
+              "Command");
+        if (n_ignore > 0) {
+          // Lost on the UART
+          n_ignore--;
+          continue;
+        }
+        if (n_foreign_acks > 0) {
+          // Our ack is lost, instead the FC refuses the same command of a GCS
+          n_foreign_acks--;
+          MavlinkMessage ack{};
+          mavlink_msg_command_ack_pack(OHD_SYS_ID_FC, 1, &ack.m,
+                                       command.command, MAV_RESULT_UNSUPPORTED,
+                                       0, 0, 255, 190);
+          ret.push_back(ack);
+          continue;
+        }
+        uint8_t result = MAV_RESULT_UNSUPPORTED;
+        if (m_supports_message_interval) {
+          result = MAV_RESULT_ACCEPTED;
+          intervals_hz[(uint32_t)command.param1] =
+              (int)std::lround(1000.0 * 1000.0 / command.param2);
+        }
+        MavlinkMessage ack{};
+        mavlink_msg_command_ack_pack(OHD_SYS_ID_FC, 1, &ack.m,
+                                     command.command, result, 0, 0,
+                                     msg.m.sysid, msg.m.compid);
+        ret.push_back(ack);
+      } else if (msg.m.msgid == MAVLINK_MSG_ID_REQUEST_DATA_STREAM) {
+        mavlink_request_data_stream_t request;
+        mavlink_msg_request_data_stream_decode(&msg.m, &request);
+        stream_rates[request.req_stream_id] = request.req_message_rate;
+      }
+    }
+    return ret;
+  }
+  void reboot() {
+    intervals_hz.clear();
+    stream_rates.clear();
+  }
+  std::map<uint32_t, int> intervals_hz;
+  std::map<int, int> stream_rates;
+  int n_ignore = 0;
+  int n_foreign_acks = 0;
+  int n_messages = 0;
+
+ private:
+  const bool m_supports_message_interval;
+};
+
+struct Simulation {
+  explicit Simulation(bool supports_message_interval)
+      : fc(supports_message_interval) {
+    negotiator.set_profile(PROFILE);
+    negotiator.set_enabled(true);
+  }
+  // Steps of 100ms, like the AirTelemetry timer. FC heartbeat at 1Hz.
+  void run(std::chrono::milliseconds duration, bool fc_alive = true) {
+    const auto end = now + duration;
+    while (now < end) {
+      if (fc_alive && (now - start) % std::chrono::seconds(1) ==
+                          std::chrono::seconds(0)) {
+        std::vector<MavlinkMessage> heartbeats{fc.heartbeat(),
+                                               SimulatedFC::gimbal_heartbeat()};
+        negotiator.on_fc_messages(heartbeats, now);
+      }
+      const auto messages = negotiator.update(condition, now);
+      const auto acks = fc.process(messages);
+      negotiator.on_fc_messages(acks, now);
+      now += std::chrono::milliseconds(100);
+    }
+  }
+  // FC streams with the scaled profile
+  void check_fc_rates(int percent, const std::string& what) {
+    check(negotiator.get_scale_percent() == percent, what + " scale");
+    std::map<uint32_t, int> expected;
+    for (const auto& [msg_id, rate_hz] : PROFILE) {
+      if (rate_hz > 0) expected[msg_id] = std::max(1, rate_hz * percent / 100);
+    }
+    check(fc.intervals_hz == expected, what + " FC rates");
+    check(negotiator.get_target_rates().at(MAVLINK_MSG_ID_ATTITUDE) ==
+              expected.at(MAVLINK_MSG_ID_ATTITUDE),
+          what + " target rates");
+  }
+  SimulatedFC fc;
+  Negotiator negotiator{OHD_SYS_ID_AIR, 191};
+  Negotiator::LinkCondition condition{0, 20000, 0};
+  const Clock::time_point start = Clock::now();
+  Clock::time_point now = start;
+};
+
+static void test_negotiation() {
+  Simulation sim(true);
+  // Two commands are lost, retried
+  sim.fc.n_ignore = 2;
+  sim.run(std::chrono::seconds(3));
+  sim.check_fc_rates(100, "Negotiation");
+  std::cout << sim.negotiator.to_string() << "\n";
+  // Nothing is sent once negotiated
+  const int n_messages = sim.fc.n_messages;
+  sim.run(std::chrono::seconds(5));
+  check(sim.fc.n_messages == n_messages, "Idle");
+  // Profile changes are applied
+  auto profile = PROFILE;
+  profile[MAVLINK_MSG_ID_ATTITUDE] = 30;
+  sim.negotiator.set_profile(profile);
+  sim.run(std::chrono::seconds(1));
+  check(sim.fc.intervals_hz[MAVLINK_MSG_ID_ATTITUDE] == 30 &&
+            sim.fc.n_messages == n_messages + 1,
+        "Profile change");
+}
+
+// Acks for another GCS / component must not be taken as ours
+static void test_foreign_ack() {
+  Simulation sim(true);
+  sim.fc.n_foreign_acks = 2;
+  sim.run(std::chrono::seconds(3));
+  sim.check_fc_rates(100, "Foreign ack");
+  check(sim.fc.stream_rates.empty(), "No data stream fallback");
+}
+
+static void test_scaling() {
+  Simulation sim(true);
+  sim.run(std::chrono::seconds(2));
+  sim.check_fc_rates(100, "Initial");
+  // Telemetry tx drops for 10 seconds - step down (with cooldown) to the min
+  for (int i = 0; i < 10; i++) {
+    sim.condition.n_tx_dropped += 10;
+    sim.run(std::chrono::seconds(1));
+  }
+  sim.check_fc_rates(25, "Drops");
+  // No drops anymore - restored one step at a time
+  sim.run(std::chrono::seconds(12));
+  sim.check_fc_rates(50, "First restore");
+  sim.run(std::chrono::seconds(25));
+  sim.check_fc_rates(100, "Restored");
+  // Lower MCS (40% of the link rate) - reduced immediately
+  sim.condition.link_rate_kbits = 8000;
+  sim.run(std::chrono::seconds(2));
+  sim.check_fc_rates(50, "Link rate");
+  // Stays there as long as the link rate is low
+  sim.run(std::chrono::seconds(30));
+  sim.check_fc_rates(50, "Link rate hold");
+  sim.condition.link_rate_kbits = 20000;
+  sim.run(std::chrono::seconds(25));
+  sim.check_fc_rates(100, "Link rate restored");
+  // Tx cannot keep up at the current rate
+  sim.condition.n_rate_adjustments = 1;
+  sim.run(std::chrono::seconds(2));
+  sim.check_fc_rates(75, "Rate adjustments");
+  std::cout << sim.negotiator.to_string() << "\n";
+}
+
+static void test_data_stream_fallback() {
+  Simulation sim(false);
+  sim.run(std::chrono::seconds(3));
+  check(sim.fc.intervals_hz.empty(), "No intervals");
+  check(sim.fc.stream_rates[MAV_DATA_STREAM_EXTRA1] == 20 &&
+            sim.fc.stream_rates[MAV_DATA_STREAM_POSITION] == 10 &&
+            sim.fc.stream_rates[MAV_DATA_STREAM_EXTRA2] == 8 &&
+            sim.fc.stream_rates.count(MAV_DATA_STREAM_RC_CHANNELS) == 0,
+        "Data streams");
+  // Scaled the same way
+  sim.condition.link_rate_kbits = 5000;
+  sim.run(std::chrono::seconds(1));
+  check(sim.fc.stream_rates[MAV_DATA_STREAM_EXTRA1] == 5, "Scaled streams");
+  std::cout << sim.negotiator.to_string() << "\n";
+}
+
+static void test_fc_reboot() {
+  Simulation sim(true);
+  sim.run(std::chrono::seconds(2));
+  sim.check_fc_rates(100, "Before reboot");
+  sim.fc.reboot();
+  sim.run(std::chrono::seconds(7), false);
+  check(sim.fc.intervals_hz.empty(), "Rebooting");
+  sim.run(std::chrono::seconds(2));
+  sim.check_fc_rates(100, "After reboot");
+}
+
+static void test_disabled() {
+  Simulation sim(true);
+  sim.negotiator.set_enabled(false);
+  sim.condition.n_tx_dropped = 100;
+  sim.run(std::chrono::seconds(5));
+  check(sim.fc.n_messages == 0, "Disabled");
+  sim.negotiator.set_enabled(true);
+  sim.run(std::chrono::seconds(2));
+  check(sim.fc.intervals_hz.size() == 3, "Enabled");
+}
+
+int main(int argc, char* argv[]) {
+  test_negotiation();
+  test_foreign_ack();
+  test_scaling();
+  test_data_stream_fallback();
+  test_fc_reboot();
+  test_disabled();
+  std::cout << "test_fc_stream_rates passed\n";
+  return 0;
+}
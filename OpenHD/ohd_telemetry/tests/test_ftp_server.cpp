@@ -0,0 +1,347 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#include <unistd.h>
+
+#include <condition_variable>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <set>
+
+#include "../src/endpoints/WBEndpoint.h"
+#include "../src/ftp/MavlinkFTPServer.h"
+#include "openhd_event_loop.h"
+#include "openhd_link.hpp"
+#include "openhd_test_util.h"
+#include "openhd_util.h"
+
+// Validates MavlinkFTPServer: listing and the path checks (nothing outside of
+// the roots, nothing written), then pulls a multi-MB file from the air unit to
+// the ground unit through two WBEndpoints connected by a lossy loopback link,
+// with a windowed / parallel burst client (like a GCS would use). Verifies the
+// CRC32 of the received data against the file and the one the server
+// calculates, and that the download stays within the tx budget.
+
+using openhd::test::check;
+using FTP = MavlinkFTPServer;
+static constexpr uint8_t AIR_SYS_ID = 101;
+static constexpr uint8_t AIR_COMP_ID = 191;
+static constexpr uint8_t GCS_SYS_ID = 255;
+static constexpr uint8_t GCS_COMP_ID = 190;
+static constexpr int FILE_SIZE = 2 * 1024 * 1024;
+static constexpr int TX_BUDGET_BYTES_PER_SECOND = 256 * 1024;
+static constexpr int LOSS_PERCENT = 5;
+
+// Drops LOSS_PERCENT of the telemetry packets, then hands them to the peer
+class LossyLoopbackLink : public OHDLink {
+ public:
+  explicit LossyLoopbackLink(uint32_t seed) : m_rng(seed) {}
+  void set_peer(LossyLoopbackLink* peer) { m_peer = peer; }
+  void transmit_telemetry_data(TelemetryTxPacket packet) override {
+    n_packets++;
+    if (std::uniform_int_distribution<int>(0, 99)(m_rng) < LOSS_PERCENT) {
+      n_dropped++;
+      return;
+    }
+    m_peer->on_receive_telemetry_data(packet.data);
+  }
+  void transmit_video_data(int, const openhd::FragmentedVideoFrame&) override {}
+  std::atomic<int> n_packets = 0;
+  std::atomic<int> n_dropped = 0;
+
+ private:
+  LossyLoopbackLink* m_peer = nullptr;
+  std::mt19937 m_rng;
+};
+
+// The ground side, like a GCS
+class FTPClient {
+ public:
+  explicit FTPClient(std::function<void(MavlinkMessageSpan)> send)
+      : m_send(std::move(send)) {}
+  void on_messages(MavlinkMessageSpan messages) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const auto& msg : messages) {
+      if (msg.m.msgid != MAVLINK_MSG_ID_FILE_TRANSFER_PROTOCOL) continue;
+      const auto payload = FTP::decode_payload(msg.m);
+      if (m_download.has_value()) on_download_packet_locked(payload);
+      if (payload.seq_number == static_cast<uint16_t>(m_seq_number + 1) &&
+          payload.req_opcode != FTP::BURST_READ_FILE) {
+        m_response = payload;
+        m_response_cv.notify_all();
+      }
+    }
+  }
+  // Sends the request until a response arrives
+  FTP::Payload request(uint8_t opcode, const std::string& path = "",
+                       uint8_t session = 0, uint32_t offset = 0) {
+    FTP::Payload req = create_request(opcode, session, offset);
+    req.size = path.size();
+    std::memcpy(req.data.data(), path.c_str(), path.size());
+    std::unique_lock<std::mutex> lock(m_mutex);
+    req.seq_number = ++m_seq_number;
+    m_response = std::nullopt;
+    for (int i = 0; i < 20; i++) {
+      send(req);
+      if (m_response_cv.wait_for(lock, std::chrono::milliseconds(500),
+                                 [this] { return m_response.has_value(); })) {
+        return m_response.value();
+      }
+    }
+    throw std::runtime_error("No response");
+  }
+  // Reads the whole file, with n_parallel sessions bursting at the same time
+  std::vector<uint8_t> download(const std::string& path, int n_parallel) {
+    std::vector<uint8_t> sessions;
+    uint32_t file_size = 0;
+    for (int i = 0; i < n_parallel; i++) {
+      const auto response = request(FTP::OPEN_FILE_RO, path);
+      check(response.opcode == FTP::ACK && response.size == 4, "Open");
+      std::memcpy(&file_size, response.data.data(), 4);
+      sessions.push_back(response.session);
+    }
+    std::unique_lock<std::mutex> lock(m_mutex);
+    Download download;
+    download.data.resize(file_size);
+    download.n_windows =
+        (file_size + FTP::BURST_MAX_N_BYTES - 1) / FTP::BURST_MAX_N_BYTES;
+    for (auto session : sessions) download.sessions[session] = {};
+    m_download = std::move(download);
+    while (true) {
+      auto& d = m_download.value();
+      const auto now = std::chrono::steady_clock::now();
+      bool all_done = d.next_window >= d.n_windows;
+      for (auto& [session, s] : d.sessions) {
+        if (s.missing.empty() && d.next_window < d.n_windows) {
+          // Next window
+          const uint32_t begin = d.next_window * FTP::BURST_MAX_N_BYTES;
+          const uint32_t end =
+              std::min(file_size, begin + FTP::BURST_MAX_N_BYTES);
+          d.next_window++;
+          for (uint32_t offset = begin; offset < end;
+               offset += FTP::MAX_DATA_LEN) {
+            s.missing.insert(offset);
+          }
+          s.request_done = true;
+        }
+        if (s.missing.empty()) continue;
+        all_done = false;
+        const auto since_rx = now - s.last_rx;
+        if (s.request_done || since_rx > std::chrono::milliseconds(300)) {
+          // Few gaps: one packet each, otherwise burst from the first gap
+          const uint32_t offset = *s.missing.begin();
+          const bool burst = s.missing.size() > 32;
+          auto req = create_request(
+              burst ? FTP::BURST_READ_FILE : FTP::READ_FILE, session, offset);
+          req.seq_number = ++m_seq_number;
+          send(req);
+          s.request_done = false;
+          s.last_rx = now;
+          (burst ? d.n_burst_requests : d.n_read_requests)++;
+        }
+      }
+      if (all_done) break;
+      m_response_cv.wait_for(lock, std::chrono::milliseconds(10));
+    }
+    auto ret = std::move(m_download->data);
+    std::cout << "Burst requests:" << m_download->n_burst_requests
+              << " read requests:" << m_download->n_read_requests << "\n";
+    m_download = std::nullopt;
+    lock.unlock();
+    for (auto session : sessions) {
+      check(request(FTP::TERMINATE_SESSION, "", session).opcode == FTP::ACK,
+            "Terminate");
+    }
+    return ret;
+  }
+
+ private:
+  struct SessionState {
+    // Offsets of the current window not yet received
+    std::set<uint32_t> missing;
+    bool request_done = false;
+    std::chrono::steady_clock::time_point last_rx;
+  };
+  struct Download {
+    std::vector<uint8_t> data;
+    uint32_t n_windows = 0;
+    uint32_t next_window = 0;
+    std::map<uint8_t, SessionState> sessions;
+    int n_burst_requests = 0;
+    int n_read_requests = 0;
+  };
+  void on_download_packet_locked(const FTP::Payload& payload) {
+    auto& d = m_download.value();
+    auto it = d.sessions.find(payload.session);
+    if (it == d.sessions.end()) return;
+    auto& s = it->second;
+    if (payload.req_opcode != FTP::BURST_READ_FILE &&
+        payload.req_opcode != FTP::READ_FILE) {
+      return;
+    }
+    s.last_rx = std::chrono::steady_clock::now();
+    if (payload.opcode == FTP::ACK && s.missing.erase(payload.offset) > 0) {
+      check(payload.offset + payload.size <= d.data.size(), "Size");
+      std::memcpy(d.data.data() + payload.offset, payload.data.data(),
+                  payload.size);
+    }
+    if (payload.req_opcode == FTP::READ_FILE || payload.burst_complete) {
+      s.request_done = true;
+      m_response_cv.notify_all();
+    }
+  }
+  static FTP::Payload create_request(uint8_t opcode, uint8_t session,
+                                     uint32_t offset) {
+    FTP::Payload req{};
+    req.opcode = opcode;
+    req.session = session;
+    req.offset = offset;
+    return req;
+  }
+  void send(const FTP::Payload& req) {
+    const auto msg = FTP::create_message(GCS_SYS_ID, GCS_COMP_ID, AIR_SYS_ID,
+                                         AIR_COMP_ID, req);
+    m_send({&msg, 1});
+  }
+  const std::function<void(MavlinkMessageSpan)> m_send;
+  std::mutex m_mutex;
+  std::condition_variable m_response_cv;
+  uint16_t m_seq_number = 0;
+  std::optional<FTP::Payload> m_response;
+  std::optional<Download> m_download;
+};
+
+static std::string get_string(const FTP::Payload& payload) {
+  // Entries are separated by \0
+  std::string ret(reinterpret_cast<const char*>(payload.data.data()),
+                  payload.size);
+  std::replace(ret.begin(), ret.end(), '\0', '|');
+  return ret;
+}
+
+static void test_paths(FTPClient& client) {
+  auto response = client.request(FTP::LIST_DIRECTORY, "/");
+  check(get_string(response) == "Drecordings|", "List roots");
+  response = client.request(FTP::LIST_DIRECTORY, "/recordings");
+  const auto listing = get_string(response);
+  std::cout << "Listing: " << listing << "\n";
+  check(listing == "Dlink|Fsmall.txt\t5|Dsub|Ftest.bin\t" +
+                       std::to_string(FILE_SIZE) + "|",
+        "List");
+  response = client.request(FTP::LIST_DIRECTORY, "/recordings", 0, 4);
+  check(response.opcode == FTP::NAK && response.data[0] == FTP::ERR_EOF,
+        "List EOF");
+  for (const auto& path :
+       {"/recordings/../recordings/small.txt", "/recordings/secret.key",
+        "/recordings/key_link.txt", "/recordings/link/passwd", "/etc/passwd",
+        "/recordings/none.txt"}) {
+    response = client.request(FTP::OPEN_FILE_RO, path);
+    check(response.opcode == FTP::NAK &&
+              response.data[0] == FTP::ERR_FILE_NOT_FOUND,
+          std::string("Not readable: ") + path);
+  }
+  response = client.request(FTP::CREATE_FILE, "/recordings/new.txt");
+  check(response.opcode == FTP::NAK &&
+            response.data[0] == FTP::ERR_FILE_PROTECTED,
+        "Read-only");
+  response = client.request(FTP::OPEN_FILE_RO, "recordings//small.txt");
+  check(response.opcode == FTP::ACK, "Open");
+  const auto session = response.session;
+  response = client.request(FTP::READ_FILE, "", session, 0);
+  check(response.opcode == FTP::ACK && get_string(response) == "hello",
+        "Read");
+  response = client.request(FTP::READ_FILE, "", session, 5);
+  check(response.opcode == FTP::NAK && response.data[0] == FTP::ERR_EOF,
+        "Read EOF");
+  check(client.request(FTP::TERMINATE_SESSION, "", session).opcode == FTP::ACK,
+        "Terminate");
+  response = client.request(FTP::READ_FILE, "", session, 0);
+  check(response.opcode == FTP::NAK &&
+            response.data[0] == FTP::ERR_INVALID_SESSION,
+        "Terminated");
+}
+
+int main(int argc, char* argv[]) {
+  char dir_template[] = "/tmp/test_ftp_XXXXXX";
+  const std::string dir = mkdtemp(dir_template);
+  std::vector<uint8_t> file(FILE_SIZE);
+  std::mt19937 rng(42);
+  for (auto& b : file) b = rng();
+  std::ofstream(dir + "/test.bin", std::ios::binary)
+      .write(reinterpret_cast<const char*>(file.data()), file.size());
+  std::ofstream(dir + "/small.txt") << "hello";
+  std::ofstream(dir + "/secret.key") << "secret";
+  std::filesystem::create_directory(dir + "/sub");
+  std::filesystem::create_directory_symlink("/etc", dir + "/link");
+  std::filesystem::create_symlink(dir + "/secret.key", dir + "/key_link.txt");
+  const uint32_t file_crc = OHDUtil::crc32(file.data(), file.size());
+
+  auto air_loop = std::make_shared<openhd::EventLoop>("air");
+  auto ground_loop = std::make_shared<openhd::EventLoop>("ground");
+  air_loop->start();
+  ground_loop->start();
+  auto air_link = std::make_shared<LossyLoopbackLink>(1);
+  auto ground_link = std::make_shared<LossyLoopbackLink>(2);
+  air_link->set_peer(ground_link.get());
+  ground_link->set_peer(air_link.get());
+  auto server = std::make_shared<FTP>(
+      AIR_SYS_ID, AIR_COMP_ID, std::vector<FTP::Root>{{"recordings", dir}});
+  server->set_tx_budget_bytes_per_second(TX_BUDGET_BYTES_PER_SECOND);
+  auto air = std::make_unique<WBEndpoint>(air_link, "air", air_loop);
+  auto ground =
+      std::make_unique<WBEndpoint>(ground_link, "ground", ground_loop);
+  air->registerCallback([&](MavlinkMessageSpan messages) {
+    const auto responses = server->process_mavlink_messages(messages);
+    air->sendMessages(responses);
+  });
+  // Like the AirTelemetry generate timer
+  const auto timer = air_loop->add_timer(std::chrono::milliseconds(100), [&] {
+    const auto messages = server->generate_mavlink_messages();
+    air->sendMessages(messages);
+  });
+  FTPClient client(
+      [&](MavlinkMessageSpan messages) { ground->sendMessages(messages); });
+  ground->registerCallback(
+      [&](MavlinkMessageSpan messages) { client.on_messages(messages); });
+
+  test_paths(client);
+
+  const auto begin = std::chrono::steady_clock::now();
+  const auto data = client.download("/recordings/test.bin", 4);
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - begin;
+  const auto crc_response =
+      client.request(FTP::CALC_FILE_CRC32, "/recordings/test.bin");
+  check(crc_response.opcode == FTP::ACK, "CRC");
+  uint32_t server_crc;
+  std::memcpy(&server_crc, crc_response.data.data(), 4);
+  const uint32_t received_crc = OHDUtil::crc32(data.data(), data.size());
+  const double throughput = FILE_SIZE / elapsed.count();
+  std::cout << "Downloaded " << FILE_SIZE / 1024 << "KiB in "
+            << elapsed.count() << "s (" << (int)(throughput / 1024)
+            << "KiB/s, budget " << TX_BUDGET_BYTES_PER_SECOND / 1024
+            << "KiB/s) loss air->ground " << air_link->n_dropped << "/"
+            << air_link->n_packets << " ground->air " << ground_link->n_dropped
+            << "/" << ground_link->n_packets << "\n";
+  std::cout << server->get_stats().to_string() << "\n";
+  std::cout << "CRC file:" << file_crc << " received:" << received_crc
+            << " server:" << server_crc << "\n";
+  check(data == file, "Content");
+  check(received_crc == file_crc && server_crc == file_crc, "CRC32");
+  // The budget counts the mavlink overhead too, file content is ~90% of it
+  check(throughput < TX_BUDGET_BYTES_PER_SECOND * 1.05, "Budget exceeded");
+  check(throughput > TX_BUDGET_BYTES_PER_SECOND * 0.5, "Too slow");
+
+  air_loop->remove_timer(timer);
+  ground = nullptr;
+  air = nullptr;
+  air_loop->stop();
+  ground_loop->stop();
+  std::filesystem::remove_all(dir);
+  std::cout << "test_ftp_server passed\n";
+  return 0;
+}
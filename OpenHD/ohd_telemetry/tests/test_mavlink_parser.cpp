@@ -0,0 +1,173 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <random>
+
+#include "../src/mav_helper.h"
+#include "../src/mav_include.h"
+#include "../src/mav_parser.h"
+#include "openhd_spdlog.h"
+
+// Validates MavlinkFrameParser against mavlink_parse_char() and compares the
+// throughput of both.
+// Usage: test_mavlink_parser [file.tlog]
+// A .tlog (8 byte timestamp + mavlink frame, repeated) is fed as it is - the
+// timestamps are garbage between frames for the parser(s). Without a file, a
+// synthetic stream with garbage in between the frames is used.
+
+static std::vector<uint8_t> create_synthetic_stream() {
+  std::vector<uint8_t> ret;
+  std::mt19937 gen(42);
+  // Garbage never contains a STX byte, otherwise mavlink_parse_char() might
+  // swallow a valid frame (it doesn't re-sync inside a bad frame)
+  std::uniform_int_distribution<int> garbage_byte(0, 0xFB);
+  for (int i = 0; i < 3000; i++) {
+    MavlinkMessage msg;
+    if (i % 3 == 0) msg = MExampleMessage::heartbeat(1 + i % 2, i % 5);
+    if (i % 3 == 1) msg = MExampleMessage::position(1 + i % 2, i % 5);
+    if (i % 3 == 2) msg = MExampleMessage::attitude(1 + i % 2, i % 5);
+    msg.m.seq = i % 256;
+    const auto packed = msg.pack();
+    ret.insert(ret.end(), packed.begin(), packed.end());
+    if (i % 10 == 0) {
+      for (int j = 0; j < 1 + i % 7; j++) ret.push_back(garbage_byte(gen));
+    }
+  }
+  return ret;
+}
+
+static std::vector<uint8_t> read_file(const std::string& filename) {
+  std::ifstream file(filename, std::ios::binary);
+  if (!file.good()) {
+    throw std::runtime_error("Cannot open " + filename);
+  }
+  return {std::istreambuf_iterator<char>(file),
+          std::istreambuf_iterator<char>()};
+}
+
+static std::vector<MavlinkMessage> parse_reference(
+    const std::vector<uint8_t>& data) {
+  std::vector<MavlinkMessage> ret;
+  mavlink_message_t msg;
+  mavlink_status_t status{};
+  for (const auto byte : data) {
+    if (mavlink_parse_char(MAVLINK_COMM_0, byte, &msg, &status)) {
+      ret.push_back(MavlinkMessage{msg});
+    }
+  }
+  return ret;
+}
+
+// Split data into chunks of random size (1..max_chunk_size)
+static std::vector<MavlinkMessage> parse_chunked(
+    const std::vector<uint8_t>& data, std::mt19937& gen, int max_chunk_size) {
+  std::vector<MavlinkMessage> ret;
+  MavlinkFrameParser parser;
+  std::uniform_int_distribution<int> chunk_size(1, max_chunk_size);
+  size_t offset = 0;
+  while (offset < data.size()) {
+    const int len =
+        std::min((int)(data.size() - offset), chunk_size(gen));
+    const auto messages = parser.parse(data.data() + offset, len);
+    ret.insert(ret.end(), messages.begin(), messages.end());
+    offset += len;
+  }
+  return ret;
+}
+
+static bool is_same(const mavlink_message_t& a, const mavlink_message_t& b) {
+  return a.msgid == b.msgid && a.sysid == b.sysid && a.compid == b.compid &&
+         a.seq == b.seq && a.len == b.len && a.magic == b.magic &&
+         a.checksum == b.checksum &&
+         std::memcmp(a.payload64, b.payload64, a.len) == 0;
+}
+
+// Every message the reference parser finds must be found by us, in order.
+// With garbage that (by chance) looks like a frame start, we might find more
+// (we re-sync on the next byte after a bad frame).
+static void validate(const std::vector<MavlinkMessage>& reference,
+                     const std::vector<MavlinkMessage>& parsed,
+                     bool exact_match) {
+  if (exact_match && reference.size() != parsed.size()) {
+    throw std::runtime_error(fmt::format("Expected {} messages, got {}",
+                                         reference.size(), parsed.size()));
+  }
+  size_t idx = 0;
+  for (const auto& msg : reference) {
+    while (idx < parsed.size() && !is_same(msg.m, parsed[idx].m)) {
+      if (exact_match) {
+        throw std::runtime_error("Message mismatch");
+      }
+      idx++;
+    }
+    if (idx == parsed.size()) {
+      throw std::runtime_error("Missing message");
+    }
+    idx++;
+  }
+}
+
+static void benchmark(const std::vector<uint8_t>& data, int chunk_size) {
+  const int n_runs = 20;
+  int64_t n_messages_reference = 0;
+  auto begin = std::chrono::steady_clock::now();
+  mavlink_message_t msg;
+  mavlink_status_t status{};
+  for (int run = 0; run < n_runs; run++) {
+    // Same as before: parse byte by byte, copy each message into a vector
+    std::vector<MavlinkMessage> messages;
+    for (size_t offset = 0; offset < data.size(); offset += chunk_size) {
+      const size_t end = std::min(data.size(), offset + chunk_size);
+      messages.clear();
+      for (size_t i = offset; i < end; i++) {
+        if (mavlink_parse_char(MAVLINK_COMM_1, data[i], &msg, &status)) {
+          messages.push_back(MavlinkMessage{msg});
+        }
+      }
+      n_messages_reference += messages.size();
+    }
+  }
+  const auto elapsed_reference = std::chrono::steady_clock::now() - begin;
+  int64_t n_messages = 0;
+  MavlinkFrameParser parser;
+  begin = std::chrono::steady_clock::now();
+  for (int run = 0; run < n_runs; run++) {
+    for (size_t offset = 0; offset < data.size(); offset += chunk_size) {
+      const int len = (int)std::min(data.size() - offset, (size_t)chunk_size);
+      n_messages += parser.parse(data.data() + offset, len).size();
+    }
+  }
+  const auto elapsed = std::chrono::steady_clock::now() - begin;
+  auto msgs_per_second = [](int64_t n, std::chrono::nanoseconds elapsed) {
+    return (double)n * 1000 * 1000 * 1000 / (double)elapsed.count();
+  };
+  std::cout << fmt::format(
+      "chunk size {}: mavlink_parse_char {:.0f} msg/s, MavlinkFrameParser "
+      "{:.0f} msg/s\n",
+      chunk_size,
+      msgs_per_second(n_messages_reference, elapsed_reference),
+      msgs_per_second(n_messages, elapsed));
+  std::cout << "Parser stats: " << parser.get_stats().to_string() << "\n";
+}
+
+int main(int argc, char* argv[]) {
+  const bool use_file = argc > 1;
+  const auto data = use_file ? read_file(argv[1]) : create_synthetic_stream();
+  const auto reference = parse_reference(data);
+  std::cout << fmt::format("{} bytes, {} messages (mavlink_parse_char)\n",
+                           data.size(), reference.size());
+  std::mt19937 gen(1);
+  // UART-like (small, random) and UDP-like (large) reads
+  for (const int max_chunk_size : {1, 7, 64, 300, 1500, 65535}) {
+    const auto parsed = parse_chunked(data, gen, max_chunk_size);
+    validate(reference, parsed, !use_file);
+  }
+  benchmark(data, 64);
+  benchmark(data, 1500);
+  std::cout << "test_mavlink_parser passed\n";
+  return 0;
+}
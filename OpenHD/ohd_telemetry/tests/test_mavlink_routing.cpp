@@ -0,0 +1,103 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#include <iostream>
+
+#include "../src/mav_helper.h"
+#include "../src/routing/MavlinkRoutingTable.h"
+#include "openhd_test_util.h"
+
+// Validates MavlinkRoutingTable with the links of a ground unit: the air unit
+// (FC + air OpenHD), a GCS via UDP (QOpenHD) and another GCS via TCP.
+
+using openhd::test::check;
+using Clock = std::chrono::steady_clock;
+
+static constexpr int LINK_AIR = 0;
+static constexpr int LINK_UDP = 1;
+static constexpr int LINK_TCP = 2;
+
+static MavlinkMessage heartbeat(uint8_t sys_id, uint8_t comp_id) {
+  MavlinkMessage msg;
+  mavlink_msg_heartbeat_pack(sys_id, comp_id, &msg.m, MAV_TYPE_GCS,
+                             MAV_AUTOPILOT_INVALID, 0, 0, 0);
+  return msg;
+}
+
+static MavlinkMessage command_long(uint8_t sys_id, uint8_t target_sys_id,
+                                   uint8_t target_comp_id) {
+  MavlinkMessage msg;
+  mavlink_msg_command_long_pack(sys_id, 190, &msg.m, target_sys_id,
+                                target_comp_id, MAV_CMD_DO_SET_MODE, 0, 0, 0,
+                                0, 0, 0, 0, 0);
+  return msg;
+}
+
+static MavlinkMessage command_ack(uint8_t sys_id, uint8_t target_sys_id) {
+  MavlinkMessage msg;
+  mavlink_msg_command_ack_pack(sys_id, 1, &msg.m, MAV_CMD_DO_SET_MODE,
+                               MAV_RESULT_ACCEPTED, 0, 0, target_sys_id, 190);
+  return msg;
+}
+
+int main(int argc, char* argv[]) {
+  MavlinkRoutingTable table({"air", "udp", "tcp"});
+  const auto now = Clock::now();
+  const std::vector<MavlinkMessage> air_heartbeats{
+      heartbeat(OHD_SYS_ID_FC, 1), heartbeat(OHD_SYS_ID_AIR, 191)};
+  const auto qopenhd_heartbeat = heartbeat(QOPENHD_SYS_ID, 190);
+  const auto tcp_gcs_heartbeat = heartbeat(254, 190);
+  table.learn(LINK_AIR, air_heartbeats, now);
+  table.learn(LINK_UDP, {&qopenhd_heartbeat, 1}, now);
+  table.learn(LINK_TCP, {&tcp_gcs_heartbeat, 1}, now);
+  // Broadcast goes everywhere, but never back
+  const auto fc_heartbeat = heartbeat(OHD_SYS_ID_FC, 1);
+  check(table.should_forward(fc_heartbeat, LINK_AIR, LINK_UDP, now) &&
+            table.should_forward(fc_heartbeat, LINK_AIR, LINK_TCP, now) &&
+            !table.should_forward(fc_heartbeat, LINK_AIR, LINK_AIR, now),
+        "Broadcast");
+  // Ack for QOpenHD only goes to QOpenHD
+  const auto ack = command_ack(OHD_SYS_ID_FC, QOPENHD_SYS_ID);
+  check(table.should_forward(ack, LINK_AIR, LINK_UDP, now) &&
+            !table.should_forward(ack, LINK_AIR, LINK_TCP, now),
+        "Targeted downlink");
+  // Command for the FC goes to the air unit, command for the TCP GCS doesn't
+  check(table.should_forward(command_long(QOPENHD_SYS_ID, OHD_SYS_ID_FC, 1),
+                             LINK_UDP, LINK_AIR, now),
+        "Command to FC");
+  check(!table.should_forward(command_long(QOPENHD_SYS_ID, 254, 190), LINK_UDP,
+                              LINK_AIR, now),
+        "Command to TCP GCS forwarded to air");
+  // Known system, unknown component -> where the system is
+  check(table.should_forward(command_long(QOPENHD_SYS_ID, OHD_SYS_ID_FC, 99),
+                             LINK_UDP, LINK_AIR, now) &&
+            !table.should_forward(
+                command_long(QOPENHD_SYS_ID, OHD_SYS_ID_FC, 99), LINK_UDP,
+                LINK_TCP, now),
+        "Unknown component");
+  // Unknown system -> broadcast
+  check(table.should_forward(command_long(QOPENHD_SYS_ID, 42, 1), LINK_UDP,
+                             LINK_AIR, now),
+        "Unknown system not forwarded");
+  // filter() doesn't copy if everything is forwarded
+  std::vector<MavlinkMessage> storage;
+  const std::vector<MavlinkMessage> all_forwarded{fc_heartbeat, ack};
+  const auto span =
+      table.filter(all_forwarded, LINK_AIR, LINK_UDP, storage, now);
+  check(span.data() == all_forwarded.data() && span.size() == 2,
+        "filter() copied");
+  const std::vector<MavlinkMessage> mixed{fc_heartbeat, ack, fc_heartbeat};
+  const auto filtered = table.filter(mixed, LINK_AIR, LINK_TCP, storage, now);
+  check(filtered.size() == 2 && filtered[0].m.msgid == MAVLINK_MSG_ID_HEARTBEAT &&
+            filtered[1].m.msgid == MAVLINK_MSG_ID_HEARTBEAT,
+        "filter()");
+  // Routes expire - QOpenHD is unknown again, the ack is broadcast
+  const auto later = now + MavlinkRoutingTable::ROUTE_TIMEOUT +
+                     std::chrono::seconds(1);
+  check(table.should_forward(ack, LINK_AIR, LINK_TCP, later),
+        "Route did not expire");
+  std::cout << table.to_string() << "\n";
+  std::cout << "test_mavlink_routing passed\n";
+  return 0;
+}
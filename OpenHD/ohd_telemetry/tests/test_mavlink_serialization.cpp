@@ -0,0 +1,112 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#include <iostream>
+
+#include "../src/mav_helper.h"
+#include "../src/mav_include.h"
+#include "openhd_spdlog.h"
+
+// Validates the allocation-free aggregation against packing each message
+// (the "old" way) and prints a rough timing comparison.
+
+static std::vector<MavlinkMessage> create_messages(int n) {
+  std::vector<MavlinkMessage> ret;
+  for (int i = 0; i < n; i++) {
+    if (i % 3 == 0) ret.push_back(MExampleMessage::heartbeat());
+    if (i % 3 == 1) ret.push_back(MExampleMessage::position());
+    if (i % 3 == 2) ret.push_back(MExampleMessage::attitude());
+  }
+  ret[n / 2].recommended_n_injections = 3;
+  return ret;
+}
+
+static void test_correctness() {
+  const auto messages = create_messages(100);
+  std::vector<uint8_t> expected;
+  for (const auto& msg : messages) {
+    const auto packed = msg.pack();
+    if ((int)packed.size() != msg.get_packed_size()) {
+      throw std::runtime_error("get_packed_size mismatch");
+    }
+    expected.insert(expected.end(), packed.begin(), packed.end());
+  }
+  if (get_size(messages) != (int)expected.size()) {
+    throw std::runtime_error("get_size mismatch");
+  }
+  const uint32_t mtu = 1024;
+  std::vector<uint8_t> aggregated;
+  int n_messages = 0;
+  int max_n_retransmissions = 0;
+  aggregate_pack_messages(
+      messages, mtu, [&](const AggregatedMavlinkPacketView& view) {
+        if (view.data_len > (int)mtu) {
+          throw std::runtime_error("Exceeds mtu");
+        }
+        aggregated.insert(aggregated.end(), view.data,
+                          view.data + view.data_len);
+        n_messages += view.n_aggregated_mavlink_packets;
+        max_n_retransmissions =
+            std::max(max_n_retransmissions, view.recommended_n_retransmissions);
+      });
+  if (aggregated != expected || n_messages != (int)messages.size() ||
+      max_n_retransmissions != 3) {
+    throw std::runtime_error("Aggregated data mismatch");
+  }
+  // Owning variant
+  std::vector<uint8_t> aggregated2;
+  for (const auto& packet : aggregate_pack_messages(messages, mtu)) {
+    aggregated2.insert(aggregated2.end(), packet.aggregated_data->begin(),
+                       packet.aggregated_data->end());
+  }
+  if (aggregated2 != expected) {
+    throw std::runtime_error("Aggregated data mismatch (owning)");
+  }
+}
+
+static void benchmark() {
+  // Roughly what one telemetry iteration sends
+  const auto messages = create_messages(10);
+  const int n_runs = 100000;
+  int64_t total = 0;
+  auto begin = std::chrono::steady_clock::now();
+  for (int i = 0; i < n_runs; i++) {
+    // Old: pack per message, insert into buffer, pack again to count
+    std::vector<uint8_t> buff;
+    buff.reserve(1024);
+    for (const auto& msg : messages) {
+      const auto data = msg.pack();
+      buff.insert(buff.end(), data.begin(), data.end());
+    }
+    for (const auto& msg : messages) total += msg.pack().size();
+    total += buff.size();
+  }
+  const auto elapsed_old = std::chrono::steady_clock::now() - begin;
+  begin = std::chrono::steady_clock::now();
+  for (int i = 0; i < n_runs; i++) {
+    aggregate_pack_messages(messages, 1024,
+                            [&total](const AggregatedMavlinkPacketView& view) {
+                              total += view.data_len;
+                            });
+    total += get_size(messages);
+  }
+  const auto elapsed_new = std::chrono::steady_clock::now() - begin;
+  std::cout << fmt::format(
+      "pack() per message: {}ns, aggregate in place: {}ns per iteration "
+      "(checksum {})\n",
+      std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed_old)
+              .count() /
+          n_runs,
+      std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed_new)
+              .count() /
+          n_runs,
+      total);
+}
+
+int main(int argc, char* argv[]) {
+  test_correctness();
+  benchmark();
+  std::cout << "test_mavlink_serialization passed\n";
+  return 0;
+}
@@ -0,0 +1,196 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#include "../src/mavsdk_temporary/XMavlinkParamProvider.h"
+#include "openhd_spdlog.h"
+#include "openhd_util.h"
+
+// Validates the param list transmission of XMavlinkParamProvider (cache hash
+// first, then all params from the pre-encoded table, paced by the tx budget)
+// and measures how long a full list takes with the air unit budget.
+
+static constexpr uint8_t SYS_ID = 100;
+static constexpr uint8_t COMP_ID = MAV_COMP_ID_ONBOARD_COMPUTER;
+static constexpr auto HASH_CHECK =
+    mavsdk::MavlinkParameterReceiver::HASH_CHECK_PARAM_ID;
+
+static std::shared_ptr<XMavlinkParamProvider> create_param_provider(
+    int n_params) {
+  auto ret = std::make_shared<XMavlinkParamProvider>(SYS_ID, COMP_ID);
+  std::vector<openhd::Setting> settings;
+  for (int i = 0; i < n_params; i++) {
+    openhd::append_int_param(settings, fmt::format("PARAM_{}", i), i,
+                             [](int) { return true; });
+  }
+  ret->add_params(settings);
+  ret->set_ready();
+  return ret;
+}
+
+static MavlinkMessage param_request_list() {
+  MavlinkMessage msg;
+  mavlink_msg_param_request_list_pack(255, 190, &msg.m, SYS_ID, COMP_ID);
+  return msg;
+}
+
+static MavlinkMessage param_request_read(const std::string& param_id) {
+  char buf[16]{};
+  std::strncpy(buf, param_id.c_str(), sizeof(buf));
+  MavlinkMessage msg;
+  mavlink_msg_param_request_read_pack(255, 190, &msg.m, SYS_ID, COMP_ID, buf,
+                                      -1);
+  return msg;
+}
+
+static MavlinkMessage param_set(const std::string& param_id, int value) {
+  char buf[16]{};
+  std::strncpy(buf, param_id.c_str(), sizeof(buf));
+  float value_bytewise;
+  std::memcpy(&value_bytewise, &value, sizeof(value));
+  MavlinkMessage msg;
+  mavlink_msg_param_set_pack(255, 190, &msg.m, SYS_ID, COMP_ID, buf,
+                             value_bytewise, MAV_PARAM_TYPE_INT32);
+  return msg;
+}
+
+struct DecodedParamValue {
+  std::string param_id;
+  uint32_t value_bytewise;
+  uint16_t param_index;
+  uint16_t param_count;
+};
+
+static std::vector<DecodedParamValue> get_param_values(
+    const std::vector<MavlinkMessage>& messages) {
+  std::vector<DecodedParamValue> ret;
+  for (const auto& msg : messages) {
+    if (msg.m.msgid != MAVLINK_MSG_ID_PARAM_VALUE) continue;
+    mavlink_param_value_t param_value;
+    mavlink_msg_param_value_decode(&msg.m, &param_value);
+    char param_id[17]{};
+    std::memcpy(param_id, param_value.param_id, 16);
+    uint32_t value_bytewise;
+    std::memcpy(&value_bytewise, &param_value.param_value, 4);
+    ret.push_back(DecodedParamValue{param_id, value_bytewise,
+                                    param_value.param_index,
+                                    param_value.param_count});
+  }
+  return ret;
+}
+
+static uint32_t request_hash(XMavlinkParamProvider& provider) {
+  const auto request = param_request_read(HASH_CHECK);
+  const auto responses =
+      get_param_values(provider.process_mavlink_messages({&request, 1}));
+  if (responses.size() != 1 || responses[0].param_id != HASH_CHECK) {
+    throw std::runtime_error("Expected only the hash");
+  }
+  return responses[0].value_bytewise;
+}
+
+static void test_list_and_hash() {
+  const int n_params = 100;
+  auto provider = create_param_provider(n_params);
+  const auto request = param_request_list();
+  const auto responses =
+      get_param_values(provider->process_mavlink_messages({&request, 1}));
+  if (responses.size() != n_params + 1 || responses[0].param_id != HASH_CHECK) {
+    throw std::runtime_error("Expected hash + all params");
+  }
+  for (int i = 0; i < n_params; i++) {
+    const auto& param = responses[i + 1];
+    if (param.param_index != i || param.param_count != n_params) {
+      throw std::runtime_error("Wrong param index / count");
+    }
+  }
+  const auto hash = request_hash(*provider);
+  if (hash != responses[0].value_bytewise) {
+    throw std::runtime_error("Hash mismatch");
+  }
+  // Same params -> same hash
+  if (request_hash(*create_param_provider(n_params)) != hash) {
+    throw std::runtime_error("Hash not deterministic");
+  }
+  const auto set_request = param_set("PARAM_3", 42);
+  const auto set_responses =
+      get_param_values(provider->process_mavlink_messages({&set_request, 1}));
+  if (set_responses.size() != 1 || set_responses[0].value_bytewise != 42) {
+    throw std::runtime_error("Param set failed");
+  }
+  if (request_hash(*provider) == hash) {
+    throw std::runtime_error("Hash didn't change after param change");
+  }
+}
+
+// The hash has to match what PX4 / QGroundControl compute, otherwise QGC
+// never uses its param cache
+static void test_hash_reference() {
+  // Standard CRC32 check value (with the initial / final inversion)
+  const char* check_data = "123456789";
+  const uint32_t check = OHDUtil::crc32(
+      reinterpret_cast<const uint8_t*>(check_data), 9, 0xFFFFFFFF);
+  if ((check ^ 0xFFFFFFFF) != 0xCBF43926) {
+    throw std::runtime_error("CRC32 check value");
+  }
+  // Reference computed independently (python zlib.crc32) the way QGC hashes
+  // its cache: sorted by id (PARAM_10 before PARAM_2), crc32part over the id
+  // (without terminating zero), then over the 4 bytes of the int32 value
+  if (request_hash(*create_param_provider(12)) != 0x952d0e5d) {
+    throw std::runtime_error("Hash doesn't match the PX4 / QGC reference");
+  }
+}
+
+static void test_pacing() {
+  // More than one burst worth of params
+  const int n_params = 500;
+  const int budget_bytes_per_second = 16 * 1024;
+  auto provider = create_param_provider(n_params);
+  provider->set_tx_budget_bytes_per_second(budget_bytes_per_second);
+  const auto begin = std::chrono::steady_clock::now();
+  const auto request = param_request_list();
+  std::vector<MavlinkMessage> sent =
+      provider->process_mavlink_messages({&request, 1});
+  while (get_param_values(sent).size() < n_params + 1) {
+    if (std::chrono::steady_clock::now() - begin > std::chrono::seconds(5)) {
+      throw std::runtime_error("Param list incomplete");
+    }
+    // Same interval as the air telemetry loop
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    auto messages = provider->generate_mavlink_messages();
+    sent.insert(sent.end(), messages.begin(), messages.end());
+  }
+  const auto elapsed = std::chrono::steady_clock::now() - begin;
+  int n_bytes = 0;
+  for (const auto& msg : sent) {
+    n_bytes += MAVLINK_NUM_NON_PAYLOAD_BYTES + msg.m.len;
+  }
+  const double elapsed_s =
+      std::chrono::duration_cast<std::chrono::duration<double>>(elapsed)
+          .count();
+  // Allow for one burst and one message over budget
+  const double max_n_bytes =
+      budget_bytes_per_second * (elapsed_s + 0.25) + MAVLINK_MAX_PACKET_LEN;
+  if (n_bytes > max_n_bytes) {
+    throw std::runtime_error(
+        fmt::format("Sent {} bytes in {}s, budget {}B/s", n_bytes, elapsed_s,
+                    budget_bytes_per_second));
+  }
+  std::cout << fmt::format(
+      "Full param list ({} params, {} bytes) with {}B/s budget took {}ms\n",
+      n_params, n_bytes, budget_bytes_per_second,
+      std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count());
+}
+
+int main(int argc, char* argv[]) {
+  test_list_and_hash();
+  test_hash_reference();
+  test_pacing();
+  std::cout << "test_param_sync passed\n";
+  return 0;
+}
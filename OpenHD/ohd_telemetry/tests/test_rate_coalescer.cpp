@@ -0,0 +1,104 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#include <iostream>
+
+#include "../src/mav_helper.h"
+#include "../src/routing/MavlinkRateCoalescer.h"
+#include "openhd_spdlog.h"
+
+// Validates MavlinkRateCoalescer: a 50Hz stream limited to 10Hz, latest value
+// wins, per sender, other messages untouched and in order.
+
+using Clock = std::chrono::steady_clock;
+
+static MavlinkMessage attitude(uint8_t comp_id, uint32_t time_boot_ms) {
+  MavlinkMessage msg;
+  mavlink_msg_attitude_pack(1, comp_id, &msg.m, time_boot_ms, 0, 0, 0, 0, 0,
+                            0);
+  return msg;
+}
+
+static uint32_t get_time_boot_ms(const MavlinkMessage& msg) {
+  return mavlink_msg_attitude_get_time_boot_ms(&msg.m);
+}
+
+static void test_downsampling() {
+  MavlinkRateCoalescer coalescer;
+  coalescer.set_max_rates({{MAVLINK_MSG_ID_ATTITUDE, 10}});
+  const auto begin = Clock::now();
+  int n_attitude_comp1 = 0;
+  int n_attitude_comp2 = 0;
+  int n_heartbeat = 0;
+  // 10 seconds, 50Hz attitude from 2 senders, 1Hz heartbeat
+  for (int ms = 0; ms < 10 * 1000; ms += 20) {
+    const auto now = begin + std::chrono::milliseconds(ms);
+    std::vector<MavlinkMessage> messages{attitude(1, ms), attitude(2, ms)};
+    if (ms % 1000 == 0) messages.push_back(MExampleMessage::heartbeat(1, 1));
+    for (const auto& msg : coalescer.process(messages, now)) {
+      if (msg.m.msgid == MAVLINK_MSG_ID_HEARTBEAT) {
+        n_heartbeat++;
+        continue;
+      }
+      // Forwarded right away - always the latest value
+      if (get_time_boot_ms(msg) != (uint32_t)ms) {
+        throw std::runtime_error("Not the latest value");
+      }
+      if (msg.m.compid == 1) n_attitude_comp1++;
+      if (msg.m.compid == 2) n_attitude_comp2++;
+    }
+  }
+  if (n_heartbeat != 10 || n_attitude_comp1 != 100 || n_attitude_comp2 != 100) {
+    throw std::runtime_error(fmt::format("Wrong rate {} {} {}", n_heartbeat,
+                                         n_attitude_comp1, n_attitude_comp2));
+  }
+  const auto stats = coalescer.get_stats();
+  if (stats.n_coalesced == 0 || stats.n_bytes_saved == 0) {
+    throw std::runtime_error("No stats");
+  }
+  std::cout << MavlinkRateCoalescer::stats_as_string(stats) << "\n";
+}
+
+static void test_flush() {
+  MavlinkRateCoalescer coalescer;
+  coalescer.set_max_rates({{MAVLINK_MSG_ID_ATTITUDE, 10}});
+  const auto begin = Clock::now();
+  // The 2nd one is held back, then the stream stops
+  const auto first = attitude(1, 0);
+  const auto second = attitude(1, 20);
+  if (coalescer.process({&first, 1}, begin).size() != 1 ||
+      !coalescer.process({&second, 1}, begin + std::chrono::milliseconds(20))
+           .empty()) {
+    throw std::runtime_error("Not held back");
+  }
+  if (!coalescer.flush(begin + std::chrono::milliseconds(50)).empty()) {
+    throw std::runtime_error("Flushed too early");
+  }
+  const auto flushed = coalescer.flush(begin + std::chrono::milliseconds(100));
+  if (flushed.size() != 1 || get_time_boot_ms(flushed[0]) != 20) {
+    throw std::runtime_error("Held back message lost");
+  }
+}
+
+static void test_parse() {
+  const auto parsed = MavlinkRateCoalescer::parse_max_rates("30:10,33:5");
+  if (!parsed.has_value() || parsed->size() != 2 || parsed->at(30) != 10 ||
+      parsed->at(33) != 5) {
+    throw std::runtime_error("parse failed");
+  }
+  if (!MavlinkRateCoalescer::parse_max_rates("").has_value() ||
+      MavlinkRateCoalescer::parse_max_rates("30").has_value() ||
+      MavlinkRateCoalescer::parse_max_rates("30:x").has_value() ||
+      MavlinkRateCoalescer::parse_max_rates("30:-1").has_value()) {
+    throw std::runtime_error("parse validation failed");
+  }
+}
+
+int main(int argc, char* argv[]) {
+  test_downsampling();
+  test_flush();
+  test_parse();
+  std::cout << "test_rate_coalescer passed\n";
+  return 0;
+}
@@ -22,8 +22,10 @@ int main(int argc, char *argv[]) {
   options.flow_control=false;
   options.enable_debug=true;
 
-  auto serial_endpoint=std::make_unique<SerialEndpoint>("ser_test",options);
-  serial_endpoint->registerCallback([](std::vector<MavlinkMessage> messages) {
+  auto event_loop=std::make_shared<openhd::EventLoop>("ser_test_loop");
+  event_loop->start();
+  auto serial_endpoint=std::make_unique<SerialEndpoint>("ser_test",options,event_loop);
+  serial_endpoint->registerCallback([](MavlinkMessageSpan messages) {
 	//debugMavlinkMessage(msg.m, "SerialTest3");
   });
   // now mavlink messages should come in. Try disconnecting and reconnecting, and see if messages continue
@@ -34,11 +36,12 @@ int main(int argc, char *argv[]) {
 	std::cout<<serial_endpoint->createInfo();
     // some implementations need a heartbeat before they start sending data.
     auto msg = MExampleMessage::heartbeat();
-    serial_endpoint->sendMessages({msg});
+    serial_endpoint->sendMessages({&msg, 1});
     std::this_thread::sleep_for(std::chrono::seconds(1));
   }
   serial_endpoint.reset();
   serial_endpoint= nullptr;
+  event_loop->stop();
   std::cout << "SerialEndpointTest3::end" << std::endl;
   return 0;
 }
\ No newline at end of file
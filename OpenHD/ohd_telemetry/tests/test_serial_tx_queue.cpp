@@ -0,0 +1,150 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include "../src/endpoints/SerialTxQueue.h"
+
+// Validates SerialTxQueue (order, priority, drop policies, coalescing) and
+// simulates a saturated 57600 baud UART - the queue (and therefore the latency
+// of a RC message) stays bounded, while the producer is never blocked.
+
+// Message with the given id as payload, such that we can validate what comes
+// out
+static std::vector<uint8_t> create_message(uint8_t id, int size) {
+  return std::vector<uint8_t>(size, id);
+}
+
+// Splits the dequeued data back into messages (all messages have size bytes)
+static std::vector<uint8_t> ids_of(const std::vector<uint8_t>& data, int size) {
+  std::vector<uint8_t> ret;
+  for (size_t i = 0; i < data.size(); i += size) {
+    for (int j = 0; j < size; j++) {
+      if (data[i + j] != data[i]) throw std::runtime_error("Broken message");
+    }
+    ret.push_back(data[i]);
+  }
+  return ret;
+}
+
+static void test_order_and_priority() {
+  SerialTxQueue queue(SerialTxQueue::Config{});
+  for (uint8_t i = 0; i < 5; i++) {
+    const auto msg = create_message(i, 40);
+    queue.enqueue(msg.data(), msg.size(), false);
+  }
+  const auto prio = create_message(100, 40);
+  queue.enqueue(prio.data(), prio.size(), true);
+  std::vector<uint8_t> out;
+  // Only 2 messages fit
+  if (queue.dequeue(out, 100) != 2) throw std::runtime_error("Coalescing");
+  const auto ids = ids_of(out, 40);
+  if (ids != std::vector<uint8_t>{100, 0}) {
+    throw std::runtime_error("Priority message not first");
+  }
+  out.clear();
+  // At least one message, even if it exceeds max_bytes
+  if (queue.dequeue(out, 10) != 1) throw std::runtime_error("Min 1 message");
+  out.clear();
+  queue.dequeue(out, 10000);
+  if (ids_of(out, 40) != std::vector<uint8_t>{2, 3, 4} || !queue.is_empty()) {
+    throw std::runtime_error("Order");
+  }
+}
+
+static void test_drop_policy(const SerialTxQueue::DropPolicy policy) {
+  SerialTxQueue::Config config{};
+  config.capacity_bytes = 100;
+  config.drop_policy = policy;
+  SerialTxQueue queue(config);
+  // 30 bytes each, 3 fit. Wraps around the ring multiple times
+  for (int round = 0; round < 10; round++) {
+    for (uint8_t i = 0; i < 5; i++) {
+      const auto msg = create_message(i, 30);
+      queue.enqueue(msg.data(), msg.size(), false);
+    }
+    std::vector<uint8_t> out;
+    queue.dequeue(out, 10000);
+    const auto ids = ids_of(out, 30);
+    const auto expected = policy == SerialTxQueue::DropPolicy::DROP_OLDEST
+                              ? std::vector<uint8_t>{2, 3, 4}
+                              : std::vector<uint8_t>{0, 1, 2};
+    if (ids != expected) throw std::runtime_error("Drop policy");
+  }
+  const auto stats = queue.get_stats();
+  if (stats.n_dropped != 20 || stats.max_queued_bytes != 90) {
+    throw std::runtime_error("Stats " + stats.to_string());
+  }
+  // Bigger than the whole queue
+  const auto big = create_message(0, 101);
+  if (queue.enqueue(big.data(), big.size(), false)) {
+    throw std::runtime_error("Too big message accepted");
+  }
+}
+
+// Producer generates more than a 57600 baud UART can send, writer is paced
+// (like SerialEndpoint with TIOCOUTQ) - simulated with 1ms steps
+static void simulate_saturated_uart() {
+  const int bytes_per_ms = 57600 / 10 / 1000;
+  SerialTxQueue::Config config{};
+  config.capacity_bytes = 2048;
+  SerialTxQueue queue(config);
+  int kernel_queue = 0;
+  const int kernel_queue_target = 128;
+  int max_rc_latency_ms = 0;
+  // when the (last) rc message has been enqueued, -1 if none in flight
+  int rc_enqueue_time = -1;
+  int rc_kernel_position = -1;
+  for (int now_ms = 0; now_ms < 10000; now_ms++) {
+    // ~2x the UART bandwidth of bulk telemetry
+    const auto bulk = create_message(1, 11);
+    queue.enqueue(bulk.data(), bulk.size(), false);
+    if (now_ms % 20 == 0 && rc_enqueue_time == -1) {
+      const auto rc = create_message(2, 42);
+      queue.enqueue(rc.data(), rc.size(), true);
+      rc_enqueue_time = now_ms;
+    }
+    // UART sends data
+    kernel_queue = std::max(0, kernel_queue - bytes_per_ms);
+    if (rc_kernel_position >= 0) {
+      rc_kernel_position -= bytes_per_ms;
+      if (rc_kernel_position < 0) {
+        max_rc_latency_ms =
+            std::max(max_rc_latency_ms, now_ms - rc_enqueue_time);
+        rc_enqueue_time = -1;
+      }
+    }
+    // Writer, every ms
+    const int budget = kernel_queue_target - kernel_queue;
+    if (budget <= 0) continue;
+    std::vector<uint8_t> out;
+    queue.dequeue(out, budget);
+    for (size_t i = 0; i < out.size(); i += (out[i] == 2 ? 42 : 11)) {
+      if (out[i] == 2) rc_kernel_position = kernel_queue + i + 42;
+    }
+    kernel_queue += out.size();
+  }
+  const auto stats = queue.get_stats();
+  std::cout << "Saturated UART: max RC latency " << max_rc_latency_ms
+            << "ms, " << stats.to_string() << "\n";
+  if (stats.n_dropped == 0 || stats.n_dropped_priority != 0) {
+    throw std::runtime_error("Unexpected drops");
+  }
+  if (stats.max_queued_bytes > config.capacity_bytes + 42) {
+    throw std::runtime_error("Queue not bounded");
+  }
+  // Behind at most the kernel queue target (+ one message)
+  if (max_rc_latency_ms > 40) throw std::runtime_error("RC latency too high");
+}
+
+int main(int argc, char* argv[]) {
+  test_order_and_priority();
+  test_drop_policy(SerialTxQueue::DropPolicy::DROP_OLDEST);
+  test_drop_policy(SerialTxQueue::DropPolicy::DROP_NEWEST);
+  simulate_saturated_uart();
+  std::cout << "test_serial_tx_queue passed\n";
+  return 0;
+}
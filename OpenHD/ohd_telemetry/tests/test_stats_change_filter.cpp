@@ -0,0 +1,147 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#include <iostream>
+#include <random>
+#include <stdexcept>
+
+#include "../src/internal/StatsChangeFilter.h"
+#include "openhd_test_util.h"
+
+// Validates StatsChangeFilter: sent on meaningful change (absolute / relative
+// thresholds, overrides), keep-alive otherwise, per instance, bytes saved.
+// Runs on simulated time.
+
+using openhd::test::check;
+using Clock = std::chrono::steady_clock;
+
+// Like the link stats
+struct LinkStats {
+  int8_t rssi = -50;
+  int32_t rx_bps = 1000000;
+  uint32_t count_p_received = 0;
+  uint8_t mcs_index = 2;
+};
+
+static const std::vector<StatsChangeFilter::Field<LinkStats>> FIELDS{
+    {"rssi", [](const LinkStats& s) -> int64_t { return s.rssi; }, 3, false},
+    {"rx_bps", [](const LinkStats& s) -> int64_t { return s.rx_bps; }, 10,
+     true},
+    {"count_p_received",
+     [](const LinkStats& s) -> int64_t { return s.count_p_received; },
+     StatsChangeFilter::THRESHOLD_NEVER, false},
+    {"mcs_index", [](const LinkStats& s) -> int64_t { return s.mcs_index; },
+     StatsChangeFilter::THRESHOLD_ANY_CHANGE, false}};
+
+static MavlinkMessage create_message() {
+  MavlinkMessage msg{};
+  mavlink_msg_heartbeat_pack(1, 191, &msg.m, MAV_TYPE_ONBOARD_CONTROLLER, 0, 0,
+                             0, 0);
+  return msg;
+}
+
+struct Simulation {
+  Simulation() {
+    filter.set_config(
+        StatsChangeFilter::Config{std::chrono::milliseconds(2000), {}});
+  }
+  // Like OHDMainComponent on air, every 500ms
+  bool step(int index = 0) {
+    now += std::chrono::milliseconds(500);
+    stats.count_p_received += 100;
+    return filter.should_send("link", index, stats, FIELDS, msg, now);
+  }
+  StatsChangeFilter filter;
+  LinkStats stats;
+  const MavlinkMessage msg = create_message();
+  Clock::time_point now = Clock::now();
+};
+
+static void test_thresholds() {
+  Simulation sim;
+  check(sim.step(), "First");
+  // Counters / small changes don't trigger a send
+  sim.stats.rssi = -52;
+  sim.stats.rx_bps = 1090000;
+  check(!sim.step() && !sim.step() && !sim.step(), "Small changes");
+  // Keep-alive (2s after the first)
+  check(sim.step(), "Keep-alive");
+  check(!sim.step(), "After keep-alive");
+  // Compared to the value last sent, not the previous one
+  sim.stats.rssi = -54;
+  check(!sim.step(), "Below absolute threshold");
+  sim.stats.rssi = -55;
+  check(sim.step(), "Absolute threshold");
+  sim.stats.rx_bps = 1090000 + 109000;
+  check(sim.step(), "Relative threshold");
+  sim.stats.mcs_index = 3;
+  check(sim.step(), "Any change");
+  // Instances are independent
+  check(sim.step(1), "Other instance");
+  check(!sim.step(1), "Other instance unchanged");
+  const auto stats = sim.filter.get_stats();
+  std::cout << stats.to_string() << "\n";
+  check(stats.n_sent == 6 && stats.n_suppressed == 6 &&
+            stats.n_bytes_saved == 6 * sim.msg.get_packed_size() &&
+            stats.n_bytes_sent == 6 * sim.msg.get_packed_size(),
+        "Stats");
+}
+
+static void test_config() {
+  Simulation sim;
+  // Disabled - always sent, like before
+  sim.filter.set_config(StatsChangeFilter::Config{});
+  for (int i = 0; i < 10; i++) check(sim.step(), "Disabled");
+  // Overrides
+  const auto thresholds = StatsChangeFilter::parse_thresholds(
+      "link.rssi:1,link.mcs_index:-1,card.rx_rssi:5");
+  check(thresholds.has_value() && thresholds->size() == 3, "Parse");
+  sim.filter.set_config(StatsChangeFilter::Config{
+      std::chrono::milliseconds(2000), thresholds.value()});
+  check(sim.step(), "Baseline");
+  sim.stats.rssi--;
+  check(sim.step(), "Lower threshold");
+  sim.stats.mcs_index++;
+  check(!sim.step(), "Never");
+  check(StatsChangeFilter::parse_thresholds("")->empty(), "Empty");
+  for (const auto& invalid : {"rssi:1", "link.rssi", "link.rssi:x",
+                              "link.rssi:-2", ".rssi:1", "link.:1"}) {
+    check(!StatsChangeFilter::parse_thresholds(invalid).has_value(),
+          std::string("Invalid ") + invalid);
+  }
+}
+
+// Stats that fluctuate within the thresholds most of the time (like on a
+// stable link), with a few real changes
+static void test_savings() {
+  Simulation sim;
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<int> rssi_noise(-1, 1);
+  std::uniform_int_distribution<int> bps_noise(-40000, 40000);
+  int n_steps = 0;
+  int n_sent = 0;
+  // 60 seconds
+  for (int i = 0; i < 120; i++) {
+    sim.stats.rssi = static_cast<int8_t>(-50 + rssi_noise(rng));
+    sim.stats.rx_bps = 1000000 + bps_noise(rng);
+    if (i == 60) sim.stats.mcs_index = 3;
+    const bool sent = sim.step();
+    if (i == 60) check(sent, "MCS change");
+    n_steps++;
+    if (sent) n_sent++;
+  }
+  const auto stats = sim.filter.get_stats();
+  std::cout << "Sent " << n_sent << " of " << n_steps << " "
+            << stats.to_string() << "\n";
+  // Keep-alive every 4th + the mcs change
+  check(n_sent <= n_steps / 4 + 2, "Savings");
+}
+
+int main(int argc, char* argv[]) {
+  test_thresholds();
+  test_config();
+  test_savings();
+  std::cout << "test_stats_change_filter passed\n";
+  return 0;
+}
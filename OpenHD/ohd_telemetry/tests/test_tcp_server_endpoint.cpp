@@ -12,7 +12,7 @@
 int main() {
   openhd::log::get_default()->debug("test_tcp_server_endpoint:end");
   std::unique_ptr<TCPEndpoint> m_server=std::make_unique<TCPEndpoint>(openhd::TCPServer::Config{TCPEndpoint::DEFAULT_PORT});//1445
-  auto cb=[](const std::vector<MavlinkMessage> messages){
+  auto cb=[](MavlinkMessageSpan messages){
     for(const auto& msg:messages){
       debugMavlinkMessage(msg.m, "TCP received");
     }
@@ -24,7 +24,7 @@ int main() {
   while ((std::chrono::steady_clock::now() - start) < std::chrono::seconds (30)) {
     openhd::log::get_default()->debug("Alive:{}",OHDUtil::yes_or_no(m_server->isAlive()));
     auto heartbeat = MExampleMessage::heartbeat();
-    m_server->sendMessages({heartbeat});
+    m_server->sendMessages({&heartbeat, 1});
     std::this_thread::sleep_for(std::chrono::seconds(1));
   }
   openhd::log::get_default()->debug("test_tcp_server_endpoint: end");
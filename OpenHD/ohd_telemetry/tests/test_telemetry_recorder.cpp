@@ -0,0 +1,214 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+#include "../src/recorder/TelemetryRecorder.h"
+#include "../src/recorder/TelemetryRecording.h"
+#include "../src/recorder/TelemetryReplay.h"
+#include "../src/routing/MavlinkRateCoalescer.h"
+#include "../src/routing/MavlinkRoutingTable.h"
+#include "openhd_test_util.h"
+#include "openhd_util_filesystem.h"
+
+// Records into a small ring (wraps around multiple times), reads the
+// recording back, validates replay timing and benchmarks recording as well as
+// the routing / aggregation code with the replayed traffic.
+
+using openhd::test::check;
+using Direction = TelemetryRecorder::Direction;
+
+static constexpr auto DIRECTORY = "/tmp/openhd_test_telemetry_recorder/";
+static constexpr int LINK_FC = 0;
+static constexpr int LINK_GROUND = 1;
+
+// The index is stored in the message, such that we can validate the order
+static MavlinkMessage attitude(uint32_t index) {
+  MavlinkMessage msg;
+  mavlink_msg_attitude_pack(OHD_SYS_ID_FC, 1, &msg.m, index, 0.1, 0.2, 0.3, 0,
+                            0, 0);
+  return msg;
+}
+
+static TelemetryRecorder::Config create_config(uint32_t segment_size) {
+  TelemetryRecorder::Config config{};
+  config.directory = DIRECTORY;
+  config.name = "test";
+  config.n_segments = 4;
+  config.segment_size = segment_size;
+  config.link_names = {"fc", "ground"};
+  return config;
+}
+
+// FC sends attitude with 1ms in between, each message is forwarded to the
+// ground.
+static void record_session(const uint32_t n_messages,
+                           const std::chrono::steady_clock::time_point start) {
+  auto recorder = TelemetryRecorder::create(create_config(64 * 1024));
+  check(recorder != nullptr, "Cannot create recorder");
+  for (uint32_t i = 0; i < n_messages; i++) {
+    const auto now = start + std::chrono::milliseconds(i);
+    const auto msg = attitude(i);
+    recorder->record(LINK_FC, Direction::RX, {&msg, 1}, now);
+    recorder->record(LINK_GROUND, Direction::TX, {&msg, 1}, now);
+    // Give the prepare thread time to map the next segment, in flight
+    // messages don't come in that fast
+    if (i % 200 == 0) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  const auto stats = recorder->get_stats();
+  std::cout << stats.to_string() << "\n";
+  check(stats.n_dropped == 0 && stats.n_records == 2 * n_messages,
+        "Recorder dropped messages");
+}
+
+static void test_record_and_read() {
+  OHDFilesystemUtil::safe_delete_directory(DIRECTORY);
+  const auto start = std::chrono::steady_clock::now();
+  // ~1.3MB, the 256kB ring wraps around multiple times
+  record_session(20000, start);
+  auto recordings = TelemetryRecording::read_all(DIRECTORY, "test");
+  check(recordings.size() == 1, "Sessions");
+  const auto& recording = recordings[0];
+  std::cout << recording.to_string() << "\n";
+  check(recording.n_bad_records == 0, "Bad records");
+  check(recording.get_link("ground") == LINK_GROUND, "Link names");
+  // Ordered, contiguous, ends with the last message. The oldest segment might
+  // start with the second message of a pair (the first one was overwritten)
+  const auto& messages = recording.messages;
+  check(!messages.empty(), "N messages");
+  const size_t offset = messages[0].link == LINK_FC ? 0 : 1;
+  const uint32_t first_index =
+      mavlink_msg_attitude_get_time_boot_ms(&messages[offset].msg.m);
+  for (size_t i = offset; i < messages.size(); i++) {
+    const auto& message = messages[i];
+    const uint32_t expected_index = first_index + (i - offset) / 2;
+    check(mavlink_msg_attitude_get_time_boot_ms(&message.msg.m) ==
+                  expected_index &&
+              message.link ==
+                  ((i - offset) % 2 == 0 ? LINK_FC : LINK_GROUND) &&
+              message.direction ==
+                  ((i - offset) % 2 == 0 ? Direction::RX : Direction::TX),
+          "Order");
+    const auto expected_time =
+        start + std::chrono::milliseconds(expected_index);
+    check(message.timestamp_us ==
+              (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+                  expected_time.time_since_epoch())
+                  .count(),
+          "Timestamp");
+  }
+  check(first_index + (messages.size() - offset) / 2 == 20000,
+        "Last message");
+  const auto n_first_session = messages.size();
+  // A new session continues after the newest segment
+  record_session(100, std::chrono::steady_clock::now());
+  recordings = TelemetryRecording::read_all(DIRECTORY, "test");
+  check(recordings.size() == 2 && recordings[1].messages.size() == 200 &&
+            recordings[0].messages.size() < n_first_session,
+        "Second session");
+  // Corrupt the first frame of a (non-empty) segment - only this record is
+  // lost
+  for (int i = 0; i < 4; i++) {
+    std::fstream file(std::string(DIRECTORY) + "test_" + std::to_string(i) +
+                          ".rec",
+                      std::ios::binary | std::ios::in | std::ios::out);
+    openhd::telemetry::recording::SegmentHeader header{};
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (header.n_records == 0) continue;
+    file.seekp(openhd::telemetry::recording::SEGMENT_HEADER_SIZE +
+               sizeof(openhd::telemetry::recording::RecordHeader) + 12);
+    file.put(0x42);
+    break;
+  }
+  const auto corrupted = TelemetryRecording::read_all(DIRECTORY, "test");
+  check(corrupted.size() == 2, "Corrupted sessions");
+  check(corrupted[0].n_bad_records + corrupted[1].n_bad_records == 1 &&
+            corrupted[0].messages.size() + corrupted[1].messages.size() ==
+                recordings[0].messages.size() +
+                    recordings[1].messages.size() - 1,
+        "Corrupted record");
+}
+
+static void test_replay_timing() {
+  const auto recording = TelemetryRecording::read_all(DIRECTORY, "test")[0];
+  // Only the last 500ms, 10x faster
+  TelemetryRecording last;
+  last.link_names = recording.link_names;
+  last.messages.assign(recording.messages.end() - 1000,
+                       recording.messages.end());
+  TelemetryReplay::Options options{};
+  options.speed = 10;
+  options.link = LINK_FC;
+  options.direction = Direction::RX;
+  uint64_t n_received = 0;
+  const auto stats = TelemetryReplay::replay(
+      last, options,
+      [&n_received](int link, Direction direction,
+                    MavlinkMessageSpan messages) {
+        check(link == LINK_FC && direction == Direction::RX, "Filter");
+        n_received += messages.size();
+      });
+  std::cout << stats.to_string() << "\n";
+  check(n_received == 500 && stats.n_batches == 500, "Replayed messages");
+  check(stats.duration >= std::chrono::milliseconds(49) &&
+            stats.duration < std::chrono::milliseconds(200),
+        "Replay timing");
+}
+
+static void benchmark() {
+  OHDFilesystemUtil::safe_delete_directory(DIRECTORY);
+  {
+    auto config = create_config(16 * 1024 * 1024);
+    auto recorder = TelemetryRecorder::create(config);
+    check(recorder != nullptr, "Cannot create recorder");
+    std::vector<MavlinkMessage> batch;
+    for (uint32_t i = 0; i < 10; i++) {
+      batch.push_back(attitude(i));
+    }
+    const int n_batches = 20000;
+    const auto before = std::chrono::steady_clock::now();
+    for (int i = 0; i < n_batches; i++) {
+      recorder->record(LINK_FC, Direction::RX, batch);
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - before;
+    std::cout << "Recording: "
+              << std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed)
+                         .count() /
+                     (n_batches * batch.size())
+              << "ns per message, " << recorder->get_stats().to_string()
+              << "\n";
+  }
+  const auto recording = TelemetryRecording::read_all(DIRECTORY, "test")[0];
+  // Like AirTelemetry: FC messages are coalesced, then routed
+  MavlinkRoutingTable routing({"fc", "ground"});
+  MavlinkRateCoalescer coalescer;
+  coalescer.set_max_rates({{MAVLINK_MSG_ID_ATTITUDE, 10}});
+  std::vector<MavlinkMessage> storage;
+  uint64_t n_forwarded = 0;
+  TelemetryReplay::Options options{};
+  options.speed = 0;
+  const auto stats = TelemetryReplay::replay(
+      recording, options,
+      [&](int link, Direction, MavlinkMessageSpan messages) {
+        routing.learn(link, messages);
+        n_forwarded +=
+            routing.filter(coalescer.process(messages), link, LINK_GROUND,
+                           storage)
+                .size();
+      });
+  std::cout << "Routing / aggregation: " << stats.to_string() << ", "
+            << n_forwarded << " forwarded\n";
+}
+
+int main(int argc, char* argv[]) {
+  test_record_and_read();
+  test_replay_timing();
+  benchmark();
+  OHDFilesystemUtil::safe_delete_directory(DIRECTORY);
+  std::cout << "test_telemetry_recorder passed\n";
+  return 0;
+}
@@ -0,0 +1,226 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#include <deque>
+#include <iostream>
+
+#include "../src/endpoints/TelemetryTxScheduler.h"
+#include "../src/mav_helper.h"
+#include "openhd_spdlog.h"
+
+// Validates TelemetryTxScheduler (priority order, latest-value-wins,
+// deadlines) and compares the command latency against a single drop-on-
+// overflow FIFO (what the link did before) on a congested link, with a
+// simulated clock.
+
+using Clock = std::chrono::steady_clock;
+using Priority = TelemetryTxScheduler::Priority;
+
+static MavlinkMessage command_long() {
+  MavlinkMessage msg;
+  mavlink_msg_command_long_pack(255, 190, &msg.m, 1, 1, MAV_CMD_DO_SET_MODE, 0,
+                                0, 0, 0, 0, 0, 0, 0);
+  msg.recommended_n_injections = 4;
+  return msg;
+}
+
+static MavlinkMessage rc_override(uint16_t value) {
+  MavlinkMessage msg;
+  mavlink_msg_rc_channels_override_pack(255, 190, &msg.m, 1, 1, value, value,
+                                        value, value, value, value, value,
+                                        value, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+  return msg;
+}
+
+static MavlinkMessage bulk(int idx) {
+  MavlinkMessage msg;
+  mavlink_msg_named_value_float_pack(1, 1, &msg.m, idx, "BULK", (float)idx);
+  return msg;
+}
+
+static int count_msg_id(const std::vector<AggregatedMavlinkPacket>& packets,
+                        uint32_t msg_id) {
+  int ret = 0;
+  mavlink_message_t msg;
+  mavlink_status_t status{};
+  for (const auto& packet : packets) {
+    for (const auto byte : *packet.aggregated_data) {
+      if (mavlink_parse_char(MAVLINK_COMM_0, byte, &msg, &status) &&
+          msg.msgid == msg_id) {
+        ret++;
+      }
+    }
+  }
+  return ret;
+}
+
+static void test_priority_order() {
+  TelemetryTxScheduler scheduler;
+  std::vector<MavlinkMessage> messages;
+  for (int i = 0; i < 100; i++) messages.push_back(bulk(i));
+  scheduler.enqueue(messages);
+  const auto command = command_long();
+  scheduler.enqueue({&command, 1});
+  auto packets = scheduler.dequeue(1);
+  if (packets.size() != 1 ||
+      count_msg_id(packets, MAVLINK_MSG_ID_COMMAND_LONG) != 1 ||
+      packets[0].recommended_n_retransmissions != 4) {
+    throw std::runtime_error("Command not sent first");
+  }
+  // past the aggregation window
+  packets = scheduler.dequeue(100, Clock::now() + std::chrono::milliseconds(10));
+  if (count_msg_id(packets, MAVLINK_MSG_ID_NAMED_VALUE_FLOAT) != 100 ||
+      !scheduler.is_empty()) {
+    throw std::runtime_error("Bulk missing");
+  }
+}
+
+static void test_latest_value_wins_and_deadline() {
+  TelemetryTxScheduler scheduler;
+  const auto begin = Clock::now();
+  for (int i = 0; i < 10; i++) {
+    const auto rc = rc_override(1000 + i);
+    scheduler.enqueue({&rc, 1}, begin + std::chrono::milliseconds(i));
+  }
+  auto stats = scheduler.get_stats().classes[(int)Priority::RC_OVERRIDE];
+  if (stats.queue_depth != 1 || stats.n_replaced != 9) {
+    throw std::runtime_error("RC override not replaced");
+  }
+  auto packets = scheduler.dequeue(1, begin + std::chrono::milliseconds(20));
+  if (count_msg_id(packets, MAVLINK_MSG_ID_RC_CHANNELS_OVERRIDE) != 1) {
+    throw std::runtime_error("RC override missing");
+  }
+  // Stale
+  const auto stale_rc = rc_override(1500);
+  scheduler.enqueue({&stale_rc, 1}, begin);
+  packets = scheduler.dequeue(1, begin + std::chrono::seconds(1));
+  stats = scheduler.get_stats().classes[(int)Priority::RC_OVERRIDE];
+  if (!packets.empty() || stats.n_dropped_stale != 1 || stats.n_sent != 1) {
+    throw std::runtime_error("Stale RC override not dropped");
+  }
+}
+
+static void test_aggregation_window() {
+  TelemetryTxScheduler scheduler;
+  scheduler.set_aggregation_window(std::chrono::milliseconds(5));
+  const auto begin = Clock::now();
+  const auto bulk_msg = bulk(0);
+  scheduler.enqueue({&bulk_msg, 1}, begin);
+  if (!scheduler.dequeue(1, begin + std::chrono::milliseconds(1)).empty() ||
+      scheduler.get_next_aggregation_flush() !=
+          begin + std::chrono::milliseconds(5)) {
+    throw std::runtime_error("Not held back");
+  }
+  // High priority is not held back, and does not flush the bulk
+  const auto command = command_long();
+  scheduler.enqueue({&command, 1}, begin + std::chrono::milliseconds(2));
+  auto packets = scheduler.dequeue(2, begin + std::chrono::milliseconds(2));
+  if (packets.size() != 1 ||
+      count_msg_id(packets, MAVLINK_MSG_ID_COMMAND_LONG) != 1) {
+    throw std::runtime_error("Command held back");
+  }
+  // Window expired
+  packets = scheduler.dequeue(2, begin + std::chrono::milliseconds(5));
+  if (count_msg_id(packets, MAVLINK_MSG_ID_NAMED_VALUE_FLOAT) != 1) {
+    throw std::runtime_error("Bulk not sent after window");
+  }
+  // A full packet is sent right away, the rest is held back
+  std::vector<MavlinkMessage> messages;
+  for (int i = 0; i < 50; i++) messages.push_back(bulk(i));
+  const auto now = begin + std::chrono::milliseconds(10);
+  scheduler.enqueue(messages, now);
+  packets = scheduler.dequeue(10, now);
+  if (packets.size() != 1 || packets[0].aggregated_data->size() < 900) {
+    throw std::runtime_error("Full packet not sent");
+  }
+  if (scheduler.is_empty()) {
+    throw std::runtime_error("Rest not held back");
+  }
+  const auto stats = scheduler.get_stats();
+  std::cout << fmt::format("Aggregation: {} packets, avg fill {}%\n",
+                           stats.n_packets, stats.avg_fill_perc);
+}
+
+// The link sends one packet every 10ms (contention with video), while bulk
+// telemetry is produced at twice that rate. A command is sent every 100ms.
+static void compare_command_latency() {
+  const auto link_interval = std::chrono::milliseconds(10);
+  const int fifo_size = 16;  // link telemetry tx queue size (ground)
+  TelemetryTxScheduler scheduler;
+  // Same as before: aggregated, then FIFO that drops on overflow
+  struct FifoEntry {
+    bool has_command;
+    Clock::time_point command_enqueue_time;
+  };
+  std::deque<FifoEntry> fifo;
+  int64_t fifo_n_commands_sent = 0, fifo_n_commands_dropped = 0;
+  std::chrono::nanoseconds fifo_latency_total{0};
+  int link_queue_depth = 0;  // scheduler only
+  const auto begin = Clock::now();
+  for (int ms = 0; ms < 10 * 1000; ms++) {
+    const auto now = begin + std::chrono::milliseconds(ms);
+    if (ms % 5 == 0) {
+      std::vector<MavlinkMessage> batch;
+      for (int i = 0; i < 10; i++) batch.push_back(bulk(i));
+      scheduler.enqueue(batch, now);
+      if ((int)fifo.size() >= fifo_size) {
+        if (fifo.front().has_command) fifo_n_commands_dropped++;
+        fifo.pop_front();
+      }
+      fifo.push_back({false, now});
+    }
+    if (ms % 100 == 0) {
+      const auto command = command_long();
+      scheduler.enqueue({&command, 1}, now);
+      if ((int)fifo.size() >= fifo_size) {
+        if (fifo.front().has_command) fifo_n_commands_dropped++;
+        fifo.pop_front();
+      }
+      fifo.push_back({true, now});
+    }
+    // Keep the link queue shallow (same as WBEndpoint)
+    if (link_queue_depth < 2) {
+      link_queue_depth += (int)scheduler.dequeue(2 - link_queue_depth, now)
+                              .size();
+    }
+    if (ms % link_interval.count() == 0) {
+      if (link_queue_depth > 0) link_queue_depth--;
+      if (!fifo.empty()) {
+        if (fifo.front().has_command) {
+          fifo_n_commands_sent++;
+          fifo_latency_total += now - fifo.front().command_enqueue_time;
+        }
+        fifo.pop_front();
+      }
+    }
+  }
+  const auto stats = scheduler.get_stats();
+  const auto& cmd_stats = stats.classes[(int)Priority::COMMAND];
+  const auto to_ms = [](std::chrono::nanoseconds t) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(t).count();
+  };
+  std::cout << fmt::format(
+      "FIFO: {} commands sent, {} dropped, avg latency {}ms (+ link queue)\n",
+      fifo_n_commands_sent, fifo_n_commands_dropped,
+      fifo_n_commands_sent > 0 ? to_ms(fifo_latency_total / fifo_n_commands_sent)
+                               : 0);
+  std::cout << fmt::format(
+      "Scheduler: {} commands sent, {} dropped, avg latency {}ms max {}ms (+ "
+      "link queue of max 2)\n",
+      cmd_stats.n_sent, cmd_stats.n_dropped_stale + cmd_stats.n_dropped_overflow,
+      to_ms(cmd_stats.sojourn_time_avg()), to_ms(cmd_stats.sojourn_time_max));
+  std::cout << TelemetryTxScheduler::stats_as_string(stats) << "\n";
+  if (cmd_stats.n_sent != 100 || cmd_stats.sojourn_time_max > link_interval) {
+    throw std::runtime_error("Commands delayed by bulk telemetry");
+  }
+}
+
+int main(int argc, char* argv[]) {
+  test_priority_order();
+  test_latest_value_wins_and_deadline();
+  test_aggregation_window();
+  compare_command_latency();
+  std::cout << "test_tx_scheduler passed\n";
+  return 0;
+}
@@ -18,8 +18,10 @@
 
 int main() {
   std::cout << "UdpEndpointTest::start" << std::endl;
-  UDPEndpoint udpEndpoint("UdpEndpoint", OHD_GROUND_CLIENT_UDP_PORT_OUT, OHD_GROUND_CLIENT_UDP_PORT_IN);
-  auto cb=[](const std::vector<MavlinkMessage> messages){
+  auto event_loop=std::make_shared<openhd::EventLoop>("udp_test_loop");
+  event_loop->start();
+  UDPEndpoint udpEndpoint("UdpEndpoint", OHD_GROUND_CLIENT_UDP_PORT_OUT, OHD_GROUND_CLIENT_UDP_PORT_IN,event_loop);
+  auto cb=[](MavlinkMessageSpan messages){
     for(const auto& msg:messages){
       debugMavlinkMessage(msg.m, "Udp");
     }
@@ -30,11 +32,11 @@ int main() {
   while ((std::chrono::steady_clock::now() - start) < std::chrono::minutes(5)) {
         openhd::log::get_default()->debug("Alive:{}",OHDUtil::yes_or_no(udpEndpoint.isAlive()));
 	auto heartbeat = MExampleMessage::heartbeat();
-	udpEndpoint.sendMessages({heartbeat});
+	udpEndpoint.sendMessages({&heartbeat, 1});
 	auto position = MExampleMessage::position();
-	udpEndpoint.sendMessages({position});
+	udpEndpoint.sendMessages({&position, 1});
 	auto attitude = MExampleMessage::attitude();
-	udpEndpoint.sendMessages({attitude});
+	udpEndpoint.sendMessages({&attitude, 1});
 	std::this_thread::sleep_for(std::chrono::seconds(1));
   }
   std::cout << "UdpEndpointTest::end" << std::endl;
@@ -0,0 +1,201 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#include <getopt.h>
+
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <sstream>
+
+#include "../src/endpoints/TCPEndpoint.h"
+#include "../src/endpoints/UDPEndpoint.h"
+#include "../src/recorder/TelemetryRecorder.h"
+#include "../src/recorder/TelemetryRecording.h"
+#include "../src/recorder/TelemetryReplay.h"
+#include "../src/routing/MavlinkRateCoalescer.h"
+#include "../src/routing/MavlinkRoutingTable.h"
+#include "openhd_event_loop.h"
+
+// Replays a recording of the telemetry flight recorder
+// (GEN_ENABLE_TELEMETRY_RECORDER), for example:
+// Show what has been recorded on the ground unit:
+//   telemetry_replay --name ground --info
+// Replay what the ground unit received from the air unit to QGroundControl
+// (udp localhost:14550), 2x faster:
+//   telemetry_replay --name ground --link air --speed 2
+// Benchmark the routing / aggregation code with the recorded traffic:
+//   telemetry_replay --name air --output bench
+
+static const char optstr[] = "?d:n:s:x:l:r:o:i";
+static const struct option long_options[] = {
+    {"directory", required_argument, nullptr, 'd'},
+    {"name", required_argument, nullptr, 'n'},
+    {"session", required_argument, nullptr, 's'},
+    {"speed", required_argument, nullptr, 'x'},
+    {"link", required_argument, nullptr, 'l'},
+    {"direction", required_argument, nullptr, 'r'},
+    {"output", required_argument, nullptr, 'o'},
+    {"info", no_argument, nullptr, 'i'},
+    {nullptr, 0, nullptr, 0},
+};
+
+struct ReplayOptions {
+  std::string directory = TelemetryRecorder::DEFAULT_DIRECTORY;
+  std::string name = "ground";
+  // -1: latest
+  int session = -1;
+  double speed = 1.0;
+  std::string link;
+  std::string direction = "rx";
+  std::string output = "udp";
+  bool info_only = false;
+};
+
+static ReplayOptions parse_args(int argc, char* argv[]) {
+  ReplayOptions ret{};
+  int c;
+  while ((c = getopt_long(argc, argv, optstr, long_options, NULL)) != -1) {
+    const char* tmp_optarg = optarg;
+    switch (c) {
+      case 'd':
+        ret.directory = tmp_optarg;
+        break;
+      case 'n':
+        ret.name = tmp_optarg;
+        break;
+      case 's':
+        ret.session = std::atoi(tmp_optarg);
+        break;
+      case 'x':
+        ret.speed = std::atof(tmp_optarg);
+        break;
+      case 'l':
+        ret.link = tmp_optarg;
+        break;
+      case 'r':
+        ret.direction = tmp_optarg;
+        break;
+      case 'o':
+        ret.output = tmp_optarg;
+        break;
+      case 'i':
+        ret.info_only = true;
+        break;
+      case '?':
+      default: {
+        std::stringstream ss;
+        ss << "Usage: \n";
+        ss << "--directory -d [recordings directory, default: "
+           << TelemetryRecorder::DEFAULT_DIRECTORY << "]\n";
+        ss << "--name -n      [air or ground, default: ground]\n";
+        ss << "--session -s   [index of the session, default: latest]\n";
+        ss << "--speed -x     [1: original timing, 0: as fast as possible, "
+              "default: 1]\n";
+        ss << "--link -l      [only messages of this link, e.g. fc, air, "
+              "gcs_udp, default: all]\n";
+        ss << "--direction -r [rx, tx or all, default: rx]\n";
+        ss << "--output -o    [udp (localhost:14550), tcp (server on "
+           << TCPEndpoint::DEFAULT_PORT << ") or bench, default: udp]\n";
+        ss << "--info -i      [only print the recorded sessions]\n";
+        std::cout << ss.str() << std::flush;
+        exit(1);
+      }
+    }
+  }
+  return ret;
+}
+
+// Replays into the routing table and rate coalescer like the air unit would
+// do with messages from the FC, as fast as possible.
+static void benchmark(const TelemetryRecording& recording,
+                      const TelemetryReplay::Options& options) {
+  MavlinkRoutingTable routing(recording.link_names);
+  MavlinkRateCoalescer coalescer;
+  coalescer.set_max_rates({{MAVLINK_MSG_ID_ATTITUDE, 10},
+                           {MAVLINK_MSG_ID_GLOBAL_POSITION_INT, 5}});
+  std::vector<MavlinkMessage> storage;
+  uint64_t n_out = 0;
+  const auto stats = TelemetryReplay::replay(
+      recording, options,
+      [&](int link, TelemetryReplay::Direction, MavlinkMessageSpan messages) {
+        routing.learn(link, messages);
+        const auto coalesced = coalescer.process(messages);
+        for (int dst = 0; dst < openhd::telemetry::recording::MAX_N_LINKS;
+             dst++) {
+          if (recording.link_names[dst].empty()) continue;
+          n_out += routing.filter(coalesced, link, dst, storage).size();
+        }
+      });
+  std::cout << stats.to_string() << "\n";
+  std::cout << "Forwarded " << n_out << " messages, "
+            << MavlinkRateCoalescer::stats_as_string(coalescer.get_stats())
+            << "\n"
+            << routing.to_string() << "\n";
+}
+
+int main(int argc, char* argv[]) {
+  const auto replay_options = parse_args(argc, argv);
+  const auto recordings = TelemetryRecording::read_all(
+      replay_options.directory, replay_options.name);
+  if (recordings.empty()) {
+    std::cerr << "No recordings of " << replay_options.name << " in "
+              << replay_options.directory << "\n";
+    return 1;
+  }
+  for (size_t i = 0; i < recordings.size(); i++) {
+    std::cout << i << ": " << recordings[i].to_string() << "\n";
+  }
+  if (replay_options.info_only) return 0;
+  const int session = replay_options.session < 0
+                          ? (int)recordings.size() - 1
+                          : replay_options.session;
+  if (session >= (int)recordings.size()) {
+    std::cerr << "No session " << session << "\n";
+    return 1;
+  }
+  const auto& recording = recordings[session];
+  TelemetryReplay::Options options{};
+  options.speed = replay_options.speed;
+  if (!replay_options.link.empty()) {
+    options.link = recording.get_link(replay_options.link);
+    if (options.link < 0) {
+      std::cerr << "No link " << replay_options.link << "\n";
+      return 1;
+    }
+  }
+  if (replay_options.direction == "rx") {
+    options.direction = TelemetryReplay::Direction::RX;
+  } else if (replay_options.direction == "tx") {
+    options.direction = TelemetryReplay::Direction::TX;
+  }
+  if (replay_options.output == "bench") {
+    options.speed = 0;
+    benchmark(recording, options);
+    return 0;
+  }
+  auto event_loop = std::make_shared<openhd::EventLoop>("replay_loop");
+  event_loop->start();
+  std::unique_ptr<MEndpoint> endpoint;
+  if (replay_options.output == "tcp") {
+    endpoint = std::make_unique<TCPEndpoint>(
+        openhd::TCPServer::Config{TCPEndpoint::DEFAULT_PORT}, event_loop);
+  } else {
+    endpoint = std::make_unique<UDPEndpoint>(
+        "Replay", OHD_GROUND_CLIENT_UDP_PORT_OUT, OHD_GROUND_CLIENT_UDP_PORT_IN,
+        event_loop);
+  }
+  std::cout << "Replaying session " << session << " to "
+            << replay_options.output << "\n";
+  const auto stats = TelemetryReplay::replay(
+      recording, options,
+      [&endpoint](int, TelemetryReplay::Direction,
+                  MavlinkMessageSpan messages) {
+        endpoint->sendMessages(messages);
+      });
+  std::cout << stats.to_string() << "\n";
+  endpoint = nullptr;
+  event_loop->stop();
+  return 0;
+}
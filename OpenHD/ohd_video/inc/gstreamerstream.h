@@ -1,9 +1,11 @@
 #ifndef GSTREAMERSTREAM_H
 #define GSTREAMERSTREAM_H
 
+#include <gst/app/gstappsink.h>
 #include <gst/gst.h>
 
 #include <array>
+#include <condition_variable>
 #include <memory>
 #include <mutex>
 #include <thread>
@@ -52,6 +54,10 @@ class GStreamerStream : public CameraStream {
   // To reduce the time on the param callback(s) - they need to return
   // immediately to not block the param server
   void request_restart();
+  // Commands (bitrate change, restart, terminate) wake up the gst thread
+  // immediately instead of waiting for the next pull timeout
+  void notify_command();
+  void wait_for_command(std::chrono::milliseconds timeout);
 
  private:
   // points to a running gst pipeline instance
@@ -73,14 +79,37 @@ class GStreamerStream : public CameraStream {
   std::atomic_bool m_request_restart = false;
   std::atomic_bool m_keep_looping = false;
   std::unique_ptr<std::thread> m_loop_thread = nullptr;
+  std::mutex m_command_mutex;
+  std::condition_variable m_command_cv;
+  bool m_command_pending = false;
+  // If enabled, samples are processed on the gst streaming thread as soon as
+  // they arrive (appsink new-sample callback) and the loop thread only handles
+  // commands. Otherwise, the loop thread polls the appsink with a timeout of
+  // 40ms and checks for commands in between (adds latency / jitter).
+  const bool m_use_appsink_callbacks = true;
+  // For 'bugged camera restart' fix
+  std::atomic<int> m_last_camera_frame_ms = 0;
+  // As soon as we get the first frame, we change the status to streaming
+  std::atomic_bool m_has_first_frame = false;
 
  private:
   // The stuff here is to pull the data out of the gstreamer pipeline, such that
   // we can forward it to the WB link
+  static GstFlowReturn on_appsink_new_sample(GstAppSink* appsink,
+                                             gpointer user_data);
+  // Takes ownership of the sample
+  void on_new_sample(GstSample* sample);
+  // Latency tracing, see openhd_latency_trace.h
+  void trace_capture_to_appsink(GstBuffer* buffer);
+  std::chrono::steady_clock::time_point m_frame_first_fragment_time =
+      std::chrono::steady_clock::now();
   void on_new_rtp_frame_fragment(std::shared_ptr<std::vector<uint8_t>> fragment,
                                  uint64_t dts);
   void on_new_rtp_fragmented_frame();
   std::vector<std::shared_ptr<std::vector<uint8_t>>> m_frame_fragments;
+  // Used to reserve the fragments vector for the next frame (avoids
+  // re-allocations while a frame is assembled)
+  size_t m_last_frame_n_fragments = 64;
   bool m_last_fu_s_idr = false;
   bool dirty_use_raw = false;
   void on_gst_nalu_buffer(const uint8_t* data, int data_len);
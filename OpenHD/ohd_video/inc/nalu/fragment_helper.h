@@ -7,12 +7,17 @@
 
 #include <unistd.h>
 
+#include "openhd_buffer_pool.h"
+
 static std::vector<std::shared_ptr<std::vector<uint8_t>>> make_fragments(
     const uint8_t* data, int data_len) {
   std::vector<std::shared_ptr<std::vector<uint8_t>>> fragments;
+  fragments.reserve(data_len / 1024 + 1);
   int bytes_used = 0;
   const uint8_t* p = data;
   static constexpr auto MAX_FRAGMENT_SIZE = 1024;
+  static_assert(MAX_FRAGMENT_SIZE <=
+                openhd::FragmentBufferPool::BUFFER_CAPACITY);
   while (true) {
     const int remaining = (int)data_len - bytes_used;
     int len = 0;
@@ -21,9 +26,8 @@ static std::vector<std::shared_ptr<std::vector<uint8_t>>> make_fragments(
     } else {
       len = remaining;
     }
-    std::shared_ptr<std::vector<uint8_t>> fragment =
-        std::make_shared<std::vector<uint8_t>>(p, p + len);
-    fragments.emplace_back(fragment);
+    fragments.emplace_back(
+        openhd::FragmentBufferPool::instance().acquire(p, len));
     p = p + len;
     bytes_used += len;
     if (bytes_used == data_len) {
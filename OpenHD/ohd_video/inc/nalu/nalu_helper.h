@@ -7,6 +7,21 @@
 
 #include <unistd.h>
 
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+// Byte-at-a-time search for the next annex-b start code (ignoring a start code
+// at the very beginning of data). Returns the offset of the next start code,
+// data_len if there is none. Prefer find_nal_start_codes() below when
+// splitting a whole buffer.
 static int find_next_nal(const uint8_t* data, int data_len) {
   int nalu_search_state = 0;
   for (int i = 0; i < data_len; i++) {
@@ -40,6 +55,88 @@ static int find_next_nal(const uint8_t* data, int data_len) {
   return data_len;
 }
 
+namespace openhd::nalu {
+
+// Append the start code 0,0,1 at position i (the 4-byte variant 0,0,0,1 is
+// reported at the position of its first zero).
+static inline void add_start_code(const uint8_t* data, int i,
+                                  std::vector<int>& out) {
+  const int begin = (i > 0 && data[i - 1] == 0) ? i - 1 : i;
+  // A start code at the very beginning is not a boundary
+  if (begin > 0) out.push_back(begin);
+}
+
+static void find_nal_start_codes_scalar(const uint8_t* data, int data_len,
+                                        int start, std::vector<int>& out) {
+  for (int i = start; i + 2 < data_len; i++) {
+    if (data[i + 2] > 1) {
+      // Neither of the 3 bytes ending at i+2 can be the '1' - skip ahead
+      i += 2;
+      continue;
+    }
+    if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1) {
+      add_start_code(data, i, out);
+      i += 2;
+    }
+  }
+}
+
+/**
+ * Single pass over an annex-b buffer, returns the offsets of all NAL
+ * boundaries (position of the first byte of each start code, the 4-byte start
+ * code 0,0,0,1 included). A start code at offset 0 is not a boundary.
+ * The NAL units are therefore [0,b0), [b0,b1), ... [bn,data_len).
+ * Uses SSE2 / NEON to check 16 positions at once, scalar fallback otherwise.
+ */
+static std::vector<int> find_nal_start_codes(const uint8_t* data,
+                                             int data_len) {
+  std::vector<int> ret;
+  int i = 0;
+#if defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i one = _mm_set1_epi8(1);
+  for (; i + 16 + 2 <= data_len; i += 16) {
+    const __m128i b0 = _mm_loadu_si128((const __m128i*)(data + i));
+    const __m128i b1 = _mm_loadu_si128((const __m128i*)(data + i + 1));
+    const __m128i b2 = _mm_loadu_si128((const __m128i*)(data + i + 2));
+    const __m128i match =
+        _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(b0, zero),
+                                    _mm_cmpeq_epi8(b1, zero)),
+                      _mm_cmpeq_epi8(b2, one));
+    auto mask = static_cast<uint32_t>(_mm_movemask_epi8(match));
+    while (mask) {
+      const int bit = __builtin_ctz(mask);
+      add_start_code(data, i + bit, ret);
+      mask &= mask - 1;
+    }
+  }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+  const uint8x16_t zero = vdupq_n_u8(0);
+  const uint8x16_t one = vdupq_n_u8(1);
+  for (; i + 16 + 2 <= data_len; i += 16) {
+    const uint8x16_t b0 = vld1q_u8(data + i);
+    const uint8x16_t b1 = vld1q_u8(data + i + 1);
+    const uint8x16_t b2 = vld1q_u8(data + i + 2);
+    const uint8x16_t match = vandq_u8(
+        vandq_u8(vceqq_u8(b0, zero), vceqq_u8(b1, zero)), vceqq_u8(b2, one));
+    const uint64x2_t match64 = vreinterpretq_u64_u8(match);
+    // Start codes are rare, only look at the individual lanes on a hit
+    if ((vgetq_lane_u64(match64, 0) | vgetq_lane_u64(match64, 1)) == 0) {
+      continue;
+    }
+    for (int j = 0; j < 16; j++) {
+      if (data[i + j] == 0 && data[i + j + 1] == 0 && data[i + j + 2] == 1) {
+        add_start_code(data, i + j, ret);
+      }
+    }
+  }
+#endif
+  find_nal_start_codes_scalar(data, data_len, i, ret);
+  return ret;
+}
+
+}  // namespace openhd::nalu
+
 static std::array<uint8_t, 6> EXAMPLE_AUD = {0, 0, 0, 1, 9, 48};
 static std::shared_ptr<std::vector<uint8_t>> get_h264_aud() {
   return std::make_shared<std::vector<uint8_t>>(
@@ -5,6 +5,10 @@
 #ifndef OPENHD_OPENHD_OHD_VIDEO_INC_OHD_VIDEO_GROUND_H_
 #define OPENHD_OPENHD_OHD_VIDEO_INC_OHD_VIDEO_GROUND_H_
 
+#include <array>
+#include <chrono>
+#include <vector>
+
 #include "openhd_external_device.h"
 #include "openhd_link.hpp"
 #include "openhd_udp.h"
@@ -43,6 +47,21 @@ class OHDVideoGround {
    * @param data and @param data_len: r.n always a full rtp frame fragment
    */
   void on_video_data(int stream_index, const uint8_t* data, int data_len);
+  // Called by the ohd link handle once a FEC block is done - flushes what is
+  // left of the batch (e.g. if the last fragment of a frame was lost)
+  void on_video_block_done(int stream_index);
+  // Batched egress only: send the batched fragments of this stream (one
+  // sendmmsg() per destination)
+  void flush(int stream_index);
+  // Batch the fragments of a frame instead of one sendto() per fragment per
+  // destination. Opt-in (NW_BATCH_VIDEO_UDP_EGRESS).
+  const bool m_batch_udp_egress;
+  // Flush after this many fragments even if the frame is not complete yet,
+  // bounds the latency added to large frames
+  static constexpr int MAX_N_BATCHED_FRAGMENTS = 8;
+  // Per stream, when each batched fragment was received (for the trace)
+  std::array<std::vector<std::chrono::steady_clock::time_point>, 2>
+      m_batched_since;
 
  private:
   void start_stop_forwarding_external_device(
@@ -7,20 +7,25 @@
 
 #include <gst/gst.h>
 
+#include "openhd_buffer_pool.h"
 #include "openhd_spdlog.h"
 
 namespace openhd {
 
+// The wb tx queue takes ownership of the fragment data, so we need exactly one
+// copy out of the gst buffer. The data is copied directly from the mapped range
+// into a (pooled) buffer - no zero-initialization followed by memcpy and
+// (once the pool is warmed up) no heap allocation per fragment.
 static std::shared_ptr<std::vector<uint8_t>> gst_copy_buffer(
     GstBuffer* buffer) {
   assert(buffer);
-  const auto buff_size = gst_buffer_get_size(buffer);
-  // openhd::log::get_default()->debug("Got buffer size {}", buff_size);
-  auto ret = std::make_shared<std::vector<uint8_t>>(buff_size);
   GstMapInfo map;
-  gst_buffer_map(buffer, &map, GST_MAP_READ);
-  assert(map.size == buff_size);
-  std::memcpy(ret->data(), map.data, buff_size);
+  if (!gst_buffer_map(buffer, &map, GST_MAP_READ)) {
+    openhd::log::get_default()->warn("Cannot map gst buffer");
+    return nullptr;
+  }
+  // openhd::log::get_default()->debug("Got buffer size {}", map.size);
+  auto ret = FragmentBufferPool::instance().acquire(map.data, map.size);
   gst_buffer_unmap(buffer, &map);
   return ret;
 }
@@ -1,5 +1,6 @@
 #include "gstreamerstream.h"
 
+#include <gst/app/gstappsink.h>
 #include <gst/gst.h>
 
 #include <iostream>
@@ -14,6 +15,7 @@
 #include "nalu/CodecConfigFinder.hpp"
 #include "nalu/fragment_helper.h"
 #include "nalu/nalu_helper.h"
+#include "openhd_latency_trace.h"
 #include "openhd_util.h"
 #include "rtp_eof_helper.h"
 #include "x20_image_quality_helper.h"
@@ -59,6 +61,7 @@ void GStreamerStream::start_looping() {
 
 void GStreamerStream::terminate_looping() {
   m_keep_looping = false;
+  notify_command();
   if (m_loop_thread) {
     m_console->debug("Wating for loop thread to terminate");
     m_loop_thread->join();
@@ -206,6 +209,14 @@ void GStreamerStream::setup() {
   m_app_sink_element =
       gst_bin_get_by_name(GST_BIN(m_gst_pipeline), "out_appsink");
   assert(m_app_sink_element);
+  if (m_use_appsink_callbacks) {
+    // Frame assembly runs on the gst streaming thread as soon as a sample
+    // arrives, the loop thread only reacts to commands (bitrate, restart)
+    GstAppSinkCallbacks callbacks{};
+    callbacks.new_sample = GStreamerStream::on_appsink_new_sample;
+    gst_app_sink_set_callbacks(GST_APP_SINK(m_app_sink_element), &callbacks,
+                               this, nullptr);
+  }
   // m_console->debug("Cam encoding format: {}",(int)cam_info.encoding_format);
 }
 
@@ -275,7 +286,24 @@ void GStreamerStream::cleanup_pipe() {
   m_console->debug("GStreamerStream::cleanup_pipe() end");
 }
 
-void GStreamerStream::request_restart() { m_request_restart = true; }
+void GStreamerStream::request_restart() {
+  m_request_restart = true;
+  notify_command();
+}
+
+void GStreamerStream::notify_command() {
+  {
+    std::lock_guard<std::mutex> lock(m_command_mutex);
+    m_command_pending = true;
+  }
+  m_command_cv.notify_one();
+}
+
+void GStreamerStream::wait_for_command(std::chrono::milliseconds timeout) {
+  std::unique_lock<std::mutex> lock(m_command_mutex);
+  m_command_cv.wait_for(lock, timeout, [this] { return m_command_pending; });
+  m_command_pending = false;
+}
 
 void GStreamerStream::handle_change_bitrate_request(
     openhd::LinkActionHandler::LinkBitrateInformation lb) {
@@ -292,16 +320,20 @@ void GStreamerStream::handle_change_bitrate_request(
     // kbits_per_second_to_string(MIN_BITRATE_KBITS));
     bitrate_for_encoder_kbits = MIN_BITRATE_KBITS;
   }
-  // The gst thread is responsible for changing the bitrate - it will be applied
-  // (as long as the cam is not bugged or the OS is overloaded) after a max
-  // delay of 40ms
-  m_curr_dynamic_bitrate_kbits = bitrate_for_encoder_kbits;
+  // The gst thread is responsible for changing the bitrate - it is woken up
+  // and applies it immediately (as long as the cam is not bugged or the OS is
+  // overloaded)
+  const int prev_bitrate_kbits =
+      m_curr_dynamic_bitrate_kbits.exchange(bitrate_for_encoder_kbits);
   if (m_camera_holder->get_settings().h26x_bitrate_kbits !=
       bitrate_for_encoder_kbits) {
     m_camera_holder->unsafe_get_settings().h26x_bitrate_kbits =
         bitrate_for_encoder_kbits;
     m_camera_holder->persist(false);
   }
+  // The link recommends the same bitrate over and over again - only wake up
+  // the gst thread on an actual change
+  if (prev_bitrate_kbits != bitrate_for_encoder_kbits) notify_command();
 }
 
 void GStreamerStream::handle_update_arming_state(bool armed) {
@@ -347,6 +379,11 @@ void GStreamerStream::stream_once() {
   // First, we (try) starting the pipeline using the current settings
   openhd::LinkActionHandler::instance().set_cam_info_status(
       m_camera_holder->get_camera().index, CAM_STATUS_RESTARTING);
+  // Reset the frame assembly state before any sample can arrive
+  m_frame_fragments.clear();
+  m_frame_fragments.reserve(m_last_frame_n_fragments);
+  m_has_first_frame = false;
+  m_last_camera_frame_ms = OHDUtil::steady_clock_time_epoch_ms();
   setup();
   start();
   // Check if we were able to successfully start the pipeline. If - for example
@@ -382,27 +419,20 @@ void GStreamerStream::stream_once() {
   int currently_applied_bitrate =
       m_camera_holder->get_settings().h26x_bitrate_kbits;
   m_curr_dynamic_bitrate_kbits = currently_applied_bitrate;
-  // Now we should have a running pipeline and are able to pull samples from it
-  // We use a timeout of 40ms to not unnecessarily wake up the thread on up to
-  // 30fps (33ms) but also quickly respond to restart requests or bitrate
-  // change(s)
+  // Polling mode only: We use a timeout of 40ms to not unnecessarily wake up
+  // the thread on up to 30fps (33ms) but also quickly respond to restart
+  // requests or bitrate change(s)
   const uint64_t timeout_ns =
       std::chrono::duration_cast<std::chrono::nanoseconds>(
           std::chrono::milliseconds(40))
           .count();
-  // For 'bugged camera restart' fix
-  std::chrono::steady_clock::time_point m_last_camera_frame =
-      std::chrono::steady_clock::now();
-  m_frame_fragments.resize(0);
-  // As soon as we get the first frame, we change the status to streaming
-  bool has_first_frame = false;
   while (true) {
     // Quickly terminate if openhd wants to terminate
     if (!m_keep_looping) break;
     // ANNOYING BUGGED CAMERAS FIX - we restart the pipeline if we don't get a
     // frame from the camera for more than X seconds
-    if (std::chrono::steady_clock::now() - m_last_camera_frame >
-        std::chrono::seconds(5)) {
+    if (OHDUtil::steady_clock_time_epoch_ms() - m_last_camera_frame_ms >
+        5 * 1000) {
       m_console->warn("Restarting camera due to no frame after 5 seconds");
       m_request_restart = true;
     }
@@ -443,36 +473,16 @@ void GStreamerStream::stream_once() {
       m_console->debug("Restart requested, restarting");
       break;
     }
-    // try get a new frame fragment from gst
-    GstSample* sample = gst_app_sink_try_pull_sample(
-        GST_APP_SINK(m_app_sink_element), timeout_ns);
-    if (sample) {
-      if (!has_first_frame) {
-        has_first_frame = true;
-        openhd::LinkActionHandler::instance().set_cam_info_status(
-            m_camera_holder->get_camera().index, CAM_STATUS_STREAMING);
-      }
-      GstBuffer* buffer = gst_sample_get_buffer(sample);
-      // tmp declaration for give sample back early optimization
-      std::shared_ptr<std::vector<uint8_t>> fragment_data = nullptr;
-      uint64_t buffer_dts = 0;
-      if (buffer && gst_buffer_get_size(buffer) > 0) {
-        fragment_data = openhd::gst_copy_buffer(buffer);
-        buffer_dts = buffer->dts;
-      }
-      // Optimization: Give the buffer back to gstreamer as soon as possible.
-      // After copying the data from the sample, unref it first, then forward
-      // the data via cb
-      gst_sample_unref(sample);
-      sample = nullptr;
-      if (fragment_data && !fragment_data->empty()) {
-        // If we got a new sample, aggregate then forward
-        if (dirty_use_raw) {
-          on_gst_nalu_buffer(fragment_data->data(), fragment_data->size());
-        } else {
-          on_new_rtp_frame_fragment(std::move(fragment_data), buffer_dts);
-        }
-        m_last_camera_frame = std::chrono::steady_clock::now();
+    if (m_use_appsink_callbacks) {
+      // Samples are handled by the appsink callback, wait until we get a
+      // command (or time out to check the camera watchdog)
+      wait_for_command(std::chrono::milliseconds(100));
+    } else {
+      // try get a new frame fragment from gst
+      GstSample* sample = gst_app_sink_try_pull_sample(
+          GST_APP_SINK(m_app_sink_element), timeout_ns);
+      if (sample) {
+        on_new_sample(sample);
       }
     }
   }
@@ -486,9 +496,70 @@ void GStreamerStream::stream_once() {
                        .count());
 }
 
+GstFlowReturn GStreamerStream::on_appsink_new_sample(GstAppSink* appsink,
+                                                     gpointer user_data) {
+  auto* self = static_cast<GStreamerStream*>(user_data);
+  // A sample is available, this doesn't block
+  GstSample* sample = gst_app_sink_pull_sample(appsink);
+  if (sample) {
+    self->on_new_sample(sample);
+  }
+  return GST_FLOW_OK;
+}
+
+void GStreamerStream::on_new_sample(GstSample* sample) {
+  if (!m_has_first_frame) {
+    m_has_first_frame = true;
+    openhd::LinkActionHandler::instance().set_cam_info_status(
+        m_camera_holder->get_camera().index, CAM_STATUS_STREAMING);
+  }
+  GstBuffer* buffer = gst_sample_get_buffer(sample);
+  if (buffer && m_frame_fragments.empty()) {
+    // First fragment of a new frame
+    m_frame_first_fragment_time = std::chrono::steady_clock::now();
+    trace_capture_to_appsink(buffer);
+  }
+  // tmp declaration for give sample back early optimization
+  std::shared_ptr<std::vector<uint8_t>> fragment_data = nullptr;
+  uint64_t buffer_dts = 0;
+  if (buffer && gst_buffer_get_size(buffer) > 0) {
+    fragment_data = openhd::gst_copy_buffer(buffer);
+    buffer_dts = buffer->dts;
+  }
+  // Optimization: Give the buffer back to gstreamer as soon as possible.
+  // After copying the data from the sample, unref it first, then forward
+  // the data via cb
+  gst_sample_unref(sample);
+  if (fragment_data && !fragment_data->empty()) {
+    // If we got a new sample, aggregate then forward
+    if (dirty_use_raw) {
+      on_gst_nalu_buffer(fragment_data->data(), fragment_data->size());
+    } else {
+      on_new_rtp_frame_fragment(std::move(fragment_data), buffer_dts);
+    }
+    m_last_camera_frame_ms = OHDUtil::steady_clock_time_epoch_ms();
+  }
+}
+
+void GStreamerStream::trace_capture_to_appsink(GstBuffer* buffer) {
+  if (!GST_BUFFER_PTS_IS_VALID(buffer)) return;
+  GstClock* clock = gst_element_get_clock(m_gst_pipeline);
+  if (clock == nullptr) return;
+  // For live sources, the PTS is the capture time (running time) - convert it
+  // to clock time using the pipeline base time.
+  const GstClockTime now = gst_clock_get_time(clock);
+  const GstClockTime capture_time =
+      gst_element_get_base_time(m_gst_pipeline) + GST_BUFFER_PTS(buffer);
+  gst_object_unref(clock);
+  if (now > capture_time) {
+    openhd::latency::LatencyTracer::instance().record(
+        openhd::latency::Stage::AIR_CAPTURE_TO_APPSINK,
+        std::chrono::nanoseconds(now - capture_time));
+  }
+}
+
 void GStreamerStream::on_new_rtp_frame_fragment(
     std::shared_ptr<std::vector<uint8_t>> fragment, uint64_t dts) {
-  m_frame_fragments.push_back(fragment);
   const auto curr_video_codec =
       m_camera_holder->get_settings().streamed_video_format.videoCodec;
   openhd::rtp_eof_helper::RTPFragmentInfo info{};
@@ -500,6 +571,8 @@ void GStreamerStream::on_new_rtp_frame_fragment(
     info = openhd::rtp_eof_helper::h264_more_info(fragment->data(),
                                                   fragment->size());
   }
+  // No need to increase / decrease the ref count, we are the only owner
+  m_frame_fragments.push_back(std::move(fragment));
   if (info.is_fu_start) {
     if (is_idr_frame(info.nal_unit_type, is_h265)) {
       m_last_fu_s_idr = true;
@@ -520,7 +593,10 @@ void GStreamerStream::on_new_rtp_frame_fragment(
   }
   if (is_last_fragment_of_frame) {
     on_new_rtp_fragmented_frame();
-    m_frame_fragments.resize(0);
+    // The fragments have been moved into the frame, re-use the previous
+    // capacity such that we don't re-allocate while the next frame grows
+    m_frame_fragments.clear();
+    m_frame_fragments.reserve(m_last_frame_n_fragments);
     m_last_fu_s_idr = false;
   }
 }
@@ -534,7 +610,12 @@ void GStreamerStream::on_new_rtp_fragmented_frame() {
     const bool is_intra_enabled =
         m_camera_holder->get_settings().h26x_intra_refresh_type != -1;
     const bool is_intra_frame = m_last_fu_s_idr;
-    auto frame = openhd::FragmentedVideoFrame{m_frame_fragments,
+    m_last_frame_n_fragments = m_frame_fragments.size();
+    openhd::latency::record_since(openhd::latency::Stage::AIR_FRAME_ASSEMBLY,
+                                  m_frame_first_fragment_time);
+    // Move the fragments into the frame instead of copying (one ref count
+    // increment / decrement per fragment and an extra vector allocation)
+    auto frame = openhd::FragmentedVideoFrame{std::move(m_frame_fragments),
                                               std::chrono::steady_clock::now(),
                                               enable_ultra_secure_encryption,
                                               nullptr,
@@ -549,11 +630,15 @@ void GStreamerStream::on_new_rtp_fragmented_frame() {
 
 void GStreamerStream::on_gst_nalu_buffer(const uint8_t* data, int data_len) {
   // m_console->debug(OHDUtil::bytes_as_string(data,data_len));
+  // Find all NAL boundaries in one pass
+  const auto boundaries = openhd::nalu::find_nal_start_codes(data, data_len);
   int offset = 0;
-  while (offset < data_len) {
-    int nalu_len = find_next_nal(&data[offset], data_len);
-    on_new_nalu(&data[offset], nalu_len);
-    offset += nalu_len;
+  for (const int boundary : boundaries) {
+    on_new_nalu(&data[offset], boundary - offset);
+    offset = boundary;
+  }
+  if (offset < data_len) {
+    on_new_nalu(&data[offset], data_len - offset);
   }
 }
 
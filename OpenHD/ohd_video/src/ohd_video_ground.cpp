@@ -7,11 +7,16 @@
 #include <utility>
 
 #include "openhd_config.h"
+#include "openhd_latency_trace.h"
 #include "openhd_util.h"
 
 OHDVideoGround::OHDVideoGround(std::shared_ptr<OHDLink> link_handle)
-    : m_link_handle(std::move(link_handle)) {
+    : m_link_handle(std::move(link_handle)),
+      m_batch_udp_egress(openhd::load_config().NW_BATCH_VIDEO_UDP_EGRESS) {
   m_console = openhd::log::create_or_get("v_gnd");
+  for (auto& batched_since : m_batched_since) {
+    batched_since.reserve(MAX_N_BATCHED_FRAGMENTS);
+  }
   m_primary_video_forwarder = std::make_unique<openhd::UDPMultiForwarder>();
   m_secondary_video_forwarder = std::make_unique<openhd::UDPMultiForwarder>();
   // We always forward video to localhost::5600 (primary) and 5601 (secondary)
@@ -29,6 +34,8 @@ OHDVideoGround::OHDVideoGround(std::shared_ptr<OHDLink> link_handle)
         [this](int stream_index, const uint8_t* data, int data_len) {
           on_video_data(stream_index, data, data_len);
         });
+    m_link_handle->register_on_receive_video_block_done_cb(
+        [this](int stream_index) { on_video_block_done(stream_index); });
   } else {
     m_console->warn("No link handle, no video forwarding");
   }
@@ -45,6 +52,7 @@ OHDVideoGround::OHDVideoGround(std::shared_ptr<OHDLink> link_handle)
 OHDVideoGround::~OHDVideoGround() {
   if (m_link_handle) {
     m_link_handle->register_on_receive_video_data_cb(nullptr);
+    m_link_handle->register_on_receive_video_block_done_cb(nullptr);
   }
 }
 
@@ -58,16 +66,62 @@ void OHDVideoGround::removeForwarder(const std::string& client_addr) {
   m_secondary_video_forwarder->removeForwarder(client_addr, 5601);
 }
 
+// RTP marker bit - set on the last fragment of a frame (access unit)
+static bool is_last_rtp_fragment_of_frame(const uint8_t* data, int data_len) {
+  static constexpr int RTP_HEADER_SIZE = 12;
+  if (data_len < RTP_HEADER_SIZE || (data[0] >> 6) != 2) return false;
+  return (data[1] & 0x80) != 0;
+}
+
 void OHDVideoGround::on_video_data(int stream_index, const uint8_t* data,
                                    int data_len) {
   // openhd::log::get_default()->debug("on_video_data {}",stream_index);
+  const auto begin = std::chrono::steady_clock::now();
+  openhd::UDPMultiForwarder* forwarder;
   if (stream_index == 0) {
-    m_primary_video_forwarder->forwardPacketViaUDP(data, data_len);
+    forwarder = m_primary_video_forwarder.get();
   } else if (stream_index == 1) {
-    m_secondary_video_forwarder->forwardPacketViaUDP(data, data_len);
+    forwarder = m_secondary_video_forwarder.get();
   } else {
     openhd::log::get_default()->debug("Invalid stream index {}", stream_index);
+    return;
+  }
+  if (m_batch_udp_egress) {
+    forwarder->enqueuePacket(data, data_len);
+    auto& batched_since = m_batched_since[stream_index];
+    batched_since.push_back(begin);
+    // The decoder cannot do anything with a frame before its last fragment
+    // arrived - batching until then adds (almost) no latency.
+    if (is_last_rtp_fragment_of_frame(data, data_len) ||
+        batched_since.size() >= MAX_N_BATCHED_FRAGMENTS) {
+      flush(stream_index);
+    }
+  } else {
+    forwarder->forwardPacketViaUDP(data, data_len);
+    openhd::latency::record_since(openhd::latency::Stage::GND_UDP_EGRESS,
+                                  begin);
+  }
+}
+
+void OHDVideoGround::on_video_block_done(int stream_index) {
+  if (!m_batch_udp_egress) return;
+  if (stream_index == 0 || stream_index == 1) flush(stream_index);
+}
+
+void OHDVideoGround::flush(int stream_index) {
+  auto& batched_since = m_batched_since[stream_index];
+  if (batched_since.empty()) return;
+  if (stream_index == 0) {
+    m_primary_video_forwarder->flush();
+  } else {
+    m_secondary_video_forwarder->flush();
+  }
+  // Per fragment, like without batching
+  for (const auto& since : batched_since) {
+    openhd::latency::record_since(openhd::latency::Stage::GND_UDP_EGRESS,
+                                  since);
   }
+  batched_since.clear();
 }
 
 static bool ip_is_host_self(const std::string& ip) {
@@ -0,0 +1,182 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <cstdlib>
+#include <ctime>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <thread>
+
+#include "openhd_buffer_pool.h"
+#include "openhd_video_frame.h"
+
+//
+// Benchmark of the appsink -> FragmentedVideoFrame -> wb tx path (without
+// gstreamer - mapping the GstBuffer costs the same for both variants):
+// - legacy: what GStreamerStream did before - a zero-initialized heap vector
+// per fragment + memcpy, fragments copied into the frame.
+// - current: pooled buffers, fragments moved into the frame.
+// A second thread takes the role of the wb tx thread and drops the frames.
+// Reports the heap allocations per second and the CPU time per Mbit of video
+// at a realistic frame rate / bitrate.
+//
+
+static std::atomic<uint64_t> g_n_allocations{0};
+
+void* operator new(size_t size) {
+  g_n_allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* p = std::malloc(size)) return p;
+  throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t size) noexcept { std::free(p); }
+
+static constexpr int FPS = 60;
+static constexpr int BITRATE_MBITS = 20;
+static constexpr size_t RTP_FRAGMENT_SIZE = 1440;
+static constexpr int N_FRAMES = FPS * 60;
+
+// Like the wb tx thread, consumes (drops) the frames
+class TxThread {
+ public:
+  TxThread() : m_thread([this] { loop(); }) {}
+  ~TxThread() {
+    {
+      std::lock_guard<std::mutex> guard(m_mutex);
+      m_done = true;
+    }
+    m_cv.notify_one();
+    m_thread.join();
+  }
+  void enqueue(const openhd::FragmentedVideoFrame& frame) {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      // In real time (one frame every 16ms) the tx thread keeps up - don't
+      // let the benchmark pile up frames
+      m_cv_space.wait(lock, [this] { return m_queue.size() < MAX_N_FRAMES; });
+      // Like WBLink::transmit_video_data, takes a reference to the fragments
+      m_queue.push_back(frame.rtp_fragments);
+    }
+    m_cv.notify_one();
+  }
+
+ private:
+  void loop() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_done || !m_queue.empty()) {
+      m_cv.wait(lock, [this] { return m_done || !m_queue.empty(); });
+      while (!m_queue.empty()) {
+        auto fragments = std::move(m_queue.front());
+        m_queue.pop_front();
+        m_cv_space.notify_one();
+        lock.unlock();
+        for (const auto& fragment : fragments) m_n_bytes += fragment->size();
+        fragments.clear();
+        lock.lock();
+      }
+    }
+  }
+  static constexpr size_t MAX_N_FRAMES = 4;
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  std::condition_variable m_cv_space;
+  std::deque<std::vector<std::shared_ptr<std::vector<uint8_t>>>> m_queue;
+  bool m_done = false;
+  uint64_t m_n_bytes = 0;
+  std::thread m_thread;
+};
+
+// Previous GStreamerStream implementation
+struct LegacyPath {
+  std::vector<std::shared_ptr<std::vector<uint8_t>>> frame_fragments;
+  void on_fragment(const uint8_t* data, size_t data_len, bool last,
+                   TxThread& tx) {
+    auto fragment = std::make_shared<std::vector<uint8_t>>(data_len);
+    std::memcpy(fragment->data(), data, data_len);
+    frame_fragments.push_back(fragment);
+    if (last) {
+      auto frame = openhd::FragmentedVideoFrame{
+          frame_fragments, std::chrono::steady_clock::now(), false, nullptr};
+      tx.enqueue(frame);
+      frame_fragments.resize(0);
+    }
+  }
+};
+
+struct CurrentPath {
+  std::vector<std::shared_ptr<std::vector<uint8_t>>> frame_fragments;
+  size_t last_frame_n_fragments = 64;
+  void on_fragment(const uint8_t* data, size_t data_len, bool last,
+                   TxThread& tx) {
+    auto fragment =
+        openhd::FragmentBufferPool::instance().acquire(data, data_len);
+    frame_fragments.push_back(std::move(fragment));
+    if (last) {
+      last_frame_n_fragments = frame_fragments.size();
+      auto frame = openhd::FragmentedVideoFrame{
+          std::move(frame_fragments), std::chrono::steady_clock::now(), false,
+          nullptr};
+      tx.enqueue(frame);
+      frame_fragments.clear();
+      frame_fragments.reserve(last_frame_n_fragments);
+    }
+  }
+};
+
+template <typename PATH>
+static void run(const std::string& name) {
+  const size_t frame_size = BITRATE_MBITS * 1000 * 1000 / 8 / FPS;
+  const int n_fragments_per_frame = static_cast<int>(
+      (frame_size + RTP_FRAGMENT_SIZE - 1) / RTP_FRAGMENT_SIZE);
+  const std::vector<uint8_t> sample(RTP_FRAGMENT_SIZE, 0x42);
+  PATH path;
+  // Warm up (pool, vector capacities)
+  {
+    TxThread tx;
+    for (int i = 0; i < n_fragments_per_frame * FPS; i++) {
+      path.on_fragment(sample.data(), sample.size(),
+                       (i + 1) % n_fragments_per_frame == 0, tx);
+    }
+  }
+  const uint64_t n_allocations_before = g_n_allocations.load();
+  const std::clock_t cpu_before = std::clock();
+  {
+    TxThread tx;
+    for (int frame = 0; frame < N_FRAMES; frame++) {
+      for (int i = 0; i < n_fragments_per_frame; i++) {
+        path.on_fragment(sample.data(), sample.size(),
+                         i == n_fragments_per_frame - 1, tx);
+      }
+    }
+  }
+  const double cpu_ms =
+      1000.0 * static_cast<double>(std::clock() - cpu_before) / CLOCKS_PER_SEC;
+  // Includes the copy of the fragment list per frame for the tx thread,
+  // which is the same for both
+  const uint64_t n_allocations = g_n_allocations.load() - n_allocations_before;
+  const double video_seconds = static_cast<double>(N_FRAMES) / FPS;
+  const double mbits = static_cast<double>(N_FRAMES) * n_fragments_per_frame *
+                       RTP_FRAGMENT_SIZE * 8 / 1000.0 / 1000.0;
+  std::cout << name << ": " << n_fragments_per_frame << " fragments/frame, "
+            << static_cast<int64_t>(n_allocations / video_seconds)
+            << " allocations/s at " << BITRATE_MBITS << "Mbit/s " << FPS
+            << "fps, " << (cpu_ms * 1000.0 / mbits) << " us CPU per Mbit\n";
+}
+
+int main(int argc, char* argv[]) {
+  for (int i = 0; i < 2; i++) {
+    run<LegacyPath>("legacy (heap + copy)");
+    run<CurrentPath>("current (pool + move)");
+  }
+  std::cout << openhd::FragmentBufferPool::instance().get_stats().to_string()
+            << "\n";
+  return 0;
+}
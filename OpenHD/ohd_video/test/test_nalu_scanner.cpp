@@ -0,0 +1,88 @@
+//
+// Created by consti10 on 17.10.26.
+//
+
+#include <chrono>
+#include <iostream>
+#include <random>
+
+#include "ffmpeg_videosamples.hpp"
+#include "nalu/nalu_helper.h"
+
+//
+// Validates the vectorized start code scanner against the byte-at-a-time
+// find_next_nal() and measures the throughput of both.
+//
+
+// Same as the previous GStreamerStream::on_gst_nalu_buffer implementation,
+// but with the remaining length passed to find_next_nal()
+static std::vector<int> split_legacy(const uint8_t* data, int data_len) {
+  std::vector<int> ret;
+  int offset = 0;
+  while (offset < data_len) {
+    const int nalu_len = find_next_nal(&data[offset], data_len - offset);
+    offset += nalu_len;
+    if (offset < data_len) ret.push_back(offset);
+  }
+  return ret;
+}
+
+static std::vector<uint8_t> create_synthetic_frame(int n_nalus,
+                                                   int nalu_size) {
+  std::mt19937 gen(42);
+  // Like in encoded video, emulation prevention makes 0,0 runs rare
+  std::uniform_int_distribution<int> dist(1, 255);
+  std::vector<uint8_t> ret;
+  for (int i = 0; i < n_nalus; i++) {
+    ret.insert(ret.end(), {0, 0, 0, 1});
+    for (int j = 0; j < nalu_size; j++) {
+      ret.push_back(static_cast<uint8_t>(dist(gen)));
+    }
+  }
+  return ret;
+}
+
+static void validate_and_benchmark(const std::string& name,
+                                   const uint8_t* data, int data_len,
+                                   int n_runs) {
+  const auto legacy = split_legacy(data, data_len);
+  const auto simd = openhd::nalu::find_nal_start_codes(data, data_len);
+  if (legacy != simd) {
+    std::cerr << name << " legacy:" << legacy.size()
+              << " simd:" << simd.size() << "\n";
+    throw std::runtime_error("Start code mismatch\n");
+  }
+  size_t dummy = 0;
+  auto begin = std::chrono::steady_clock::now();
+  for (int i = 0; i < n_runs; i++) dummy += split_legacy(data, data_len).size();
+  const auto legacy_time = std::chrono::steady_clock::now() - begin;
+  begin = std::chrono::steady_clock::now();
+  for (int i = 0; i < n_runs; i++) {
+    dummy += openhd::nalu::find_nal_start_codes(data, data_len).size();
+  }
+  const auto simd_time = std::chrono::steady_clock::now() - begin;
+  const double total_mb = (double)data_len * n_runs / (1024 * 1024);
+  const auto mb_per_s = [total_mb](auto elapsed) {
+    return total_mb /
+           std::chrono::duration_cast<std::chrono::duration<double>>(elapsed)
+               .count();
+  };
+  std::cout << name << " (" << data_len << " bytes, " << simd.size()
+            << " boundaries): legacy " << mb_per_s(legacy_time)
+            << " MB/s, simd " << mb_per_s(simd_time) << " MB/s"
+            << " [" << dummy % 2 << "]\n";
+}
+
+int main(int argc, char* argv[]) {
+  validate_and_benchmark("k_H264TestFrame", k_H264TestFrame,
+                         sizeof(k_H264TestFrame), 100000);
+  validate_and_benchmark("k_HEVCMainTestFrame", k_HEVCMainTestFrame,
+                         sizeof(k_HEVCMainTestFrame), 100000);
+  // ~1080p I-frame / P-frame sized
+  const auto large = create_synthetic_frame(4, 128 * 1024);
+  validate_and_benchmark("synthetic_512k", large.data(), large.size(), 1000);
+  const auto many = create_synthetic_frame(400, 1000);
+  validate_and_benchmark("synthetic_400_slices", many.data(), many.size(),
+                         1000);
+  return 0;
+}